@@ -38,6 +38,7 @@
 #include "fsal.h"
 #include "cache_inode.h"
 #include "cache_inode_avl.h"
+#include "cache_inode_dirarray.h"
 #include "murmur3.h"
 
 #include <unistd.h>
@@ -49,6 +50,10 @@
 
 void cache_inode_avl_init(cache_entry_t *entry)
 {
+    if (cache_inode_params.use_dirent_array) {
+        cache_inode_dirarray_init(entry);
+        return;
+    }
     avltree_init(&entry->object.dir.avl.t, avl_dirent_hk_cmpf, 0 /* flags */);
     avltree_init(&entry->object.dir.avl.c, avl_dirent_hk_cmpf, 0 /* flags */);
 }
@@ -79,6 +84,11 @@ avl_dirent_set_deleted(cache_entry_t *entry, cache_inode_dir_entry_t *v)
     struct avltree *t = &entry->object.dir.avl.t;
     struct avltree_node *node;
 
+    if (cache_inode_params.use_dirent_array) {
+        cache_inode_dirarray_set_deleted(entry, v);
+        return;
+    }
+
     assert(! (v->flags & DIR_ENTRY_FLAG_DELETED));
 
     node = avltree_inline_lookup(&v->node_hk, t);
@@ -105,6 +115,11 @@ avl_dirent_clear_deleted(cache_entry_t *entry, cache_inode_dir_entry_t *v)
     struct avltree *c = &entry->object.dir.avl.c;
     struct avltree_node *node;
 
+    if (cache_inode_params.use_dirent_array) {
+        cache_inode_dirarray_clear_deleted(entry, v);
+        return;
+    }
+
     node = avltree_inline_lookup(&v->node_hk, c);
     assert(node);
     avltree_remove(&v->node_hk, c);
@@ -171,6 +186,22 @@ cache_inode_avl_insert_impl(cache_entry_t *entry, cache_inode_dir_entry_t *v,
     return (code);
 }
 
+/*
+ * Dispatch a single insertion attempt to the configured dirent
+ * representation.  Returns 0 if v was linked in, 1 if v was copied
+ * (the caller disposes of it), -1 to keep probing, and less than -1
+ * on a hard failure.
+ */
+static inline int
+cache_inode_insert_impl(cache_entry_t *entry, cache_inode_dir_entry_t *v,
+                        int j, int j2)
+{
+    if (cache_inode_params.use_dirent_array)
+        return (cache_inode_dirarray_insert_impl(entry, v, j, j2));
+
+    return (cache_inode_avl_insert_impl(entry, v, j, j2));
+}
+
 #define MIN_COOKIE_VAL 3
 
 /*
@@ -204,9 +235,11 @@ int cache_inode_avl_qp_insert(
         if (v->hk.k < MIN_COOKIE_VAL)
             continue;
 
-        code = cache_inode_avl_insert_impl(entry, v, j, 0);
+        code = cache_inode_insert_impl(entry, v, j, 0);
         if (code >= 0)
             return (code);
+        if (code < -1)
+            return (-1);
     }
 
     LogCrit(COMPONENT_CACHE_INODE,
@@ -216,9 +249,11 @@ int cache_inode_avl_qp_insert(
     memcpy(&v->hk.k, hk, 8);
     for (j2 = 1 /* tried j=0 */; j2 < UINT64_MAX; j2++) {
         v->hk.k = v->hk.k + j2;
-        code = cache_inode_avl_insert_impl(entry, v, j, j2);
+        code = cache_inode_insert_impl(entry, v, j, j2);
         if (code >= 0)
             return (code);
+        if (code < -1)
+            return (-1);
         j2++;
     }
 
@@ -230,13 +265,17 @@ int cache_inode_avl_qp_insert(
 }
 
 cache_inode_dir_entry_t *
-cache_inode_avl_lookup_k(cache_entry_t *entry, uint64_t k, uint32_t flags)
+cache_inode_avl_lookup_k(cache_entry_t *entry, uint64_t k, uint32_t flags,
+                         cache_inode_dir_entry_t *scratch)
 {
     struct avltree *t = &entry->object.dir.avl.t;
     struct avltree *c = &entry->object.dir.avl.c;
     cache_inode_dir_entry_t dirent_key[1], *dirent = NULL;
     struct avltree_node *node, *node2;
 
+    if (cache_inode_params.use_dirent_array)
+        return (cache_inode_dirarray_lookup_k(entry, k, flags, scratch));
+
     dirent_key->hk.k = k;
 
     node = avltree_inline_lookup(&dirent_key->node_hk, t);
@@ -287,6 +326,11 @@ cache_inode_avl_qp_lookup_s(
 
     for (j = 0; j < maxj; j++) {
         v->hk.k = (v->hk.k + (j * 2));
+        if (cache_inode_params.use_dirent_array) {
+            if (cache_inode_dirarray_lookup(entry, v))
+                return (v);
+            continue;
+        }
         node = avltree_lookup(&v->node_hk, t);
         if (node) {
             /* ensure that node is related to v */
@@ -304,3 +348,47 @@ cache_inode_avl_qp_lookup_s(
 
     return (NULL);
 }
+
+cache_inode_dir_entry_t *
+cache_inode_avl_first(cache_entry_t *entry,
+                      cache_inode_dir_entry_t *scratch)
+{
+    struct avltree_node *node;
+
+    if (cache_inode_params.use_dirent_array)
+        return (cache_inode_dirarray_first(entry, scratch));
+
+    node = avltree_first(&entry->object.dir.avl.t);
+    if (! node)
+        return (NULL);
+
+    return (avltree_container_of(node, cache_inode_dir_entry_t, node_hk));
+}
+
+cache_inode_dir_entry_t *
+cache_inode_avl_next(cache_entry_t *entry, cache_inode_dir_entry_t *v,
+                     cache_inode_dir_entry_t *scratch)
+{
+    struct avltree_node *node;
+
+    if (cache_inode_params.use_dirent_array)
+        return (cache_inode_dirarray_next(entry, v, scratch));
+
+    node = avltree_next(&v->node_hk);
+    if (! node)
+        return (NULL);
+
+    return (avltree_container_of(node, cache_inode_dir_entry_t, node_hk));
+}
+
+void
+cache_inode_avl_set_entry(cache_entry_t *entry, cache_inode_dir_entry_t *v,
+                          gweakref_t ref)
+{
+    if (cache_inode_params.use_dirent_array) {
+        cache_inode_dirarray_set_entry(entry, v, ref);
+        return;
+    }
+
+    v->entry = ref;
+}
@@ -211,6 +211,7 @@ cache_inode_create(cache_entry_t *parent,
                                    &object_attributes,
                                    type,
                                    create_arg,
+                                   CACHE_INODE_FLAG_NONE,
                                    status);
      if (entry == NULL) {
           *status = CACHE_INODE_INSERT_ERROR;
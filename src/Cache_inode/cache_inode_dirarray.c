@@ -0,0 +1,549 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ * \file    cache_inode_dirarray.c
+ * \brief   Compact array dirent representation
+ *
+ * All functions expect the directory's content lock to be held, for
+ * write if they modify the array.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_mem.h"
+#include "cache_inode.h"
+#include "cache_inode_avl.h"
+#include "cache_inode_dirarray.h"
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <string.h>
+#include <assert.h>
+
+/* Initial allocations, both grow by doubling */
+#define DIRARRAY_MIN_SLOTS 16
+#define DIRARRAY_MIN_NAMES 1024
+
+/* Compact once this many deleted slots have piled up, regardless of
+ * directory size.  This matches the bound on persisted cookies in the
+ * AVL representation. */
+#define DIRARRAY_MAX_DELETED 65535
+
+/* Below this, deleted slots and stale names are not worth compacting */
+#define DIRARRAY_COMPACT_MIN 1024
+
+static inline uint32_t
+dirarray_bucket(uint64_t k, uint32_t mask)
+{
+    return ((uint32_t) (k ^ (k >> 32))) & mask;
+}
+
+/**
+ * @brief Find the slot holding a cookie
+ *
+ * Deleted slots are found as well; it is up to the caller to check.
+ *
+ * @return The slot number, or -1 if the cookie is unknown.
+ */
+
+static int64_t
+dirarray_find(cache_entry_t *entry, uint64_t k)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    uint32_t b, s;
+
+    if (dir->array.index == NULL)
+        return (-1);
+
+    /* The index is kept at most half full, so this terminates */
+    for (b = dirarray_bucket(k, dir->array.index_mask); ;
+         b = (b + 1) & dir->array.index_mask) {
+        s = dir->array.index[b];
+        if (s == 0)
+            return (-1);
+        if (dir->array.slots[s - 1].k == k)
+            return (s - 1);
+    }
+}
+
+static inline void
+dirarray_index_add(cache_entry_t *entry, uint32_t slot)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    uint32_t b;
+
+    for (b = dirarray_bucket(dir->array.slots[slot].k,
+                             dir->array.index_mask);
+         dir->array.index[b] != 0;
+         b = (b + 1) & dir->array.index_mask)
+        ;
+    dir->array.index[b] = slot + 1;
+}
+
+/**
+ * @brief Rebuild the cookie index for the current slot allocation
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+
+static int
+dirarray_reindex(cache_entry_t *entry)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    uint32_t size = 1, i;
+    uint32_t *index;
+
+    while (size < 2 * dir->array.maxslots)
+        size <<= 1;
+
+    index = gsh_calloc(size, sizeof(uint32_t));
+    if (index == NULL)
+        return (-1);
+
+    gsh_free(dir->array.index);
+    dir->array.index = index;
+    dir->array.index_mask = size - 1;
+
+    for (i = 0; i < dir->array.nslots; i++)
+        dirarray_index_add(entry, i);
+
+    return (0);
+}
+
+/**
+ * @brief Drop deleted slots and unreferenced names
+ *
+ * Cookies of deleted entries are forgotten, so a readdir resuming
+ * from one of them will fail, exactly as when the AVL representation
+ * recycles a persisted cookie.
+ */
+
+static void
+dirarray_compact(cache_entry_t *entry)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    cache_inode_dirent_slot_t *slot;
+    uint32_t size = 0, len = 0, i, n = 0;
+    char *names;
+
+    for (i = 0; i < dir->array.nslots; i++) {
+        if (!(dir->array.slots[i].flags & DIR_ENTRY_FLAG_DELETED))
+            size += dir->array.slots[i].name_len + 1;
+    }
+    if (size < DIRARRAY_MIN_NAMES)
+        size = DIRARRAY_MIN_NAMES;
+
+    names = gsh_malloc(size);
+    if (names == NULL) {
+        LogMajor(COMPONENT_CACHE_INODE,
+                 "could not allocate %u bytes to compact dirents of %p",
+                 size, entry);
+        return;
+    }
+
+    for (i = 0; i < dir->array.nslots; i++) {
+        slot = &dir->array.slots[i];
+        if (slot->flags & DIR_ENTRY_FLAG_DELETED)
+            continue;
+        memcpy(names + len, dir->array.names + slot->name_off,
+               slot->name_len + 1);
+        slot->name_off = len;
+        len += slot->name_len + 1;
+        dir->array.slots[n++] = *slot;
+    }
+
+    LogDebug(COMPONENT_CACHE_INODE,
+             "compacted dirents of %p: %u slots, %u names bytes "
+             "-> %u slots, %u names bytes",
+             entry, dir->array.nslots, dir->array.names_len, n, len);
+
+    gsh_free(dir->array.names);
+    dir->array.names = names;
+    dir->array.names_len = len;
+    dir->array.names_size = size;
+    dir->array.names_garbage = 0;
+    dir->array.nslots = n;
+    dir->array.ndeleted = 0;
+
+    /* Cannot fail, the table is not resized */
+    memset(dir->array.index, 0,
+           (dir->array.index_mask + 1) * sizeof(uint32_t));
+    for (i = 0; i < n; i++)
+        dirarray_index_add(entry, i);
+}
+
+/**
+ * @brief Copy a name into the arena
+ *
+ * @return The offset of the name, or -1 if memory could not be
+ *         allocated.
+ */
+
+static int64_t
+dirarray_add_name(cache_entry_t *entry, const char *name, uint32_t len)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    uint32_t off, size;
+    char *names;
+
+    if (dir->array.names_len + len + 1 > dir->array.names_size) {
+        size = dir->array.names_size ? dir->array.names_size
+            : DIRARRAY_MIN_NAMES;
+        while (dir->array.names_len + len + 1 > size)
+            size *= 2;
+        names = gsh_realloc(dir->array.names, size);
+        if (names == NULL)
+            return (-1);
+        dir->array.names = names;
+        dir->array.names_size = size;
+    }
+
+    off = dir->array.names_len;
+    memcpy(dir->array.names + off, name, len);
+    dir->array.names[off + len] = '\0';
+    dir->array.names_len += len + 1;
+
+    return (off);
+}
+
+static void
+dirarray_fill(cache_entry_t *entry, uint32_t i, cache_inode_dir_entry_t *v)
+{
+    cache_inode_dirent_slot_t *slot = &entry->object.dir.array.slots[i];
+
+    strncpy(v->name.name, entry->object.dir.array.names + slot->name_off,
+            FSAL_MAX_NAME_LEN);
+    v->name.len = slot->name_len;
+    v->hk.k = slot->k;
+    v->hk.p = slot->p;
+    v->entry = slot->entry;
+    v->fsal_cookie = 0;
+    v->flags = slot->flags;
+}
+
+static cache_inode_dir_entry_t *
+dirarray_next_active(cache_entry_t *entry, int64_t i,
+                     cache_inode_dir_entry_t *scratch)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+
+    for (; i < dir->array.nslots; i++) {
+        if (!(dir->array.slots[i].flags & DIR_ENTRY_FLAG_DELETED)) {
+            dirarray_fill(entry, i, scratch);
+            return (scratch);
+        }
+    }
+    return (NULL);
+}
+
+void
+cache_inode_dirarray_init(cache_entry_t *entry)
+{
+    memset(&entry->object.dir.array, 0, sizeof(entry->object.dir.array));
+}
+
+/**
+ * @brief Release cached dirents
+ *
+ * Releasing CACHE_INODE_AVL_NAMES marks every entry deleted, keeping
+ * its cookie; releasing CACHE_INODE_AVL_COOKIES drops the deleted
+ * entries; releasing both frees all storage.
+ */
+
+void
+cache_inode_dirarray_release(cache_entry_t *entry,
+                             cache_inode_avl_which_t which)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    uint32_t i;
+
+    switch (which) {
+    case CACHE_INODE_AVL_NAMES:
+        for (i = 0; i < dir->array.nslots; i++)
+            dir->array.slots[i].flags |= DIR_ENTRY_FLAG_DELETED;
+        dir->array.ndeleted = dir->array.nslots;
+        break;
+
+    case CACHE_INODE_AVL_COOKIES:
+        if (dir->array.ndeleted > 0)
+            dirarray_compact(entry);
+        break;
+
+    case CACHE_INODE_AVL_BOTH:
+        gsh_free(dir->array.slots);
+        gsh_free(dir->array.index);
+        gsh_free(dir->array.names);
+        cache_inode_dirarray_init(entry);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Try to store a dirent under the cookie in v->hk.k
+ *
+ * A deleted slot with the same cookie is reused, as the AVL
+ * representation does with persisted cookies.  The dirent is always
+ * copied, never linked, so on success the caller must dispose of v.
+ *
+ * @retval 1 on success.
+ * @retval -1 if the cookie is held by an active entry.
+ * @retval -2 if memory could not be allocated.
+ */
+
+int
+cache_inode_dirarray_insert_impl(cache_entry_t *entry,
+                                 cache_inode_dir_entry_t *v,
+                                 int j, int j2)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    cache_inode_dirent_slot_t *slot, *slots;
+    uint32_t len = strnlen(v->name.name, FSAL_MAX_NAME_LEN);
+    uint32_t maxslots;
+    int64_t i, off;
+
+    i = dirarray_find(entry, v->hk.k);
+    if (i >= 0) {
+        slot = &dir->array.slots[i];
+        if (!(slot->flags & DIR_ENTRY_FLAG_DELETED))
+            return (-1);
+
+        /* reuse the slot, and the name's storage if it fits */
+        if (len <= slot->name_len) {
+            memcpy(dir->array.names + slot->name_off, v->name.name, len);
+            dir->array.names[slot->name_off + len] = '\0';
+            dir->array.names_garbage += slot->name_len - len;
+        } else {
+            off = dirarray_add_name(entry, v->name.name, len);
+            if (off < 0)
+                return (-2);
+            /* the arena may have moved */
+            slot = &dir->array.slots[i];
+            dir->array.names_garbage += slot->name_len + 1;
+            slot->name_off = off;
+        }
+        slot->name_len = len;
+        slot->entry = v->entry;
+        slot->flags &= ~DIR_ENTRY_FLAG_DELETED;
+        dir->array.ndeleted--;
+        v->hk.p = slot->p;
+        return (1);
+    }
+
+    if ((dir->array.ndeleted > DIRARRAY_MAX_DELETED) ||
+        ((dir->array.ndeleted > DIRARRAY_COMPACT_MIN) &&
+         (dir->array.ndeleted > dir->array.nslots / 2)) ||
+        ((dir->array.names_garbage > DIRARRAY_COMPACT_MIN) &&
+         (dir->array.names_garbage > dir->array.names_len / 2))) {
+        dirarray_compact(entry);
+    }
+
+    if (dir->array.nslots == dir->array.maxslots) {
+        maxslots = dir->array.maxslots ? 2 * dir->array.maxslots
+            : DIRARRAY_MIN_SLOTS;
+        slots = gsh_realloc(dir->array.slots,
+                            maxslots * sizeof(cache_inode_dirent_slot_t));
+        if (slots == NULL)
+            return (-2);
+        dir->array.slots = slots;
+        dir->array.maxslots = maxslots;
+        if (dirarray_reindex(entry) != 0) {
+            /* The old index still covers every slot in use */
+            LogMajor(COMPONENT_CACHE_INODE,
+                     "could not grow dirent index of %p", entry);
+            dir->array.maxslots = dir->array.nslots;
+            return (-2);
+        }
+    }
+
+    off = dirarray_add_name(entry, v->name.name, len);
+    if (off < 0)
+        return (-2);
+
+    slot = &dir->array.slots[dir->array.nslots];
+    slot->k = v->hk.k;
+    slot->entry = v->entry;
+    slot->name_off = off;
+    slot->name_len = len;
+    slot->p = MIN(j + j2, UINT8_MAX);
+    slot->flags = DIR_ENTRY_FLAG_NONE;
+    dirarray_index_add(entry, dir->array.nslots);
+    dir->array.nslots++;
+
+    v->hk.p = j + j2;
+    if (dir->array.collisions < v->hk.p)
+        dir->array.collisions = v->hk.p;
+
+    LogDebug(COMPONENT_CACHE_INODE,
+             "inserted new dirent on entry=%p cookie=%"PRIu64
+             " collisions %d",
+             entry, v->hk.k, dir->array.collisions);
+
+    return (1);
+}
+
+/**
+ * @brief Look up the active entry with cookie v->hk.k and name v->name
+ *
+ * @return v, filled in from the slot, or NULL.
+ */
+
+cache_inode_dir_entry_t *
+cache_inode_dirarray_lookup(cache_entry_t *entry,
+                            cache_inode_dir_entry_t *v)
+{
+    struct cache_inode_dir__ *dir = &entry->object.dir;
+    cache_inode_dirent_slot_t *slot;
+    uint32_t len;
+    int64_t i;
+
+    i = dirarray_find(entry, v->hk.k);
+    if (i < 0)
+        return (NULL);
+
+    slot = &dir->array.slots[i];
+    if (slot->flags & DIR_ENTRY_FLAG_DELETED)
+        return (NULL);
+
+    len = strnlen(v->name.name, FSAL_MAX_NAME_LEN);
+    if ((len != slot->name_len) ||
+        memcmp(v->name.name, dir->array.names + slot->name_off, len))
+        return (NULL);
+
+    v->hk.p = slot->p;
+    v->entry = slot->entry;
+    v->flags = slot->flags;
+    return (v);
+}
+
+/**
+ * @brief Seek to a cookie
+ *
+ * If the cookie belongs to a deleted entry, or the caller asked for
+ * CACHE_INODE_FLAG_NEXT_ACTIVE, the next active entry is returned.
+ */
+
+cache_inode_dir_entry_t *
+cache_inode_dirarray_lookup_k(cache_entry_t *entry, uint64_t k,
+                              uint32_t flags,
+                              cache_inode_dir_entry_t *scratch)
+{
+    cache_inode_dir_entry_t *dirent;
+    int64_t i;
+
+    i = dirarray_find(entry, k);
+    if (i < 0)
+        return (NULL);
+
+    if (!(flags & CACHE_INODE_FLAG_NEXT_ACTIVE) &&
+        !(entry->object.dir.array.slots[i].flags & DIR_ENTRY_FLAG_DELETED)) {
+        dirarray_fill(entry, i, scratch);
+        return (scratch);
+    }
+
+    dirent = dirarray_next_active(entry, i + 1, scratch);
+    if (! dirent) {
+        LogFullDebug(COMPONENT_NFS_READDIR,
+                     "seek to cookie=%"PRIu64" fail (no next entry)",
+                     k);
+    }
+    return (dirent);
+}
+
+cache_inode_dir_entry_t *
+cache_inode_dirarray_first(cache_entry_t *entry,
+                           cache_inode_dir_entry_t *scratch)
+{
+    return (dirarray_next_active(entry, 0, scratch));
+}
+
+cache_inode_dir_entry_t *
+cache_inode_dirarray_next(cache_entry_t *entry,
+                          cache_inode_dir_entry_t *v,
+                          cache_inode_dir_entry_t *scratch)
+{
+    int64_t i = dirarray_find(entry, v->hk.k);
+
+    if (i < 0)
+        return (NULL);
+
+    return (dirarray_next_active(entry, i + 1, scratch));
+}
+
+void
+cache_inode_dirarray_set_deleted(cache_entry_t *entry,
+                                 cache_inode_dir_entry_t *v)
+{
+    int64_t i = dirarray_find(entry, v->hk.k);
+
+    assert(i >= 0);
+    assert(!(entry->object.dir.array.slots[i].flags &
+             DIR_ENTRY_FLAG_DELETED));
+
+    /* The name and weakref are kept so the entry can be undeleted */
+    entry->object.dir.array.slots[i].flags |= DIR_ENTRY_FLAG_DELETED;
+    entry->object.dir.array.ndeleted++;
+    v->flags |= DIR_ENTRY_FLAG_DELETED;
+}
+
+void
+cache_inode_dirarray_clear_deleted(cache_entry_t *entry,
+                                   cache_inode_dir_entry_t *v)
+{
+    int64_t i = dirarray_find(entry, v->hk.k);
+
+    if (i < 0) {
+        /* compacted away in the meantime */
+        LogDebug(COMPONENT_CACHE_INODE,
+                 "cannot undelete cookie=%"PRIu64" on entry=%p",
+                 v->hk.k, entry);
+        return;
+    }
+
+    if (entry->object.dir.array.slots[i].flags & DIR_ENTRY_FLAG_DELETED) {
+        entry->object.dir.array.slots[i].flags &= ~DIR_ENTRY_FLAG_DELETED;
+        entry->object.dir.array.ndeleted--;
+    }
+    v->flags &= ~DIR_ENTRY_FLAG_DELETED;
+}
+
+void
+cache_inode_dirarray_set_entry(cache_entry_t *entry,
+                               cache_inode_dir_entry_t *v,
+                               gweakref_t ref)
+{
+    int64_t i = dirarray_find(entry, v->hk.k);
+
+    if (i >= 0)
+        entry->object.dir.array.slots[i].entry = ref;
+    v->entry = ref;
+}
@@ -194,6 +194,7 @@ cache_inode_get(cache_inode_fsal_data_t *fsdata,
                                        &fsal_attributes,
                                        type,
                                        &create_arg,
+                                       CACHE_INODE_FLAG_NONE,
                                        status)) == NULL) {
                return NULL;
           }
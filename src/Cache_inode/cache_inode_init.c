@@ -50,6 +50,7 @@
 #include "sal_data.h"
 #include "cache_inode_lru.h"
 #include "cache_inode_weakref.h"
+#include "cache_inode_path.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -61,8 +62,8 @@
  *
  * @brief Initialize the caching layer
  *
- * This function initializes the memory pools, hash table, and weakref
- * table used for cache management.
+ * This function initializes the memory pools, hash table, weakref
+ * table, and path cache used for cache management.
  *
  * @param[in]  param  The parameters for this cache
  * @param[out] status Operation status
@@ -121,6 +122,7 @@ hash_table_t *cache_inode_init(cache_inode_parameter_t param,
   LogInfo(COMPONENT_CACHE_INODE, "Hash Table initiated");
 
   cache_inode_weakref_init();
+  cache_inode_path_init();
 
   return ht;
 }                               /* cache_inode_init */
@@ -52,6 +52,7 @@
 #include "cache_inode_avl.h"
 #include "cache_inode_weakref.h"
 #include "cache_inode_lru.h"
+#include "cache_inode_prefetch.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -231,14 +232,22 @@ cache_inode_lookup_impl(cache_entry_t *parent,
                                        &object_attributes,
                                        type,
                                        &create_arg,
+                                       CACHE_INODE_FLAG_NONE,
                                        status)) == NULL) {
           return NULL;
      }
 
+     /* A client that looks up a directory is likely to list it
+        next; get a head start on populating it. */
+     if (type == DIRECTORY) {
+          cache_inode_prefetch_dir(entry, &object_attributes, context);
+     }
+
      if (broken_dirent) {
           /* Directory entry existed, but the weak reference
              was broken.  Just update with the new one. */
-          broken_dirent->entry = entry->weakref;
+          cache_inode_avl_set_entry(parent, broken_dirent,
+                                    entry->weakref);
           cache_status = CACHE_INODE_SUCCESS;
      } else {
           /* Entry was found in the FSAL, add this entry to the
@@ -1399,3 +1399,54 @@ void lru_wake_thread(uint32_t flags)
      if (lru_thread_state.flags & LRU_SLEEPING)
           pthread_cond_signal(&lru_cv);
 }
+
+/**
+ * @brief Collect weak references to resident entries, hottest first
+ *
+ * This function walks L1 and then L2, each lane from its MRU end,
+ * and stores up to max weak references to the entries found.  The
+ * lanes of a level share what room is left evenly, so the result is
+ * not skewed towards low numbered lanes.  No references are taken;
+ * the caller must use cache_inode_weakref_get on the results.
+ *
+ * @param[out] refs Array to receive the weak references
+ * @param[in]  max  Size of refs
+ *
+ * @return The number of weak references stored.
+ */
+
+size_t
+cache_inode_lru_collect(gweakref_t *refs, size_t max)
+{
+     struct lru_q_ *levels[] = { LRU_1, LRU_2 };
+     struct lru_q_base *qs[2] = { NULL, NULL };
+     struct glist_head *node = NULL;
+     cache_entry_t *entry = NULL;
+     size_t n = 0;
+     size_t quota = 0;
+     uint32_t level = 0;
+     uint32_t lane = 0;
+     uint32_t i = 0;
+
+     for (level = 0; level < 2; ++level) {
+          for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+               quota = n + (max - n) / (LRU_N_Q_LANES - lane);
+               qs[0] = &levels[level][lane].lru;
+               qs[1] = &levels[level][lane].lru_pinned;
+               for (i = 0; i < 2; ++i) {
+                    pthread_mutex_lock(&qs[i]->mtx);
+                    for (node = qs[i]->q.prev;
+                         (node != &qs[i]->q) && (n < quota);
+                         node = node->prev) {
+                         entry = glist_entry(node, cache_entry_t, lru.q);
+                         if (entry->weakref.ptr != NULL) {
+                              refs[n++] = entry->weakref;
+                         }
+                    }
+                    pthread_mutex_unlock(&qs[i]->mtx);
+               }
+          }
+     }
+
+     return n;
+}
@@ -45,6 +45,8 @@
 #include "fsal.h"
 #include "cache_inode.h"
 #include "cache_inode_avl.h"
+#include "cache_inode_dirarray.h"
+#include "cache_inode_prefetch.h"
 #include "cache_inode_lru.h"
 #include "cache_inode_weakref.h"
 #include "nfs4_acls.h"
@@ -237,6 +239,8 @@ int cache_inode_set_time_current(fsal_time_t *time)
  *                        (must not be NULL)
  * @param[in]  type       Type of entry to create
  * @param[in]  create_arg Type specific creation data
+ * @param[in]  flags      CACHE_INODE_FLAG_STALE if attr should not be
+ *                        trusted, else CACHE_INODE_FLAG_NONE
  * @param[out] status     Returned status
  *
  * @return the new entry or NULL on error.
@@ -247,6 +251,7 @@ cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
                       fsal_attrib_list_t *attr,
                       cache_inode_file_type_t type,
                       cache_inode_create_arg_t *create_arg,
+                      uint32_t flags,
                       cache_inode_status_t *status)
 {
      cache_entry_t *entry = NULL;
@@ -384,6 +389,7 @@ cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
 
      entry->type = type;
      entry->flags = 0;
+     entry->attr_ttl = 0;
      init_glist(&entry->state_list);
 
      switch (type) {
@@ -394,6 +400,14 @@ cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
 
           /* No locks, yet. */
           init_glist(&entry->object.file.lock_list);
+          itree_init(&entry->object.file.lock_tree);
+          itree_init(&entry->object.file.blocked_tree);
+          entry->object.file.lock_pexport = NULL;
+          entry->object.file.lock_pexport_cnt = 0;
+
+          /* No delegations either */
+          entry->object.file.deleg_cnt = 0;
+          entry->object.file.deleg_recall_time = 0;
 #ifdef _USE_NLM
           init_glist(&entry->object.file.nlm_share_list);   /* No associated NLM shares yet */
 #endif
@@ -426,6 +440,7 @@ cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
 
           entry->object.dir.avl.collisions = 0;
           entry->object.dir.nbactive = 0;
+          entry->object.dir.dirent_gen = 0;
           entry->object.dir.referral = NULL;
           entry->object.dir.parent.ptr = NULL;
           entry->object.dir.parent.gen = 0;
@@ -477,6 +492,9 @@ cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
      /* Use the supplied attributes and fix up metadata */
      entry->attributes = *attr;
      cache_inode_fixup_md(entry);
+     if (flags & CACHE_INODE_FLAG_STALE) {
+          entry->flags &= ~CACHE_INODE_TRUST_ATTRS;
+     }
 
      /* Adding the entry in the hash table */
      key.pdata = entry->fh_desc.start;
@@ -782,7 +800,7 @@ cache_inode_types_are_rename_compatible(cache_entry_t *src,
  */
 void cache_inode_print_dir(cache_entry_t *entry)
 {
-  struct avltree_node *dirent_node;
+  cache_inode_dir_entry_t scratch;
   cache_inode_dir_entry_t *dirent;
   int i = 0;
 
@@ -793,10 +811,9 @@ void cache_inode_print_dir(cache_entry_t *entry)
       return;
     }
 
-  dirent_node = avltree_first(&entry->object.dir.avl.t);
-  do {
-      dirent = avltree_container_of(dirent_node, cache_inode_dir_entry_t,
-                                    node_hk);
+  for (dirent = cache_inode_avl_first(entry, &scratch);
+       dirent != NULL;
+       dirent = cache_inode_avl_next(entry, dirent, &scratch)) {
       LogFullDebug(COMPONENT_CACHE_INODE,
                    "Name = %s, DIRECTORY entry = (%p, %"PRIu64") i=%d",
                    dirent->name.name,
@@ -804,7 +821,7 @@ void cache_inode_print_dir(cache_entry_t *entry)
                    dirent->entry.gen,
                    i);
       i++;
-  } while ((dirent_node = avltree_next(dirent_node)));
+  }
 
   LogFullDebug(COMPONENT_CACHE_INODE, "------------------");
 } /* cache_inode_print_dir */
@@ -827,6 +844,23 @@ void cache_inode_release_symlink(cache_entry_t *entry)
      }
 }
 
+/**
+ * @brief Update directory state once its active dirents are released
+ *
+ * @param[in,out] entry The directory
+ */
+
+static inline void
+cache_inode_release_dirents_done(cache_entry_t *entry)
+{
+    entry->object.dir.nbactive = 0;
+    atomic_inc_uint32_t(&entry->object.dir.dirent_gen);
+    cache_inode_prefetch_discarded(entry);
+    atomic_clear_uint32_t_bits(&entry->flags,
+                               (CACHE_INODE_TRUST_CONTENT |
+                                CACHE_INODE_DIR_POPULATED));
+}
+
 /**
  * @brief Release cached directory content
  *
@@ -849,6 +883,13 @@ void cache_inode_release_dirents(cache_entry_t *entry,
     if (entry->type != DIRECTORY)
         return;
 
+    if (cache_inode_params.use_dirent_array) {
+        cache_inode_dirarray_release(entry, which);
+        if (which & CACHE_INODE_AVL_NAMES)
+            cache_inode_release_dirents_done(entry);
+        return;
+    }
+
     switch (which)
     {
     case CACHE_INODE_AVL_NAMES:
@@ -885,10 +926,7 @@ void cache_inode_release_dirents(cache_entry_t *entry,
            }
 
           if (tree == &entry->object.dir.avl.t) {
-              entry->object.dir.nbactive = 0;
-              atomic_clear_uint32_t_bits(&entry->flags,
-                                         (CACHE_INODE_TRUST_CONTENT |
-                                          CACHE_INODE_DIR_POPULATED));
+              cache_inode_release_dirents_done(entry);
           }
     }
 }
@@ -913,6 +951,63 @@ cache_inode_file_holds_state(cache_entry_t *entry)
               !glist_empty(&entry->state_list));
 } /* cache_inode_file_holds_state */
 
+/**
+ * @brief Check whether cached attributes are within their lifetime
+ *
+ * @param[in] entry        The entry to check
+ * @param[in] current_time The current time
+ *
+ * @return TRUE if the attributes have not yet expired.
+ */
+
+static inline bool_t
+cache_inode_attrs_fresh(cache_entry_t *entry,
+                        time_t current_time)
+{
+     switch (cache_inode_params.expire_type_attr) {
+     case CACHE_INODE_EXPIRE_NEVER:
+          return TRUE;
+
+     case CACHE_INODE_EXPIRE_ADAPTIVE:
+          return (current_time - entry->attr_time < entry->attr_ttl);
+
+     default:
+          return (current_time - entry->attr_time <
+                  cache_inode_params.grace_period_attr);
+     }
+}
+
+/**
+ * @brief Ask the FSAL whether an entry changed since its last refresh
+ *
+ * This uses the FSAL's change probe, if it has one, which is expected
+ * to be much cheaper than a full getattr.  The caller must hold the
+ * attribute lock for write.
+ *
+ * @param[in] entry   The entry to probe
+ * @param[in] context FSAL credentials
+ *
+ * @return TRUE if the cached attributes are known to be current,
+ *         FALSE if they must be reloaded.
+ */
+
+static bool_t
+cache_inode_probe_change(cache_entry_t *entry,
+                         fsal_op_context_t *context)
+{
+     fsal_status_t fsal_status = {0, 0};
+     fsal_u64_t change = 0;
+
+     fsal_status = FSAL_getchange(&entry->handle, context, &change);
+     if (FSAL_IS_ERROR(fsal_status)) {
+          /* Not supported, or a real error the full getattr will
+             report (and kill the entry for, if stale.) */
+          return FALSE;
+     }
+
+     return (change == entry->attr_change);
+}
+
 /**
  * @brief Conditionally refresh attributes
  *
@@ -951,9 +1046,7 @@ cache_inode_check_trust(cache_entry_t *entry,
      oldmtime = entry->attributes.mtime.seconds;
 
      /* Do we need a refresh? */
-     if (((cache_inode_params.expire_type_attr == CACHE_INODE_EXPIRE_NEVER) ||
-          (current_time - entry->attr_time <
-           cache_inode_params.grace_period_attr)) &&
+     if (cache_inode_attrs_fresh(entry, current_time) &&
          (entry->flags & CACHE_INODE_TRUST_ATTRS) &&
          !((cache_inode_params.getattr_dir_invalidation)&&
            (entry->type == DIRECTORY))) {
@@ -967,15 +1060,27 @@ cache_inode_check_trust(cache_entry_t *entry,
      current_time = time(NULL);
 
      /* Make sure no one else has first */
-     if (((cache_inode_params.expire_type_attr == CACHE_INODE_EXPIRE_NEVER) ||
-          (current_time - entry->attr_time <
-           cache_inode_params.grace_period_attr)) &&
+     if (cache_inode_attrs_fresh(entry, current_time) &&
          (entry->flags & CACHE_INODE_TRUST_ATTRS) &&
          !((cache_inode_params.getattr_dir_invalidation) &&
            (entry->type == DIRECTORY))) {
           goto unlock;
      }
 
+     /* In adaptive mode, ask the FSAL whether anything changed
+        before paying for a full getattr. */
+     if ((cache_inode_params.expire_type_attr ==
+          CACHE_INODE_EXPIRE_ADAPTIVE) &&
+         (entry->flags & CACHE_INODE_TRUST_ATTRS) &&
+         (entry->type != SYMBOLIC_LINK) &&
+         !((cache_inode_params.getattr_dir_invalidation) &&
+           (entry->type == DIRECTORY)) &&
+         cache_inode_probe_change(entry, context)) {
+          entry->attr_time = current_time;
+          cache_inode_grow_attr_ttl(entry);
+          goto unlock;
+     }
+
      if ((status = cache_inode_refresh_attrs(entry, context))
          != CACHE_INODE_SUCCESS) {
           goto unlock;
@@ -0,0 +1,501 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_path.c
+ * \brief Path-prefix lookup cache
+ *
+ * \section DESCRIPTION
+ *
+ * Resolve multi-component paths from a starting directory with a
+ * single probe of a bounded, direct-mapped table.  Records hold only
+ * weak references, so they neither pin entries nor need to be
+ * purged when an entry is recycled: a record whose target or any
+ * traversed directory is gone, has a different change attribute, or
+ * has had a cached name removed or renamed since the record was
+ * made, simply fails validation and the caller falls back to
+ * component-by-component lookup.
+ *
+ * Access to every traversed directory is re-checked against the
+ * caller's credentials on each hit, so a record made on behalf of one
+ * user never grants another user a traversal it would be denied.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <time.h>
+#include <pthread.h>
+#include <string.h>
+#include <assert.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "log.h"
+#include "fsal.h"
+#include "cache_inode.h"
+#include "cache_inode_lru.h"
+#include "cache_inode_weakref.h"
+#include "cache_inode_path.h"
+#include "murmur3.h"
+
+/* Number of mutexes striped over the slots; prime, as for weakrefs */
+#define PATH_CACHE_PARTITIONS 17
+
+/**
+ * One record of the path cache.
+ */
+
+typedef struct cache_inode_path_slot__
+{
+  uint64_t hk; /*< Hash of the whole key, 0 if the slot is empty */
+  void *export; /*< FSAL export context the path was resolved in */
+  gweakref_t base; /*< Starting directory */
+  gweakref_t target; /*< Entry the path resolves to */
+  uint32_t depth; /*< Number of components */
+  uint32_t len; /*< Length of the packed component string */
+  char path[CACHE_INODE_PATH_MAX_LEN]; /*< Packed component string */
+  cache_inode_path_anc_t anc[CACHE_INODE_PATH_MAX_DEPTH]; /*< Validators */
+} cache_inode_path_slot_t;
+
+static struct {
+  uint32_t size;
+  cache_inode_path_slot_t *slots;
+  pthread_mutex_t locks[PATH_CACHE_PARTITIONS];
+} path_cache = {
+  .size = 0,
+  .slots = NULL
+};
+
+static cache_inode_path_stats_t path_stats;
+
+/**
+ * @brief Initialize the path cache
+ *
+ * Allocate the slot table sized from the CacheInode configuration.
+ * If the cache is disabled or cannot be allocated, every probe
+ * misses and no walk is ever started.
+ */
+
+void cache_inode_path_init(void)
+{
+     int i = 0;
+
+     if (!cache_inode_params.use_path_cache ||
+         cache_inode_params.path_cache_size == 0) {
+          LogInfo(COMPONENT_CACHE_INODE,
+                  "Path cache disabled");
+          return;
+     }
+
+     for (i = 0; i < PATH_CACHE_PARTITIONS; i++) {
+          pthread_mutex_init(&path_cache.locks[i], NULL);
+     }
+
+     path_cache.slots = gsh_calloc(cache_inode_params.path_cache_size,
+                                   sizeof(cache_inode_path_slot_t));
+     if (path_cache.slots == NULL) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "Unable to allocate %u path cache slots, path cache "
+                  "disabled", cache_inode_params.path_cache_size);
+          return;
+     }
+     path_cache.size = cache_inode_params.path_cache_size;
+
+     LogInfo(COMPONENT_CACHE_INODE,
+             "Path cache initialized with %u slots", path_cache.size);
+}
+
+/**
+ * @brief Release the path cache
+ *
+ * Workers may still be running at exit, so the slots are freed with
+ * every partition held and probed only under their partition lock;
+ * the size and the locks are kept for them.
+ */
+
+void cache_inode_path_shutdown(void)
+{
+     cache_inode_path_slot_t *slots = NULL;
+     int i = 0;
+
+     if (path_cache.slots == NULL)
+          return;
+
+     for (i = 0; i < PATH_CACHE_PARTITIONS; i++) {
+          pthread_mutex_lock(&path_cache.locks[i]);
+     }
+     slots = path_cache.slots;
+     path_cache.slots = NULL;
+     for (i = PATH_CACHE_PARTITIONS - 1; i >= 0; i--) {
+          pthread_mutex_unlock(&path_cache.locks[i]);
+     }
+
+     gsh_free(slots);
+}
+
+/**
+ * @brief Pack components into a NUL separated string
+ *
+ * @param[in]  names Components
+ * @param[in]  count Number of components
+ * @param[out] path  Output buffer of CACHE_INODE_PATH_MAX_LEN bytes
+ * @param[out] len   Length of the packed string
+ *
+ * @return TRUE if the components fit.
+ */
+
+static bool_t
+path_pack(fsal_name_t *names, uint32_t count, char *path, uint32_t *len)
+{
+     uint32_t i = 0;
+     uint32_t off = 0;
+
+     for (i = 0; i < count; i++) {
+          if (off + names[i].len + 1 > CACHE_INODE_PATH_MAX_LEN)
+               return FALSE;
+          memcpy(path + off, names[i].name, names[i].len);
+          off += names[i].len;
+          path[off++] = '\0';
+     }
+
+     *len = off;
+     return TRUE;
+}
+
+/**
+ * @brief Hash a path cache key
+ */
+
+static uint64_t
+path_hash(void *export, gweakref_t *base, const char *path, uint32_t len)
+{
+     uint64_t hk[2];
+
+     MurmurHash3_x64_128(path, len, 67, hk);
+
+     hk[0] ^= (uint64_t) (uintptr_t) export;
+     hk[0] ^= (uint64_t) (uintptr_t) base->ptr * 0x9e3779b97f4a7c15ULL;
+     hk[0] ^= base->gen;
+
+     /* 0 marks an empty slot */
+     return hk[0] ? hk[0] : 1;
+}
+
+static inline uint32_t
+path_slot_index(uint64_t hk)
+{
+     return hk % path_cache.size;
+}
+
+static inline pthread_mutex_t *
+path_slot_lock(uint32_t idx)
+{
+     return &path_cache.locks[idx % PATH_CACHE_PARTITIONS];
+}
+
+/**
+ * @brief Check that a traversed directory still resolves as recorded
+ *
+ * @param[in] anc     Validation data recorded for the directory
+ * @param[in] context FSAL credentials of the caller
+ *
+ * @return TRUE if the directory is live, unchanged, and searchable
+ *         by the caller.
+ */
+
+static bool_t
+path_anc_valid(cache_inode_path_anc_t *anc,
+               fsal_op_context_t *context)
+{
+     cache_entry_t *dir = NULL;
+     cache_inode_status_t status = CACHE_INODE_SUCCESS;
+     bool_t valid = FALSE;
+     fsal_accessflags_t access_mask
+          = (FSAL_MODE_MASK_SET(FSAL_X_OK) |
+             FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR));
+
+     if ((dir = cache_inode_weakref_get(&anc->dir, LRU_FLAG_NONE)) == NULL)
+          return FALSE;
+
+     /* Honour the attribute expiration policy as PUTFH would */
+     if (cache_inode_check_trust(dir, context) != CACHE_INODE_SUCCESS)
+          goto out;
+
+     if (!(dir->flags & CACHE_INODE_TRUST_CONTENT) ||
+         (atomic_fetch_uint32_t(&dir->object.dir.dirent_gen) !=
+          anc->dirent_gen))
+          goto out;
+
+     if (cache_inode_lock_trust_attrs(dir, context) != CACHE_INODE_SUCCESS)
+          goto out;
+
+     if ((dir->attributes.change == anc->change) &&
+         (cache_inode_access_no_mutex(dir, access_mask, context, &status)
+          == CACHE_INODE_SUCCESS))
+          valid = TRUE;
+
+     pthread_rwlock_unlock(&dir->attr_lock);
+
+out:
+     cache_inode_lru_unref(dir, LRU_FLAG_NONE);
+     return valid;
+}
+
+/**
+ * @brief Resolve a path through the path cache
+ *
+ * Look up the path made of the given components, starting at base,
+ * with a single probe.  Every directory traversed is validated before
+ * the result is trusted.  On a miss, or if validation fails, NULL is
+ * returned and the caller should fall back to cache_inode_lookup.
+ *
+ * If a cache entry is returned, its refcount is incremented by 1.
+ *
+ * @param[in]  base    Directory to start from
+ * @param[in]  names   Components of the path
+ * @param[in]  count   Number of components
+ * @param[out] attr    Attributes of the found entry
+ * @param[in]  context FSAL credentials
+ *
+ * @return The entry the path resolves to, or NULL.
+ */
+
+cache_entry_t *
+cache_inode_path_lookup(cache_entry_t *base,
+                        fsal_name_t *names,
+                        uint32_t count,
+                        fsal_attrib_list_t *attr,
+                        fsal_op_context_t *context)
+{
+     char path[CACHE_INODE_PATH_MAX_LEN];
+     cache_inode_path_anc_t anc[CACHE_INODE_PATH_MAX_DEPTH];
+     cache_inode_path_slot_t *slot = NULL;
+     cache_entry_t *entry = NULL;
+     gweakref_t target;
+     uint32_t len = 0;
+     uint32_t idx = 0;
+     uint32_t i = 0;
+     uint64_t hk = 0;
+     bool_t found = FALSE;
+
+     if ((path_cache.slots == NULL) ||
+         (count == 0) || (count > CACHE_INODE_PATH_MAX_DEPTH) ||
+         !path_pack(names, count, path, &len))
+          return NULL;
+
+     hk = path_hash(context->export_context, &base->weakref, path, len);
+     idx = path_slot_index(hk);
+
+     pthread_mutex_lock(path_slot_lock(idx));
+     if (path_cache.slots == NULL) {
+          pthread_mutex_unlock(path_slot_lock(idx));
+          return NULL;
+     }
+     slot = &path_cache.slots[idx];
+     if ((slot->hk == hk) &&
+         (slot->export == (void *) context->export_context) &&
+         (slot->base.ptr == base->weakref.ptr) &&
+         (slot->base.gen == base->weakref.gen) &&
+         (slot->depth == count) &&
+         (slot->len == len) &&
+         (memcmp(slot->path, path, len) == 0)) {
+          memcpy(anc, slot->anc, count * sizeof(cache_inode_path_anc_t));
+          target = slot->target;
+          found = TRUE;
+     }
+     pthread_mutex_unlock(path_slot_lock(idx));
+
+     if (!found) {
+          atomic_inc_uint64_t(&path_stats.misses);
+          return NULL;
+     }
+
+     for (i = 0; i < count; i++) {
+          if (!path_anc_valid(&anc[i], context))
+               goto stale;
+     }
+
+     if ((entry = cache_inode_weakref_get(&target, LRU_FLAG_NONE)) == NULL)
+          goto stale;
+
+     if (cache_inode_lock_trust_attrs(entry, context) != CACHE_INODE_SUCCESS) {
+          cache_inode_lru_unref(entry, LRU_FLAG_NONE);
+          goto stale;
+     }
+     *attr = entry->attributes;
+     pthread_rwlock_unlock(&entry->attr_lock);
+
+     atomic_inc_uint64_t(&path_stats.hits);
+     LogFullDebug(COMPONENT_CACHE_INODE,
+                  "Path cache hit: base=%p depth=%u entry=%p",
+                  base, count, entry);
+     return entry;
+
+stale:
+     atomic_inc_uint64_t(&path_stats.stale);
+     return NULL;
+}
+
+/**
+ * @brief Start recording a path resolution
+ *
+ * @param[out] walk  The walk to initialize
+ * @param[in]  base  Directory the resolution starts from
+ * @param[in]  names Components that are about to be resolved
+ * @param[in]  count Number of components
+ *
+ * @return TRUE if the walk was started.
+ */
+
+bool_t
+cache_inode_path_walk_start(cache_inode_path_walk_t *walk,
+                            cache_entry_t *base,
+                            fsal_name_t *names,
+                            uint32_t count)
+{
+     cache_inode_path_walk_abort(walk);
+
+     /* A single component is already a single dirent probe */
+     if ((path_cache.slots == NULL) ||
+         (count < 2) || (count > CACHE_INODE_PATH_MAX_DEPTH))
+          return FALSE;
+
+     if (!path_pack(names, count, walk->path, &walk->len))
+          return FALSE;
+
+     walk->base = base->weakref;
+     walk->last = base->weakref;
+     walk->depth = 0;
+     walk->remaining = count;
+
+     return TRUE;
+}
+
+/**
+ * @brief Record the state of a directory about to be searched
+ *
+ * The caller must have checked cache_inode_path_walk_active.  The
+ * validators are taken before the search so that any change racing
+ * with it invalidates the record.
+ *
+ * @param[in,out] walk The walk
+ * @param[in]     dir  The directory about to be searched
+ */
+
+void
+cache_inode_path_walk_enter(cache_inode_path_walk_t *walk,
+                            cache_entry_t *dir)
+{
+     cache_inode_path_anc_t *anc = &walk->anc[walk->depth];
+
+     assert(walk->depth < CACHE_INODE_PATH_MAX_DEPTH);
+
+     anc->dir = dir->weakref;
+     anc->dirent_gen = atomic_fetch_uint32_t(&dir->object.dir.dirent_gen);
+     pthread_rwlock_rdlock(&dir->attr_lock);
+     anc->change = dir->attributes.change;
+     pthread_rwlock_unlock(&dir->attr_lock);
+}
+
+/**
+ * @brief Record the result of searching a directory
+ *
+ * Advance the walk to the entry just found.  When the last component
+ * has been resolved, publish the record, replacing whatever occupied
+ * its slot.
+ *
+ * @param[in,out] walk    The walk
+ * @param[in]     entry   The entry found
+ * @param[in]     context FSAL credentials
+ */
+
+void
+cache_inode_path_walk_leave(cache_inode_path_walk_t *walk,
+                            cache_entry_t *entry,
+                            fsal_op_context_t *context)
+{
+     cache_inode_path_slot_t *slot = NULL;
+     uint32_t idx = 0;
+     uint64_t hk = 0;
+
+     if (walk->remaining == 0)
+          return;
+
+     walk->last = entry->weakref;
+     walk->depth++;
+     walk->remaining--;
+
+     if (walk->remaining > 0) {
+          /* Do not cache paths through referrals */
+          if ((entry->type != DIRECTORY) ||
+              (entry->object.dir.referral != NULL))
+               cache_inode_path_walk_abort(walk);
+          return;
+     }
+
+     hk = path_hash(context->export_context, &walk->base,
+                    walk->path, walk->len);
+     idx = path_slot_index(hk);
+
+     pthread_mutex_lock(path_slot_lock(idx));
+     if (path_cache.slots == NULL) {
+          pthread_mutex_unlock(path_slot_lock(idx));
+          cache_inode_path_walk_abort(walk);
+          return;
+     }
+     slot = &path_cache.slots[idx];
+     slot->hk = hk;
+     slot->export = (void *) context->export_context;
+     slot->base = walk->base;
+     slot->target = entry->weakref;
+     slot->depth = walk->depth;
+     slot->len = walk->len;
+     memcpy(slot->path, walk->path, walk->len);
+     memcpy(slot->anc, walk->anc,
+            walk->depth * sizeof(cache_inode_path_anc_t));
+     pthread_mutex_unlock(path_slot_lock(idx));
+
+     atomic_inc_uint64_t(&path_stats.inserts);
+     cache_inode_path_walk_abort(walk);
+}
+
+/**
+ * @brief Copy out path cache statistics
+ *
+ * @param[out] stats Current counters
+ */
+
+void cache_inode_path_get_stats(cache_inode_path_stats_t *stats)
+{
+     stats->hits = atomic_fetch_uint64_t(&path_stats.hits);
+     stats->misses = atomic_fetch_uint64_t(&path_stats.misses);
+     stats->stale = atomic_fetch_uint64_t(&path_stats.stale);
+     stats->inserts = atomic_fetch_uint64_t(&path_stats.inserts);
+}
@@ -0,0 +1,406 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_prefetch.c
+ * \brief Background directory prefetch
+ *
+ * \section DESCRIPTION
+ *
+ * A single helper thread drains a bounded ring of directories queued
+ * by cache_inode_lookup_impl and populates their dirent caches.  Each
+ * request carries a copy of the credentials of the lookup that
+ * queued it, so the FSAL is asked to list the directory on behalf of
+ * the user who is about to read it; READDIR still checks access
+ * against its own caller before returning anything from the cache.
+ *
+ * Prefetching is advisory: when the ring is full the request is
+ * dropped, and a directory that has been recycled or populated by
+ * the time the thread reaches it is skipped.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+#include <string.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "cache_inode.h"
+#include "cache_inode_lru.h"
+#include "cache_inode_weakref.h"
+#include "cache_inode_prefetch.h"
+
+/**
+ * A queued prefetch
+ */
+
+typedef struct cache_inode_prefetch_req__
+{
+  gweakref_t dir; /*< The directory to populate */
+  fsal_op_context_t context; /*< Credentials of the lookup that found it */
+} cache_inode_prefetch_req_t;
+
+static struct {
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  pthread_t thread_id;
+  bool_t running; /*< The helper thread was started */
+  bool_t shutdown; /*< The helper thread has been asked to exit */
+  uint32_t size; /*< Capacity of the ring */
+  uint32_t head; /*< Next request to serve */
+  uint32_t count; /*< Requests pending */
+  cache_inode_prefetch_req_t *ring;
+} prefetch_state = {
+  .mtx = PTHREAD_MUTEX_INITIALIZER,
+  .cv = PTHREAD_COND_INITIALIZER,
+  .running = FALSE,
+  .shutdown = FALSE,
+  .size = 0,
+  .head = 0,
+  .count = 0,
+  .ring = NULL
+};
+
+static cache_inode_prefetch_stats_t prefetch_stats;
+
+/**
+ * @brief Populate one queued directory
+ *
+ * @param[in] req The request to serve
+ */
+
+static void
+prefetch_one(cache_inode_prefetch_req_t *req)
+{
+     cache_entry_t *entry = NULL;
+     cache_inode_status_t status = CACHE_INODE_SUCCESS;
+
+     entry = cache_inode_weakref_get(&req->dir, LRU_REQ_SCAN);
+     if (entry == NULL) {
+          atomic_inc_uint64_t(&prefetch_stats.skipped);
+          return;
+     }
+
+     pthread_rwlock_wrlock(&entry->content_lock);
+     if ((entry->flags & CACHE_INODE_DIR_POPULATED) &&
+         (entry->flags & CACHE_INODE_TRUST_CONTENT)) {
+          atomic_inc_uint64_t(&prefetch_stats.skipped);
+     } else if (cache_inode_readdir_populate(entry,
+                                             &req->context,
+                                             &status)
+                != CACHE_INODE_SUCCESS) {
+          LogDebug(COMPONENT_CACHE_INODE,
+                   "Prefetch of directory %p failed: %s",
+                   entry, cache_inode_err_str(status));
+          atomic_inc_uint64_t(&prefetch_stats.failed);
+     } else {
+          atomic_set_uint32_t_bits(&entry->flags,
+                                   CACHE_INODE_DIR_PREFETCHED);
+          atomic_inc_uint64_t(&prefetch_stats.populated);
+     }
+     pthread_rwlock_unlock(&entry->content_lock);
+
+     cache_inode_lru_unref(entry, 0);
+}
+
+/**
+ * @brief Function that executes in the prefetch thread
+ *
+ * @param[in] arg A void pointer, currently ignored.
+ *
+ * @return A void pointer, currently NULL.
+ */
+
+static void *
+prefetch_thread(void *arg __attribute__((unused)))
+{
+     cache_inode_prefetch_req_t *req = NULL;
+
+     SetNameFunction("prefetch_thread");
+
+     req = gsh_malloc(sizeof(cache_inode_prefetch_req_t));
+     if (req == NULL) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "Unable to allocate prefetch request, prefetch thread "
+                  "exiting");
+          return NULL;
+     }
+
+     while (1) {
+          pthread_mutex_lock(&prefetch_state.mtx);
+          while ((prefetch_state.count == 0) &&
+                 !prefetch_state.shutdown) {
+               pthread_cond_wait(&prefetch_state.cv, &prefetch_state.mtx);
+          }
+          if (prefetch_state.shutdown) {
+               pthread_mutex_unlock(&prefetch_state.mtx);
+               break;
+          }
+          *req = prefetch_state.ring[prefetch_state.head];
+          prefetch_state.head = (prefetch_state.head + 1) %
+               prefetch_state.size;
+          prefetch_state.count--;
+          pthread_mutex_unlock(&prefetch_state.mtx);
+
+          prefetch_one(req);
+     }
+
+     gsh_free(req);
+     return NULL;
+}
+
+/**
+ * @brief Start the prefetch thread
+ *
+ * Must be called after cache_inode_lru_pkginit.  Does nothing unless
+ * Use_Readdir_Prefetch is set.
+ */
+
+void
+cache_inode_prefetch_pkginit(void)
+{
+     pthread_attr_t attr_thr;
+     int code = 0;
+
+     if (!cache_inode_params.use_readdir_prefetch ||
+         cache_inode_params.readdir_prefetch_queue == 0) {
+          LogInfo(COMPONENT_CACHE_INODE,
+                  "Readdir prefetch disabled");
+          return;
+     }
+
+     prefetch_state.ring
+          = gsh_calloc(cache_inode_params.readdir_prefetch_queue,
+                       sizeof(cache_inode_prefetch_req_t));
+     if (prefetch_state.ring == NULL) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "Unable to allocate %u prefetch requests, readdir "
+                  "prefetch disabled",
+                  cache_inode_params.readdir_prefetch_queue);
+          return;
+     }
+     prefetch_state.size = cache_inode_params.readdir_prefetch_queue;
+
+     if (pthread_attr_init(&attr_thr) != 0) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "can't init pthread's attributes");
+     }
+
+     if (pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's scope");
+     }
+
+     if (pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_JOINABLE)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's join state");
+     }
+
+     if (pthread_attr_setstacksize(&attr_thr, THREAD_STACK_SIZE)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's stack size");
+     }
+
+     code = pthread_create(&prefetch_state.thread_id, &attr_thr,
+                           prefetch_thread, NULL);
+     if (code != 0) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "Unable to start readdir prefetch thread, error code %d, "
+                  "readdir prefetch disabled", code);
+          gsh_free(prefetch_state.ring);
+          prefetch_state.ring = NULL;
+          prefetch_state.size = 0;
+          return;
+     }
+
+     prefetch_state.running = TRUE;
+     LogInfo(COMPONENT_CACHE_INODE,
+             "Readdir prefetch started, queue of %u, directories up to "
+             "%llu bytes", prefetch_state.size,
+             (unsigned long long)
+             cache_inode_params.readdir_prefetch_max_size);
+}
+
+/**
+ * @brief Stop the prefetch thread
+ *
+ * Waits for the directory being populated, if any; pending requests
+ * are abandoned.  The counters are logged.
+ */
+
+void
+cache_inode_prefetch_pkgshutdown(void)
+{
+     cache_inode_prefetch_stats_t stats;
+
+     if (!prefetch_state.running)
+          return;
+
+     pthread_mutex_lock(&prefetch_state.mtx);
+     prefetch_state.shutdown = TRUE;
+     pthread_cond_signal(&prefetch_state.cv);
+     pthread_mutex_unlock(&prefetch_state.mtx);
+
+     pthread_join(prefetch_state.thread_id, NULL);
+
+     /* Queuers check shutdown under the mutex before using the ring */
+     pthread_mutex_lock(&prefetch_state.mtx);
+     gsh_free(prefetch_state.ring);
+     prefetch_state.ring = NULL;
+     prefetch_state.size = 0;
+     prefetch_state.count = 0;
+     prefetch_state.running = FALSE;
+     pthread_mutex_unlock(&prefetch_state.mtx);
+
+     cache_inode_prefetch_get_stats(&stats);
+     LogInfo(COMPONENT_CACHE_INODE,
+             "Readdir prefetch: %"PRIu64" queued, %"PRIu64" dropped, "
+             "%"PRIu64" skipped, %"PRIu64" failed, %"PRIu64" populated, "
+             "%"PRIu64" useful, %"PRIu64" wasted",
+             stats.queued, stats.dropped, stats.skipped, stats.failed,
+             stats.populated, stats.useful, stats.wasted);
+}
+
+/**
+ * @brief Queue a directory for background population
+ *
+ * Called with a reference held on entry.  The directory is queued
+ * only if prefetch is running, the directory is not already
+ * populated, and its size attribute is within the configured limit.
+ *
+ * @param[in] entry   The directory
+ * @param[in] attr    Its attributes, as just returned by the FSAL
+ * @param[in] context Credentials to populate it with
+ */
+
+void
+cache_inode_prefetch_dir(cache_entry_t *entry,
+                         fsal_attrib_list_t *attr,
+                         fsal_op_context_t *context)
+{
+     cache_inode_prefetch_req_t *req = NULL;
+
+     if (!prefetch_state.running ||
+         (entry->type != DIRECTORY) ||
+         (entry->flags & CACHE_INODE_DIR_POPULATED))
+          return;
+
+     if (attr->filesize > cache_inode_params.readdir_prefetch_max_size)
+          return;
+
+     pthread_mutex_lock(&prefetch_state.mtx);
+     if (prefetch_state.shutdown) {
+          pthread_mutex_unlock(&prefetch_state.mtx);
+          return;
+     }
+     if (prefetch_state.count == prefetch_state.size) {
+          pthread_mutex_unlock(&prefetch_state.mtx);
+          atomic_inc_uint64_t(&prefetch_stats.dropped);
+          return;
+     }
+     req = &prefetch_state.ring[(prefetch_state.head + prefetch_state.count)
+                                % prefetch_state.size];
+     req->dir = entry->weakref;
+     req->context = *context;
+     prefetch_state.count++;
+     pthread_cond_signal(&prefetch_state.cv);
+     pthread_mutex_unlock(&prefetch_state.mtx);
+
+     atomic_inc_uint64_t(&prefetch_stats.queued);
+}
+
+/**
+ * @brief Note that READDIR is using a directory's cached dirents
+ *
+ * Counts a useful prefetch the first time a prefetched directory is
+ * read.  The content lock must be held on entry.
+ *
+ * @param[in,out] entry The directory
+ */
+
+void
+cache_inode_prefetch_consumed(cache_entry_t *entry)
+{
+     if (!(entry->flags & CACHE_INODE_DIR_PREFETCHED))
+          return;
+
+     /* Readers may race here under the shared content lock; decide
+        the winner under the queue mutex so each prefetch is counted
+        once. */
+     pthread_mutex_lock(&prefetch_state.mtx);
+     if (entry->flags & CACHE_INODE_DIR_PREFETCHED) {
+          atomic_clear_uint32_t_bits(&entry->flags,
+                                     CACHE_INODE_DIR_PREFETCHED);
+          atomic_inc_uint64_t(&prefetch_stats.useful);
+     }
+     pthread_mutex_unlock(&prefetch_state.mtx);
+}
+
+/**
+ * @brief Note that a directory's cached dirents are being released
+ *
+ * Counts a wasted prefetch if no READDIR used the prefetched
+ * dirents.  The content lock must be held for write on entry.
+ *
+ * @param[in,out] entry The directory
+ */
+
+void
+cache_inode_prefetch_discarded(cache_entry_t *entry)
+{
+     if (!(entry->flags & CACHE_INODE_DIR_PREFETCHED))
+          return;
+
+     atomic_clear_uint32_t_bits(&entry->flags,
+                                CACHE_INODE_DIR_PREFETCHED);
+     atomic_inc_uint64_t(&prefetch_stats.wasted);
+}
+
+/**
+ * @brief Return a snapshot of the prefetch statistics
+ *
+ * @param[out] stats Where to store the counters
+ */
+
+void
+cache_inode_prefetch_get_stats(cache_inode_prefetch_stats_t *stats)
+{
+     stats->queued = atomic_fetch_uint64_t(&prefetch_stats.queued);
+     stats->dropped = atomic_fetch_uint64_t(&prefetch_stats.dropped);
+     stats->skipped = atomic_fetch_uint64_t(&prefetch_stats.skipped);
+     stats->failed = atomic_fetch_uint64_t(&prefetch_stats.failed);
+     stats->populated = atomic_fetch_uint64_t(&prefetch_stats.populated);
+     stats->useful = atomic_fetch_uint64_t(&prefetch_stats.useful);
+     stats->wasted = atomic_fetch_uint64_t(&prefetch_stats.wasted);
+}
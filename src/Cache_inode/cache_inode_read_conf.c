@@ -55,6 +55,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdlib.h>
 
 static const char *CONF_LABEL_CACHE_INODE_GCPOL = "CacheInode_GC_Policy";
 static const char *CONF_LABEL_CACHE_INODE = "CacheInode";
@@ -170,6 +171,8 @@ int parse_cache_expire(cache_inode_expire_type_t *type, time_t *value, char *key
     *type = CACHE_INODE_EXPIRE_NEVER;
   else if (strcasecmp(key_value, "Immediate") == 0)
     *type = CACHE_INODE_EXPIRE_IMMEDIATE;
+  else if (strcasecmp(key_value, "Adaptive") == 0)
+    *type = CACHE_INODE_EXPIRE_ADAPTIVE;
   else
     return CACHE_INODE_INVALID_ARGUMENT;
 
@@ -189,6 +192,9 @@ void cache_inode_expire_to_str(cache_inode_expire_type_t type, time_t value, cha
       case CACHE_INODE_EXPIRE_IMMEDIATE:
         strcpy(out, "Immediate");
         break;
+      case CACHE_INODE_EXPIRE_ADAPTIVE:
+        strcpy(out, "Adaptive");
+        break;
     }
 }
 
@@ -262,6 +268,18 @@ cache_inode_read_conf_parameter(config_file_t config,
                                    key_value);
           if(err != CACHE_INODE_SUCCESS)
             return err;
+          /* Adaptive expiration is driven by the change attribute,
+             so make sure we always fetch it. */
+          if(param->expire_type_attr == CACHE_INODE_EXPIRE_ADAPTIVE)
+            param->attrmask |= FSAL_ATTR_CHGTIME | FSAL_ATTR_CHANGE;
+        }
+      else if(!strcasecmp(key_name, "Attr_Expiration_Min"))
+        {
+          param->attr_ttl_min = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Attr_Expiration_Max"))
+        {
+          param->attr_ttl_max = atoi(key_value);
         }
       else if(!strcasecmp(key_name, "Symlink_Expiration_Time"))
         {
@@ -270,6 +288,12 @@ cache_inode_read_conf_parameter(config_file_t config,
                                    key_value);
           if(err != CACHE_INODE_SUCCESS)
             return err;
+          if(param->expire_type_link == CACHE_INODE_EXPIRE_ADAPTIVE)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Adaptive expiration is only supported for Attr_Expiration_Time");
+              return CACHE_INODE_INVALID_ARGUMENT;
+            }
         }
       else if(!strcasecmp(key_name, "Directory_Expiration_Time"))
         {
@@ -278,6 +302,12 @@ cache_inode_read_conf_parameter(config_file_t config,
                                    key_value);
           if(err != CACHE_INODE_SUCCESS)
             return err;
+          if(param->expire_type_dirent == CACHE_INODE_EXPIRE_ADAPTIVE)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Adaptive expiration is only supported for Attr_Expiration_Time");
+              return CACHE_INODE_INVALID_ARGUMENT;
+            }
         }
       else if(!strcasecmp(key_name, "Use_Getattr_Directory_Invalidation"))
         {
@@ -291,6 +321,43 @@ cache_inode_read_conf_parameter(config_file_t config,
         {
           param->use_fsal_hash = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Use_Dirent_Array"))
+        {
+          param->use_dirent_array = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Use_Path_Cache"))
+        {
+          param->use_path_cache = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Path_Cache_Size"))
+        {
+          param->path_cache_size = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Use_Readdir_Prefetch"))
+        {
+          param->use_readdir_prefetch = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Readdir_Prefetch_Max_Size"))
+        {
+          param->readdir_prefetch_max_size = strtoull(key_value, NULL, 10);
+        }
+      else if(!strcasecmp(key_name, "Readdir_Prefetch_Queue"))
+        {
+          param->readdir_prefetch_queue = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Snapshot_File"))
+        {
+          strncpy(param->snapshot_file, key_value, MAXPATHLEN);
+          param->snapshot_file[MAXPATHLEN - 1] = '\0';
+        }
+      else if(!strcasecmp(key_name, "Snapshot_Interval"))
+        {
+          param->snapshot_interval = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Snapshot_Max_Entries"))
+        {
+          param->snapshot_max_entries = atoi(key_value);
+        }
       else if(!strcasecmp(key_name, "DebugLevel"))
         {
           DebugLevel = ReturnLevelAscii(key_value);
@@ -318,6 +385,14 @@ cache_inode_read_conf_parameter(config_file_t config,
         }
     }
 
+  if((param->attr_ttl_min < 1) ||
+     (param->attr_ttl_max < param->attr_ttl_min))
+    {
+      LogCrit(COMPONENT_CONFIG,
+              "Attr_Expiration_Min must be at least 1 and no larger than Attr_Expiration_Max");
+      return CACHE_INODE_INVALID_ARGUMENT;
+    }
+
   /* init logging */
   if(LogFile)
     SetComponentLogFile(COMPONENT_CACHE_INODE, LogFile);
@@ -483,12 +558,34 @@ void cache_inode_print_conf_parameter(FILE *output,
 {
   fprintf(output, "CacheInode: Attr_Expiration_Time         = %jd\n",
           param->grace_period_attr);
+  fprintf(output, "CacheInode: Attr_Expiration_Min          = %jd\n",
+          param->attr_ttl_min);
+  fprintf(output, "CacheInode: Attr_Expiration_Max          = %jd\n",
+          param->attr_ttl_max);
   fprintf(output, "CacheInode: Symlink_Expiration_Time      = %jd\n",
           param->grace_period_link);
   fprintf(output, "CacheInode: Directory_Expiration_Time    = %jd\n",
           param->grace_period_dirent);
   fprintf(output, "CacheInode: Use_Test_Access              = %s\n",
           (param->use_test_access ? "TRUE" : "FALSE"));
+  fprintf(output, "CacheInode: Use_Dirent_Array             = %s\n",
+          (param->use_dirent_array ? "TRUE" : "FALSE"));
+  fprintf(output, "CacheInode: Use_Path_Cache               = %s\n",
+          (param->use_path_cache ? "TRUE" : "FALSE"));
+  fprintf(output, "CacheInode: Path_Cache_Size              = %u\n",
+          param->path_cache_size);
+  fprintf(output, "CacheInode: Use_Readdir_Prefetch         = %s\n",
+          (param->use_readdir_prefetch ? "TRUE" : "FALSE"));
+  fprintf(output, "CacheInode: Readdir_Prefetch_Max_Size    = %llu\n",
+          (unsigned long long) param->readdir_prefetch_max_size);
+  fprintf(output, "CacheInode: Readdir_Prefetch_Queue       = %u\n",
+          param->readdir_prefetch_queue);
+  fprintf(output, "CacheInode: Snapshot_File                = %s\n",
+          param->snapshot_file);
+  fprintf(output, "CacheInode: Snapshot_Interval            = %jd\n",
+          param->snapshot_interval);
+  fprintf(output, "CacheInode: Snapshot_Max_Entries         = %u\n",
+          param->snapshot_max_entries);
 } /* cache_inode_print_conf_parameter */
 
 /**
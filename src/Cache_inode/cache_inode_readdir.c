@@ -52,6 +52,7 @@
 #include "cache_inode_lru.h"
 #include "cache_inode_avl.h"
 #include "cache_inode_weakref.h"
+#include "cache_inode_prefetch.h"
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -129,7 +130,9 @@ cache_inode_operate_cached_dirent(cache_entry_t *directory,
                                   cache_inode_dirent_op_t dirent_op)
 {
      cache_inode_dir_entry_t dirent_key[1], *dirent, *dirent2, *dirent3;
+     cache_inode_dir_entry_t newname_key[1];
      cache_inode_status_t status = CACHE_INODE_SUCCESS;
+     gweakref_t ref;
      int code = 0;
 
      /* Sanity check */
@@ -171,15 +174,17 @@ cache_inode_operate_cached_dirent(cache_entry_t *directory,
 
      switch (dirent_op) {
      case CACHE_INODE_DIRENT_OP_REMOVE:
+         atomic_inc_uint32_t(&directory->object.dir.dirent_gen);
          /* mark deleted */
          avl_dirent_set_deleted(directory, dirent);
          directory->object.dir.nbactive--;
          break;
 
      case CACHE_INODE_DIRENT_OP_RENAME:
-         FSAL_namecpy(&dirent_key->name, newname);
+         /* A separate key, as dirent may be dirent_key itself */
+         FSAL_namecpy(&newname_key->name, newname);
          dirent2 = cache_inode_avl_qp_lookup_s(directory,
-                                               dirent_key, 1);
+                                               newname_key, 1);
          if (dirent2) {
              /* rename would cause a collision */
              if (directory->flags &
@@ -190,12 +195,14 @@ cache_inode_operate_cached_dirent(cache_entry_t *directory,
                  status = CACHE_INODE_ENTRY_EXISTS;
              }
          } else {
+             atomic_inc_uint32_t(&directory->object.dir.dirent_gen);
              /* try to rename--no longer in-place */
+             ref = dirent->entry;
              avl_dirent_set_deleted(directory, dirent);
              dirent3 = pool_alloc(cache_inode_dir_entry_pool, NULL);
              FSAL_namecpy(&dirent3->name, newname);
              dirent3->flags = DIR_ENTRY_FLAG_NONE;
-             dirent3->entry = dirent->entry;
+             dirent3->entry = ref;
              code = cache_inode_avl_qp_insert(directory, dirent3);
              switch (code) {
              case 0:
@@ -250,7 +257,8 @@ out:
  * @param[in,out] parent    Cache entry of the directory being updated
  * @param[in]     name      The name to add to the entry
  * @param[in]     entry     The cache entry associated with name
- * @param[out]    dir_entry The directory entry newly added (optional)
+ * @param[out]    dir_entry The directory entry newly added (optional),
+ *                          NULL if it was stored by copy
  * @param[out]    status    Same as return value
  *
  * @return CACHE_INODE_SUCCESS or errors on failure.
@@ -268,6 +276,10 @@ cache_inode_add_cached_dirent(cache_entry_t *parent,
 
      *status = CACHE_INODE_SUCCESS;
 
+     if (dir_entry) {
+         *dir_entry = NULL;
+     }
+
      /* Sanity check */
      if(parent->type != DIRECTORY) {
           *status = CACHE_INODE_BAD_TYPE;
@@ -291,10 +303,13 @@ cache_inode_add_cached_dirent(cache_entry_t *parent,
      switch (code) {
      case 0:
          /* CACHE_INODE_SUCCESS */
+         if (dir_entry) {
+             *dir_entry = new_dir_entry;
+         }
          break;
      case 1:
-         /* we reused an existing dirent, dirent has been deep
-          * copied, dispose it */
+         /* we reused an existing dirent, or the dirent array copied
+          * it, dispose it */
          pool_free(cache_inode_dir_entry_pool, new_dir_entry);
          /* CACHE_INODE_SUCCESS */
          break;
@@ -307,10 +322,6 @@ cache_inode_add_cached_dirent(cache_entry_t *parent,
          break;
      }
 
-     if (dir_entry) {
-         *dir_entry = new_dir_entry;
-     }
-
      /* we're going to succeed */
      parent->object.dir.nbactive++;
 
@@ -511,6 +522,7 @@ cache_inode_readdir_populate(cache_entry_t *directory,
                                       &array_dirent[iter].attributes,
                                       type,
                                       &create_arg,
+                                      CACHE_INODE_FLAG_NONE,
                                       status)) == NULL)
             goto bail;
           cache_status
@@ -538,7 +550,8 @@ cache_inode_readdir_populate(cache_entry_t *directory,
            * I'm ignoring the status because the default operation is
            * a memcpy-- we already -have- the cookie. */
 
-          if (cache_status != CACHE_INODE_ENTRY_EXISTS)
+          if (cache_status != CACHE_INODE_ENTRY_EXISTS &&
+              new_dir_entry != NULL)
               FSAL_cookie_to_uint64(&array_dirent[iter].handle,
                                     context, &array_dirent[iter].cookie,
                                     &new_dir_entry->fsal_cookie);
@@ -609,8 +622,8 @@ cache_inode_readdir(cache_entry_t *directory,
 {
      /* The entry being examined */
      cache_inode_dir_entry_t *dirent = NULL;
-     /* The node in the tree being traversed */
-     struct avltree_node *dirent_node;
+     /* Where the dirent array representation returns entries */
+     cache_inode_dir_entry_t scratch;
      /* The access mask corresponding to permission to list directory
         entries */
      const fsal_accessflags_t access_mask
@@ -659,6 +672,7 @@ cache_inode_readdir(cache_entry_t *directory,
      } else {
           pthread_rwlock_rdlock(&directory->content_lock);
           pthread_rwlock_unlock(&directory->attr_lock);
+          cache_inode_prefetch_consumed(directory);
      }
 
      /* deal with initial cookie value:
@@ -678,7 +692,8 @@ cache_inode_readdir(cache_entry_t *directory,
 
           /* we assert this can now succeed */
           dirent = cache_inode_avl_lookup_k(directory, cookie,
-                                            CACHE_INODE_FLAG_NEXT_ACTIVE);
+                                            CACHE_INODE_FLAG_NEXT_ACTIVE,
+                                            &scratch);
           if (!dirent) {
                LogFullDebug(COMPONENT_NFS_READDIR,
                             "%s: seek to cookie=%"PRIu64" fail",
@@ -689,11 +704,10 @@ cache_inode_readdir(cache_entry_t *directory,
 
           /* dirent is the NEXT entry to return, since we sent
            * CACHE_INODE_FLAG_NEXT_ACTIVE */
-          dirent_node = &dirent->node_hk;
 
      } else {
           /* initial readdir */
-         dirent_node = avltree_first(&directory->object.dir.avl.t);
+         dirent = cache_inode_avl_first(directory, &scratch);
      }
 
      LogFullDebug(COMPONENT_NFS_READDIR,
@@ -708,14 +722,10 @@ cache_inode_readdir(cache_entry_t *directory,
      *nbfound = 0;
      *eod_met = FALSE;
 
-     while (in_result && dirent_node) {
+     while (in_result && dirent) {
           cache_entry_t *entry = NULL;
           cache_inode_status_t lookup_status = 0;
 
-          dirent = avltree_container_of(dirent_node,
-                                        cache_inode_dir_entry_t,
-                                        node_hk);
-
           if ((entry
                = cache_inode_weakref_get(&dirent->entry,
                                          LRU_REQ_SCAN))
@@ -733,6 +743,8 @@ cache_inode_readdir(cache_entry_t *directory,
                             going. */
                          atomic_clear_uint32_t_bits(&directory->flags,
                                                     CACHE_INODE_TRUST_CONTENT);
+                         dirent = cache_inode_avl_next(directory, dirent,
+                                                       &scratch);
                          continue;
                     } else {
                          /* Something is more seriously wrong,
@@ -767,13 +779,13 @@ cache_inode_readdir(cache_entry_t *directory,
           if (!in_result) {
                break;
           }
-          dirent_node = avltree_next(dirent_node);
+          dirent = cache_inode_avl_next(directory, dirent, &scratch);
      }
 
      /* We have reached the last node and every node traversed was
         added to the result */;
 
-     if (!dirent_node && in_result) {
+     if (!dirent && in_result) {
           *eod_met = TRUE;
      } else {
           *eod_met = FALSE;
@@ -139,6 +139,11 @@ cache_inode_clean_internal(cache_entry_t *entry)
           pthread_rwlock_wrlock(&entry->content_lock);
           cache_inode_release_symlink(entry);
           pthread_rwlock_unlock(&entry->content_lock);
+     } else if (entry->type == DIRECTORY) {
+          /* The dirent array storage must not outlive the entry */
+          pthread_rwlock_wrlock(&entry->content_lock);
+          cache_inode_release_dirents(entry, CACHE_INODE_AVL_BOTH);
+          pthread_rwlock_unlock(&entry->content_lock);
      }
 
      return CACHE_INODE_SUCCESS;
@@ -0,0 +1,809 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_snapshot.c
+ * \brief Persistent snapshot of the hot set of cache entries
+ *
+ * \section DESCRIPTION
+ *
+ * The file is a header followed by one record per entry, hottest
+ * first.  Each record is a fixed part (type, flags, lengths and the
+ * attributes) followed by the handle key, the symbolic link content
+ * if any, and the directory entries if any.  A directory entry names
+ * its target by the index of the target's record, so only entries
+ * that are themselves in the snapshot can be named.
+ *
+ * Snapshots are written to a temporary file which is synced and
+ * renamed over the previous one, so a crash while saving leaves the
+ * last complete snapshot in place.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <time.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "cache_inode.h"
+#include "cache_inode_avl.h"
+#include "cache_inode_lru.h"
+#include "cache_inode_weakref.h"
+#include "cache_inode_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x474e5053 /* "SPNG" */
+#define SNAPSHOT_VERSION 1
+
+/* Record flags */
+#define SNAPSHOT_REC_CONTENT   0x01 /* Link content or dirents saved */
+#define SNAPSHOT_REC_POPULATED 0x02 /* Every dirent of the directory saved */
+
+typedef struct snapshot_header__
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t attr_size; /*< sizeof(fsal_attrib_list_t) of the writer */
+  uint32_t handle_size; /*< sizeof(fsal_handle_t) of the writer */
+  uint32_t count; /*< Number of records */
+  uint32_t pad;
+} snapshot_header_t;
+
+typedef struct snapshot_record__
+{
+  uint32_t type; /*< cache_inode_file_type_t */
+  uint32_t flags; /*< SNAPSHOT_REC_* */
+  uint32_t handle_len; /*< Length of the handle key that follows */
+  uint32_t link_len; /*< Length of the link content that follows */
+  uint32_t ndirents; /*< Number of directory entries that follow */
+  uint32_t pad;
+  fsal_attrib_list_t attributes;
+} snapshot_record_t;
+
+typedef struct snapshot_dirent__
+{
+  uint32_t child; /*< Index of the record of the entry named */
+  uint32_t name_len; /*< Length of the name that follows */
+} snapshot_dirent_t;
+
+/**
+ * Where an entry's weak reference is found in the snapshot, for
+ * mapping dirents to record indexes.
+ */
+
+typedef struct snapshot_index__
+{
+  gweakref_t ref;
+  uint32_t idx;
+} snapshot_index_t;
+
+/**
+ * A record parsed from a snapshot being loaded
+ */
+
+typedef struct snapshot_loaded__
+{
+  snapshot_record_t rec; /*< Fixed part */
+  char *handle; /*< Handle key, in the file buffer */
+  char *link; /*< Link content, in the file buffer */
+  char *dirents; /*< First dirent, in the file buffer */
+  cache_entry_t *entry; /*< Entry created or found for this record */
+  bool_t created; /*< TRUE if the entry was created from this record */
+} snapshot_loaded_t;
+
+static struct {
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  pthread_t thread_id;
+  bool_t running;
+  bool_t shutdown;
+} snapshot_state = {
+  .mtx = PTHREAD_MUTEX_INITIALIZER,
+  .cv = PTHREAD_COND_INITIALIZER,
+  .running = FALSE,
+  .shutdown = FALSE
+};
+
+/* Serializes saves, the periodic one against the one at shutdown */
+static pthread_mutex_t snapshot_save_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+snapshot_index_cmp(const void *a, const void *b)
+{
+     const snapshot_index_t *ia = a;
+     const snapshot_index_t *ib = b;
+
+     if (ia->ref.ptr != ib->ref.ptr)
+          return ((uintptr_t) ia->ref.ptr < (uintptr_t) ib->ref.ptr) ?
+               -1 : 1;
+     if (ia->ref.gen != ib->ref.gen)
+          return (ia->ref.gen < ib->ref.gen) ? -1 : 1;
+     return 0;
+}
+
+/**
+ * @brief Find the record index of a weak reference
+ *
+ * @return The index or -1 if the entry is not in the snapshot.
+ */
+
+static int64_t
+snapshot_index_find(snapshot_index_t *index, uint32_t n, gweakref_t *ref)
+{
+     snapshot_index_t key;
+     snapshot_index_t *found = NULL;
+
+     key.ref = *ref;
+     key.idx = 0;
+     found = bsearch(&key, index, n, sizeof(snapshot_index_t),
+                     snapshot_index_cmp);
+
+     return found ? (int64_t) found->idx : -1;
+}
+
+static bool_t
+snapshot_write(FILE *f, const void *buf, size_t len)
+{
+     return (len == 0) || (fwrite(buf, len, 1, f) == 1);
+}
+
+/**
+ * @brief Drop the attributes that do not survive the process
+ *
+ * The ACL is a pointer to a shared ACL of this process; the entry
+ * fetches it again from the FSAL when its attributes are refreshed.
+ *
+ * @param[in,out] attr Attributes being saved or loaded
+ */
+
+static void
+snapshot_scrub_attrs(fsal_attrib_list_t *attr)
+{
+     attr->acl = NULL;
+     attr->asked_attributes &= ~FSAL_ATTR_ACL;
+     attr->supported_attributes &= ~FSAL_ATTR_ACL;
+}
+
+/**
+ * @brief Write one entry's record
+ *
+ * @param[in] f       Snapshot file
+ * @param[in] entry   The entry, referenced by the caller
+ * @param[in] index   Sorted weak reference index of all saved entries
+ * @param[in] n       Number of saved entries
+ *
+ * @return TRUE on success, FALSE on a write error.
+ */
+
+static bool_t
+snapshot_write_entry(FILE *f, cache_entry_t *entry,
+                     snapshot_index_t *index, uint32_t n)
+{
+     snapshot_record_t rec;
+     snapshot_dirent_t d;
+     cache_inode_dir_entry_t *dirent = NULL;
+     cache_inode_dir_entry_t scratch;
+     bool_t complete = TRUE;
+     bool_t ok = TRUE;
+     int64_t child = 0;
+     long fixed = 0;
+     long end = 0;
+
+     memset(&rec, 0, sizeof(rec));
+     rec.type = entry->type;
+     rec.handle_len = entry->fh_desc.len;
+
+     pthread_rwlock_rdlock(&entry->attr_lock);
+     rec.attributes = entry->attributes;
+     pthread_rwlock_unlock(&entry->attr_lock);
+     snapshot_scrub_attrs(&rec.attributes);
+
+     pthread_rwlock_rdlock(&entry->content_lock);
+
+     if ((entry->type == SYMBOLIC_LINK) &&
+         (entry->flags & CACHE_INODE_TRUST_CONTENT)) {
+          rec.flags |= SNAPSHOT_REC_CONTENT;
+          rec.link_len = entry->object.symlink->content.len;
+     }
+
+     /* The number of dirents is only known after walking them, so
+        write the fixed part now and rewrite it at the end. */
+     fixed = ftell(f);
+     ok = snapshot_write(f, &rec, sizeof(rec)) &&
+          snapshot_write(f, entry->fh_desc.start, rec.handle_len);
+     if (ok && rec.link_len)
+          ok = snapshot_write(f, entry->object.symlink->content.path,
+                              rec.link_len);
+
+     if (ok && (entry->type == DIRECTORY) &&
+         (entry->flags & CACHE_INODE_TRUST_CONTENT)) {
+          rec.flags |= SNAPSHOT_REC_CONTENT;
+          for (dirent = cache_inode_avl_first(entry, &scratch);
+               ok && (dirent != NULL);
+               dirent = cache_inode_avl_next(entry, dirent, &scratch)) {
+               if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+                    continue;
+               child = snapshot_index_find(index, n, &dirent->entry);
+               if (child < 0) {
+                    complete = FALSE;
+                    continue;
+               }
+               d.child = child;
+               d.name_len = dirent->name.len;
+               ok = snapshot_write(f, &d, sizeof(d)) &&
+                    snapshot_write(f, dirent->name.name, d.name_len);
+               rec.ndirents++;
+          }
+          if (complete && (entry->flags & CACHE_INODE_DIR_POPULATED))
+               rec.flags |= SNAPSHOT_REC_POPULATED;
+     }
+
+     pthread_rwlock_unlock(&entry->content_lock);
+
+     if (ok && ((rec.flags & SNAPSHOT_REC_CONTENT) || rec.ndirents)) {
+          end = ftell(f);
+          ok = (fseek(f, fixed, SEEK_SET) == 0) &&
+               snapshot_write(f, &rec, sizeof(rec)) &&
+               (fseek(f, end, SEEK_SET) == 0);
+     }
+
+     return ok;
+}
+
+/**
+ * @brief Save the hot set of entries
+ *
+ * @param[in] path File to write
+ * @param[in] max  Most entries to save
+ *
+ * @return 0 on success or an errno value.
+ */
+
+int
+cache_inode_snapshot_save(const char *path, uint32_t max)
+{
+     char tmp[MAXPATHLEN];
+     gweakref_t *refs = NULL;
+     cache_entry_t **entries = NULL;
+     snapshot_index_t *index = NULL;
+     snapshot_header_t hdr;
+     FILE *f = NULL;
+     size_t nrefs = 0;
+     uint32_t n = 0;
+     uint32_t i = 0;
+     int rc = 0;
+
+     if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp))
+          return ENAMETOOLONG;
+
+     refs = gsh_malloc(max * sizeof(gweakref_t));
+     entries = gsh_malloc(max * sizeof(cache_entry_t *));
+     index = gsh_malloc(max * sizeof(snapshot_index_t));
+     if ((refs == NULL) || (entries == NULL) || (index == NULL)) {
+          rc = ENOMEM;
+          goto out;
+     }
+
+     pthread_mutex_lock(&snapshot_save_mtx);
+
+     /* Pin what is still there, so the index stays valid while we
+        write. */
+     nrefs = cache_inode_lru_collect(refs, max);
+     for (i = 0; i < nrefs; i++) {
+          cache_entry_t *entry = cache_inode_weakref_get(&refs[i],
+                                                         LRU_REQ_SCAN);
+          if (entry == NULL)
+               continue;
+          switch (entry->type) {
+          case REGULAR_FILE:
+          case DIRECTORY:
+          case SYMBOLIC_LINK:
+          case SOCKET_FILE:
+          case FIFO_FILE:
+          case BLOCK_FILE:
+          case CHARACTER_FILE:
+               entries[n] = entry;
+               index[n].ref = entry->weakref;
+               index[n].idx = n;
+               n++;
+               break;
+          default:
+               cache_inode_lru_unref(entry, LRU_FLAG_NONE);
+               break;
+          }
+     }
+     qsort(index, n, sizeof(snapshot_index_t), snapshot_index_cmp);
+
+     f = fopen(tmp, "w");
+     if (f == NULL) {
+          rc = errno;
+          goto unpin;
+     }
+
+     memset(&hdr, 0, sizeof(hdr));
+     hdr.magic = SNAPSHOT_MAGIC;
+     hdr.version = SNAPSHOT_VERSION;
+     hdr.attr_size = sizeof(fsal_attrib_list_t);
+     hdr.handle_size = sizeof(fsal_handle_t);
+     hdr.count = n;
+
+     if (!snapshot_write(f, &hdr, sizeof(hdr)))
+          rc = EIO;
+     for (i = 0; (rc == 0) && (i < n); i++) {
+          if (!snapshot_write_entry(f, entries[i], index, n))
+               rc = EIO;
+     }
+
+     if ((rc == 0) && ((fflush(f) != 0) || (fsync(fileno(f)) != 0)))
+          rc = errno;
+     if ((fclose(f) != 0) && (rc == 0))
+          rc = errno;
+     if ((rc == 0) && (rename(tmp, path) != 0))
+          rc = errno;
+     if (rc != 0)
+          unlink(tmp);
+
+unpin:
+     for (i = 0; i < n; i++)
+          cache_inode_lru_unref(entries[i], LRU_FLAG_NONE);
+
+     pthread_mutex_unlock(&snapshot_save_mtx);
+
+     if (rc == 0)
+          LogInfo(COMPONENT_CACHE_INODE,
+                  "Saved %u entries to cache snapshot %s", n, path);
+     else
+          LogMajor(COMPONENT_CACHE_INODE,
+                   "Could not save cache snapshot %s: %s",
+                   path, strerror(rc));
+
+out:
+     gsh_free(refs);
+     gsh_free(entries);
+     gsh_free(index);
+     return rc;
+}
+
+/**
+ * @brief Take len bytes from a buffer being parsed
+ *
+ * @return The bytes or NULL if the buffer is exhausted.
+ */
+
+static char *
+snapshot_take(char **cur, size_t *left, size_t len)
+{
+     char *p = *cur;
+
+     if (len > *left)
+          return NULL;
+     *cur += len;
+     *left -= len;
+     return p;
+}
+
+/**
+ * @brief Parse and check every record of a snapshot
+ *
+ * @return TRUE if the whole file is consistent.
+ */
+
+static bool_t
+snapshot_parse(char *cur, size_t left, snapshot_loaded_t *loaded,
+               uint32_t count)
+{
+     snapshot_dirent_t d;
+     char *p = NULL;
+     uint32_t i = 0;
+     uint32_t j = 0;
+
+     for (i = 0; i < count; i++) {
+          if ((p = snapshot_take(&cur, &left,
+                                 sizeof(snapshot_record_t))) == NULL)
+               return FALSE;
+          memcpy(&loaded[i].rec, p, sizeof(snapshot_record_t));
+
+          switch (loaded[i].rec.type) {
+          case REGULAR_FILE:
+          case DIRECTORY:
+          case SOCKET_FILE:
+          case FIFO_FILE:
+          case BLOCK_FILE:
+          case CHARACTER_FILE:
+               if (loaded[i].rec.link_len != 0)
+                    return FALSE;
+               break;
+          case SYMBOLIC_LINK:
+               if (loaded[i].rec.link_len >= FSAL_MAX_PATH_LEN)
+                    return FALSE;
+               break;
+          default:
+               return FALSE;
+          }
+          if ((loaded[i].rec.ndirents != 0) &&
+              (loaded[i].rec.type != DIRECTORY))
+               return FALSE;
+          if ((loaded[i].rec.handle_len == 0) ||
+              (loaded[i].rec.handle_len > sizeof(fsal_handle_t)))
+               return FALSE;
+
+          if ((loaded[i].handle = snapshot_take(&cur, &left,
+                                                loaded[i].rec.handle_len))
+              == NULL)
+               return FALSE;
+          if ((loaded[i].link = snapshot_take(&cur, &left,
+                                              loaded[i].rec.link_len))
+              == NULL)
+               return FALSE;
+
+          loaded[i].dirents = cur;
+          for (j = 0; j < loaded[i].rec.ndirents; j++) {
+               if ((p = snapshot_take(&cur, &left, sizeof(d))) == NULL)
+                    return FALSE;
+               memcpy(&d, p, sizeof(d));
+               if ((d.child >= count) ||
+                   (d.name_len == 0) ||
+                   (d.name_len >= FSAL_MAX_NAME_LEN) ||
+                   (snapshot_take(&cur, &left, d.name_len) == NULL))
+                    return FALSE;
+          }
+     }
+
+     return (left == 0);
+}
+
+/**
+ * @brief Bring one record into the cache
+ *
+ * @param[in,out] l The parsed record
+ */
+
+static void
+snapshot_load_entry(snapshot_loaded_t *l)
+{
+     cache_inode_fsal_data_t fsdata;
+     cache_inode_create_arg_t create_arg;
+     fsal_handle_t handle;
+     cache_inode_status_t status = CACHE_INODE_SUCCESS;
+
+     memset(&handle, 0, sizeof(handle));
+     memcpy(&handle, l->handle, l->rec.handle_len);
+     fsdata.fh_desc.start = (caddr_t) &handle;
+     fsdata.fh_desc.len = l->rec.handle_len;
+
+     memset(&create_arg, 0, sizeof(create_arg));
+     if (l->rec.type == SYMBOLIC_LINK) {
+          memcpy(create_arg.link_content.path, l->link, l->rec.link_len);
+          create_arg.link_content.path[l->rec.link_len] = '\0';
+          create_arg.link_content.len = l->rec.link_len;
+     }
+
+     /* Snapshots may have been written by an older version that saved
+        the ACL pointer */
+     snapshot_scrub_attrs(&l->rec.attributes);
+
+     l->entry = cache_inode_new_entry(&fsdata, &l->rec.attributes,
+                                      l->rec.type, &create_arg,
+                                      CACHE_INODE_FLAG_STALE, &status);
+     l->created = (l->entry != NULL) && (status == CACHE_INODE_SUCCESS);
+
+     /* Link content never changes for a given handle. */
+     if (l->created && (l->rec.type == SYMBOLIC_LINK) &&
+         (l->rec.flags & SNAPSHOT_REC_CONTENT))
+          atomic_set_uint32_t_bits(&l->entry->flags,
+                                   CACHE_INODE_TRUST_CONTENT);
+}
+
+/**
+ * @brief Reload the dirents of a directory created from a record
+ *
+ * Nothing is done if the directory has been used since it was
+ * created: its attributes have then been refreshed, and the saved
+ * dirents might no longer match them.
+ *
+ * @param[in] l      The directory's record
+ * @param[in] loaded All records
+ */
+
+static void
+snapshot_load_dirents(snapshot_loaded_t *l, snapshot_loaded_t *loaded)
+{
+     cache_entry_t *dir = l->entry;
+     cache_inode_status_t status = CACHE_INODE_SUCCESS;
+     snapshot_dirent_t d;
+     fsal_name_t name;
+     char *cur = l->dirents;
+     bool_t complete = (l->rec.flags & SNAPSHOT_REC_POPULATED) != 0;
+     uint32_t j = 0;
+
+     pthread_rwlock_rdlock(&dir->attr_lock);
+     if (dir->flags & CACHE_INODE_TRUST_ATTRS) {
+          pthread_rwlock_unlock(&dir->attr_lock);
+          return;
+     }
+     pthread_rwlock_wrlock(&dir->content_lock);
+     if (dir->flags & CACHE_INODE_TRUST_CONTENT)
+          goto unlock;
+
+     for (j = 0; j < l->rec.ndirents; j++) {
+          memcpy(&d, cur, sizeof(d));
+          cur += sizeof(d);
+          memcpy(name.name, cur, d.name_len);
+          name.name[d.name_len] = '\0';
+          name.len = d.name_len;
+          cur += d.name_len;
+
+          if (loaded[d.child].entry == NULL) {
+               complete = FALSE;
+               continue;
+          }
+          if ((cache_inode_add_cached_dirent(dir, &name,
+                                             loaded[d.child].entry,
+                                             NULL, &status)
+               != CACHE_INODE_SUCCESS) &&
+              (status != CACHE_INODE_ENTRY_EXISTS))
+               complete = FALSE;
+     }
+
+     atomic_set_uint32_t_bits(&dir->flags, CACHE_INODE_TRUST_CONTENT);
+     if (complete)
+          atomic_set_uint32_t_bits(&dir->flags, CACHE_INODE_DIR_POPULATED);
+
+unlock:
+     pthread_rwlock_unlock(&dir->content_lock);
+     pthread_rwlock_unlock(&dir->attr_lock);
+}
+
+/**
+ * @brief Load a snapshot into the cache
+ *
+ * @param[in] path File to read
+ *
+ * @return 0 on success or an errno value.
+ */
+
+int
+cache_inode_snapshot_load(const char *path)
+{
+     snapshot_header_t hdr;
+     snapshot_loaded_t *loaded = NULL;
+     struct stat st;
+     char *buf = NULL;
+     FILE *f = NULL;
+     uint32_t count = 0;
+     uint32_t created = 0;
+     uint32_t i = 0;
+     int rc = 0;
+
+     if ((f = fopen(path, "r")) == NULL)
+          return errno;
+
+     if (fstat(fileno(f), &st) != 0) {
+          rc = errno;
+          goto out;
+     }
+     if ((size_t) st.st_size < sizeof(hdr)) {
+          rc = EINVAL;
+          goto out;
+     }
+     if ((buf = gsh_malloc(st.st_size)) == NULL) {
+          rc = ENOMEM;
+          goto out;
+     }
+     if (fread(buf, st.st_size, 1, f) != 1) {
+          rc = EIO;
+          goto out;
+     }
+
+     memcpy(&hdr, buf, sizeof(hdr));
+     if ((hdr.magic != SNAPSHOT_MAGIC) ||
+         (hdr.version != SNAPSHOT_VERSION) ||
+         (hdr.attr_size != sizeof(fsal_attrib_list_t)) ||
+         (hdr.handle_size != sizeof(fsal_handle_t)) ||
+         (hdr.count > (st.st_size - sizeof(hdr)) /
+          sizeof(snapshot_record_t))) {
+          rc = EINVAL;
+          goto out;
+     }
+     count = hdr.count;
+
+     if ((loaded = gsh_calloc(count ? count : 1,
+                              sizeof(snapshot_loaded_t))) == NULL) {
+          rc = ENOMEM;
+          goto out;
+     }
+     if (!snapshot_parse(buf + sizeof(hdr), st.st_size - sizeof(hdr),
+                         loaded, count)) {
+          rc = EINVAL;
+          goto out;
+     }
+
+     /* Coldest first, so the hottest entries end up nearest the MRU
+        end of the queues. */
+     for (i = count; i > 0; i--) {
+          if (snapshot_state.shutdown)
+               break;
+          snapshot_load_entry(&loaded[i - 1]);
+          if (loaded[i - 1].created)
+               created++;
+     }
+
+     for (i = 0; i < count; i++) {
+          if (loaded[i].created && (loaded[i].rec.type == DIRECTORY) &&
+              (loaded[i].rec.flags & SNAPSHOT_REC_CONTENT))
+               snapshot_load_dirents(&loaded[i], loaded);
+     }
+
+     for (i = 0; i < count; i++) {
+          if (loaded[i].entry != NULL)
+               cache_inode_lru_unref(loaded[i].entry, LRU_FLAG_NONE);
+     }
+
+     LogInfo(COMPONENT_CACHE_INODE,
+             "Loaded %u of %u entries from cache snapshot %s",
+             created, count, path);
+
+out:
+     if (rc != 0)
+          LogMajor(COMPONENT_CACHE_INODE,
+                   "Could not load cache snapshot %s: %s",
+                   path, strerror(rc));
+     fclose(f);
+     gsh_free(buf);
+     gsh_free(loaded);
+     return rc;
+}
+
+/**
+ * @brief Function that executes in the snapshot thread
+ *
+ * Loads the snapshot left by the previous run, then saves a new one
+ * every Snapshot_Interval seconds until shutdown.
+ *
+ * @param[in] arg A void pointer, currently ignored.
+ *
+ * @return A void pointer, currently NULL.
+ */
+
+static void *
+snapshot_thread(void *arg __attribute__((unused)))
+{
+     struct timespec then;
+
+     SetNameFunction("snapshot_thread");
+
+     if (access(cache_inode_params.snapshot_file, F_OK) == 0)
+          cache_inode_snapshot_load(cache_inode_params.snapshot_file);
+
+     pthread_mutex_lock(&snapshot_state.mtx);
+     while (!snapshot_state.shutdown) {
+          if (cache_inode_params.snapshot_interval == 0) {
+               pthread_cond_wait(&snapshot_state.cv, &snapshot_state.mtx);
+               continue;
+          }
+          then.tv_sec = time(NULL) + cache_inode_params.snapshot_interval;
+          then.tv_nsec = 0;
+          if ((pthread_cond_timedwait(&snapshot_state.cv,
+                                      &snapshot_state.mtx,
+                                      &then) == ETIMEDOUT) &&
+              !snapshot_state.shutdown) {
+               pthread_mutex_unlock(&snapshot_state.mtx);
+               cache_inode_snapshot_save(
+                    cache_inode_params.snapshot_file,
+                    cache_inode_params.snapshot_max_entries);
+               pthread_mutex_lock(&snapshot_state.mtx);
+          }
+     }
+     pthread_mutex_unlock(&snapshot_state.mtx);
+
+     return NULL;
+}
+
+/**
+ * @brief Start the snapshot thread
+ *
+ * Must be called after cache_inode_lru_pkginit.  Does nothing unless
+ * Snapshot_File is set.
+ */
+
+void
+cache_inode_snapshot_pkginit(void)
+{
+     pthread_attr_t attr_thr;
+     int code = 0;
+
+     if ((cache_inode_params.snapshot_file[0] == '\0') ||
+         (cache_inode_params.snapshot_max_entries == 0)) {
+          LogInfo(COMPONENT_CACHE_INODE,
+                  "Cache snapshot disabled");
+          return;
+     }
+
+     if (pthread_attr_init(&attr_thr) != 0) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "can't init pthread's attributes");
+     }
+
+     if (pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's scope");
+     }
+
+     if (pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_JOINABLE)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's join state");
+     }
+
+     if (pthread_attr_setstacksize(&attr_thr, THREAD_STACK_SIZE)
+         != 0) {
+          LogCrit(COMPONENT_CACHE_INODE, "can't set pthread's stack size");
+     }
+
+     code = pthread_create(&snapshot_state.thread_id, &attr_thr,
+                           snapshot_thread, NULL);
+     if (code != 0) {
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "Unable to start cache snapshot thread, error code %d, "
+                  "cache snapshot disabled", code);
+          return;
+     }
+
+     snapshot_state.running = TRUE;
+}
+
+/**
+ * @brief Stop the snapshot thread and save a final snapshot
+ */
+
+void
+cache_inode_snapshot_pkgshutdown(void)
+{
+     if (!snapshot_state.running)
+          return;
+
+     pthread_mutex_lock(&snapshot_state.mtx);
+     snapshot_state.shutdown = TRUE;
+     pthread_cond_signal(&snapshot_state.cv);
+     pthread_mutex_unlock(&snapshot_state.mtx);
+
+     pthread_join(snapshot_state.thread_id, NULL);
+     snapshot_state.running = FALSE;
+
+     cache_inode_snapshot_save(cache_inode_params.snapshot_file,
+                               cache_inode_params.snapshot_max_entries);
+}
@@ -42,6 +42,8 @@
 #include <utime.h>
 #include <sys/time.h>
 
+#define MAX_2( x, y )    ( (x) > (y) ? (x) : (y) )
+
 extern fsal_status_t posixstat64_2_fsal_attributes(struct stat64 *p_buffstat,
                                                    fsal_attrib_list_t * p_fsalattr_out);
 
@@ -161,6 +163,50 @@ fsal_status_t VFSFSAL_getattrs_descriptor(fsal_file_t * p_file_descriptor,     /
 
 }
 
+/**
+ * VFSFSAL_getchange:
+ * Get the change attribute of the object specified by its filehandle.
+ * This is a single stat with no attribute conversion, used by the
+ * cache to revalidate attributes that are otherwise still cached.
+ *
+ * \param p_filehandle (input):
+ *        The handle of the object to probe.
+ * \param p_context (input):
+ *        Authentication context for the operation (user,...).
+ * \param p_change (output):
+ *        The change attribute, computed as VFSFSAL_getattrs does.
+ *
+ * \return Major error codes :
+ *        - ERR_FSAL_NO_ERROR     (no error)
+ *        - Another error code if an error occured.
+ */
+fsal_status_t VFSFSAL_getchange(fsal_handle_t * p_filehandle,       /* IN */
+                                fsal_op_context_t * p_context,      /* IN */
+                                fsal_u64_t * p_change               /* OUT */
+    )
+{
+  int rc = 0 ;
+  int errsv;
+  struct stat buffstat;
+
+  if(!p_filehandle || !p_context || !p_change)
+    Return(ERR_FSAL_FAULT, 0, INDEX_FSAL_getchange);
+
+  TakeTokenFSCall();
+  rc = vfs_stat_by_handle( ((vfsfsal_op_context_t *)p_context)->export_context->mount_root_fd,
+                           &((vfsfsal_handle_t *)p_filehandle)->data.vfs_handle,
+                           &buffstat ) ;
+  errsv = errno;
+  ReleaseTokenFSCall();
+
+  if( rc == -1 )
+    Return(posix2fsal_error(errsv), errsv, INDEX_FSAL_getchange);
+
+  *p_change = (fsal_u64_t) MAX_2(buffstat.st_mtime, buffstat.st_ctime);
+
+  Return(ERR_FSAL_NO_ERROR, 0, INDEX_FSAL_getchange);
+}
+
 /**
  * VFSFSAL_setattrs:
  * Set attributes for the object specified by its filehandle.
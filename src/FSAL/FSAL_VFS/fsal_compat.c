@@ -91,7 +91,8 @@ fsal_functions_t fsal_vfs_functions = {
   .fsal_removexattrbyname = VFSFSAL_RemoveXAttrByName,
   .fsal_getextattrs = COMMON_getextattrs_notsupp,
   .fsal_getfileno = VFSFSAL_GetFileno,
-  .fsal_share_op = COMMON_share_op_notsupp
+  .fsal_share_op = COMMON_share_op_notsupp,
+  .fsal_getchange = VFSFSAL_getchange
 };
 
 fsal_const_t fsal_vfs_consts = {
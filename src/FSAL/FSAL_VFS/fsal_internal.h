@@ -135,6 +135,10 @@ fsal_status_t VFSFSAL_getattrs_descriptor(fsal_file_t * p_file_descriptor,     /
                                            fsal_op_context_t * p_context,       /* IN */
                                            fsal_attrib_list_t * p_object_attributes /* IN/OUT */ );
 
+fsal_status_t VFSFSAL_getchange(fsal_handle_t * p_filehandle,        /* IN */
+                                fsal_op_context_t * p_context,       /* IN */
+                                fsal_u64_t * p_change                /* OUT */ );
+
 fsal_status_t VFSFSAL_setattrs(fsal_handle_t * p_filehandle, /* IN */
                                fsal_op_context_t * p_context,        /* IN */
                                fsal_attrib_list_t * p_attrib_set,       /* IN */
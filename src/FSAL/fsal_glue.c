@@ -70,6 +70,16 @@ fsal_status_t FSAL_getattrs_descriptor(fsal_file_t * p_file_descriptor,
     }
 }
 
+fsal_status_t FSAL_getchange(fsal_handle_t * p_filehandle,   /* IN */
+                             fsal_op_context_t * p_context,  /* IN */
+                             fsal_u64_t * p_change           /* OUT */ )
+{
+  if(fsal_functions.fsal_getchange != NULL)
+    return fsal_functions.fsal_getchange(p_filehandle, p_context, p_change);
+
+  Return(ERR_FSAL_NOTSUPP, 0, INDEX_FSAL_getchange);
+}
+
 fsal_status_t FSAL_setattrs(fsal_handle_t * p_filehandle,       /* IN */
                             fsal_op_context_t * p_context,      /* IN */
                             fsal_attrib_list_t * p_attrib_set,  /* IN */
@@ -159,6 +159,9 @@ static int ChangeoverExports()
    * All references to the exports list should be up-to-date now. */
   memcpy(nfs_param.pexportlist, temp_pexportlist, sizeof(exportlist_t));
 
+  /* Whatever was cached from the old entries is now stale */
+  export_generation++;
+
   /* We no longer need the head that was created for
    * the new list since the export list is built as a linked list. */
   gsh_free(temp_pexportlist);
@@ -48,8 +48,13 @@
 #include "nlm4.h"
 #include "rquota.h"
 #include "nfs_core.h"
+#include "nfs_rpc_tcp_coalesce.h"
+#include "nfs_cred_cache.h"
 #include "cache_inode.h"
 #include "cache_inode_lru.h"
+#include "cache_inode_prefetch.h"
+#include "cache_inode_path.h"
+#include "cache_inode_snapshot.h"
 #include "err_cache_inode.h"
 #include "nfs_file_handle.h"
 #include "nfs_exports.h"
@@ -112,6 +117,7 @@ pthread_t admin_thrid;
 pthread_t fcc_gc_thrid;
 pthread_t sigmgr_thrid;
 pthread_t reaper_thrid;
+pthread_t tcp_coalesce_thrid;
 pthread_t gsh_dbus_thrid;
 pthread_t upp_thrid;
 nfs_tcb_t gccb;
@@ -319,6 +325,14 @@ void nfs_set_param_default()
 
   nfs_param.core_param.max_send_buffer_size = NFS_DEFAULT_SEND_BUFFER_SIZE;
   nfs_param.core_param.max_recv_buffer_size = NFS_DEFAULT_RECV_BUFFER_SIZE;
+  nfs_param.core_param.udp_batch_size = NFS_DEFAULT_UDP_BATCH_SIZE;
+  nfs_param.core_param.udp_batch_delay = NFS_DEFAULT_UDP_BATCH_DELAY;
+  nfs_param.core_param.tcp_coalesce_delay = NFS_DEFAULT_TCP_COALESCE_DELAY;
+  nfs_param.core_param.max_inflight = NFS_DEFAULT_MAX_INFLIGHT;
+  nfs_param.core_param.max_inflight_xprt = NFS_DEFAULT_MAX_INFLIGHT_XPRT;
+  nfs_param.core_param.cred_cache_size = 4096;
+  nfs_param.core_param.cred_cache_expiration = 600;
+  nfs_param.core_param.manage_gids = FALSE;
 
 #ifdef _USE_NLM
   nfs_param.core_param.nsm_use_caller_name = FALSE;
@@ -326,12 +340,6 @@ void nfs_set_param_default()
 
   nfs_param.core_param.clustered = FALSE;
 
-  /* Worker parameters : LRU dupreq */
-  nfs_param.worker_param.lru_dupreq.nb_call_gc_invalid = 100;
-  nfs_param.worker_param.lru_dupreq.clean_entry = clean_entry_dupreq;
-  nfs_param.worker_param.lru_dupreq.entry_to_str = print_entry_dupreq;
-  nfs_param.worker_param.lru_dupreq.lp_name = "Worker DupReq LRU";
-
   /* Worker parameters : GC */
   nfs_param.worker_param.nb_before_gc = NB_REQUEST_BEFORE_GC;
 
@@ -344,17 +352,7 @@ void nfs_set_param_default()
   strlcpy(nfs_param.krb5_param.ccache_dir, DEFAULT_NFS_CCACHE_DIR,
           sizeof(nfs_param.krb5_param.ccache_dir));
   nfs_param.krb5_param.active_krb5 = TRUE;
-  nfs_param.krb5_param.hash_param.index_size = PRIME_ID_MAPPER;
-  nfs_param.krb5_param.hash_param.alphabet_length = 10;      /* Not used for UID_MAPPER */
-  nfs_param.krb5_param.hash_param.hash_func_key = gss_ctx_hash_func;
-  nfs_param.krb5_param.hash_param.hash_func_rbt = gss_ctx_rbt_hash_func;
-  nfs_param.krb5_param.hash_param.hash_func_both = NULL ; /* BUGAZOMEU */
-  nfs_param.krb5_param.hash_param.compare_key = compare_gss_ctx;
-  nfs_param.krb5_param.hash_param.key_to_str = display_gss_ctx;
-  nfs_param.krb5_param.hash_param.val_to_str = display_gss_svc_data;
-  nfs_param.krb5_param.hash_param.ht_name = "KRB5 ID Mapper";
-  nfs_param.krb5_param.hash_param.flags = HT_FLAG_NONE;
-  nfs_param.krb5_param.hash_param.ht_log_component = COMPONENT_IDMAPPER;
+  nfs_param.krb5_param.ctx_cache_size = DEFAULT_GSS_CTX_CACHE_SIZE;
 #endif
 
   /* NFSv4 parameter */
@@ -362,20 +360,24 @@ void nfs_set_param_default()
   nfs_param.nfsv4_param.fh_expire = FALSE;
   nfs_param.nfsv4_param.returns_err_fh_expired = TRUE;
   nfs_param.nfsv4_param.return_bad_stateid = TRUE;
+  nfs_param.nfsv4_param.max_session_slots = NFS41_DEFAULT_MAX_SLOTS;
+  nfs_param.nfsv4_param.slot_cache_hiwat = NFS41_DEFAULT_SLOT_CACHE_HIWAT;
+  nfs_param.nfsv4_param.delegations = FALSE;
+  nfs_param.nfsv4_param.max_delegations = NFS4_DEFAULT_MAX_DELEGATIONS;
+  nfs_param.nfsv4_param.recov_journal = FALSE;
+  nfs_param.nfsv4_param.grace_early_exit = FALSE;
+  nfs_param.nfsv4_param.grace_reclaim_fraction = 100;
+  nfs_param.nfsv4_param.grace_reclaim_timeout = 15;
   strncpy(nfs_param.nfsv4_param.domainname, DEFAULT_DOMAIN, MAXNAMLEN);
   strncpy(nfs_param.nfsv4_param.idmapconf, DEFAULT_IDMAPCONF, MAXPATHLEN);
 
-  /* Worker parameters : dupreq hash table */
+  /* Worker parameters : dupreq shards */
   nfs_param.dupreq_param.hash_param.index_size = PRIME_DUPREQ;
   nfs_param.dupreq_param.hash_param.alphabet_length = 10;    /* Xid is a numerical decimal value */
-  nfs_param.dupreq_param.hash_param.hash_func_key = dupreq_value_hash_func;
-  nfs_param.dupreq_param.hash_param.hash_func_rbt = dupreq_rbt_hash_func;
-  nfs_param.dupreq_param.hash_param.compare_key = compare_req;
-  nfs_param.dupreq_param.hash_param.key_to_str = display_req_key;
-  nfs_param.dupreq_param.hash_param.val_to_str = display_req_val;
   nfs_param.dupreq_param.hash_param.ht_name = "Duplicate Request Cache";
-  nfs_param.dupreq_param.hash_param.flags = HT_FLAG_NONE; /* ! */
   nfs_param.dupreq_param.hash_param.ht_log_component = COMPONENT_DUPREQ;
+  nfs_param.dupreq_param.shard_size = DUPREQ_SHARD_SIZE;
+  nfs_param.dupreq_param.checksum_len = DUPREQ_CHECKSUM_LEN;
 
   /*  Worker parameters : IP/name hash table */
   nfs_param.ip_name_param.hash_param.index_size = PRIME_IP_NAME;
@@ -643,6 +645,8 @@ void nfs_set_param_default()
   cache_inode_params.grace_period_attr   = 0;
   cache_inode_params.grace_period_link   = 0;
   cache_inode_params.grace_period_dirent = 0;
+  cache_inode_params.attr_ttl_min        = 3;
+  cache_inode_params.attr_ttl_max        = 60;
   cache_inode_params.expire_type_attr    = CACHE_INODE_EXPIRE_NEVER;
   cache_inode_params.expire_type_link    = CACHE_INODE_EXPIRE_NEVER;
   cache_inode_params.expire_type_dirent  = CACHE_INODE_EXPIRE_NEVER;
@@ -654,6 +658,15 @@ void nfs_set_param_default()
   cache_inode_params.attrmask = FSAL_ATTR_MASK_V2_V3;
 #endif
   cache_inode_params.use_fsal_hash = 1;
+  cache_inode_params.use_dirent_array = FALSE;
+  cache_inode_params.use_path_cache = FALSE;
+  cache_inode_params.path_cache_size = 4096;
+  cache_inode_params.use_readdir_prefetch = FALSE;
+  cache_inode_params.readdir_prefetch_max_size = 65536;
+  cache_inode_params.readdir_prefetch_queue = 64;
+  cache_inode_params.snapshot_file[0] = '\0';
+  cache_inode_params.snapshot_interval = 300;
+  cache_inode_params.snapshot_max_entries = 65536;
 
   /* FSAL parameters */
   nfs_param.fsal_param.fsal_info.max_fs_calls = 30;  /* No semaphore to access the FSAL */
@@ -1163,9 +1176,6 @@ int nfs_check_param_consistency()
 
   // check for parameters which need to be primes
   if (!is_prime(nfs_param.dupreq_param.hash_param.index_size) ||
-#ifdef _HAVE_GSSAPI
-      !is_prime(nfs_param.krb5_param.hash_param.index_size) ||
-#endif
       !is_prime(nfs_param.ip_name_param.hash_param.index_size) ||
       !is_prime(nfs_param.uidmap_cache_param.hash_param.index_size) ||
       !is_prime(nfs_param.unamemap_cache_param.hash_param.index_size) ||
@@ -1416,6 +1426,20 @@ static void nfs_Start_threads(void)
   LogEvent(COMPONENT_THREAD,
            "reaper thread was started successfully");
 
+  /* Starting the thread writing overdue TCP replies */
+  if(nfs_param.core_param.tcp_coalesce_delay != 0)
+    {
+      if((rc = pthread_create(&tcp_coalesce_thrid, &attr_thr,
+                              tcp_coalesce_thread, NULL)) != 0)
+        {
+          LogFatal(COMPONENT_THREAD,
+                   "Could not create tcp_coalesce_thread, error = %d (%s)",
+                   errno, strerror(errno));
+        }
+      LogEvent(COMPONENT_THREAD,
+               "TCP reply coalescing thread was started successfully");
+    }
+
 #ifdef _USE_UPCALL_SIMULATOR
   /* Starts the thread that mimics upcalls from the FSAL */
    /* Starting the stats thread */
@@ -1515,6 +1539,13 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
      cache_inode_init() so the GC policy has been set */
   cache_inode_lru_pkginit();
 
+  /* Background directory prefetch, which needs the LRU */
+  cache_inode_prefetch_pkginit();
+
+  /* Reload the hot set saved by the previous run, and save it
+     periodically from now on */
+  cache_inode_snapshot_pkginit();
+
 #ifdef _USE_NFS4_1
   nfs41_session_pool = pool_init("NFSv4.1 session pool",
                                  sizeof(nfs41_session_t),
@@ -1632,8 +1663,8 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
       /* Don't release name until shutdown, it will be used by the
        * backchannel. */
 
-      /* Init the HashTable */
-      if(Gss_ctx_Hash_Init(nfs_param.krb5_param) == -1)
+      /* Init the context cache */
+      if(Gss_ctx_cache_init(&nfs_param.krb5_param) == -1)
         {
           LogFatal(COMPONENT_INIT, "Impossible to init GSS CTX cache");
         }
@@ -1715,6 +1746,11 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
   LogInfo(COMPONENT_INIT,
           "duplicate request hash table cache successfully initialized");
 
+  /* Init the credential cache */
+  if(nfs_Init_cred_cache() != 0)
+    LogFatal(COMPONENT_INIT,
+             "Error while initializing the credential cache");
+
   /* Init the IP/name cache */
   LogDebug(COMPONENT_INIT, "Now building IP/name cache");
   if(nfs_Init_ip_name(nfs_param.ip_name_param) != IP_NAME_SUCCESS)
@@ -2102,6 +2138,15 @@ void nfs_start(nfs_start_info_t * p_start_info)
   LogEvent(COMPONENT_MAIN,
            "NFS EXIT: regular exit");
 
+  /* Stop the directory prefetch */
+  cache_inode_prefetch_pkgshutdown();
+
+  /* Release the path cache */
+  cache_inode_path_shutdown();
+
+  /* Save the hot set for the next start */
+  cache_inode_snapshot_pkgshutdown();
+
   /* if not in grace period, clean up the old state directory */
   if(!nfs_in_grace())
     nfs4_clean_old_recov_dir();
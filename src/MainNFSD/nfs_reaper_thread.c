@@ -43,83 +43,63 @@
 
 unsigned int reaper_delay = REAPER_DELAY;
 
-static void reap_hash_table(hash_table_t * ht_reap)
+/* Expire the clientids whose lease ran out.  Only those filed in the
+ * lease wheel for a second already past are looked at. */
+static void reap_expired_leases(void)
 {
-  struct rbt_head     * head_rbt;
-  hash_data_t         * pdata = NULL;
-  uint32_t              i;
-  int                   v4, rc;
-  struct rbt_node     * pn;
+  time_t                now = time(NULL);
+  int                   v4;
   nfs_client_id_t     * pclientid;
   nfs_client_record_t * precord;
 
-  /* For each bucket of the requested hashtable */
-  for(i = 0; i < ht_reap->parameter.index_size; i++)
+  while((pclientid = nfs4_lease_wheel_pop(now)) != NULL)
     {
-      head_rbt = &ht_reap->partitions[i].rbt;
+      /*
+       * little hack: only want to reap v4 clients
+       * 4.1 initializess this field to '1'
+       */
+      v4 = (pclientid->cid_create_session_sequence == 0);
 
- restart:
-      /* acquire mutex */
-      pthread_rwlock_wrlock(&ht_reap->partitions[i].lock);
+      P(pclientid->cid_mutex);
 
-      /* go through all entries in the red-black-tree*/
-      RBT_LOOP(head_rbt, pn)
+      if(!valid_lease(pclientid) && v4)
         {
-          pdata = RBT_OPAQ(pn);
+          /* Take a reference to the client record */
+          precord = pclientid->cid_client_record;
+          inc_client_record_ref(precord);
 
-          pclientid = (nfs_client_id_t *)pdata->buffval.pdata;
-          /*
-           * little hack: only want to reap v4 clients
-           * 4.1 initializess this field to '1'
-           */
-          v4 = (pclientid->cid_create_session_sequence == 0);
+          V(pclientid->cid_mutex);
 
-          P(pclientid->cid_mutex);
-
-          if(!valid_lease(pclientid) && v4)
+          if(isDebug(COMPONENT_CLIENTID))
             {
-              inc_client_id_ref(pclientid);
-
-              /* Take a reference to the client record */
-              precord = pclientid->cid_client_record;
-              inc_client_record_ref(precord);
-
-              V(pclientid->cid_mutex);
+              char str[HASHTABLE_DISPLAY_STRLEN];
 
-              pthread_rwlock_unlock(&ht_reap->partitions[i].lock);
+              display_client_id_rec(pclientid, str);
 
-              if(isDebug(COMPONENT_CLIENTID))
-                {
-                  char str[HASHTABLE_DISPLAY_STRLEN];
-
-                  display_client_id_rec(pclientid, str);
-
-                  LogFullDebug(COMPONENT_CLIENTID,
-                               "Expire index %d %s",
-                               i, str);
-                }
+              LogFullDebug(COMPONENT_CLIENTID,
+                           "Expire %s",
+                           str);
+            }
 
-              /* Take cr_mutex and expire clientid */
-              P(precord->cr_mutex);
+          /* Take cr_mutex and expire clientid */
+          P(precord->cr_mutex);
 
-              rc = nfs_client_id_expire(pclientid);
+          (void) nfs_client_id_expire(pclientid);
 
-              V(precord->cr_mutex);
+          V(precord->cr_mutex);
 
-              dec_client_id_ref(pclientid);
-              dec_client_record_ref(precord);
-              if(rc)
-                goto restart;
-            }
-          else
-            {
-              V(pclientid->cid_mutex);
-            }
+          dec_client_record_ref(precord);
+        }
+      else
+        {
+          /* Renewed since it was filed, file it again */
+          nfs4_lease_wheel_arm(pclientid);
 
-          RBT_INCREMENT(pn);
+          V(pclientid->cid_mutex);
         }
 
-      pthread_rwlock_unlock(&ht_reap->partitions[i].lock);
+      /* Release the reference taken by nfs4_lease_wheel_pop */
+      dec_client_id_ref(pclientid);
     }
 }
 
@@ -153,8 +133,10 @@ void *reaper_thread(void *UnusedArg)
                    "Now checking NFS4 clients for expiration%s",
                    nfs_in_grace() ? " IN GRACE" : "");
 
-      reap_hash_table(ht_confirmed_client_id);
-      reap_hash_table(ht_unconfirmed_client_id);
+      reap_expired_leases();
+
+      /* Probe callback paths, revoke the delegations not returned */
+      state_deleg_reap();
     }                           /* while ( 1 ) */
 
   return NULL;
@@ -0,0 +1,323 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs_rpc_admission.c
+ * \brief   Admission control of the requests read on TCP connections.
+ *
+ * A request is in flight from the SVC_RECV that read it until its
+ * reply is sent.  The dispatcher blocks the events of a connection
+ * before handing it to a worker, and the worker unblocks them once it
+ * has read everything there was to read.  Before reading one more
+ * request, nfs_rpc_admit is checked; when it refuses, the connection
+ * is parked with its events still blocked:
+ *
+ *  - over Max_Inflight_Requests_Per_Conn, it waits for its own
+ *    requests to drop to half the limit;
+ *
+ *  - over Max_Inflight_Requests, it is queued, in order, behind the
+ *    other parked connections.  Each completing request dispatches
+ *    as many of them as there is room for.
+ *
+ * A parked connection holds a reference on its transport.  When it
+ * is resumed, a new leader request reads from it, as if the
+ * dispatcher had seen it readable.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "nlm_list.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "ganesha_rpc.h"
+#include "nfs_core.h"
+#include "nfs_rpc_admission.h"
+
+/* Values of gsh_xprt_private_t.throttled */
+#define ADMISSION_NONE   0
+#define ADMISSION_XPRT   1      /* over its own limit */
+#define ADMISSION_GLOBAL 2      /* in admission_parked */
+
+typedef struct admission_park
+{
+  struct glist_head list;
+  SVCXPRT *xprt;
+} admission_park_t;
+
+static uint32_t admission_inflight = 0;
+static uint32_t admission_parked_cnt = 0;
+static uint64_t admission_throttled_xprt = 0;
+static uint64_t admission_throttled_global = 0;
+
+/* Connections waiting for room under Max_Inflight_Requests, oldest first */
+static pthread_mutex_t admission_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head admission_parked = {
+  &admission_parked, &admission_parked
+};
+
+static inline gsh_xprt_private_t *admission_xu(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+  if(xu == NULL || !(xu->flags & XPRT_PRIVATE_FLAG_ADMIT))
+    return NULL;
+
+  return xu;
+}
+
+/* Requests a connection over its limit has to drop to */
+static inline uint32_t admission_lowat(uint32_t max)
+{
+  return max / 2;
+}
+
+/* Requests that can still be read under Max_Inflight_Requests */
+static inline uint32_t admission_room(void)
+{
+  uint32_t max = nfs_param.core_param.max_inflight;
+  uint32_t inflight;
+
+  if(max == 0)
+    return UINT32_MAX;
+
+  inflight = atomic_fetch_uint32_t(&admission_inflight);
+
+  return inflight < max ? max - inflight : 0;
+}
+
+/* Hand a parked connection back to the workers, dropping the
+ * reference taken when it was parked */
+static void admission_resume(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+  bool_t destroyed;
+
+  pthread_rwlock_rdlock(&xprt->lock);
+  destroyed = (xu->flags & XPRT_PRIVATE_FLAG_DESTROYED) != 0;
+  pthread_rwlock_unlock(&xprt->lock);
+
+  if(!destroyed)
+    {
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Resuming xprt=%p fd=%d, inflight=%u",
+                   xprt, xprt->xp_fd, xu->inflight);
+      (void) dispatch_rpc_request(xprt);
+    }
+
+  gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE);
+}
+
+/* Queue xprt behind the other parked connections if there is no room
+ * for it.  Returns TRUE if it may be read now. */
+static bool_t admission_global(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+  admission_park_t *park;
+
+  if(nfs_param.core_param.max_inflight == 0)
+    return TRUE;
+
+  /* Do not overtake those already waiting */
+  if(admission_room() > 0 &&
+     atomic_fetch_uint32_t(&admission_parked_cnt) == 0)
+    return TRUE;
+
+  park = gsh_malloc(sizeof(admission_park_t));
+  if(park == NULL)
+    return TRUE;
+
+  park->xprt = xprt;
+  gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_NONE);
+
+  P(admission_mutex);
+  xu->throttled = ADMISSION_GLOBAL;
+  glist_add_tail(&admission_parked, &park->list);
+  (void) atomic_inc_uint32_t(&admission_parked_cnt);
+  V(admission_mutex);
+
+  (void) atomic_inc_uint64_t(&admission_throttled_global);
+
+  LogFullDebug(COMPONENT_DISPATCH,
+               "Parking xprt=%p fd=%d, %u requests in flight",
+               xprt, xprt->xp_fd,
+               atomic_fetch_uint32_t(&admission_inflight));
+
+  /* The requests in flight may all have completed in between */
+  nfs_rpc_admission_kick();
+
+  return FALSE;
+}
+
+/**
+ * nfs_rpc_admission_attach: put an accepted connection under admission
+ * control.
+ */
+void nfs_rpc_admission_attach(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+  if(xu == NULL)
+    return;
+
+  if(nfs_param.core_param.max_inflight == 0 &&
+     nfs_param.core_param.max_inflight_xprt == 0)
+    return;
+
+  xu->flags |= XPRT_PRIVATE_FLAG_ADMIT;
+}
+
+/**
+ * nfs_rpc_admit: tell if one more request may be read from xprt.
+ *
+ * Called with the events of xprt blocked.  When FALSE is returned, the
+ * connection has been parked and will be dispatched again later: the
+ * caller must neither read from it nor unblock its events.
+ */
+bool_t nfs_rpc_admit(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = admission_xu(xprt);
+  uint32_t max;
+
+  if(xu == NULL)
+    return TRUE;
+
+  max = nfs_param.core_param.max_inflight_xprt;
+
+  if(max != 0 && atomic_fetch_uint32_t(&xu->inflight) >= max)
+    {
+      gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_NONE);
+      atomic_store_uint32_t(&xu->throttled, ADMISSION_XPRT);
+      (void) atomic_inc_uint64_t(&admission_throttled_xprt);
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Throttling xprt=%p fd=%d, %u requests in flight",
+                   xprt, xprt->xp_fd, max);
+
+      /* Its requests may have completed in between */
+      if(atomic_fetch_uint32_t(&xu->inflight) > admission_lowat(max) ||
+         !atomic_cas_uint32_t(&xu->throttled, ADMISSION_XPRT, ADMISSION_NONE))
+        return FALSE;
+
+      gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE);
+    }
+
+  return admission_global(xprt);
+}
+
+/**
+ * nfs_rpc_admission_begin: count a request read from xprt.
+ */
+void nfs_rpc_admission_begin(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = admission_xu(xprt);
+
+  if(xu == NULL)
+    return;
+
+  (void) atomic_inc_uint32_t(&admission_inflight);
+  (void) atomic_inc_uint32_t(&xu->inflight);
+}
+
+/**
+ * nfs_rpc_admission_end: a request counted by nfs_rpc_admission_begin
+ * has been answered (or dropped).  Resumes the connections it was
+ * holding back.
+ */
+void nfs_rpc_admission_end(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = admission_xu(xprt);
+  uint32_t max = nfs_param.core_param.max_inflight_xprt;
+  uint32_t inflight;
+
+  if(xu == NULL)
+    return;
+
+  (void) atomic_dec_uint32_t(&admission_inflight);
+  inflight = atomic_dec_uint32_t(&xu->inflight);
+
+  if(max != 0 && inflight <= admission_lowat(max) &&
+     atomic_fetch_uint32_t(&xu->throttled) == ADMISSION_XPRT &&
+     atomic_cas_uint32_t(&xu->throttled, ADMISSION_XPRT, ADMISSION_NONE))
+    {
+      if(admission_global(xprt))
+        admission_resume(xprt);
+      else
+        gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_NONE);
+    }
+
+  nfs_rpc_admission_kick();
+}
+
+/**
+ * nfs_rpc_admission_kick: dispatch the oldest parked connections, as
+ * many as there is room for under Max_Inflight_Requests.
+ */
+void nfs_rpc_admission_kick(void)
+{
+  struct glist_head resumed;
+  struct glist_head *glist, *glistn;
+  admission_park_t *park;
+  uint32_t room;
+
+  if(atomic_fetch_uint32_t(&admission_parked_cnt) == 0)
+    return;
+
+  init_glist(&resumed);
+
+  P(admission_mutex);
+  room = admission_room();
+  while(room > 0 && !glist_empty(&admission_parked))
+    {
+      park = glist_first_entry(&admission_parked, admission_park_t, list);
+      glist_del(&park->list);
+      glist_add_tail(&resumed, &park->list);
+      ((gsh_xprt_private_t *) park->xprt->xp_u1)->throttled = ADMISSION_NONE;
+      (void) atomic_dec_uint32_t(&admission_parked_cnt);
+      room--;
+    }
+  V(admission_mutex);
+
+  glist_for_each_safe(glist, glistn, &resumed)
+    {
+      park = glist_entry(glist, admission_park_t, list);
+      glist_del(&park->list);
+      admission_resume(park->xprt);
+      gsh_free(park);
+    }
+}
+
+void nfs_rpc_admission_get_stats(nfs_rpc_admission_stats_t *pstats)
+{
+  pstats->inflight = atomic_fetch_uint32_t(&admission_inflight);
+  pstats->parked = atomic_fetch_uint32_t(&admission_parked_cnt);
+  pstats->throttled_xprt = atomic_fetch_uint64_t(&admission_throttled_xprt);
+  pstats->throttled_global =
+      atomic_fetch_uint64_t(&admission_throttled_global);
+}
@@ -58,6 +58,8 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nlm4.h"
+#include "nfs_rpc_tcp_coalesce.h"
+#include "nfs_rpc_admission.h"
 #include "rquota.h"
 #include "nfs_init.h"
 #include "nfs_core.h"
@@ -737,6 +739,12 @@ static u_int nfs_rpc_rdvs(SVCXPRT *xprt, SVCXPRT *newxprt, const u_int flags,
 
     pthread_mutex_unlock(&mtx);
 
+    /* queue its replies, if enabled */
+    nfs_rpc_tcp_coalesce_attach(newxprt);
+
+    /* bound its requests in flight, if enabled */
+    nfs_rpc_admission_attach(newxprt);
+
     (void) svc_rqst_evchan_reg(rpc_evchan[tchan].chan_id, newxprt,
                                SVC_RQST_FLAG_NONE);
 
@@ -745,8 +753,10 @@ static u_int nfs_rpc_rdvs(SVCXPRT *xprt, SVCXPRT *newxprt, const u_int flags,
 
 static void nfs_rpc_free_xprt(SVCXPRT *xprt)
 {
-    if (xprt->xp_u1)
+    if (xprt->xp_u1) {
+        nfs_rpc_tcp_coalesce_release(xprt);
         free_gsh_xprt_private(xprt->xp_u1);
+    }
 }
 
 /**
@@ -1022,6 +1032,7 @@ process_status_t dispatch_rpc_request(SVCXPRT *xprt)
 
   /* Count as 1 ref */
   gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_NONE);
+  nfs_rpc_tcp_coalesce_begin(xprt);
 
   /* Hand it off */
   DispatchWorkNFS(nfsreq, worker_index);
@@ -1126,6 +1137,11 @@ nfs_rpc_getreq_ng(SVCXPRT *xprt /*, int chan_id */)
      * completion of SVC_RECV */
     (void) svc_rqst_block_events(xprt, SVC_RQST_FLAG_NONE);
 
+    /* Too many requests in flight, leave it blocked until some
+     * complete */
+    if (! nfs_rpc_admit(xprt))
+        return (TRUE);
+
     dispatch_rpc_request(xprt);
 
     return (TRUE);
@@ -0,0 +1,501 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs_rpc_tcp_coalesce.c
+ * \brief   Coalescing of the replies sent on a TCP connection.
+ *
+ * Each reply sent with svc_sendreply2 on a vc transport is written by
+ * the RPC library as its own record, with its own sendmsg(), so a
+ * client pipelining small calls gets one small segment per reply.
+ *
+ * Accepted connections get a copy of the transport ops whose
+ * xp_reply encodes the record mark and the reply into a buffer of the
+ * connection.  The buffer is written:
+ *  - by the last request of the connection to finish, ie when no other
+ *    request of the connection is queued or in progress, as counted by
+ *    nfs_rpc_tcp_coalesce_begin and nfs_rpc_tcp_coalesce_done;
+ *  - when the next reply does not fit in it;
+ *  - by tcp_coalesce_thread, once its oldest reply has waited
+ *    TCP_Reply_Coalesce_Delay microseconds.
+ *
+ * The buffer is only touched with the duplex lock of the transport
+ * held, as every other write on the connection.  A connection that
+ * does not drain within TCP_COALESCE_WRITE_TRIES waits is shut down,
+ * as the RPC library does on a failed write, and its later replies
+ * are dropped.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "nlm_list.h"
+#include "abstract_atomic.h"
+#include "ganesha_rpc.h"
+#include "nfs_core.h"
+#include "nfs_rpc_tcp_coalesce.h"
+
+extern SVCAUTH Svc_auth_none;
+
+/* Last fragment bit of the record mark */
+#define TCP_COALESCE_LAST_FRAG 0x80000000
+
+/* Transports flushed per pass of tcp_coalesce_thread */
+#define TCP_COALESCE_PASS 64
+
+/* Waits for a full socket to drain, and their length in ms, before a
+ * flush gives up on the connection */
+#define TCP_COALESCE_WRITE_TRIES 5
+#define TCP_COALESCE_WRITE_WAIT 1000
+
+typedef struct tcp_reply_queue
+{
+  struct glist_head pending;    /* in tcp_coalesce_pending if count > 0 */
+  SVCXPRT *xprt;
+  struct timespec first;        /* when the oldest reply was queued */
+  uint32_t active;              /* requests begun and not yet done */
+  bool_t dead;                  /* a flush failed, replies are dropped */
+  u_int count;
+  u_int len;
+  char buf[TCP_COALESCE_BUFSIZE];
+} tcp_reply_queue_t;
+
+static pthread_mutex_t tcp_coalesce_ops_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const struct xp_ops *tcp_coalesce_orig_ops = NULL;
+static struct xp_ops tcp_coalesce_ops;
+
+/* Queues holding replies, oldest first */
+static pthread_mutex_t tcp_coalesce_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tcp_coalesce_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head tcp_coalesce_pending = {
+  &tcp_coalesce_pending, &tcp_coalesce_pending
+};
+
+static inline tcp_reply_queue_t *tcp_coalesce_queue(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+  return xu != NULL ? xu->reply_queue : NULL;
+}
+
+/* Deadline of a queue, first + TCP_Reply_Coalesce_Delay */
+static void tcp_coalesce_deadline(tcp_reply_queue_t *q, struct timespec *ts)
+{
+  long nsec = q->first.tv_nsec +
+              (long)nfs_param.core_param.tcp_coalesce_delay * 1000;
+
+  ts->tv_sec = q->first.tv_sec + nsec / 1000000000;
+  ts->tv_nsec = nsec % 1000000000;
+}
+
+static bool_t tcp_coalesce_due(tcp_reply_queue_t *q, struct timespec *now)
+{
+  struct timespec deadline;
+
+  tcp_coalesce_deadline(q, &deadline);
+
+  return (now->tv_sec > deadline.tv_sec ||
+          (now->tv_sec == deadline.tv_sec &&
+           now->tv_nsec >= deadline.tv_nsec));
+}
+
+/*
+ * Writes the queued replies; the duplex lock must be held.  Gives up
+ * after TCP_COALESCE_WRITE_TRIES waits on a full socket: the
+ * connection is then shut down so that its next read fails and the
+ * worker destroys it, as for any dead connection.
+ */
+static bool_t tcp_coalesce_flush(tcp_reply_queue_t *q)
+{
+  char *p = q->buf;
+  u_int left = q->len;
+  struct pollfd pfd;
+  int tries = 0;
+  ssize_t n;
+
+  while(left > 0)
+    {
+      n = write(q->xprt->xp_fd, p, left);
+      if(n < 0)
+        {
+          if(errno == EINTR)
+            continue;
+          if((errno == EAGAIN || errno == EWOULDBLOCK) &&
+             tries++ < TCP_COALESCE_WRITE_TRIES)
+            {
+              pfd.fd = q->xprt->xp_fd;
+              pfd.events = POLLOUT;
+              (void) poll(&pfd, 1, TCP_COALESCE_WRITE_WAIT);
+              continue;
+            }
+          LogInfo(COMPONENT_DISPATCH,
+                  "write of %u queued replies on socket %d failed: %s",
+                  q->count, q->xprt->xp_fd, strerror(errno));
+          q->dead = TRUE;
+          (void) shutdown(q->xprt->xp_fd, SHUT_RDWR);
+          break;
+        }
+      p += n;
+      left -= n;
+    }
+
+  if(!q->dead)
+    LogFullDebug(COMPONENT_DISPATCH,
+                 "Wrote %u replies, %u bytes on socket %d",
+                 q->count, q->len, q->xprt->xp_fd);
+
+  q->count = 0;
+  q->len = 0;
+
+  pthread_mutex_lock(&tcp_coalesce_mutex);
+  if(q->pending.next != NULL)
+    glist_del(&q->pending);
+  pthread_mutex_unlock(&tcp_coalesce_mutex);
+
+  return !q->dead;
+}
+
+/*
+ * Encodes a reply as svc_vc_reply() does, as a single fragment record
+ * appended to the queue.  Fails, leaving msg and the queue unchanged,
+ * if the reply cannot be encoded or does not fit.
+ */
+static bool_t tcp_coalesce_encode(tcp_reply_queue_t *q, SVCXPRT *xprt,
+                                  struct rpc_msg *msg)
+{
+  SVCAUTH *auth = xprt->xp_auth != NULL ? xprt->xp_auth : &Svc_auth_none;
+  u_int start = q->len;
+  xdrproc_t xdr_proc;
+  caddr_t xdr_where;
+  uint32_t mark;
+  XDR xdrs;
+  u_int len;
+  bool_t ok;
+
+  if(TCP_COALESCE_BUFSIZE - start <= 2 * BYTES_PER_XDR_UNIT)
+    return FALSE;
+
+  xdrmem_create(&xdrs, q->buf + start + BYTES_PER_XDR_UNIT,
+                TCP_COALESCE_BUFSIZE - start - BYTES_PER_XDR_UNIT,
+                XDR_ENCODE);
+
+  if(msg->rm_reply.rp_stat == MSG_ACCEPTED &&
+     msg->rm_reply.rp_acpt.ar_stat == SUCCESS)
+    {
+      xdr_proc = msg->acpted_rply.ar_results.proc;
+      xdr_where = msg->acpted_rply.ar_results.where;
+      msg->acpted_rply.ar_results.proc = (xdrproc_t) xdr_void;
+      msg->acpted_rply.ar_results.where = NULL;
+
+      ok = xdr_replymsg(&xdrs, msg) &&
+           SVCAUTH_WRAP(auth, &xdrs, xdr_proc, xdr_where);
+
+      msg->acpted_rply.ar_results.proc = xdr_proc;
+      msg->acpted_rply.ar_results.where = xdr_where;
+    }
+  else
+    ok = xdr_replymsg(&xdrs, msg);
+
+  len = XDR_GETPOS(&xdrs);
+  XDR_DESTROY(&xdrs);
+
+  if(!ok)
+    return FALSE;
+
+  mark = htonl(TCP_COALESCE_LAST_FRAG | len);
+  memcpy(q->buf + start, &mark, BYTES_PER_XDR_UNIT);
+  q->len += BYTES_PER_XDR_UNIT + len;
+  q->count++;
+
+  return TRUE;
+}
+
+/*
+ * xp_reply of the coalescing transports, called with the duplex lock
+ * held.
+ */
+static bool_t tcp_coalesce_reply(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  tcp_reply_queue_t *q = tcp_coalesce_queue(xprt);
+
+  if(q == NULL)
+    return tcp_coalesce_orig_ops->xp_reply(xprt, msg);
+
+  /* The connection is being torn down */
+  if(q->dead)
+    return FALSE;
+
+  if(!tcp_coalesce_encode(q, xprt, msg))
+    {
+      /* Make room, or keep the order of replies when this one is too
+       * large for the buffer and is written by the RPC library */
+      if(q->count > 0 && !tcp_coalesce_flush(q))
+        return FALSE;
+
+      if(!tcp_coalesce_encode(q, xprt, msg))
+        return tcp_coalesce_orig_ops->xp_reply(xprt, msg);
+    }
+
+  if(q->count == 1)
+    {
+      pthread_mutex_lock(&tcp_coalesce_mutex);
+      clock_gettime(CLOCK_REALTIME, &q->first);
+      glist_add_tail(&tcp_coalesce_pending, &q->pending);
+      pthread_cond_signal(&tcp_coalesce_cond);
+      pthread_mutex_unlock(&tcp_coalesce_mutex);
+    }
+
+  return TRUE;
+}
+
+/**
+ *
+ * nfs_rpc_tcp_coalesce_attach: makes a newly accepted transport coalesce
+ * its replies.
+ *
+ * Does nothing unless TCP_Reply_Coalesce_Delay is set.  The private
+ * data of the transport must already be allocated.
+ *
+ */
+void nfs_rpc_tcp_coalesce_attach(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+  tcp_reply_queue_t *q;
+  bool_t same_ops;
+
+  if(nfs_param.core_param.tcp_coalesce_delay == 0)
+    return;
+
+  pthread_mutex_lock(&tcp_coalesce_ops_mutex);
+  if(tcp_coalesce_orig_ops == NULL)
+    {
+      tcp_coalesce_orig_ops = xprt->xp_ops;
+      tcp_coalesce_ops = *xprt->xp_ops;
+      tcp_coalesce_ops.xp_reply = tcp_coalesce_reply;
+    }
+  same_ops = (xprt->xp_ops == tcp_coalesce_orig_ops);
+  pthread_mutex_unlock(&tcp_coalesce_ops_mutex);
+
+  /* Only one kind of vc transport is expected */
+  if(!same_ops)
+    return;
+
+  q = gsh_malloc(sizeof(tcp_reply_queue_t));
+  if(q == NULL)
+    {
+      LogMajor(COMPONENT_DISPATCH,
+               "Could not allocate reply queue for socket %d",
+               xprt->xp_fd);
+      return;
+    }
+
+  q->pending.next = NULL;
+  q->pending.prev = NULL;
+  q->xprt = xprt;
+  q->active = 0;
+  q->dead = FALSE;
+  q->count = 0;
+  q->len = 0;
+
+  xu->reply_queue = q;
+  xprt->xp_ops = &tcp_coalesce_ops;
+}
+
+/**
+ *
+ * nfs_rpc_tcp_coalesce_release: frees the reply queue of a transport
+ * being destroyed.
+ *
+ * Queued replies, if any, are lost with the connection.
+ *
+ */
+void nfs_rpc_tcp_coalesce_release(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+  tcp_reply_queue_t *q = xu->reply_queue;
+
+  if(q == NULL)
+    return;
+
+  pthread_mutex_lock(&tcp_coalesce_mutex);
+  if(q->pending.next != NULL)
+    glist_del(&q->pending);
+  pthread_mutex_unlock(&tcp_coalesce_mutex);
+
+  xu->reply_queue = NULL;
+  gsh_free(q);
+}
+
+/**
+ *
+ * nfs_rpc_tcp_coalesce_begin: called when a request of xprt is queued
+ * to a worker, be it the leader reading the connection or a request
+ * it hands over.
+ *
+ * Each call is matched by one to nfs_rpc_tcp_coalesce_done.
+ *
+ * @param xprt the transport, referenced by the request
+ *
+ */
+void nfs_rpc_tcp_coalesce_begin(SVCXPRT *xprt)
+{
+  tcp_reply_queue_t *q = tcp_coalesce_queue(xprt);
+
+  if(q != NULL)
+    (void) atomic_inc_uint32_t(&q->active);
+}
+
+/**
+ *
+ * nfs_rpc_tcp_coalesce_done: called when a request of xprt is finished.
+ *
+ * The queued replies are written if no other request of the
+ * transport is queued or in progress, or if they are overdue.
+ *
+ * @param xprt the transport, referenced by the finished request
+ * @param sigmask the signal mask of the calling worker
+ *
+ */
+void nfs_rpc_tcp_coalesce_done(SVCXPRT *xprt, sigset_t *sigmask)
+{
+  tcp_reply_queue_t *q = tcp_coalesce_queue(xprt);
+  struct timespec now;
+  bool_t busy;
+
+  if(q == NULL)
+    return;
+
+  busy = atomic_dec_uint32_t(&q->active) > 0;
+
+  /* A reply queued after this peek belongs to a request that will
+   * come here in turn */
+  if(q->count == 0)
+    return;
+
+  svc_dplx_lock_x(xprt, sigmask);
+  if(q->count > 0)
+    {
+      if(busy)
+        clock_gettime(CLOCK_REALTIME, &now);
+      if(!busy || tcp_coalesce_due(q, &now))
+        (void) tcp_coalesce_flush(q);
+    }
+  svc_dplx_unlock_x(xprt, sigmask);
+}
+
+/**
+ *
+ * tcp_coalesce_thread: writes the queued replies that are overdue.
+ *
+ * Replies normally leave with the last request of their connection;
+ * this thread bounds the wait of those queued behind a slow request.
+ *
+ */
+void *tcp_coalesce_thread(void *UnusedArg)
+{
+  SVCXPRT *due[TCP_COALESCE_PASS];
+  struct glist_head *node, *noden;
+  tcp_reply_queue_t *q;
+  gsh_xprt_private_t *xu;
+  struct timespec now, wake;
+  sigset_t sigmask;
+  int i, n;
+
+  SetNameFunction("tcp_coalesce");
+
+  pthread_sigmask(SIG_SETMASK, (sigset_t *) 0, &sigmask);
+
+  pthread_mutex_lock(&tcp_coalesce_mutex);
+  while(1)
+    {
+      if(glist_empty(&tcp_coalesce_pending))
+        {
+          pthread_cond_wait(&tcp_coalesce_cond, &tcp_coalesce_mutex);
+          continue;
+        }
+
+      clock_gettime(CLOCK_REALTIME, &now);
+      n = 0;
+
+      /* The list is in queueing order, so stop at the first queue
+       * that is not due yet and sleep until it is */
+      glist_for_each_safe(node, noden, &tcp_coalesce_pending)
+        {
+          q = glist_entry(node, tcp_reply_queue_t, pending);
+          if(!tcp_coalesce_due(q, &now) || n == TCP_COALESCE_PASS)
+            break;
+
+          /* Skip transports whose last reference is being dropped */
+          xu = (gsh_xprt_private_t *) q->xprt->xp_u1;
+          pthread_rwlock_wrlock(&q->xprt->lock);
+          if(xu->refcnt > 0)
+            {
+              ++(xu->refcnt);
+              due[n++] = q->xprt;
+            }
+          pthread_rwlock_unlock(&q->xprt->lock);
+
+          glist_del(&q->pending);
+        }
+
+      if(n == 0)
+        {
+          q = glist_first_entry(&tcp_coalesce_pending, tcp_reply_queue_t,
+                                pending);
+          tcp_coalesce_deadline(q, &wake);
+          (void) pthread_cond_timedwait(&tcp_coalesce_cond,
+                                        &tcp_coalesce_mutex, &wake);
+          continue;
+        }
+
+      pthread_mutex_unlock(&tcp_coalesce_mutex);
+
+      for(i = 0; i < n; i++)
+        {
+          q = tcp_coalesce_queue(due[i]);
+
+          svc_dplx_lock_x(due[i], &sigmask);
+          if(q != NULL && q->count > 0)
+            (void) tcp_coalesce_flush(q);
+          svc_dplx_unlock_x(due[i], &sigmask);
+
+          gsh_xprt_unref(due[i], XPRT_PRIVATE_FLAG_NONE);
+        }
+
+      pthread_mutex_lock(&tcp_coalesce_mutex);
+    }
+
+  return NULL;
+}
@@ -0,0 +1,653 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs_rpc_udp_batch.c
+ * \brief   Batched receive and transmit on the UDP transports.
+ *
+ * The SVCXPRT created by svc_dg_create() holds a single receive and
+ * a single send buffer, so it reads and answers one datagram at a
+ * time and every request on it is serialized on that transport.
+ *
+ * Here the worker woken for a UDP transport empties the socket with
+ * recvmmsg() and wraps each datagram in a clone transport that owns
+ * the datagram, its source address and its reply.  A clone is
+ * dispatched like any other transport; its ops decode from the
+ * datagram in memory and encode the reply into the clone, which is
+ * then queued on the worker until the queue is sent with sendmmsg():
+ * when it is full, when its oldest reply has waited UDP_Batch_Delay,
+ * or when the worker has nothing else to do.
+ *
+ * A clone carries one request: it is marked destroyed once that
+ * request has been processed, and is freed when the last reference,
+ * the request's or the reply queue's, is dropped.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "log.h"
+#include "ganesha_rpc.h"
+#include "nfs_core.h"
+#include "nfs_rpc_udp_batch.h"
+
+#ifndef SVCAUTH_DESTROY
+#define SVCAUTH_DESTROY(auth) \
+     ((*((auth)->svc_ah_ops->svc_ah_destroy))(auth))
+#endif
+
+extern SVCAUTH Svc_auth_none;
+extern SVCXPRT *udp_xprt[P_COUNT];
+
+/* Number of batches read in a row before the socket is handed back to
+ * the event channel, so one busy socket cannot hold a worker forever */
+#define UDP_BATCH_RECV_ROUNDS 4
+
+typedef struct udp_batch_slot
+{
+  SVCXPRT xprt;
+  struct sockaddr_storage addr;
+  XDR xdrs;                     /* decodes from data */
+  char *reply;                  /* encoded reply, NULL if none yet */
+  u_int reply_len;
+  u_int len;
+  char data[];
+} udp_batch_slot_t;
+
+/* Per worker receive buffers, allocated on first use */
+typedef struct udp_batch_rx
+{
+  unsigned int size;
+  size_t bufsize;
+  struct mmsghdr *msgs;
+  struct iovec *iov;
+  struct sockaddr_storage *addrs;
+  char *bufs;
+} udp_batch_rx_t;
+
+/* Per worker queue of replies waiting for sendmmsg() */
+typedef struct udp_batch_tx
+{
+  unsigned int size;
+  unsigned int count;
+  struct timespec first;        /* when the oldest reply was queued */
+  udp_batch_slot_t **slots;
+  struct mmsghdr *msgs;
+  struct iovec *iov;
+} udp_batch_tx_t;
+
+static __thread udp_batch_rx_t *udp_batch_rx = NULL;
+static __thread udp_batch_tx_t *udp_batch_tx = NULL;
+
+static unsigned int udp_batch_size(void)
+{
+  unsigned int size = nfs_param.core_param.udp_batch_size;
+
+  if(size > UDP_BATCH_SIZE_MAX)
+    size = UDP_BATCH_SIZE_MAX;
+
+  return size;
+}
+
+/* Has the oldest reply of tx waited UDP_Batch_Delay? */
+static bool_t udp_batch_due(udp_batch_tx_t *tx)
+{
+  struct timespec now;
+  long usec;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  usec = (now.tv_sec - tx->first.tv_sec) * 1000000L +
+         (now.tv_nsec - tx->first.tv_nsec) / 1000;
+
+  return usec >= (long)nfs_param.core_param.udp_batch_delay;
+}
+
+/*
+ * Sends one reply right away, for threads without a reply queue.
+ */
+static bool_t udp_batch_send_one(udp_batch_slot_t *slot)
+{
+  ssize_t rc;
+
+  do
+    rc = sendto(slot->xprt.xp_fd, slot->reply, slot->reply_len, 0,
+                (struct sockaddr *)&slot->addr, slot->xprt.xp_rtaddr.len);
+  while(rc < 0 && errno == EINTR);
+
+  if(rc < 0)
+    {
+      LogInfo(COMPONENT_DISPATCH,
+              "sendto on socket %d failed: %s",
+              slot->xprt.xp_fd, strerror(errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * Clone transport ops
+ */
+
+static bool_t udp_batch_recv(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  udp_batch_slot_t *slot = xprt->xp_p1;
+
+  xdrmem_create(&slot->xdrs, slot->data, slot->len, XDR_DECODE);
+
+  return xdr_callmsg(&slot->xdrs, msg);
+}
+
+static enum xprt_stat udp_batch_stat(SVCXPRT *xprt)
+{
+  return XPRT_IDLE;
+}
+
+static bool_t udp_batch_getargs(SVCXPRT *xprt, xdrproc_t xdr_args,
+                                void *args_ptr)
+{
+  udp_batch_slot_t *slot = xprt->xp_p1;
+
+  return SVCAUTH_UNWRAP(xprt->xp_auth, &slot->xdrs, xdr_args, args_ptr);
+}
+
+static bool_t udp_batch_freeargs(SVCXPRT *xprt, xdrproc_t xdr_args,
+                                 void *args_ptr)
+{
+  udp_batch_slot_t *slot = xprt->xp_p1;
+
+  slot->xdrs.x_op = XDR_FREE;
+  return (*xdr_args) (&slot->xdrs, args_ptr);
+}
+
+/*
+ * Encodes the reply as svc_dg_reply() does, but into a buffer of the
+ * clone, and queues the clone on this thread's reply queue.
+ */
+static bool_t udp_batch_reply(SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  udp_batch_slot_t *slot = xprt->xp_p1;
+  udp_batch_tx_t *tx = udp_batch_tx;
+  u_int size = nfs_param.core_param.max_send_buffer_size;
+  xdrproc_t xdr_proc;
+  caddr_t xdr_where;
+  XDR xdrs;
+  bool_t ok;
+
+  /* One reply per call; a retransmitted reply replaces the first */
+  if(slot->reply == NULL)
+    {
+      slot->reply = gsh_malloc(size);
+      if(slot->reply == NULL)
+        return FALSE;
+    }
+
+  xdrmem_create(&xdrs, slot->reply, size, XDR_ENCODE);
+
+  if(msg->rm_reply.rp_stat == MSG_ACCEPTED &&
+     msg->rm_reply.rp_acpt.ar_stat == SUCCESS)
+    {
+      xdr_proc = msg->acpted_rply.ar_results.proc;
+      xdr_where = msg->acpted_rply.ar_results.where;
+      msg->acpted_rply.ar_results.proc = (xdrproc_t) xdr_void;
+      msg->acpted_rply.ar_results.where = NULL;
+
+      ok = xdr_replymsg(&xdrs, msg) &&
+           SVCAUTH_WRAP(xprt->xp_auth, &xdrs, xdr_proc, xdr_where);
+    }
+  else
+    ok = xdr_replymsg(&xdrs, msg);
+
+  slot->reply_len = XDR_GETPOS(&xdrs);
+  XDR_DESTROY(&xdrs);
+
+  if(!ok)
+    {
+      LogDebug(COMPONENT_DISPATCH,
+               "Could not encode reply xid=%u", msg->rm_xid);
+      return FALSE;
+    }
+
+  if(tx == NULL)
+    return udp_batch_send_one(slot);
+
+  /* The queue holds a reference until the reply is sent */
+  gsh_xprt_ref(xprt, XPRT_PRIVATE_FLAG_NONE);
+  if(tx->count == 0)
+    clock_gettime(CLOCK_MONOTONIC, &tx->first);
+  tx->slots[tx->count++] = slot;
+
+  if(tx->count == tx->size || udp_batch_due(tx))
+    nfs_rpc_udp_batch_flush();
+
+  return TRUE;
+}
+
+static void udp_batch_destroy(SVCXPRT *xprt)
+{
+  udp_batch_slot_t *slot = xprt->xp_p1;
+
+  if(xprt->xp_auth != NULL && xprt->xp_auth != &Svc_auth_none)
+    SVCAUTH_DESTROY(xprt->xp_auth);
+
+  if(xprt->xp_u1)
+    free_gsh_xprt_private(xprt->xp_u1);
+
+  pthread_rwlock_destroy(&xprt->lock);
+
+  if(slot->reply != NULL)
+    gsh_free(slot->reply);
+  gsh_free(slot);
+}
+
+static bool_t udp_batch_control(SVCXPRT *xprt, const u_int rq, void *in)
+{
+  return FALSE;
+}
+
+static struct xp_ops udp_batch_ops = {
+  .xp_recv = udp_batch_recv,
+  .xp_stat = udp_batch_stat,
+  .xp_getargs = udp_batch_getargs,
+  .xp_reply = udp_batch_reply,
+  .xp_freeargs = udp_batch_freeargs,
+  .xp_destroy = udp_batch_destroy
+};
+
+static struct xp_ops2 udp_batch_ops2 = {
+  .xp_control = udp_batch_control
+};
+
+/*
+ * Wraps one datagram read on parent in a clone transport.
+ */
+static SVCXPRT *udp_batch_clone_create(SVCXPRT *parent,
+                                       struct sockaddr_storage *addr,
+                                       socklen_t addrlen,
+                                       char *buf, size_t len)
+{
+  udp_batch_slot_t *slot = gsh_malloc(sizeof(udp_batch_slot_t) + len);
+  SVCXPRT *xprt;
+
+  if(slot == NULL)
+    return NULL;
+
+  memset(slot, 0, sizeof(udp_batch_slot_t));
+  memcpy(&slot->addr, addr, addrlen);
+  memcpy(slot->data, buf, len);
+  slot->len = len;
+
+  xprt = &slot->xprt;
+  xprt->xp_fd = parent->xp_fd;
+  xprt->xp_port = parent->xp_port;
+  xprt->xp_ops = &udp_batch_ops;
+  xprt->xp_ops2 = &udp_batch_ops2;
+  xprt->xp_netid = parent->xp_netid;
+  xprt->xp_tp = parent->xp_tp;
+  xprt->xp_rtaddr.buf = &slot->addr;
+  xprt->xp_rtaddr.len = addrlen;
+  xprt->xp_rtaddr.maxlen = sizeof(slot->addr);
+  xprt->xp_auth = &Svc_auth_none;
+
+  /* The duplicate request cache tells UDP from TCP by xp_p2 */
+  xprt->xp_p1 = slot;
+  xprt->xp_p2 = slot;
+
+  xprt->xp_u1 = alloc_gsh_xprt_private(XPRT_PRIVATE_FLAG_NONE);
+  pthread_rwlock_init(&xprt->lock, NULL);
+
+  return xprt;
+}
+
+static udp_batch_rx_t *udp_batch_rx_get(void)
+{
+  udp_batch_rx_t *rx = udp_batch_rx;
+  unsigned int i;
+
+  if(rx != NULL)
+    return rx;
+
+  rx = gsh_calloc(1, sizeof(udp_batch_rx_t));
+  if(rx == NULL)
+    return NULL;
+
+  rx->size = udp_batch_size();
+  rx->bufsize = nfs_param.core_param.max_recv_buffer_size;
+  rx->msgs = gsh_calloc(rx->size, sizeof(struct mmsghdr));
+  rx->iov = gsh_calloc(rx->size, sizeof(struct iovec));
+  rx->addrs = gsh_calloc(rx->size, sizeof(struct sockaddr_storage));
+  rx->bufs = gsh_malloc(rx->size * rx->bufsize);
+
+  if(rx->msgs == NULL || rx->iov == NULL || rx->addrs == NULL ||
+     rx->bufs == NULL)
+    {
+      gsh_free(rx->msgs);
+      gsh_free(rx->iov);
+      gsh_free(rx->addrs);
+      gsh_free(rx->bufs);
+      gsh_free(rx);
+      return NULL;
+    }
+
+  for(i = 0; i < rx->size; i++)
+    {
+      rx->iov[i].iov_base = rx->bufs + i * rx->bufsize;
+      rx->iov[i].iov_len = rx->bufsize;
+      rx->msgs[i].msg_hdr.msg_name = &rx->addrs[i];
+      rx->msgs[i].msg_hdr.msg_iov = &rx->iov[i];
+      rx->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+  udp_batch_rx = rx;
+  return rx;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_thread_init: sets up the reply queue of a worker.
+ *
+ * Does nothing unless UDP batching is enabled.
+ *
+ */
+void nfs_rpc_udp_batch_thread_init(void)
+{
+  udp_batch_tx_t *tx;
+  unsigned int i;
+
+  if(udp_batch_size() <= 1 || udp_batch_tx != NULL)
+    return;
+
+  tx = gsh_calloc(1, sizeof(udp_batch_tx_t));
+  if(tx == NULL)
+    return;
+
+  tx->size = udp_batch_size();
+  tx->slots = gsh_calloc(tx->size, sizeof(udp_batch_slot_t *));
+  tx->msgs = gsh_calloc(tx->size, sizeof(struct mmsghdr));
+  tx->iov = gsh_calloc(tx->size, sizeof(struct iovec));
+
+  if(tx->slots == NULL || tx->msgs == NULL || tx->iov == NULL)
+    {
+      LogMajor(COMPONENT_DISPATCH,
+               "Could not allocate UDP reply queue, replies are sent one by one");
+      gsh_free(tx->slots);
+      gsh_free(tx->msgs);
+      gsh_free(tx->iov);
+      gsh_free(tx);
+      return;
+    }
+
+  for(i = 0; i < tx->size; i++)
+    {
+      tx->msgs[i].msg_hdr.msg_iov = &tx->iov[i];
+      tx->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+  udp_batch_tx = tx;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_thread_shutdown: sends what is queued and frees the
+ * buffers of the calling thread.
+ *
+ */
+void nfs_rpc_udp_batch_thread_shutdown(void)
+{
+  udp_batch_rx_t *rx = udp_batch_rx;
+  udp_batch_tx_t *tx = udp_batch_tx;
+
+  if(tx != NULL)
+    {
+      nfs_rpc_udp_batch_flush();
+      udp_batch_tx = NULL;
+      gsh_free(tx->slots);
+      gsh_free(tx->msgs);
+      gsh_free(tx->iov);
+      gsh_free(tx);
+    }
+
+  if(rx != NULL)
+    {
+      udp_batch_rx = NULL;
+      gsh_free(rx->msgs);
+      gsh_free(rx->iov);
+      gsh_free(rx->addrs);
+      gsh_free(rx->bufs);
+      gsh_free(rx);
+    }
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_parent: is xprt a UDP transport read in batches?
+ *
+ */
+bool_t nfs_rpc_udp_batch_parent(SVCXPRT *xprt)
+{
+  protos p;
+
+  if(udp_batch_size() <= 1)
+    return FALSE;
+
+  for(p = P_NFS; p < P_COUNT; p++)
+    if(udp_xprt[p] == xprt)
+      return TRUE;
+
+  return FALSE;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_clone: is xprt a clone carrying one datagram?
+ *
+ */
+bool_t nfs_rpc_udp_batch_clone(SVCXPRT *xprt)
+{
+  return xprt->xp_ops == &udp_batch_ops;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_recv: reads the datagrams waiting on a UDP transport.
+ *
+ * Up to UDP_Batch_Size datagrams are read per recvmmsg() call, and
+ * reading goes on while full batches are returned.  Each datagram is
+ * dispatched to the workers as a request on its own clone.
+ *
+ * @param xprt the UDP transport, its events must be blocked
+ *
+ * @return the number of datagrams dispatched.
+ *
+ */
+unsigned int nfs_rpc_udp_batch_recv(SVCXPRT *xprt)
+{
+  udp_batch_rx_t *rx = udp_batch_rx_get();
+  unsigned int i, round, total = 0;
+  SVCXPRT *clone;
+  int n;
+
+  if(rx == NULL)
+    {
+      LogMajor(COMPONENT_DISPATCH,
+               "Could not allocate UDP receive buffers");
+      return 0;
+    }
+
+  for(round = 0; round < UDP_BATCH_RECV_ROUNDS; round++)
+    {
+      for(i = 0; i < rx->size; i++)
+        rx->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+      n = recvmmsg(xprt->xp_fd, rx->msgs, rx->size, MSG_DONTWAIT, NULL);
+      if(n < 0)
+        {
+          if(errno == EINTR)
+            continue;
+          if(errno != EAGAIN && errno != EWOULDBLOCK)
+            LogMajor(COMPONENT_DISPATCH,
+                     "recvmmsg on socket %d failed: %s",
+                     xprt->xp_fd, strerror(errno));
+          break;
+        }
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "recvmmsg on socket %d returned %d datagrams",
+                   xprt->xp_fd, n);
+
+      for(i = 0; i < (unsigned int)n; i++)
+        {
+          if(rx->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+              LogInfo(COMPONENT_DISPATCH,
+                      "Dropping datagram larger than %zu bytes on socket %d",
+                      rx->bufsize, xprt->xp_fd);
+              continue;
+            }
+
+          clone = udp_batch_clone_create(xprt, &rx->addrs[i],
+                                         rx->msgs[i].msg_hdr.msg_namelen,
+                                         rx->iov[i].iov_base,
+                                         rx->msgs[i].msg_len);
+          if(clone == NULL)
+            {
+              LogMajor(COMPONENT_DISPATCH,
+                       "Could not allocate UDP request, datagram dropped");
+              continue;
+            }
+
+          (void) dispatch_rpc_request(clone);
+          total++;
+        }
+
+      if((unsigned int)n < rx->size)
+        break;
+    }
+
+  return total;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_done: releases a clone once its request is processed.
+ *
+ * The clone is freed when the request and the reply queue have both
+ * dropped their references.
+ *
+ */
+void nfs_rpc_udp_batch_done(SVCXPRT *xprt)
+{
+  gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+  pthread_rwlock_wrlock(&xprt->lock);
+  xu->flags |= XPRT_PRIVATE_FLAG_DESTROYED;
+  pthread_rwlock_unlock(&xprt->lock);
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_flush: sends the replies queued by the calling thread.
+ *
+ * sendmmsg() works on one socket, so each run of replies for the same
+ * socket goes in one call.  A reply that cannot be sent is dropped,
+ * as svc_dg_reply() would do; the client will retransmit.
+ *
+ */
+void nfs_rpc_udp_batch_flush(void)
+{
+  udp_batch_tx_t *tx = udp_batch_tx;
+  unsigned int i, start, end, sent;
+  int fd, n;
+
+  if(tx == NULL || tx->count == 0)
+    return;
+
+  for(i = 0; i < tx->count; i++)
+    {
+      udp_batch_slot_t *slot = tx->slots[i];
+
+      tx->iov[i].iov_base = slot->reply;
+      tx->iov[i].iov_len = slot->reply_len;
+      tx->msgs[i].msg_hdr.msg_name = &slot->addr;
+      tx->msgs[i].msg_hdr.msg_namelen = slot->xprt.xp_rtaddr.len;
+    }
+
+  for(start = 0; start < tx->count; start = end)
+    {
+      fd = tx->slots[start]->xprt.xp_fd;
+      for(end = start + 1;
+          end < tx->count && tx->slots[end]->xprt.xp_fd == fd;
+          end++) ;
+
+      sent = start;
+      while(sent < end)
+        {
+          n = sendmmsg(fd, &tx->msgs[sent], end - sent, 0);
+          if(n < 0)
+            {
+              if(errno == EINTR)
+                continue;
+              LogInfo(COMPONENT_DISPATCH,
+                      "sendmmsg on socket %d failed, %u replies dropped: %s",
+                      fd, end - sent, strerror(errno));
+              break;
+            }
+          sent += n;
+        }
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Sent %u replies on socket %d", sent - start, fd);
+    }
+
+  for(i = 0; i < tx->count; i++)
+    gsh_xprt_unref(&tx->slots[i]->xprt, XPRT_PRIVATE_FLAG_NONE);
+
+  tx->count = 0;
+}
+
+/**
+ *
+ * nfs_rpc_udp_batch_flush_due: sends the replies queued by the calling
+ * thread if the oldest one has waited UDP_Batch_Delay.
+ *
+ * Called between requests, so that replies are not held back while
+ * the worker goes on with requests that do not reply over UDP.
+ *
+ */
+void nfs_rpc_udp_batch_flush_due(void)
+{
+  udp_batch_tx_t *tx = udp_batch_tx;
+
+  if(tx != NULL && tx->count != 0 && udp_batch_due(tx))
+    nfs_rpc_udp_batch_flush();
+}
@@ -50,6 +50,11 @@
 #include "nfs_core.h"
 #include "nfs_stat.h"
 #include "nfs_exports.h"
+#include "nfs_cred_cache.h"
+#include "nfs_rpc_admission.h"
+#include "cache_inode_prefetch.h"
+#include "cache_inode_path.h"
+#include "sal_functions.h"
 #include "log.h"
 
 extern hash_table_t *ht_ip_stats[NB_MAX_WORKER_THREAD];
@@ -403,6 +408,14 @@ void *stats_thread(void *UnusedArg)
   hash_stat_t            *hstat_drc_udp = &ganesha_stats.drc_udp;
   hash_stat_t            *hstat_drc_tcp = &ganesha_stats.drc_tcp;
   fsal_statistics_t      *global_fsal_stat = &ganesha_stats.global_fsal;
+  nfs_cred_cache_stats_t cred_stats;
+  nfs_rpc_admission_stats_t admission_stats;
+  state_deleg_stats_t    deleg_stats;
+  cache_inode_prefetch_stats_t prefetch_stats;
+  cache_inode_path_stats_t path_stats;
+#ifdef _HAVE_GSSAPI
+  gss_ctx_cache_stats_t  gss_ctx_stats;
+#endif
 
 
   SetNameFunction("stat_thr");
@@ -635,6 +648,67 @@ void *stats_thread(void *UnusedArg)
               hstat_drc_udp->average_rbt_num_node +
               hstat_drc_tcp->average_rbt_num_node);
 
+#ifdef _HAVE_GSSAPI
+      Gss_ctx_cache_get_stats(&gss_ctx_stats);
+      fprintf(stats_file,
+              "GSS_CTX_CACHE,%s;%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)gss_ctx_stats.entries,
+              (unsigned long long)gss_ctx_stats.hits,
+              (unsigned long long)gss_ctx_stats.misses,
+              (unsigned long long)gss_ctx_stats.reclaimed);
+#endif
+
+      nfs_cred_cache_get_stats(&cred_stats);
+      fprintf(stats_file,
+              "CRED_CACHE,%s;%llu,%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)cred_stats.entries,
+              (unsigned long long)cred_stats.hits,
+              (unsigned long long)cred_stats.misses,
+              (unsigned long long)cred_stats.expired,
+              (unsigned long long)cred_stats.evicted);
+
+      nfs_rpc_admission_get_stats(&admission_stats);
+      fprintf(stats_file,
+              "ADMISSION,%s;%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)admission_stats.inflight,
+              (unsigned long long)admission_stats.parked,
+              (unsigned long long)admission_stats.throttled_xprt,
+              (unsigned long long)admission_stats.throttled_global);
+
+      state_deleg_get_stats(&deleg_stats);
+      fprintf(stats_file,
+              "DELEGATIONS,%s;%llu,%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)deleg_stats.outstanding,
+              (unsigned long long)deleg_stats.granted,
+              (unsigned long long)deleg_stats.recalled,
+              (unsigned long long)deleg_stats.returned,
+              (unsigned long long)deleg_stats.revoked);
+
+      cache_inode_path_get_stats(&path_stats);
+      fprintf(stats_file,
+              "PATH_CACHE,%s;%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)path_stats.hits,
+              (unsigned long long)path_stats.misses,
+              (unsigned long long)path_stats.stale,
+              (unsigned long long)path_stats.inserts);
+
+      cache_inode_prefetch_get_stats(&prefetch_stats);
+      fprintf(stats_file,
+              "READDIR_PREFETCH,%s;%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+              strdate,
+              (unsigned long long)prefetch_stats.queued,
+              (unsigned long long)prefetch_stats.dropped,
+              (unsigned long long)prefetch_stats.skipped,
+              (unsigned long long)prefetch_stats.failed,
+              (unsigned long long)prefetch_stats.populated,
+              (unsigned long long)prefetch_stats.useful,
+              (unsigned long long)prefetch_stats.wasted);
+
       fprintf(stats_file,
               "UIDMAP_HASH,%s;%zu,%zu,%zu,%zu\n", strdate,
               uid_map_hstat->entries, uid_map_hstat->min_rbt_num_node,
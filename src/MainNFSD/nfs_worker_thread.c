@@ -57,6 +57,7 @@
 #include "log.h"
 #include "ganesha_rpc.h"
 #include "nfs23.h"
+#include "xdr_fast.h"
 #include "nfs4.h"
 #include "mount.h"
 #include "nlm4.h"
@@ -70,6 +71,9 @@
 #include "nfs_file_handle.h"
 #include "nfs_stat.h"
 #include "nfs_tcb.h"
+#include "nfs_rpc_udp_batch.h"
+#include "nfs_rpc_tcp_coalesce.h"
+#include "nfs_rpc_admission.h"
 #include "SemN.h"
 
 extern nfs_worker_data_t *workers_data;
@@ -152,25 +156,25 @@ const nfs_function_desc_t nfs3_func_desc[] = {
    (xdrproc_t) xdr_void,
    "nfs_Null",
    NOTHING_SPECIAL},
-  {nfs_Getattr, nfs_Getattr_Free, (xdrproc_t) xdr_GETATTR3args,
-   (xdrproc_t) xdr_GETATTR3res, "nfs_Getattr", NEEDS_CRED | SUPPORTS_GSS},
+  {nfs_Getattr, nfs_Getattr_Free, (xdrproc_t) xdr_GETATTR3args_fast,
+   (xdrproc_t) xdr_GETATTR3res_fast, "nfs_Getattr", NEEDS_CRED | SUPPORTS_GSS},
   {nfs_Setattr, nfs_Setattr_Free, (xdrproc_t) xdr_SETATTR3args,
    (xdrproc_t) xdr_SETATTR3res, "nfs_Setattr",
    MAKES_WRITE | NEEDS_CRED | CAN_BE_DUP | SUPPORTS_GSS},
-  {nfs_Lookup, nfs3_Lookup_Free, (xdrproc_t) xdr_LOOKUP3args,
-   (xdrproc_t) xdr_LOOKUP3res, "nfs_Lookup",
+  {nfs_Lookup, nfs3_Lookup_Free, (xdrproc_t) xdr_LOOKUP3args_fast,
+   (xdrproc_t) xdr_LOOKUP3res_fast, "nfs_Lookup",
    NEEDS_CRED | SUPPORTS_GSS},
-  {nfs3_Access, nfs3_Access_Free, (xdrproc_t) xdr_ACCESS3args,
-   (xdrproc_t) xdr_ACCESS3res, "nfs3_Access",
+  {nfs3_Access, nfs3_Access_Free, (xdrproc_t) xdr_ACCESS3args_fast,
+   (xdrproc_t) xdr_ACCESS3res_fast, "nfs3_Access",
    NEEDS_CRED | SUPPORTS_GSS},
   {nfs_Readlink, nfs3_Readlink_Free, (xdrproc_t) xdr_READLINK3args,
    (xdrproc_t) xdr_READLINK3res, "nfs_Readlink",
    NEEDS_CRED | SUPPORTS_GSS},
-  {nfs_Read, nfs3_Read_Free, (xdrproc_t) xdr_READ3args,
-   (xdrproc_t) xdr_READ3res, "nfs_Read",
+  {nfs_Read, nfs3_Read_Free, (xdrproc_t) xdr_READ3args_fast,
+   (xdrproc_t) xdr_READ3res_fast, "nfs_Read",
    NEEDS_CRED | SUPPORTS_GSS},
-  {nfs_Write, nfs_Write_Free, (xdrproc_t) xdr_WRITE3args,
-   (xdrproc_t) xdr_WRITE3res, "nfs_Write",
+  {nfs_Write, nfs_Write_Free, (xdrproc_t) xdr_WRITE3args_fast,
+   (xdrproc_t) xdr_WRITE3res_fast, "nfs_Write",
    MAKES_WRITE | NEEDS_CRED | CAN_BE_DUP | SUPPORTS_GSS},
   {nfs_Create, nfs_Create_Free, (xdrproc_t) xdr_CREATE3args,
    (xdrproc_t) xdr_CREATE3res, "nfs_Create",
@@ -223,7 +227,7 @@ const nfs_function_desc_t nfs4_func_desc[] = {
    (xdrproc_t) xdr_void, "nfs_Null",
    NOTHING_SPECIAL},
   {nfs4_Compound, nfs4_Compound_Free, (xdrproc_t) xdr_COMPOUND4args,
-   (xdrproc_t) xdr_COMPOUND4res, "nfs4_Compound", NEEDS_CRED}
+   (xdrproc_t) xdr_COMPOUND4res_extended, "nfs4_Compound", NEEDS_CRED}
 };
 
 const nfs_function_desc_t mnt1_func_desc[] = {
@@ -743,6 +747,9 @@ int nfs_rpc_get_args(nfs_request_data_t *preqnfs, const nfs_function_desc_t *pfu
       return FALSE;
     }
 
+  if(pfuncdesc->dispatch_behaviour & CAN_BE_DUP)
+    nfs_dupreq_checksum(preqnfs, pfuncdesc->xdr_decode_func);
+
   return TRUE;
 }
 
@@ -763,7 +770,7 @@ static void nfs_rpc_execute(request_data_t *preq,
   nfs_arg_t *parg_nfs = &preqnfs->arg_nfs;
   nfs_res_t res_nfs;
   short exportid;
-  LRU_list_t *lru_dupreq = NULL;
+  dupreq_reply_t dupreq_reply;
   struct svc_req *req = &preqnfs->req;
   SVCXPRT *xprt = preqnfs->xprt;
   nfs_stat_type_t stat_type;
@@ -785,9 +792,6 @@ static void nfs_rpc_execute(request_data_t *preq,
 
   memset(&related_client, 0, sizeof(exportlist_client_entry_t));
 
-  /* Get the value from the worker data */
-  lru_dupreq = pworker_data->duplicate_request;
-
   /* initializing RPC structure */
   memset(&res_nfs, 0, sizeof(res_nfs));
 
@@ -830,7 +834,14 @@ static void nfs_rpc_execute(request_data_t *preq,
 
   do_dupreq_cache = pworker_data->pfuncdesc->dispatch_behaviour & CAN_BE_DUP;
   LogFullDebug(COMPONENT_DISPATCH, "do_dupreq_cache = %d", do_dupreq_cache);
-  dpq_status = nfs_dupreq_add_not_finished(req, &res_nfs);
+
+  /* Idempotent requests are simply executed again when retransmitted,
+   * they never go through the duplicate request cache. */
+  if(do_dupreq_cache)
+    dpq_status = nfs_dupreq_add_not_finished(preqnfs, &dupreq_reply);
+  else
+    dpq_status = DUPREQ_SUCCESS;
+
   switch(dpq_status)
     {
       /* a new request, continue processing it */
@@ -840,46 +851,33 @@ static void nfs_rpc_execute(request_data_t *preq,
       /* Found the reuqest in the dupreq cache. It's an old request so resend
        * old reply. */
     case DUPREQ_ALREADY_EXISTS:
-      if(do_dupreq_cache)
-        {
-          /* Request was known, use the previous reply */
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "NFS DISPATCHER: DupReq Cache Hit: using previous "
-                       "reply, rpcxid=%u",
-                       req->rq_xid);
-
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "Before svc_sendreply on socket %d (dup req)",
-                       xprt->xp_fd);
+      /* Request was known, send the previous reply as it was encoded */
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "NFS DISPATCHER: DupReq Cache Hit: using previous "
+                   "reply, rpcxid=%u",
+                   req->rq_xid);
 
-          svc_dplx_lock_x(xprt, &pworker_data->sigmask);
-          if(svc_sendreply2
-             (xprt, req, pworker_data->pfuncdesc->xdr_encode_func,
-              (caddr_t) &res_nfs) == FALSE)
-            {
-              LogDebug(COMPONENT_DISPATCH,
-                       "NFS DISPATCHER: FAILURE: Error while calling "
-                       "svc_sendreply");
-              svcerr_systemerr2(xprt, req);
-            }
-          svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Before svc_sendreply on socket %d (dup req)",
+                   xprt->xp_fd);
 
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "After svc_sendreply on socket %d (dup req)",
-                       xprt->xp_fd);
-          return;
-        }
-      else
+      svc_dplx_lock_x(xprt, &pworker_data->sigmask);
+      if(svc_sendreply2
+         (xprt, req, (xdrproc_t) xdr_dupreq_reply,
+          (caddr_t) &dupreq_reply) == FALSE)
         {
-          LogCrit(COMPONENT_DISPATCH,
-                  "Error: Duplicate request rejected because it was found "
-                  "in the cache but is not allowed to be cached.");
-          svc_dplx_lock_x(xprt, &pworker_data->sigmask);
+          LogDebug(COMPONENT_DISPATCH,
+                   "NFS DISPATCHER: FAILURE: Error while calling "
+                   "svc_sendreply");
           svcerr_systemerr2(xprt, req);
-          svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
-          return;
         }
-      break;
+      svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
+      nfs_dupreq_free_reply(&dupreq_reply);
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "After svc_sendreply on socket %d (dup req)",
+                   xprt->xp_fd);
+      return;
 
       /* Another thread owns the request */
     case DUPREQ_BEING_PROCESSED:
@@ -977,7 +975,7 @@ static void nfs_rpc_execute(request_data_t *preq,
                   svc_dplx_lock_x(xprt, &pworker_data->sigmask);
                   svcerr_auth2(xprt, req, AUTH_FAILED);
                   svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
-                  if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+                  if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
                     {
                       LogCrit(COMPONENT_DISPATCH,
                               "Attempt to delete duplicate request failed on "
@@ -1029,7 +1027,7 @@ static void nfs_rpc_execute(request_data_t *preq,
                   svc_dplx_lock_x(xprt, &pworker_data->sigmask);
                   svcerr_auth2(xprt, req, AUTH_FAILED);
                   svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
-                  if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+                  if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
                     {
                       LogCrit(COMPONENT_DISPATCH,
                               "Attempt to delete duplicate request failed on "
@@ -1136,7 +1134,7 @@ static void nfs_rpc_execute(request_data_t *preq,
               svc_dplx_lock_x(xprt, &pworker_data->sigmask);
               svcerr_auth2(xprt, req, AUTH_FAILED);
               svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
-              if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+              if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
                 {
                   LogCrit(COMPONENT_DISPATCH,
                           "Attempt to delete duplicate request failed on line "
@@ -1167,7 +1165,7 @@ static void nfs_rpc_execute(request_data_t *preq,
           svc_dplx_lock_x(xprt, &pworker_data->sigmask);
           svcerr_auth2(xprt, req, AUTH_TOOWEAK);
           svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
-          if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+          if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on "
@@ -1204,7 +1202,7 @@ static void nfs_rpc_execute(request_data_t *preq,
           /* XXX */
           pworker_data->current_xid = 0;    /* No more xid managed */
 
-          if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+          if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on line %d",
@@ -1226,7 +1224,7 @@ static void nfs_rpc_execute(request_data_t *preq,
           /* XXX */
           pworker_data->current_xid = 0;    /* No more xid managed */
 
-          if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+          if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on line %d",
@@ -1274,7 +1272,7 @@ static void nfs_rpc_execute(request_data_t *preq,
       /* XXX */
       pworker_data->current_xid = 0;        /* No more xid managed */
 
-      if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+      if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
         {
           LogCrit(COMPONENT_DISPATCH,
                   "Attempt to delete duplicate request failed on line %d",
@@ -1323,11 +1321,11 @@ static void nfs_rpc_execute(request_data_t *preq,
       if(pworker_data->pfuncdesc->dispatch_behaviour & NEEDS_CRED)
         {
           /* Swap the anonymous uid/gid if the user should be anonymous */
-          if(nfs_check_anon(&related_client, pexport, &user_credentials) == FALSE
-             || nfs_build_fsal_context(req,
-                                       pexport,
-                                       &pworker_data->thread_fsal_context,
-                                       &user_credentials) == FALSE)
+          if(nfs_make_fsal_context(req,
+                                   &related_client,
+                                   pexport,
+                                   &pworker_data->thread_fsal_context,
+                                   &user_credentials) == FALSE)
             {
               LogInfo(COMPONENT_DISPATCH,
                       "authentication failed, rejecting client");
@@ -1337,7 +1335,7 @@ static void nfs_rpc_execute(request_data_t *preq,
               /* XXX */
               pworker_data->current_xid = 0;    /* No more xid managed */
 
-              if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+              if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
                 {
                   LogCrit(COMPONENT_DISPATCH,
                          "Attempt to delete duplicate request failed on line %d",
@@ -1473,8 +1471,7 @@ static void nfs_rpc_execute(request_data_t *preq,
       /* If the request is not normally cached, then the entry will be removed
        * later. We only remove a reply that is normally cached that has been
        * dropped. */
-      if(do_dupreq_cache)
-        if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+      if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
           {
             LogCrit(COMPONENT_DISPATCH,
                     "Attempt to delete duplicate request failed on line %d",
@@ -1497,7 +1494,7 @@ static void nfs_rpc_execute(request_data_t *preq,
                    "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply");
           svcerr_systemerr2(xprt, req);
 
-          if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
+          if (do_dupreq_cache && nfs_dupreq_delete(preqnfs) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on line %d",
@@ -1515,7 +1512,13 @@ static void nfs_rpc_execute(request_data_t *preq,
       LogFullDebug(COMPONENT_DUPREQ, "YES?: %d", do_dupreq_cache);
       if(do_dupreq_cache)
         {
-          dpq_status = nfs_dupreq_finish(req, &res_nfs, lru_dupreq);
+          dpq_status = nfs_dupreq_finish(preqnfs, &res_nfs,
+                                         pworker_data->pfuncdesc->xdr_encode_func);
+          if(dpq_status != DUPREQ_SUCCESS)
+            LogDebug(COMPONENT_DUPREQ,
+                     "Reply to xid=%u not kept in the duplicate request "
+                     "cache (status %d)",
+                     req->rq_xid, dpq_status);
         }
     } /* rc == NFS_REQ_DROP */
 
@@ -1535,24 +1538,13 @@ static void nfs_rpc_execute(request_data_t *preq,
   /* XXX we must hold xprt lock across SVC_FREEARGS */
   svc_dplx_unlock_x(xprt, &pworker_data->sigmask);
     
-  /* Free the reply.
-   * This should not be done if the request is dupreq cached because this will
-   * mark the dupreq cached info eligible for being reuse by other requests */
-  if(!do_dupreq_cache)
-    {
-      if (nfs_dupreq_delete(req) != DUPREQ_SUCCESS)
-        {
-          LogCrit(COMPONENT_DISPATCH,
-                  "Attempt to delete duplicate request failed on line %d",
-                  __LINE__);
-        }
-      /* Free only the non dropped requests */
-      if(rc == NFS_REQ_OK) {
-          pworker_data->pfuncdesc->free_function(&res_nfs);
-      }
-    }
+  /* Free the reply, only for the non dropped requests.  The duplicate
+   * request cache keeps its own encoded copy, so this is done whether the
+   * request was cached or not. */
+  if(rc == NFS_REQ_OK)
+    pworker_data->pfuncdesc->free_function(&res_nfs);
 
-  /* By now the dupreq cache entry should have been completed w/ a request
+  /* By now the dupreq cache entry should have been completed w/ a reply
    * that is reusable or the dupreq cache entry should have been removed. */
   return;
 }                               /* nfs_rpc_execute */
@@ -1572,7 +1564,6 @@ static void nfs_rpc_execute(request_data_t *preq,
 
 int nfs_Init_worker_data(nfs_worker_data_t * pdata)
 {
-  LRU_status_t status = LRU_LIST_SUCCESS;
   char name[256];
 
   if(pthread_mutex_init(&(pdata->request_pool_mutex), NULL) != 0)
@@ -1585,16 +1576,6 @@ int nfs_Init_worker_data(nfs_worker_data_t * pdata)
   init_glist(&pdata->pending_request);
   pdata->pending_request_len = 0;
 
-  sprintf(name, "Worker Thread #%u Duplicate Request", pdata->worker_index);
-  nfs_param.worker_param.lru_dupreq.lp_name = name;
-
-  if((pdata->duplicate_request =
-      LRU_Init(nfs_param.worker_param.lru_dupreq, &status)) == NULL)
-    {
-      LogError(COMPONENT_DISPATCH, ERR_LRU, ERR_LRU_LIST_INIT, status);
-      return -1;
-    }
-
   pdata->passcounter = 0;
   pdata->wcb.tcb_ready = FALSE;
   pdata->gc_in_progress = FALSE;
@@ -1740,8 +1721,10 @@ cond_multi_dispatch(nfs_worker_data_t *pmydata, request_data_t *nfsreq,
     SVCXPRT *xprt = nfsreq->r_u.nfs->xprt;
 
     stat = SVC_STAT(xprt);
-    svc_dplx_unlock_x(xprt, &pmydata->sigmask);
-    *locked = FALSE;
+    if (*locked) {
+        svc_dplx_unlock_x(xprt, &pmydata->sigmask);
+        *locked = FALSE;
+    }
 
     if (stat == XPRT_MOREREQS)
         try_multi = TRUE;
@@ -1765,6 +1748,7 @@ cond_multi_dispatch(nfs_worker_data_t *pmydata, request_data_t *nfsreq,
         /* we need an atomic total-outstanding counter, check against hiwat */
         if (xu->multi_cnt < nfs_param.core_param.dispatch_multi_xprt_max) {
             ++(xu->multi_cnt);
+            nfs_rpc_tcp_coalesce_begin(xprt);
             /* dispatch it */
             rc_multi = dispatch_rpc_subrequest(pmydata, nfsreq);
             dispatched = TRUE;
@@ -1775,6 +1759,7 @@ cond_multi_dispatch(nfs_worker_data_t *pmydata, request_data_t *nfsreq,
     if (! dispatched) {
         /* Execute it */
         nfs_rpc_execute(nfsreq, pmydata);
+        nfs_rpc_admission_end(xprt);
     }
 
     return (stat);
@@ -1786,7 +1771,7 @@ cond_multi_dispatch(nfs_worker_data_t *pmydata, request_data_t *nfsreq,
  */
 
 #define DISP_LOCK(x) do { \
-    if (! locked) { \
+    if (! locked && ! batched) { \
         svc_dplx_lock_x(xprt, &pmydata->sigmask); \
         locked = TRUE; \
       }\
@@ -1811,6 +1796,21 @@ nfs_worker_process_rpc_requests(nfs_worker_data_t *pmydata,
   process_status_t rc = PROCESS_DONE;
   SVCXPRT *xprt;
   bool locked = FALSE;
+  bool batched;
+  bool counted = FALSE;
+
+  /* A batched UDP transport is only read here; each datagram comes
+   * back to the workers as a request on a clone of its own */
+  if(nfs_rpc_udp_batch_parent(nfsreq->r_u.nfs->xprt))
+    {
+      (void) nfs_rpc_udp_batch_recv(nfsreq->r_u.nfs->xprt);
+      (void) svc_rqst_unblock_events(nfsreq->r_u.nfs->xprt,
+                                     SVC_RQST_FLAG_NONE);
+      return (PROCESS_DONE);
+    }
+
+  /* Clones carry exactly one call and no event registration */
+  batched = nfs_rpc_udp_batch_clone(nfsreq->r_u.nfs->xprt);
 again:
   /*
    * Receive from socket.
@@ -1892,6 +1892,9 @@ again:
     }
   else
     {
+      nfs_rpc_admission_begin(xprt);
+      counted = TRUE;
+
       nfsreq->r_u.nfs->req.rq_prog = pmsg->rm_call.cb_prog;
       nfsreq->r_u.nfs->req.rq_vers = pmsg->rm_call.cb_vers;
       nfsreq->r_u.nfs->req.rq_proc = pmsg->rm_call.cb_proc;
@@ -1915,8 +1918,12 @@ again:
       /* Validate the rpc request as being a valid program, version,
        * and proc. If not, report the error. Otherwise, execute the
        * funtion. */
-      if(is_rpc_call_valid(preq->rq_xprt, preq) == TRUE)
+      if(is_rpc_call_valid(preq->rq_xprt, preq) == TRUE) {
+          /* answered, or handed to another worker, which will
+           * count it as done */
+          counted = FALSE;
           stat = cond_multi_dispatch(pmydata, nfsreq, &locked);
+      }
 
       rc = PROCESS_DISPATCHED;
     }
@@ -1927,19 +1934,38 @@ unblock:
    * additional RPC records (TCP).  Also, we expect to move the SVC_RECV
    * into the worker thread, so this will asynchronous wrt to the shared
    * event loop */
+  if (counted) {
+      nfs_rpc_admission_end(xprt);
+      counted = FALSE;
+  }
+
+  if (batched) {
+      nfs_rpc_udp_batch_done(xprt);
+      return (rc);
+  }
+
   if (rc == PROCESS_DISPATCHED) {
-      if (stat == XPRT_MOREREQS)
-          goto again;
-      else {
+      bool_t more = (stat == XPRT_MOREREQS);
+
+      if (! more) {
           /* XXX dont bother re-arming epoll for xprt if there is data 
            * waiting */
           struct pollfd fd;
           fd.fd = xprt->xp_fd;
           fd.events = POLLIN;
-          if (poll(&fd, 1, 0 /* ms, ie, now */) > 0)
-              goto again;
+          more = (poll(&fd, 1, 0 /* ms, ie, now */) > 0);
       }
-  }
+
+      if (more) {
+          /* leave the events blocked if the connection is parked, it
+           * is dispatched again once requests complete */
+          DISP_UNLOCK(xprt);
+          if (! nfs_rpc_admit(xprt))
+              return (rc);
+          goto again;
+      }
+  } else
+      nfs_rpc_admission_kick();
 
   DISP_UNLOCK(xprt);
 
@@ -2015,6 +2041,8 @@ void *worker_thread(void *IndexArg)
                "Error initializing thread's credential");
     }
 
+  nfs_rpc_udp_batch_thread_init();
+
   LogInfo(COMPONENT_DISPATCH, "Worker successfully initialized");
 
   /* Worker's infinite loop */
@@ -2033,6 +2061,9 @@ void *worker_thread(void *IndexArg)
           pmydata->stats.last_stat_update = time(NULL);
         }
 
+      /* Do not hold UDP replies back behind a long run of requests */
+      nfs_rpc_udp_batch_flush_due();
+
       /* Wait on condition variable for work to be done */
       LogFullDebug(COMPONENT_DISPATCH,
                    "waiting for requests to process, pending=%d",
@@ -2043,6 +2074,9 @@ void *worker_thread(void *IndexArg)
        */
       if((pmydata->wcb.tcb_state != STATE_AWAKE) ||
           (pmydata->pending_request_len == 0)) {
+          /* Nothing else to do for now, send the queued UDP replies */
+          nfs_rpc_udp_batch_flush();
+
           while(1)
             {
               P(pmydata->wcb.tcb_mutex);
@@ -2069,6 +2103,8 @@ void *worker_thread(void *IndexArg)
                   case THREAD_SM_EXIT:
                     LogDebug(COMPONENT_DISPATCH, "Worker exiting as requested");
                     V(pmydata->wcb.tcb_mutex);
+                    nfs_rpc_udp_batch_thread_shutdown();
+                    nfs4_fattr_plan_thread_shutdown();
                     return NULL;
                 }
             }
@@ -2167,10 +2203,15 @@ void *worker_thread(void *IndexArg)
       /* Drop multi_cnt and xprt refcnt, if appropriate */
       switch(nfsreq->rtype) {
        case NFS_REQUEST_LEADER:
+           nfs_rpc_tcp_coalesce_done(nfsreq->r_u.nfs->xprt,
+                                     &pmydata->sigmask);
            gsh_xprt_unref(
                nfsreq->r_u.nfs->xprt, XPRT_PRIVATE_FLAG_NONE);
            break;
        case NFS_REQUEST:
+           nfs_rpc_tcp_coalesce_done(nfsreq->r_u.nfs->xprt,
+                                     &pmydata->sigmask);
+           nfs_rpc_admission_end(nfsreq->r_u.nfs->xprt);
            pthread_rwlock_wrlock(&nfsreq->r_u.nfs->xprt->lock);
            --(xu->multi_cnt);
            gsh_xprt_unref(
@@ -2192,39 +2233,7 @@ void *worker_thread(void *IndexArg)
       if(pmydata->passcounter > nfs_param.worker_param.nb_before_gc)
         {
           /* Garbage collection on dup req cache */
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "before dupreq invalidation nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
-          if((rc =
-              LRU_invalidate_by_function(pmydata->duplicate_request,
-                                         nfs_dupreq_gc_function,
-                                         NULL)) != LRU_LIST_SUCCESS)
-            {
-              LogCrit(COMPONENT_DISPATCH,
-                      "FAILURE: Impossible to invalidate entries for duplicate "
-                      "request cache (error %d)",
-                      rc);
-            }
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "after dupreq invalidation nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
-          if((rc =
-              LRU_gc_invalid(pmydata->duplicate_request, NULL)
-              != LRU_LIST_SUCCESS))
-            LogCrit(COMPONENT_DISPATCH,
-                    "FAILURE: Impossible to gc entries for duplicate request "
-                    "cache (error %d)",
-                    rc);
-          else
-            LogFullDebug(COMPONENT_DISPATCH,
-                         "gc entries for duplicate request cache OK");
-
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "after dupreq gc nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
+          nfs_dupreq_gc();
 
           /* Performing garbabbge collection */
           LogFullDebug(COMPONENT_DISPATCH,
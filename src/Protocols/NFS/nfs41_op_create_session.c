@@ -175,13 +175,13 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
          && (pfound->cid_create_session_slot.cache_used == TRUE))
         {
           data->use_drc = TRUE;
-          data->pcached_res = &pfound->cid_create_session_slot.cached_result;
+          data->pcached_slot = &pfound->cid_create_session_slot;
 
           res_CREATE_SESSION4.csr_status = NFS4_OK;
 
           dec_client_id_ref(pfound);
 
-          LogDebug(component, "CREATE_SESSION replay=%p special case", data->pcached_res);
+          LogDebug(component, "CREATE_SESSION replay=%p special case", data->pcached_slot);
 
           goto out;
         }
@@ -300,12 +300,31 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
   nfs41_session->fore_channel_attrs = arg_CREATE_SESSION4.csa_fore_chan_attrs;
   nfs41_session->back_channel_attrs = arg_CREATE_SESSION4.csa_back_chan_attrs;
 
+  /* Grant the slots asked for, up to Max_Session_Slots */
+  if(!nfs41_Session_Alloc_Slots(nfs41_session,
+                                arg_CREATE_SESSION4.csa_fore_chan_attrs.ca_maxrequests))
+    {
+      LogDebug(component,
+               "Could not allocate the slots of a session");
+
+      pool_free(nfs41_session_pool, nfs41_session);
+
+      dec_client_id_ref(pfound);
+
+      res_CREATE_SESSION4.csr_status = NFS4ERR_SERVERFAULT;
+
+      goto out;
+    }
+
   /* Take reference to clientid record */
   inc_client_id_ref(pfound);
 
   /* Set ca_maxrequests */
-  nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
-  nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
+  nfs41_session->fore_channel_attrs.ca_maxrequests = nfs41_session->nb_slots;
+
+  /* Replies larger than this are not kept in the slots */
+  if(nfs41_session->fore_channel_attrs.ca_maxresponsesize_cached > NFS41_DRC_SIZE)
+    nfs41_session->fore_channel_attrs.ca_maxresponsesize_cached = NFS41_DRC_SIZE;
 
   nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
@@ -324,10 +343,12 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
          NFS4_SESSIONID_SIZE);
 
   /* Create Session replay cache */
-  data->pcached_res = &pfound->cid_create_session_slot.cached_result;
-  pfound->cid_create_session_slot.cache_used = TRUE;
+  data->pcached_slot = &pfound->cid_create_session_slot;
+  P(pfound->cid_create_session_slot.lock);
+  nfs41_Session_Slot_Cache(&pfound->cid_create_session_slot);
+  V(pfound->cid_create_session_slot.lock);
 
-  LogDebug(component, "CREATE_SESSION replay=%p", data->pcached_res);
+  LogDebug(component, "CREATE_SESSION replay=%p", data->pcached_slot);
 
   if(!nfs41_Session_Set(nfs41_session->session_id, nfs41_session))
     {
@@ -339,6 +360,7 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
       dec_client_id_ref(pfound);
 
       /* Free the memory for the session */
+      nfs41_Session_Free_Slots(nfs41_session);
       pool_free(nfs41_session_pool, nfs41_session);
 
       res_CREATE_SESSION4.csr_status = NFS4ERR_SERVERFAULT;     /* Maybe a more precise status would be better */
@@ -458,6 +458,17 @@ int nfs41_op_open(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
                       openflags = FSAL_O_RDWR;
                     }
 
+                  /* Writers wait for the read delegations of the other
+                   * clients to be returned */
+                  if(((arg_OPEN4.share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+                      (arg_OPEN4.share_deny & OPEN4_SHARE_DENY_READ)) &&
+                     state_deleg_recall(pentry_lookup, powner))
+                    {
+                      res_OPEN4.status = NFS4ERR_DELAY;
+                      cause2 = " (delegation recalled)";
+                      goto out;
+                    }
+
                   /* Set the state for the related file */
 
                   /* Prepare state management structure */
@@ -898,6 +909,18 @@ int nfs41_op_open(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
                 }
             }
 
+          /* Writers wait for the read delegations of the other clients
+           * to be returned */
+          if(((arg_OPEN4.share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+              (arg_OPEN4.share_deny & OPEN4_SHARE_DENY_READ)) &&
+             state_deleg_recall_locked(pentry_newfile, powner))
+            {
+              res_OPEN4.status = NFS4ERR_DELAY;
+              cause2 = " (delegation recalled)";
+              pthread_rwlock_unlock(&pentry_newfile->state_lock);
+              goto out;
+            }
+
           if(pfile_state == NULL)
             {
               /* Set the state for the related file */
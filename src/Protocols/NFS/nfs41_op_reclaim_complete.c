@@ -61,6 +61,7 @@
 #include "nfs_proto_functions.h"
 #include "nfs_file_handle.h"
 #include "nfs_tools.h"
+#include "sal_functions.h"
 
 /**
  * 
@@ -89,6 +90,11 @@ int nfs41_op_reclaim_complete(struct nfs_argop4 *op, compound_data_t * data,
 
   resp->resop = NFS4_OP_RECLAIM_COMPLETE;
 
+  /* The client is done reclaiming, on every file system unless told
+   * otherwise; this may end the grace period. */
+  if(!arg_RECLAIM_COMPLETE4.rca_one_fs && data->psession != NULL)
+    nfs4_reclaim_complete(data->psession->pclientid_record, TRUE);
+
   res_RECLAIM_COMPLETE4.rcr_status = NFS4_OK;
   return res_RECLAIM_COMPLETE4.rcr_status;
 }                               /* nfs41_op_reclaim_complete */
@@ -66,6 +66,7 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
 #define res_SEQUENCE4  resp->nfs_resop4_u.opsequence
 
   nfs41_session_t *psession;
+  nfs41_session_slot_t *pslot;
 
   resp->resop = NFS4_OP_SEQUENCE;
   res_SEQUENCE4.sr_status = NFS4_OK;
@@ -110,41 +111,57 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
   V(psession->pclientid_record->cid_mutex);
 
   /* Check is slot is compliant with ca_maxrequests */
-  if(arg_SEQUENCE4.sa_slotid >= psession->fore_channel_attrs.ca_maxrequests)
+  if(arg_SEQUENCE4.sa_slotid >= psession->nb_slots)
     {
       res_SEQUENCE4.sr_status = NFS4ERR_BADSLOT;
       return res_SEQUENCE4.sr_status;
     }
 
+  pslot = nfs41_Session_Get_Slot(psession, arg_SEQUENCE4.sa_slotid);
+  if(pslot == NULL)
+    {
+      res_SEQUENCE4.sr_status = NFS4ERR_DELAY;
+      return res_SEQUENCE4.sr_status;
+    }
+
   /* By default, no DRC replay */
   data->use_drc = FALSE;
 
-  P(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
-  if(psession->slots[arg_SEQUENCE4.sa_slotid].sequence + 1 != arg_SEQUENCE4.sa_sequenceid)
+  P(pslot->lock);
+  if(pslot->sequence + 1 != arg_SEQUENCE4.sa_sequenceid)
     {
-      if(psession->slots[arg_SEQUENCE4.sa_slotid].sequence == arg_SEQUENCE4.sa_sequenceid)
+      if(pslot->sequence == arg_SEQUENCE4.sa_sequenceid)
         {
-          if(psession->slots[arg_SEQUENCE4.sa_slotid].cache_used == TRUE)
+          if(pslot->cache_used == TRUE && pslot->cached_reply == NULL)
+            {
+              /* The request is still being processed */
+              V(pslot->lock);
+              res_SEQUENCE4.sr_status = NFS4ERR_DELAY;
+              return res_SEQUENCE4.sr_status;
+            }
+          else if(pslot->cache_used == TRUE)
             {
               /* Replay operation through the DRC */
               data->use_drc = TRUE;
-              data->pcached_res = &psession->slots[arg_SEQUENCE4.sa_slotid].cached_result;
+              data->pcached_slot = pslot;
 
               LogFullDebug(COMPONENT_SESSIONS,
                            "Use sesson slot %"PRIu32"=%p for DRC",
-                           arg_SEQUENCE4.sa_slotid, data->pcached_res);
+                           arg_SEQUENCE4.sa_slotid, data->pcached_slot);
 
+              V(pslot->lock);
               res_SEQUENCE4.sr_status = NFS4_OK;
               return res_SEQUENCE4.sr_status;
             }
           else
             {
               /* Illegal replay */
+              V(pslot->lock);
               res_SEQUENCE4.sr_status = NFS4ERR_RETRY_UNCACHED_REP;
               return res_SEQUENCE4.sr_status;
             }
         }
-      V(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
+      V(pslot->lock);
       res_SEQUENCE4.sr_status = NFS4ERR_SEQ_MISORDERED;
       return res_SEQUENCE4.sr_status;
     }
@@ -153,36 +170,37 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
   data->psession = psession;
 
   /* Update the sequence id within the slot */
-  psession->slots[arg_SEQUENCE4.sa_slotid].sequence += 1;
+  pslot->sequence += 1;
 
   memcpy((char *)res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sessionid,
          (char *)arg_SEQUENCE4.sa_sessionid, NFS4_SESSIONID_SIZE);
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sequenceid =
-      psession->slots[arg_SEQUENCE4.sa_slotid].sequence;
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sequenceid = pslot->sequence;
   res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_slotid = arg_SEQUENCE4.sa_slotid;
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_highest_slotid = NFS41_NB_SLOTS - 1;
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid = arg_SEQUENCE4.sa_slotid;    /* Maybe not the best choice */
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_highest_slotid = psession->nb_slots - 1;
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
+      nfs41_Session_Target_Slots(psession, arg_SEQUENCE4.sa_highest_slotid);
   res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;   /* What is to be set here ? */
 
   if(arg_SEQUENCE4.sa_cachethis == TRUE)
     {
-      data->pcached_res = &psession->slots[arg_SEQUENCE4.sa_slotid].cached_result;
-      psession->slots[arg_SEQUENCE4.sa_slotid].cache_used = TRUE;
+      data->pcached_slot = pslot;
+      nfs41_Session_Slot_Cache(pslot);
 
       LogFullDebug(COMPONENT_SESSIONS,
                    "Use sesson slot %"PRIu32"=%p for DRC",
-                   arg_SEQUENCE4.sa_slotid, data->pcached_res);
+                   arg_SEQUENCE4.sa_slotid, data->pcached_slot);
     }
   else
     {
-      data->pcached_res = NULL;
-      psession->slots[arg_SEQUENCE4.sa_slotid].cache_used = FALSE;
+      /* The previous reply of this slot will not be replayed anymore */
+      data->pcached_slot = NULL;
+      nfs41_Session_Slot_Uncache(pslot);
 
       LogFullDebug(COMPONENT_SESSIONS,
                    "Don't use sesson slot %"PRIu32"=NULL for DRC",
                    arg_SEQUENCE4.sa_slotid);
     }
-  V(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
+  V(pslot->lock);
 
   res_SEQUENCE4.sr_status = NFS4_OK;
   return res_SEQUENCE4.sr_status;
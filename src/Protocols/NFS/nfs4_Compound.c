@@ -224,6 +224,10 @@ int nfs4_Compound(nfs_arg_t *parg,
 #define COMPOUND4_ARRAY parg->arg_compound4.argarray
 #define COMPOUND4_MINOR parg->arg_compound4.minorversion
 
+  /* Encoded as a regular COMPOUND4res, unless replayed from a slot */
+  pres->res_compound4_extended.res_replay = NULL;
+  pres->res_compound4_extended.res_replay_len = 0;
+
 #ifdef _USE_NFS4_1
   if(COMPOUND4_MINOR > 1)
 #else
@@ -286,6 +290,8 @@ int nfs4_Compound(nfs_arg_t *parg,
   data.pworker = pworker;
   data.pseudofs = nfs4_GetPseudoFs();
   data.reqp = preq;
+  data.argarray = COMPOUND4_ARRAY.argarray_val;
+  data.argarray_len = COMPOUND4_ARRAY.argarray_len;
 
   strcpy(data.MntPath, "/");
 
@@ -349,8 +355,8 @@ int nfs4_Compound(nfs_arg_t *parg,
   for(i = 0; i < COMPOUND4_ARRAY.argarray_len; i++)
     {
       /* Use optab4index to reference the operation */
-#ifdef _USE_NFS4_1
       data.oppos = i;           /* Useful to check if OP_SEQUENCE is used as the first operation */
+#ifdef _USE_NFS4_1
 
       if(COMPOUND4_MINOR == 1)
         {
@@ -434,14 +440,26 @@ int nfs4_Compound(nfs_arg_t *parg,
            */
           LogFullDebug(COMPONENT_SESSIONS,
                        "Use session replay cache %p",
-                       data.pcached_res);
+                       data.pcached_slot);
+
+          /* Send the reply encoded the first time */
+          if(!nfs41_Session_Slot_Replay(data.pcached_slot,
+                                        &pres->res_compound4_extended))
+            {
+              /* Released since SEQUENCE found it */
+              status = NFS4ERR_RETRY_UNCACHED_REP;
+              pres->res_compound4.resarray.resarray_val[i].nfs_resop4_u.opaccess.
+                  status = status;
+              pres->res_compound4.resarray.resarray_len = i + 1;
+              break;
+            }
 
           /* Free the reply allocated above */
           gsh_free(pres->res_compound4.resarray.resarray_val);
+          pres->res_compound4.resarray.resarray_val = NULL;
+          pres->res_compound4.resarray.resarray_len = 0;
 
-          /* Copy the reply from the cache */
-          pres->res_compound4_extended = *data.pcached_res;
-          status = ((COMPOUND4res *) data.pcached_res)->status;
+          status = pres->res_compound4_extended.res_compound4.status;
           break;    /* Exit the for loop */
         }
 #endif
@@ -454,28 +472,20 @@ int nfs4_Compound(nfs_arg_t *parg,
   /* Manage session's DRC: keep NFS4.1 replay for later use, but don't save a
    * replayed result again.
    */
-  if(data.pcached_res != NULL && !data.use_drc)
+  if(data.pcached_slot != NULL && !data.use_drc)
     {
-      /* Pointer has been set by nfs41_op_sequence and points to slot to cache
-       * result in.
+      /* Pointer has been set by nfs41_op_sequence (or create_session) and
+       * points to slot to cache result in, as encoded on the wire.
        */
       LogFullDebug(COMPONENT_SESSIONS,
-                   "Save result in session replay cache %p sizeof nfs_res_t=%d",
-                   data.pcached_res,
-                   (int) sizeof(nfs_res_t));
-
-      /* Indicate to nfs4_Compound_Free that this reply is cached. */
-      pres->res_compound4_extended.res_cached = TRUE;
-
-      /* If the cache is already in use, free it. */
-      if(data.pcached_res->res_cached)
-        {
-          data.pcached_res->res_cached = FALSE;
-          nfs4_Compound_Free((nfs_res_t *)data.pcached_res);
-        }
-
-      /* Save the result in the cache. */
-      *data.pcached_res = pres->res_compound4_extended;
+                   "Save result in session replay cache %p",
+                   data.pcached_slot);
+
+      nfs41_Session_Slot_Save(data.pcached_slot,
+                              &pres->res_compound4,
+                              data.psession != NULL
+                              ? data.psession->fore_channel_attrs.ca_maxresponsesize_cached
+                              : NFS41_DRC_SIZE);
     }
 
   /* If we have reserved a lease, update it and release it */
@@ -735,12 +745,10 @@ void nfs4_Compound_Free(nfs_res_t *pres)
   if(isFullDebug(COMPONENT_SESSIONS))
     component = COMPONENT_SESSIONS;
 
-  if(pres->res_compound4_extended.res_cached)
+  if(pres->res_compound4_extended.res_replay != NULL)
     {
-      LogFullDebug(component,
-                   "Skipping free of NFS4 result %p",
-                   pres);
-      return;
+      gsh_free(pres->res_compound4_extended.res_replay);
+      pres->res_compound4_extended.res_replay = NULL;
     }
 
   LogFullDebug(component,
@@ -922,29 +930,23 @@ void nfs4_Compound_CopyResOne(nfs_resop4 * pres_dst, nfs_resop4 * pres_src)
 
 /**
  *
- * nfs4_Compound_CopyRes: Copy the result for NFS4PROC_COMPOUND
- *
- * Copy the result for NFS4PROC_COMPOUND.
- *
- * @param resp pointer to be freed
- *
- * @return nothing (void function).
+ * xdr_COMPOUND4res_extended: encodes the result of NFS4PROC_COMPOUND.
  *
- * @see nfs4_op_getfh
+ * A reply replayed from a session slot is sent as the bytes cached when
+ * it was first encoded.
  *
  */
-void nfs4_Compound_CopyRes(nfs_res_t * pres_dst, nfs_res_t * pres_src)
+bool_t xdr_COMPOUND4res_extended(XDR * xdrs, COMPOUND4res_extended * objp)
 {
-  unsigned int i = 0;
+  if(objp->res_replay != NULL)
+    {
+      if(xdrs->x_op != XDR_ENCODE)
+        return TRUE;
 
-  LogFullDebug(COMPONENT_NFS_V4,
-               "nfs4_Compound_CopyRes of %p to %p (resarraylen : %i)",
-               pres_src, pres_dst,
-               pres_src->res_compound4.resarray.resarray_len);
+      return xdr_opaque(xdrs, objp->res_replay, objp->res_replay_len);
+    }
 
-  for(i = 0; i < pres_src->res_compound4.resarray.resarray_len; i++)
-    nfs4_Compound_CopyResOne(&pres_dst->res_compound4.resarray.resarray_val[i],
-                             &pres_src->res_compound4.resarray.resarray_val[i]);
+  return xdr_COMPOUND4res(xdrs, &objp->res_compound4);
 }
 
 /**
@@ -59,7 +59,9 @@
 #include "nfs_exports.h"
 #include "nfs_creds.h"
 #include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
 #include "nfs_tools.h"
+#include "sal_functions.h"
 
 /**
  * nfs4_op_delegreturn: The NFS4_OP_DELEGRETURN
@@ -81,10 +83,40 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op,
 {
   char __attribute__ ((__unused__)) funcname[] = "nfs4_op_delegreturn";
 
-  /* Lock are not supported */
+  state_t        * pstate_found = NULL;
+  state_status_t   state_status;
+  const char     * tag = "DELEGRETURN";
+
   resp->resop = NFS4_OP_DELEGRETURN;
   res_DELEGRETURN4.status = NFS4_OK;
 
+  /* Delegations are only granted on regular files */
+  res_DELEGRETURN4.status = nfs4_sanity_check_FH(data, REGULAR_FILE);
+  if(res_DELEGRETURN4.status != NFS4_OK)
+    return res_DELEGRETURN4.status;
+
+  /* Check stateid correctness and get pointer to state */
+  res_DELEGRETURN4.status = nfs4_Check_Stateid(&arg_DELEGRETURN4.deleg_stateid,
+                                               data->current_entry,
+                                               &pstate_found,
+                                               data,
+                                               STATEID_SPECIAL_FOR_LOCK,
+                                               tag);
+  if(res_DELEGRETURN4.status != NFS4_OK)
+    return res_DELEGRETURN4.status;
+
+  if(pstate_found->state_type != STATE_TYPE_DELEG)
+    {
+      LogDebug(COMPONENT_STATE,
+               "DELEGRETURN with stateid of type %d",
+               (int) pstate_found->state_type);
+      res_DELEGRETURN4.status = NFS4ERR_BAD_STATEID;
+      return res_DELEGRETURN4.status;
+    }
+
+  if(state_deleg_return(pstate_found, &state_status) != STATE_SUCCESS)
+    res_DELEGRETURN4.status = nfs4_Errno_state(state_status);
+
   return res_DELEGRETURN4.status;
 }                               /* nfs4_op_delegreturn */
 
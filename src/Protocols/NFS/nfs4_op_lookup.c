@@ -61,6 +61,71 @@
 #include "nfs_proto_functions.h"
 #include "nfs_tools.h"
 #include "nfs_proto_tools.h"
+#include "cache_inode_path.h"
+
+/**
+ * nfs4_lookup_run: collects the names of a run of LOOKUP operations.
+ *
+ * Starting with the operation being processed, whose name has already
+ * been checked, collects the names of the LOOKUP operations that
+ * immediately follow it in the compound, as long as each name would
+ * pass the checks done by nfs4_op_lookup. The run can then be resolved
+ * at once through the path cache.
+ *
+ * @param data  [IN]  Pointer to the compound request's data
+ * @param first [IN]  Name looked up by the current operation
+ * @param names [OUT] Array of CACHE_INODE_PATH_MAX_DEPTH names
+ *
+ * @return the number of names collected (at least 1).
+ *
+ */
+static uint32_t nfs4_lookup_run(compound_data_t * data,
+                                fsal_name_t * first,
+                                fsal_name_t * names)
+{
+  char strname[MAXNAMLEN];
+#ifndef _NO_XATTRD
+  char objname[MAXNAMLEN];
+#endif
+  uint32_t count = 1;
+  uint32_t pos;
+  utf8string *objname4;
+
+  names[0] = *first;
+
+  if(data->argarray == NULL)
+    return count;
+
+  for(pos = data->oppos + 1;
+      pos < data->argarray_len && count < CACHE_INODE_PATH_MAX_DEPTH; pos++)
+    {
+      if(data->argarray[pos].argop != NFS4_OP_LOOKUP)
+        break;
+
+      objname4 = &data->argarray[pos].nfs_argop4_u.oplookup.objname;
+      if(objname4->utf8string_len == 0 || objname4->utf8string_val == NULL ||
+         objname4->utf8string_len > FSAL_MAX_NAME_LEN)
+        break;
+
+      utf82str(strname, sizeof(strname), objname4);
+
+#ifndef _NO_XATTRD
+      if(nfs_XattrD_Name(strname, objname))
+        break;
+#endif
+
+      if(FSAL_IS_ERROR(FSAL_str2name(strname, MAXNAMLEN, &names[count])))
+        break;
+
+      if(!FSAL_namecmp(&names[count], (fsal_name_t *) & FSAL_DOT)
+         || !FSAL_namecmp(&names[count], (fsal_name_t *) & FSAL_DOT_DOT))
+        break;
+
+      count++;
+    }
+
+  return count;
+}                               /* nfs4_lookup_run */
 
 /**
  * nfs4_op_lookup: looks up into theFSAL.
@@ -92,6 +157,9 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t * data, struct nfs_res
   fsal_attrib_list_t     attrlookup;
   cache_inode_status_t   cache_status;
   fsal_handle_t        * pfsal_handle = NULL;
+  fsal_name_t            names[CACHE_INODE_PATH_MAX_DEPTH];
+  uint32_t               count;
+  bool_t                 walking = FALSE;
 
   resp->resop = NFS4_OP_LOOKUP;
   res_LOOKUP4.status = NFS4_OK;
@@ -101,6 +169,14 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t * data, struct nfs_res
   if(res_LOOKUP4.status != NFS4_OK)
     return res_LOOKUP4.status;
 
+  /* This LOOKUP has already been resolved, with the ones before it in
+   * the same run, through the path cache */
+  if(data->lookup_skip > 0)
+    {
+      data->lookup_skip--;
+      return res_LOOKUP4.status;
+    }
+
   /* Check for empty name */
   if(op->nfs_argop4_u.oplookup.objname.utf8string_len == 0 ||
      op->nfs_argop4_u.oplookup.objname.utf8string_val == NULL)
@@ -179,12 +255,46 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t * data, struct nfs_res
       return res_LOOKUP4.status;
     }
 
+  /* Either continue recording the run of LOOKUPs we are in, or try to
+   * resolve the run that starts here in one go */
+  if(cache_inode_path_walk_active(&data->path_walk, dir_pentry))
+    {
+      cache_inode_path_walk_enter(&data->path_walk, dir_pentry);
+      walking = TRUE;
+    }
+  else if(xattr_found == FALSE)
+    {
+      count = nfs4_lookup_run(data, &name, names);
+      if(count > 1)
+        {
+          file_pentry = cache_inode_path_lookup(dir_pentry,
+                                                names,
+                                                count,
+                                                &attrlookup,
+                                                data->pcontext);
+          if(file_pentry != NULL)
+            data->lookup_skip = count - 1;
+          else if(cache_inode_path_walk_start(&data->path_walk,
+                                              dir_pentry, names, count))
+            {
+              cache_inode_path_walk_enter(&data->path_walk, dir_pentry);
+              walking = TRUE;
+            }
+        }
+    }
+
   /* BUGAZOMEU: Faire la gestion des cross junction traverse */
-  if((file_pentry = cache_inode_lookup(dir_pentry,
-                                       &name,
-                                       &attrlookup,
-                                       data->pcontext, &cache_status)) != NULL)
+  if(file_pentry == NULL)
+    file_pentry = cache_inode_lookup(dir_pentry,
+                                     &name,
+                                     &attrlookup,
+                                     data->pcontext, &cache_status);
+  if(file_pentry != NULL)
     {
+      if(walking)
+        cache_inode_path_walk_leave(&data->path_walk, file_pentry,
+                                    data->pcontext);
+
       /* Extract the fsal attributes from the cache inode pentry */
       pfsal_handle = &file_pentry->handle;
 
@@ -260,6 +370,7 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t * data, struct nfs_res
   /* If the part of the code is reached, then something wrong occured in the lookup process, status is not HPSS_E_NOERROR 
    * and contains the code for the error */
 
+  cache_inode_path_walk_abort(&data->path_walk);
   res_LOOKUP4.status = nfs4_Errno(cache_status);
 
   return res_LOOKUP4.status;
@@ -70,6 +70,9 @@ static nfsstat4 nfs4_do_open(struct nfs_argop4  * op,
                              char              ** cause2);
 
 static nfsstat4 nfs4_create_fh(compound_data_t *, cache_entry_t *, char **);
+
+static void nfs4_open_deleg(OPEN4args *, compound_data_t *, cache_entry_t *,
+                            state_owner_t *, open_delegation4 *);
 /**
  * nfs4_op_open: NFS4_OP_OPEN, opens and eventually creates a regular file.
  *
@@ -113,6 +116,7 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
   nfs_client_id_t         * pclientid;
   state_t                 * pfile_state = NULL;
   state_t                 * pstate_iterate;
+  state_data_t              share_data;
   state_nfs4_owner_name_t   owner_name;
   state_owner_t           * powner = NULL;
   const char              * tag = "OPEN";
@@ -120,6 +124,8 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
   const char              * cause2 = "";
   struct glist_head       * glist;
   open_claim_type4          claim = arg_OPEN4.claim.claim;
+  component4              * claim_file = &arg_OPEN4.claim.open_claim4_u.file;
+  state_t                 * pdeleg_state = NULL;
   nfsstat4                  status4;
   uint32_t                  tmp_attr[2];
 #ifdef _USE_QUOTA
@@ -295,6 +301,13 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
         }
     }
 
+  /* NFSv4.0 has no RECLAIM_COMPLETE, a client opens anew once it has
+   * reclaimed what it had.  Only a hint to end grace early: the client
+   * keeps its right to reclaim. */
+  if (claim == CLAIM_NULL && data->minorversion == 0 &&
+      nfs_param.nfsv4_param.grace_early_exit && nfs_in_grace())
+    nfs4_reclaim_complete(pclientid, FALSE);
+
   if (nfs_in_grace() && claim != CLAIM_PREVIOUS)
     {
        cause2 = " (in grace period)";
@@ -339,16 +352,35 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
   /* First switch is based upon claim type */
   switch (claim)
     {
+    case CLAIM_DELEGATE_CUR:
+      /* The client tells about an open it did under its delegation,
+       * before returning it.  The file is opened by name, as with
+       * CLAIM_NULL. */
+      if(!nfs4_State_Get_Pointer(arg_OPEN4.claim.open_claim4_u.delegate_cur_info
+                                 .delegate_stateid.other, &pdeleg_state) ||
+         pdeleg_state->state_type != STATE_TYPE_DELEG ||
+         pdeleg_state->state_powner->so_owner.so_nfs4_owner.so_clientid !=
+         arg_OPEN4.owner.clientid)
+        {
+          res_OPEN4.status = NFS4ERR_BAD_STATEID;
+          cause2 = " (not a delegation of the client)";
+          goto out;
+        }
+
+      claim_file = &arg_OPEN4.claim.open_claim4_u.delegate_cur_info.file;
+
+      /* fall through */
+
     case CLAIM_NULL:
       /* Check for name length */
-      if(arg_OPEN4.claim.open_claim4_u.file.utf8string_len > FSAL_MAX_NAME_LEN)
+      if(claim_file->utf8string_len > FSAL_MAX_NAME_LEN)
         {
           res_OPEN4.status = NFS4ERR_NAMETOOLONG;
           goto out;
         }
 
       /* get the filename from the argument, it should not be empty */
-      if(arg_OPEN4.claim.open_claim4_u.file.utf8string_len == 0)
+      if(claim_file->utf8string_len == 0)
         {
           res_OPEN4.status = NFS4ERR_INVAL;
           cause2 = " (empty filename)";
@@ -380,8 +412,8 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
       /* Check if filename is correct */
       if((cache_status =
           cache_inode_error_convert(FSAL_buffdesc2name
-                                    ((fsal_buffdesc_t *) & arg_OPEN4.claim.open_claim4_u.
-                                     file, &filename))) != CACHE_INODE_SUCCESS)
+                                    ((fsal_buffdesc_t *) claim_file,
+                                     &filename))) != CACHE_INODE_SUCCESS)
         {
           res_OPEN4.status = nfs4_Errno(cache_status);
           cause2 = " FSAL_buffdesc2name";
@@ -470,6 +502,20 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
                                              &attr_newfile,
                                              data->pcontext,
                                              &cache_status);
+
+          /* The delegation must be on the file being opened, which
+           * therefore exists */
+          if(pdeleg_state != NULL &&
+             (cache_status != CACHE_INODE_SUCCESS ||
+              pdeleg_state->state_pentry != pentry_lookup))
+            {
+              res_OPEN4.status = NFS4ERR_BAD_STATEID;
+              cause2 = " (delegation of another file)";
+              if(cache_status == CACHE_INODE_SUCCESS)
+                cache_inode_put(pentry_lookup);
+              goto out;
+            }
+
           if(cache_status != CACHE_INODE_NOT_FOUND)
             {
               /* if open is UNCHECKED, return NFS4_OK (RFC3530 page 172) */
@@ -530,10 +576,6 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
                        = cache_inode_get_changeid4(pentry_parent);
                   res_OPEN4.OPEN4res_u.resok4.cinfo.atomic = FALSE;
 
-                  /* No delegation */
-                  res_OPEN4.OPEN4res_u.resok4.delegation.delegation_type =
-                      OPEN_DELEGATE_NONE;
-
                   /* If server use OPEN_CONFIRM4, set the correct flag */
                   P(powner->so_mutex);
                   if(powner->so_owner.so_nfs4_owner.so_confirmed == FALSE)
@@ -563,6 +605,9 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
                   data->current_entry = pentry_lookup;
                   data->current_filetype = REGULAR_FILE;
 
+                  nfs4_open_deleg(&arg_OPEN4, data, pentry_lookup, powner,
+                                  &res_OPEN4.OPEN4res_u.resok4.delegation);
+
                   /* regular exit */
                   goto out_success;
                 }
@@ -773,6 +818,16 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
                 }
             }
 
+          /* The delegation must be on the file being opened */
+          if(pdeleg_state != NULL &&
+             pdeleg_state->state_pentry != pentry_newfile)
+            {
+              res_OPEN4.status = NFS4ERR_BAD_STATEID;
+              cause2 = " (delegation of another file)";
+              cache_inode_put(pentry_newfile);
+              goto out;
+            }
+
           status4 = nfs4_chk_shrdny(op, data, pentry_newfile, read_access,
               write_access, &openflags, FALSE, NULL, resp);
           if (status4 != NFS4_OK)
@@ -794,75 +849,43 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
             }
 #endif
 
+          /* Fail early, without the state lock, if the open conflicts
+           * with the shares already held on the file.  In all cases
+           * opening in read access a read denied file or write access to
+           * a write denied file should fail, even if the owner is the
+           * same, see discussion in 14.2.16 and 8.9.  Conflicts showing
+           * up in the meantime are caught by nfs4_do_open.
+           */
+          share_data.share.share_access = arg_OPEN4.share_access;
+          share_data.share.share_deny = arg_OPEN4.share_deny;
+          if(state_share_summary_conflict(pentry_newfile, STATE_TYPE_SHARE,
+                                          &share_data))
+            {
+              res_OPEN4.status = NFS4ERR_SHARE_DENIED;
+              cause2 = " (share conflict)";
+              cache_inode_put(pentry_newfile);
+              goto out;
+            }
+
           pthread_rwlock_wrlock(&pentry_newfile->state_lock);
           /* Try to find if the same open_owner already has acquired a
-             stateid for this file */
-          glist_for_each(glist, &pentry_newfile->state_list)
+             stateid for this file, among the few states of the owner
+             rather than the many opens of a hot file */
+          P(powner->so_mutex);
+          glist_for_each(glist, &powner->so_owner.so_nfs4_owner.so_state_list)
             {
-              pstate_iterate = glist_entry(glist, state_t, state_list);
-
-              // TODO FSF: currently only care about share types
-              if(pstate_iterate->state_type != STATE_TYPE_SHARE)
-                continue;
-
-              /* Check is open_owner is the same */
-              if((pstate_iterate->state_powner->so_owner.so_nfs4_owner
-                  .so_clientid == arg_OPEN4.owner.clientid) &&
-                 ((pstate_iterate->state_powner->so_owner_len ==
-                   arg_OPEN4.owner.owner.owner_len) &&
-                  (!memcmp(arg_OPEN4.owner.owner.owner_val,
-                           pstate_iterate->state_powner->so_owner_val,
-                           pstate_iterate->state_powner->so_owner_len))))
+              pstate_iterate = glist_entry(glist, state_t, state_owner_list);
+
+              if(pstate_iterate->state_type == STATE_TYPE_SHARE &&
+                 pstate_iterate->state_pentry == pentry_newfile)
                 {
                   /* We'll be re-using the found state */
                   pfile_state = pstate_iterate;
                   ReuseState  = TRUE;
-                }
-              else
-                {
-                  /* This is a different owner, check for possible conflicts */
-                  if((pstate_iterate->state_data.share.share_access &
-                      OPEN4_SHARE_ACCESS_WRITE)
-                     && (arg_OPEN4.share_deny & OPEN4_SHARE_DENY_WRITE))
-                    {
-                      res_OPEN4.status = NFS4ERR_SHARE_DENIED;
-                      cause2 = " (OPEN4_SHARE_DENY_WRITE)";
-                      pthread_rwlock_unlock(&pentry_newfile->state_lock);
-                      cache_inode_put(pentry_newfile);
-                      goto out;
-                    }
-                }
-
-              /* In all cases opening in read access a read denied
-               * file or write access to a write denied file should
-               * fail, even if the owner is the same, see discussion
-               * in 14.2.16 and 8.9
-               */
-
-              /* deny read access on read denied file */
-              if((pstate_iterate->state_data.share.share_deny &
-                  OPEN4_SHARE_DENY_READ)
-                 && (arg_OPEN4.share_access & OPEN4_SHARE_ACCESS_READ))
-                {
-                  res_OPEN4.status = NFS4ERR_SHARE_DENIED;
-                  cause2 = " (OPEN4_SHARE_ACCESS_READ)";
-                  pthread_rwlock_unlock(&pentry_newfile->state_lock);
-                  cache_inode_put(pentry_newfile);
-                  goto out;
-                }
-
-              /* deny write access on write denied file */
-              if((pstate_iterate->state_data.share.share_deny &
-                  OPEN4_SHARE_DENY_WRITE)
-                 && (arg_OPEN4.share_access & OPEN4_SHARE_ACCESS_WRITE))
-                {
-                  res_OPEN4.status = NFS4ERR_SHARE_DENIED;
-                  cause2 = " (OPEN4_SHARE_ACCESS_WRITE)";
-                  pthread_rwlock_unlock(&pentry_newfile->state_lock);
-                  cache_inode_put(pentry_newfile);
-                  goto out;
+                  break;
                 }
             }
+          V(powner->so_mutex);
 
           status4 = nfs4_do_open(op, data, pentry_newfile, pentry_parent,
               powner, &pfile_state, &filename, openflags, &text);
@@ -901,7 +924,6 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
         }
       goto out_prev;
 
-    case CLAIM_DELEGATE_CUR:
     case CLAIM_DELEGATE_PREV:
       /* Check for name length */
       if(arg_OPEN4.claim.open_claim4_u.file.utf8string_len > FSAL_MAX_NAME_LEN)
@@ -987,8 +1009,8 @@ out_prev:
        = cache_inode_get_changeid4(pentry_parent);
   res_OPEN4.OPEN4res_u.resok4.cinfo.atomic = FALSE;
 
-  /* No delegation */
-  res_OPEN4.OPEN4res_u.resok4.delegation.delegation_type |= OPEN_DELEGATE_NONE;
+  nfs4_open_deleg(&arg_OPEN4, data, pentry_newfile, powner,
+                  &res_OPEN4.OPEN4res_u.resok4.delegation);
 
   /* If server use OPEN_CONFIRM4, set the correct flag */
   if(powner->so_owner.so_nfs4_owner.so_confirmed == FALSE)
@@ -1179,6 +1201,16 @@ static nfsstat4 nfs4_do_open(struct nfs_argop4  * op,
         candidate_data.share.share_access_prev = 0;
         candidate_data.share.share_deny_prev   = 0;
 
+        /* Writers wait for the read delegations of the other clients
+         * to be returned */
+        if(((args->share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+            (args->share_deny & OPEN4_SHARE_DENY_READ)) &&
+           state_deleg_recall_locked(pentry_newfile, powner))
+          {
+            *cause2 = " (delegation recalled)";
+            return NFS4ERR_DELAY;
+          }
+
         /* Quick exit if there is any share conflict */
         if(state_share_check_conflict(pentry_newfile,
                                       candidate_data.share.share_access,
@@ -1322,3 +1354,37 @@ nfs4_create_fh(compound_data_t *data, cache_entry_t *pentry, char **cause2)
 
         return NFS4_OK;
 }
+
+/* Grant a read delegation with a CLAIM_NULL open, if SAL agrees to.
+ * Only NFSv4.0 clients are offered one: CB_RECALL is not sent over
+ * NFSv4.1 back channels. */
+static void nfs4_open_deleg(OPEN4args *args, compound_data_t *data,
+                            cache_entry_t *pentry, state_owner_t *powner,
+                            open_delegation4 *pdeleg)
+{
+        open_read_delegation4 *pread = &pdeleg->open_delegation4_u.read;
+        state_t *pstate;
+
+        memset(pdeleg, 0, sizeof(*pdeleg));
+        pdeleg->delegation_type = OPEN_DELEGATE_NONE;
+
+        if(data->minorversion != 0 || args->claim.claim != CLAIM_NULL)
+                return;
+
+        if(!state_deleg_grant(pentry, powner, data->pexport, data->pcontext,
+                              args->share_access, args->share_deny,
+                              &data->currentFH, &pstate))
+                return;
+
+        pdeleg->delegation_type = OPEN_DELEGATE_READ;
+        pread->stateid.seqid = pstate->state_seqid;
+        memcpy(pread->stateid.other, pstate->stateid_other, OTHERSIZE);
+        pread->recall = FALSE;
+
+        /* Let the client ask ACCESS */
+        pread->permissions.type = ACE4_ACCESS_ALLOWED_ACE_TYPE;
+        pread->permissions.flag = 0;
+        pread->permissions.access_mask = 0;
+        pread->permissions.who.utf8string_len = 0;
+        pread->permissions.who.utf8string_val = NULL;
+}
@@ -226,6 +226,12 @@ int nfs4_op_read(struct nfs_argop4 *op, compound_data_t * data, struct nfs_resop
             /* Nothing to do */
             break ;
 
+         case STATE_TYPE_DELEG:
+            res_READ4.status = state_deleg_check_io(pstate_found, FALSE);
+            if(res_READ4.status != NFS4_OK)
+              return res_READ4.status;
+            break ;
+
          default:
             /* Sanity check: all other types are illegal.  we should
              * not got that place (similar check above), anyway it
@@ -90,6 +90,7 @@ int nfs4_op_setattr(struct nfs_argop4 *op,
   const char           * tag = "SETATTR";
   state_t              * pstate_found = NULL;
   state_t              * pstate_open  = NULL;
+  state_t              * pstate_stateid = NULL;
   cache_entry_t        * pentry       = NULL;
 
   memset(&sattr, 0, sizeof(sattr));
@@ -128,6 +129,24 @@ int nfs4_op_setattr(struct nfs_argop4 *op,
   if(res_SETATTR4.status != NFS4_OK)
     return res_SETATTR4.status;
 
+  /* Changing the size of a file conflicts with the read delegations
+   * of the other clients, wait for them to be returned */
+  if(FSAL_TEST_MASK(sattr.asked_attributes, FSAL_ATTR_SIZE) &&
+     data->current_entry->type == REGULAR_FILE &&
+     data->current_entry->object.file.deleg_cnt != 0)
+    {
+      if(!nfs4_State_Get_Pointer(arg_SETATTR4.stateid.other, &pstate_stateid))
+        pstate_stateid = NULL;
+
+      if(state_deleg_recall(data->current_entry,
+                            pstate_stateid != NULL ? pstate_stateid->state_powner
+                                                 : NULL))
+        {
+          res_SETATTR4.status = NFS4ERR_DELAY;
+          return res_SETATTR4.status;
+        }
+    }
+
   /*
    * trunc may change Xtime so we have to start with trunc and finish
    * by the mtime and atime 
@@ -174,6 +193,10 @@ int nfs4_op_setattr(struct nfs_argop4 *op,
                 break;
 
               case STATE_TYPE_DELEG:
+                res_SETATTR4.status = state_deleg_check_io(pstate_found,
+                                                           TRUE);
+                if(res_SETATTR4.status != NFS4_OK)
+                  return res_SETATTR4.status;
                 pstate_open = NULL;
                 break;
 
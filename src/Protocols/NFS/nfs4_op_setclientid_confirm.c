@@ -46,6 +46,7 @@
 #include "nfs_core.h"
 #include "sal_functions.h"
 #include "nfs_proto_functions.h"
+#include "abstract_atomic.h"
 
 /**
  *
@@ -368,6 +369,7 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 * op,
         punconf->cid_cb.cb_u.v40.cb_callback_ident;
 
       nfs_rpc_destroy_chan(&pconf->cid_cb.cb_u.v40.cb_chan);
+      atomic_store_uint32_t(&pconf->cid_cb.cid_path_state, CB_PATH_UNKNOWN);
 
       memcpy(pconf->cid_verifier, punconf->cid_verifier, NFS4_VERIFIER_SIZE);
 
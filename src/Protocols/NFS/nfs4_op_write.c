@@ -170,6 +170,15 @@ int nfs4_op_write(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
   if(res_WRITE4.status != NFS4_OK)
     return res_WRITE4.status;
 
+  /* Wait for the read delegations of the other clients to be returned */
+  if(state_deleg_recall(pentry,
+                        pstate_found != NULL ? pstate_found->state_powner
+                                             : NULL))
+    {
+      res_WRITE4.status = NFS4ERR_DELAY;
+      return res_WRITE4.status;
+    }
+
   /* NB: After this points, if pstate_found == NULL, then the stateid is all-0 or all-1 */
 
   if(pstate_found != NULL)
@@ -187,12 +196,22 @@ int nfs4_op_write(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
             break;
 
           case STATE_TYPE_DELEG:
+            res_WRITE4.status = state_deleg_check_io(pstate_found, TRUE);
+            if(res_WRITE4.status != NFS4_OK)
+              {
+                LogDebug(COMPONENT_NFS_V4_LOCK,
+                         "WRITE with read delegation stateid %p",
+                         pstate_found);
+                return res_WRITE4.status;
+              }
+            pstate_open = NULL;
+            break;
+
 #ifdef _USE_NFS4_1
           case STATE_TYPE_LAYOUT:
-#endif /* _USE_NFS4_1 */
             pstate_open = NULL;
-            // TODO FSF: should check that this is a write delegation?
             break;
+#endif /* _USE_NFS4_1 */
 
           default:
             res_WRITE4.status = NFS4ERR_BAD_STATEID;
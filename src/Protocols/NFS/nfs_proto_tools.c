@@ -873,15 +873,21 @@ int nfs4_supported_attrs_to_fattr(char *attrvalsBuffer)
   return LastOffset;
 }
 
-int nfs4_Fattr_Fill(fattr4 *Fattr, int cnt, uint32_t *attrvalslist,
-                    int LastOffset, char *attrvalsBuffer)
+static int nfs4_Fattr_Fill_Bitmap(fattr4 *Fattr, const uint32_t *bitmap,
+                                  int LastOffset, char *attrvalsBuffer)
 {
-  /* Set the bitmap for result */
+  int i;
+
+  /* Set the bitmap for result, trailing empty words are not sent */
   memset(Fattr, 0, sizeof(*Fattr));
   if((Fattr->attrmask.bitmap4_val = gsh_calloc(3, sizeof(uint32_t))) == NULL)
     return -1;
-  Fattr->attrmask.bitmap4_len = 3;
-  nfs4_list_to_bitmap4(&(Fattr->attrmask), cnt, attrvalslist);
+  for(i = 0; i < 3; i++)
+    {
+      Fattr->attrmask.bitmap4_val[i] = bitmap[i];
+      if(bitmap[i] != 0)
+        Fattr->attrmask.bitmap4_len = i + 1;
+    }
 
   /* Set the attrlist4 */
   /* LastOffset contains the length of the attrvalsBuffer usefull data */
@@ -899,872 +905,801 @@ int nfs4_Fattr_Fill(fattr4 *Fattr, int cnt, uint32_t *attrvalslist,
     }
   return 0;
 }
-/**
- *
- * nfs4_FSALattr_To_Fattr: Converts FSAL Attributes to NFSv4 Fattr buffer.
- *
- * Converts FSAL Attributes to NFSv4 Fattr buffer.
- *
- * @param pexport [IN]  the related export entry.
- * @param pattr   [IN]  pointer to FSAL attributes.
- * @param Fattr   [OUT] NFSv4 Fattr buffer
- *		  Memory for bitmap_val and attr_val is dynamically allocated,
- *		  caller is responsible for freeing it.
- * @param data    [IN]  NFSv4 compoud request's data.
- * @param objFH   [IN]  The NFSv4 filehandle of the object whose
- *                      attributes are requested
- * @param Bitmap  [IN]  Bitmap of attributes being requested
- *
- * @return -1 if failed, 0 if successful.
- *
- */
 
-int nfs4_FSALattr_To_Fattr(exportlist_t *pexport,
-                           fsal_attrib_list_t *pattr,
-                           fattr4 *Fattr,
-                           compound_data_t *data,
-                           nfs_fh4 *objFH,
-                           bitmap4 *Bitmap)
+int nfs4_Fattr_Fill(fattr4 *Fattr, int cnt, uint32_t *attrvalslist,
+                    int LastOffset, char *attrvalsBuffer)
 {
-  fattr4_type file_type = 0;
-  fattr4_link_support link_support;
-  fattr4_symlink_support symlink_support;
-  fattr4_fh_expire_type expire_type;
-  fattr4_named_attr named_attr;
-  fattr4_unique_handles unique_handles;
-  fattr4_archive archive;
-  fattr4_cansettime cansettime;
-  fattr4_case_insensitive case_insensitive;
-  fattr4_case_preserving case_preserving;
-  fattr4_chown_restricted chown_restricted;
-  fattr4_hidden hidden;
-  fattr4_mode file_mode;
-  fattr4_no_trunc no_trunc;
-  fattr4_numlinks file_numlinks;
-  fattr4_rawdev rawdev;
-  fattr4_system system;
-  fattr4_size file_size;
-  fattr4_space_used file_space_used;
-  fattr4_fsid fsid;
-  fattr4_time_access time_access;
-  fattr4_time_modify time_modify;
-  fattr4_time_metadata time_metadata;
-  fattr4_time_delta time_delta;
-  fattr4_change file_change;
-  fattr4_fileid file_id;
-  fattr4_owner file_owner;
-  fattr4_owner_group file_owner_group;
-  fattr4_space_avail space_avail;
-  fattr4_space_free space_free;
-  fattr4_space_total space_total;
-  fattr4_files_avail files_avail;
-  fattr4_files_free files_free;
-  fattr4_files_total files_total;
-  fattr4_lease_time lease_time;
-  fattr4_time_create time_create;
-  fattr4_maxfilesize max_filesize;
-  fattr4_maxread maxread;
-  fattr4_maxwrite maxwrite;
-  fattr4_maxname maxname;
-  fattr4_maxlink maxlink;
-  fattr4_homogeneous homogeneous;
-  fattr4_aclsupport aclsupport;
-#ifndef _USE_NFS4_ACL
-  fattr4_acl acl;
-#endif
-  fattr4_rdattr_error rdattr_error;
-  fattr4_quota_avail_hard quota_avail_hard;
-  fattr4_quota_avail_soft quota_avail_soft;
-  fattr4_quota_used quota_used;
-#ifdef _PNFS_MDS
-  fattr4_layout_blksize layout_blksize;
-#endif /* _PNFS_MDS */
+  uint32_t bitmap_val[3];
+  bitmap4 bitmap;
 
-  u_int tmp_int;
-  char tmp_buff[1024];
+  bitmap.bitmap4_val = bitmap_val;
+  bitmap.bitmap4_len = 3;
+  nfs4_list_to_bitmap4(&bitmap, cnt, attrvalslist);
 
-  uint32_t attribute_to_set = 0;
+  return nfs4_Fattr_Fill_Bitmap(Fattr, bitmap_val, LastOffset, attrvalsBuffer);
+}
 
-  u_int fhandle_len = 0;
-  u_int LastOffset;
-  u_int len = 0, off = 0;       /* Use for XDR alignment */
-  int op_attr_success = 0;
+/*
+ * Encoding plans for nfs4_FSALattr_To_Fattr.
+ *
+ * A plan is the list of encoders for the attributes of one bitmap, as
+ * seen from one export.  The attributes whose value only depends on
+ * the export and on the configuration are encoded once, when the plan
+ * is built, and are copied as a single block for every object; those
+ * the server never returns are dropped from the plan altogether.
+ * Plans are kept in a small per thread cache, so GETATTR and every
+ * entry of a READDIR asking for the same bitmap share one.  A plan is
+ * tied to the export generation it was built in, as a reload of the
+ * exports rewrites the entries in place.
+ */
 
 #ifdef _USE_NFS4_1
-  uint32_t attrmasklist[FATTR4_FS_CHARSET_CAP]; /* List cannot be longer than FATTR4_FS_CHARSET_CAP */
-  uint32_t attrvalslist[FATTR4_FS_CHARSET_CAP]; /* List cannot be longer than FATTR4_FS_CHARSET_CAP */
+#define FATTR4_PLAN_NATTRS (FATTR4_FS_CHARSET_CAP + 1)
 #else
-  uint32_t attrmasklist[FATTR4_MOUNTED_ON_FILEID];      /* List cannot be longer than FATTR4_MOUNTED_ON_FILEID */
-  uint32_t attrvalslist[FATTR4_MOUNTED_ON_FILEID];      /* List cannot be longer than FATTR4_MOUNTED_ON_FILEID */
+#define FATTR4_PLAN_NATTRS (FATTR4_MOUNTED_ON_FILEID + 1)
 #endif
-  uint32_t attrmasklen = 0;
-  char attrvalsBuffer[ATTRVALS_BUFFLEN];
+#define FATTR4_PLAN_WORDS 3
+#define FATTR4_PLAN_CACHE_SIZE 32
 
-  uint_t i = 0;
-  uint_t j = 0;
-
-  cache_inode_status_t cache_status;
-
-  int statfscalled = 0;
-  fsal_staticfsinfo_t * pstaticinfo = NULL ;
+typedef struct fattr4_encode_ctx__
+{
+  exportlist_t *pexport;
+  fsal_attrib_list_t *pattr;
+  compound_data_t *data;
+  nfs_fh4 *objFH;
+  fsal_staticfsinfo_t *pstaticinfo;
+  int statfscalled;
   fsal_dynamicfsinfo_t dynamicinfo;
+} fattr4_encode_ctx_t;
 
-  if( data != NULL )
-    pstaticinfo = data->pcontext->export_context->fe_static_fs_info;
-
-#ifdef _USE_NFS4_ACL
-  int rc;
-#endif
+/* Returns the number of bytes written, or -1 if the attribute can not
+ * be returned for this object */
+typedef int (*fattr4_encode_t) (fattr4_encode_ctx_t *ctx, char *buf);
 
-  /* basic init */
-  memset(attrvalsBuffer, 0, NFS4_ATTRVALS_BUFFLEN);
-#ifdef _USE_NFS4_1
-  memset((uint32_t *) attrmasklist, 0, FATTR4_FS_CHARSET_CAP * sizeof(uint32_t));
-  memset((uint32_t *) attrvalslist, 0, FATTR4_FS_CHARSET_CAP * sizeof(uint32_t));
-#else
-  memset((uint32_t *) attrmasklist, 0, FATTR4_MOUNTED_ON_FILEID * sizeof(uint32_t));
-  memset((uint32_t *) attrvalslist, 0, FATTR4_MOUNTED_ON_FILEID * sizeof(uint32_t));
-#endif
+typedef struct fattr4_plan_step__
+{
+  uint32_t attr;
+  fattr4_encode_t encode;       /* NULL for a block of constants */
+  u_int constoff;
+  u_int constlen;
+} fattr4_plan_step_t;
 
-  /* Convert the attribute bitmap to an attribute list */
-  nfs4_bitmap4_to_list(Bitmap, &attrmasklen, attrmasklist);
+typedef struct fattr4_plan__
+{
+  exportlist_t *pexport;
+  uint32_t generation;                  /* export_generation when built */
+  fsal_staticfsinfo_t *pstaticinfo;
+  uint32_t bitmap[FATTR4_PLAN_WORDS];   /* requested */
+  uint32_t result[FATTR4_PLAN_WORDS];   /* returned, if no encoder fails */
+  u_int nsteps;
+  fattr4_plan_step_t steps[FATTR4_PLAN_NATTRS];
+  u_int constlen;
+  char constants[];
+} fattr4_plan_t;
+
+static __thread fattr4_plan_t *fattr4_plan_cache[FATTR4_PLAN_CACHE_SIZE];
+
+static inline int fattr4_put_uint32(char *buf, uint32_t val)
+{
+  val = htonl(val);
+  memcpy(buf, &val, sizeof(val));
+  return sizeof(val);
+}
 
-  /* Once the bitmap has been converted to a list of attribute, manage each attribute */
-  LastOffset = 0;
-  j = 0;
+static inline int fattr4_put_uint64(char *buf, uint64_t val)
+{
+  val = nfs_htonl64(val);
+  memcpy(buf, &val, sizeof(val));
+  return sizeof(val);
+}
 
-  for(i = 0; i < attrmasklen; i++)
-    {
-      attribute_to_set = attrmasklist[i];
+static inline int fattr4_put_time(char *buf, int64_t seconds, uint32_t nseconds)
+{
+  int len = fattr4_put_uint64(buf, (uint64_t) seconds);
 
-#ifdef _USE_NFS4_1
-      if(attrmasklist[i] > FATTR4_FS_CHARSET_CAP)
-#else
-      if(attrmasklist[i] > FATTR4_MOUNTED_ON_FILEID)
-#endif
-        {
-          /* Erroneous value... skip */
-          continue;
-        }
-      LogFullDebug(COMPONENT_NFS_V4,
-                   "Flag for Operation (Regular) = %d|%d is ON,  name  = %s  reply_size = %d",
-                   attrmasklist[i],
-                   fattr4tab[attribute_to_set].val,
-                   fattr4tab[attribute_to_set].name,
-                   fattr4tab[attribute_to_set].size_fattr4);
+  return len + fattr4_put_uint32(buf + len, nseconds);
+}
 
-      op_attr_success = 0;
+static int fattr4_statfs(fattr4_encode_ctx_t *ctx)
+{
+  cache_inode_status_t cache_status;
 
-      /* compute the new size for the fattr4 reply */
-      /* This space is to be filled below in the big switch/case statement */
-      switch (attribute_to_set)
-        {
-        case FATTR4_SUPPORTED_ATTRS:
-          LastOffset += nfs4_supported_attrs_to_fattr(attrvalsBuffer + LastOffset);
+  if(ctx->statfscalled)
+    return 0;
 
-          /* This kind of operation is always a success */
-          op_attr_success = 1;
-          break;
+  if(cache_inode_statfs(ctx->data->current_entry,
+                        &ctx->dynamicinfo,
+                        ctx->data->pcontext,
+                        &cache_status) != CACHE_INODE_SUCCESS)
+    return -1;
 
-        case FATTR4_TYPE:
-          switch (pattr->type)
-            {
-            case FSAL_TYPE_FILE:
-            case FSAL_TYPE_XATTR:
-              file_type = htonl(NF4REG);        /* Regular file */
-              break;
+  ctx->statfscalled = 1;
+  return 0;
+}
 
-            case FSAL_TYPE_DIR:
-              file_type = htonl(NF4DIR);        /* Directory */
-              break;
+static int fattr4_encode_supported_attrs(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return nfs4_supported_attrs_to_fattr(buf);
+}
 
-            case FSAL_TYPE_BLK:
-              file_type = htonl(NF4BLK);        /* Special File - block device */
-              break;
+static int fattr4_encode_type(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  fattr4_type file_type = 0;
 
-            case FSAL_TYPE_CHR:
-              file_type = htonl(NF4CHR);        /* Special File - character device */
-              break;
+  switch (ctx->pattr->type)
+    {
+    case FSAL_TYPE_FILE:
+    case FSAL_TYPE_XATTR:
+      file_type = NF4REG;       /* Regular file */
+      break;
 
-            case FSAL_TYPE_LNK:
-              file_type = htonl(NF4LNK);        /* Symbolic Link */
-              break;
+    case FSAL_TYPE_DIR:
+      file_type = NF4DIR;       /* Directory */
+      break;
 
-            case FSAL_TYPE_SOCK:
-              file_type = htonl(NF4SOCK);       /* Special File - socket */
-              break;
+    case FSAL_TYPE_BLK:
+      file_type = NF4BLK;       /* Special File - block device */
+      break;
 
-            case FSAL_TYPE_FIFO:
-              file_type = htonl(NF4FIFO);       /* Special File - fifo */
-              break;
+    case FSAL_TYPE_CHR:
+      file_type = NF4CHR;       /* Special File - character device */
+      break;
 
-            case FSAL_TYPE_JUNCTION:
-              /* For wanting of a better solution */
-              file_type = 0;
-              op_attr_success = 0;      /* This was no success */
-              break;
-            }                   /* switch( pattr->type ) */
+    case FSAL_TYPE_LNK:
+      file_type = NF4LNK;       /* Symbolic Link */
+      break;
 
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_type, sizeof(fattr4_type));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+    case FSAL_TYPE_SOCK:
+      file_type = NF4SOCK;      /* Special File - socket */
+      break;
 
-        case FATTR4_FH_EXPIRE_TYPE:
-          /* For the moment, we handle only the persistent filehandle */
-          if(nfs_param.nfsv4_param.fh_expire == TRUE)
-            expire_type = htonl(FH4_VOLATILE_ANY);
-          else
-            expire_type = htonl(FH4_PERSISTENT);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &expire_type,
-                 sizeof(expire_type));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+    case FSAL_TYPE_FIFO:
+      file_type = NF4FIFO;      /* Special File - fifo */
+      break;
 
-        case FATTR4_CHANGE:
-          /* a value that change when the object change. I use the file's mtime */
-          memset(&file_change, 0, sizeof(changeid4));
-          file_change = nfs_htonl64((changeid4) pattr->change);
+    case FSAL_TYPE_JUNCTION:
+      /* For wanting of a better solution */
+      file_type = 0;
+      break;
+    }                           /* switch( pattr->type ) */
 
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_change,
-                 sizeof(fattr4_change));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  return fattr4_put_uint32(buf, file_type);
+}
 
-        case FATTR4_SIZE:
-          file_size = nfs_htonl64((fattr4_size) pattr->filesize);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_size, sizeof(fattr4_size));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_fh_expire_type(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* For the moment, we handle only the persistent filehandle */
+  if(nfs_param.nfsv4_param.fh_expire == TRUE)
+    return fattr4_put_uint32(buf, FH4_VOLATILE_ANY);
+  else
+    return fattr4_put_uint32(buf, FH4_PERSISTENT);
+}
 
-        case FATTR4_LINK_SUPPORT:
-          /* HPSS NameSpace support hard link */
-          link_support = htonl(TRUE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &link_support,
-                 sizeof(fattr4_link_support));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_change(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* a value that change when the object change */
+  return fattr4_put_uint64(buf, (changeid4) ctx->pattr->change);
+}
 
-        case FATTR4_SYMLINK_SUPPORT:
-          /* HPSS NameSpace support symbolic link */
-          symlink_support = htonl(TRUE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &symlink_support,
-                 sizeof(fattr4_symlink_support));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_size(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint64(buf, (fattr4_size) ctx->pattr->filesize);
+}
 
-        case FATTR4_NAMED_ATTR:
-          /* For this version of the binary, named attributes is not supported */
-          named_attr = htonl(FALSE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &named_attr,
-                 sizeof(fattr4_named_attr));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_true(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint32(buf, TRUE);
+}
 
-        case FATTR4_FSID:
-          /* The file system id (taken from the configuration file) */
-          fsid.major = nfs_htonl64((uint64_t) pexport->filesystem_id.major);
-          fsid.minor = nfs_htonl64((uint64_t) pexport->filesystem_id.minor);
+static int fattr4_encode_false(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint32(buf, FALSE);
+}
 
-          /* If object is a directory attached to a referral, then a different fsid is to be returned
-           * to tell the client that a different fs is being crossed */
-          if(nfs4_Is_Fh_Referral(objFH))
-            {
-              fsid.major = ~(nfs_htonl64((uint64_t) pexport->filesystem_id.major));
-              fsid.minor = ~(nfs_htonl64((uint64_t) pexport->filesystem_id.minor));
-            }
+static int fattr4_encode_fsid(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* The file system id (taken from the configuration file) */
+  uint64_t major = (uint64_t) ctx->pexport->filesystem_id.major;
+  uint64_t minor = (uint64_t) ctx->pexport->filesystem_id.minor;
+  int len;
 
-          memcpy((char *)(attrvalsBuffer + LastOffset), &fsid, sizeof(fattr4_fsid));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  /* If object is a directory attached to a referral, then a different fsid is to be returned
+   * to tell the client that a different fs is being crossed */
+  if(nfs4_Is_Fh_Referral(ctx->objFH))
+    {
+      major = ~major;
+      minor = ~minor;
+    }
 
-        case FATTR4_UNIQUE_HANDLES:
-          /* Filehandles are unique */
-          unique_handles = htonl(TRUE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &unique_handles,
-                 sizeof(fattr4_unique_handles));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  len = fattr4_put_uint64(buf, major);
+  return len + fattr4_put_uint64(buf + len, minor);
+}
 
-        case FATTR4_LEASE_TIME:
-          /* lease_time = htonl( (fattr4_lease_time)pstaticinfo->lease_time.seconds ) ; */
-          lease_time = htonl(nfs_param.nfsv4_param.lease_lifetime);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &lease_time,
-                 sizeof(fattr4_lease_time));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_lease_time(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint32(buf, nfs_param.nfsv4_param.lease_lifetime);
+}
 
-        case FATTR4_RDATTR_ERROR:
-          rdattr_error = htonl(NFS4_OK);        /* By default, READDIR call may use a different value */
-          memcpy((char *)(attrvalsBuffer + LastOffset), &rdattr_error,
-                 sizeof(fattr4_rdattr_error));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_rdattr_error(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* By default, READDIR call may use a different value */
+  return fattr4_put_uint32(buf, NFS4_OK);
+}
 
-        case FATTR4_ACL:
+static int fattr4_encode_acl(fattr4_encode_ctx_t *ctx, char *buf)
+{
 #ifdef _USE_NFS4_ACL
-          rc = nfs4_encode_acl(pattr, attrvalsBuffer, &LastOffset);
-          if(rc == 0)  /* uid/gid mapping to a string failure */
-            LogEvent(COMPONENT_NFS_V4, "Failed to map uid/gid to a string.");
+  u_int LastOffset = 0;
+
+  if(nfs4_encode_acl(ctx->pattr, buf, &LastOffset) == 0)
+    /* uid/gid mapping to a string failure */
+    LogEvent(COMPONENT_NFS_V4, "Failed to map uid/gid to a string.");
+  return LastOffset;
 #else
-          memset(&acl, 0, sizeof(acl));
-          memcpy((char *)(attrvalsBuffer + LastOffset), &acl, sizeof(fattr4_acl));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
+  memset(buf, 0, fattr4tab[FATTR4_ACL].size_fattr4);
+  return fattr4tab[FATTR4_ACL].size_fattr4;
 #endif
-          op_attr_success = 1;
-          break;
+}
 
-        case FATTR4_ACLSUPPORT:
+static int fattr4_encode_aclsupport(fattr4_encode_ctx_t *ctx, char *buf)
+{
 #ifdef _USE_NFS4_ACL
-          aclsupport = htonl(ACL4_SUPPORT_ALLOW_ACL | ACL4_SUPPORT_DENY_ACL);
+  return fattr4_put_uint32(buf, ACL4_SUPPORT_ALLOW_ACL | ACL4_SUPPORT_DENY_ACL);
 #else
-          aclsupport = htonl(0);
+  return fattr4_put_uint32(buf, 0);
 #endif
-          memcpy((char *)(attrvalsBuffer + LastOffset), &aclsupport,
-                 sizeof(fattr4_aclsupport));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+}
 
-        case FATTR4_ARCHIVE:
-          /* Archive flag is not supported */
-          archive = htonl(FALSE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &archive, sizeof(fattr4_archive));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_case_insensitive(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, ctx->pstaticinfo->case_insensitive);
+}
 
-        case FATTR4_CANSETTIME:
-          /* The time can be set on files */
-          cansettime = htonl(TRUE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &cansettime,
-                 sizeof(fattr4_cansettime));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_case_preserving(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, ctx->pstaticinfo->case_preserving);
+}
 
-        case FATTR4_CASE_INSENSITIVE:
-          case_insensitive = htonl(pstaticinfo->case_insensitive);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &case_insensitive,
-                 sizeof(fattr4_case_insensitive));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_chown_restricted(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, ctx->pstaticinfo->chown_restricted);
+}
 
-        case FATTR4_CASE_PRESERVING:
-          case_preserving = htonl(pstaticinfo->case_preserving);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &case_preserving,
-                 sizeof(fattr4_case_preserving));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_filehandle(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  u_int len = ctx->objFH->nfs_fh4_len;
+  u_int pad = (4 - (len % 4)) % 4;
+
+  /* Return the file handle, with XDR's 32-bit alignment */
+  fattr4_put_uint32(buf, len);
+  memcpy(buf + sizeof(uint32_t), ctx->objFH->nfs_fh4_val, len);
+  memset(buf + sizeof(uint32_t) + len, 0, pad);
+  return sizeof(uint32_t) + len + pad;
+}
 
-        case FATTR4_CHOWN_RESTRICTED:
-          /* chown is restricted to root */
-          chown_restricted = htonl(pstaticinfo->chown_restricted);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &chown_restricted,
-                 sizeof(fattr4_chown_restricted));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_fileid(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* The analog to the inode number. RFC3530 says "a number uniquely identifying the file within the filesystem" */
+  return fattr4_put_uint64(buf, ctx->pattr->fileid);
+}
 
-        case FATTR4_FILEHANDLE:
-          /* Return the file handle */
-          fhandle_len = htonl(objFH->nfs_fh4_len);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &fhandle_len, sizeof(u_int));
-          LastOffset += sizeof(u_int);
+static int fattr4_encode_files_avail(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.avail_files);
+}
 
-          memcpy((char *)(attrvalsBuffer + LastOffset),
-                 objFH->nfs_fh4_val, objFH->nfs_fh4_len);
-          LastOffset += objFH->nfs_fh4_len;
+static int fattr4_encode_files_free(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.free_files);
+}
 
-          /* XDR's special stuff for 32-bit alignment */
-          len = objFH->nfs_fh4_len;
-          off = 0;
-          while((len + off) % 4 != 0)
-            {
-              char c = '\0';
+static int fattr4_encode_files_total(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.total_files);
+}
 
-              off += 1;
-              memset((char *)(attrvalsBuffer + LastOffset), (int)c, 1);
-              LastOffset += 1;
-            }
+static int fattr4_encode_fs_locations(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  u_int len;
 
-          op_attr_success = 1;
-          break;
+  if(ctx->data->current_entry->type != DIRECTORY)
+    return -1;
 
-        case FATTR4_FILEID:
-          /* The analog to the inode number. RFC3530 says "a number uniquely identifying the file within the filesystem" 
-           * I use hpss_GetObjId to extract this information from the Name Server's handle */
-          file_id = nfs_htonl64(pattr->fileid);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_id, sizeof(fattr4_fileid));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  if(!nfs4_referral_str_To_Fattr_fs_location
+     (ctx->data->current_entry->object.dir.referral, buf, &len))
+    return -1;
 
-        case FATTR4_FILES_AVAIL:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          files_avail = nfs_htonl64((fattr4_files_avail) dynamicinfo.avail_files);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &files_avail,
-                 sizeof(fattr4_files_avail));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  return len;
+}
 
-        case FATTR4_FILES_FREE:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          files_free = nfs_htonl64((fattr4_files_avail) dynamicinfo.free_files);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &files_free,
-                 sizeof(fattr4_files_free));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_maxfilesize(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint64(buf, (fattr4_maxfilesize) FSINFO_MAX_FILESIZE);
+}
 
-        case FATTR4_FILES_TOTAL:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          files_total = nfs_htonl64((fattr4_files_avail) dynamicinfo.total_files);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &files_total,
-                 sizeof(fattr4_files_total));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_maxlink(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, ctx->pstaticinfo->maxlink);
+}
 
-        case FATTR4_FS_LOCATIONS:
-          if(data->current_entry->type != DIRECTORY)
-            {
-              op_attr_success = 0;
-              break;
-            }
+static int fattr4_encode_maxname(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, (fattr4_maxname) ctx->pstaticinfo->maxnamelen);
+}
 
-          if(!nfs4_referral_str_To_Fattr_fs_location
-             (data->current_entry->object.dir.referral, tmp_buff, &tmp_int))
-            {
-              op_attr_success = 0;
-              break;
-            }
+static int fattr4_encode_maxread(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* The exports.c MAXREAD-MAXWRITE code establishes these semantics: 
+   *  a. If you set the MaxWrite and MaxRead defaults in an export file
+   *  they apply. 
+   *  b. If you set the MaxWrite and MaxRead defaults in the main.conf
+   *  file they apply unless overwritten by an export file setting. 
+   *  c. If no settings are present in the export file or the main.conf
+   *  file then the defaults values in the FSAL apply. 
+   */
+  if(ctx->pexport == NULL)
+    return -1;
+  return fattr4_put_uint64(buf, (fattr4_maxread) ctx->pexport->MaxRead);
+}
 
-          memcpy((char *)(attrvalsBuffer + LastOffset), tmp_buff, tmp_int);
-          LastOffset += tmp_int;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_maxwrite(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pexport == NULL)
+    return -1;
+  return fattr4_put_uint64(buf, (fattr4_maxwrite) ctx->pexport->MaxWrite);
+}
 
-        case FATTR4_HIDDEN:
-          /* There are no hidden file in HPSS */
-          hidden = htonl(FALSE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &hidden, sizeof(fattr4_hidden));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_mode(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint32(buf, (fattr4_mode) fsal2unix_mode(ctx->pattr->mode));
+}
 
-        case FATTR4_HOMOGENEOUS:
-          /* Unix semantic is homogeneous (all objects have the same kind of attributes) */
-          homogeneous = htonl(TRUE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &homogeneous,
-                 sizeof(fattr4_homogeneous));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_no_trunc(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, ctx->pstaticinfo->no_trunc);
+}
 
-        case FATTR4_MAXFILESIZE:
-          max_filesize = nfs_htonl64((fattr4_maxfilesize) FSINFO_MAX_FILESIZE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &max_filesize,
-                 sizeof(fattr4_maxfilesize));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_numlinks(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_uint32(buf, (fattr4_numlinks) ctx->pattr->numlinks);
+}
 
-        case FATTR4_MAXLINK:
-          maxlink = htonl(pstaticinfo->maxlink);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &maxlink, sizeof(fattr4_maxlink));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_owner(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  fattr4_owner file_owner;
 
-        case FATTR4_MAXNAME:
-          maxname = htonl((fattr4_maxname) pstaticinfo->maxnamelen);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &maxname, sizeof(fattr4_maxname));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  /* Return the uid as a human readable utf8 string */
+  if(uid2utf8(ctx->pattr->owner, &file_owner) != 0)
+    return -1;
+  return nfs_tools_xdr_utf8(&file_owner, buf);
+}
 
-        case FATTR4_MAXREAD:
-          /* The exports.c MAXREAD-MAXWRITE code establishes these semantics: 
-           *  a. If you set the MaxWrite and MaxRead defaults in an export file
-           *  they apply. 
-           *  b. If you set the MaxWrite and MaxRead defaults in the main.conf
-           *  file they apply unless overwritten by an export file setting. 
-           *  c. If no settings are present in the export file or the main.conf
-           *  file then the defaults values in the FSAL apply. 
-           */
-
-          maxread = nfs_htonl64((fattr4_maxread) pexport->MaxRead );
-          memcpy((char *)(attrvalsBuffer + LastOffset), &maxread, sizeof(fattr4_maxread));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_owner_group(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  fattr4_owner_group file_owner_group;
 
-        case FATTR4_MAXWRITE:
-          maxwrite = nfs_htonl64((fattr4_maxwrite) pexport->MaxWrite );
-          memcpy((char *)(attrvalsBuffer + LastOffset), &maxwrite,
-                 sizeof(fattr4_maxwrite));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  /* Return the gid as a human-readable utf8 string */
+  if(gid2utf8(ctx->pattr->group, &file_owner_group) != 0)
+    return -1;
+  return nfs_tools_xdr_utf8(&file_owner_group, buf);
+}
 
-        case FATTR4_MIMETYPE:
-          memset((char *)(attrvalsBuffer + LastOffset), 0,
-                 sizeof(fattr4_mimetype));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 0;  /* No supported for the moment */
-          break;
+static int fattr4_encode_rawdev(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  int len = fattr4_put_uint32(buf, ctx->pattr->rawdev.major);
 
-        case FATTR4_MODE:
-          /* file_mode = (fattr4_mode) htonl(fsal2unix_mode(pattr->mode)) ; */
-          file_mode = htonl((fattr4_mode) fsal2unix_mode(pattr->mode));
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_mode, sizeof(fattr4_mode));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  return len + fattr4_put_uint32(buf + len, ctx->pattr->rawdev.minor);
+}
 
-        case FATTR4_NO_TRUNC:
-          /* File's names are not truncated, an error is returned is name is too long */
-          no_trunc = htonl(pstaticinfo->no_trunc);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &no_trunc,
-                 sizeof(fattr4_no_trunc));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_space_avail(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.avail_bytes);
+}
 
-        case FATTR4_NUMLINKS:
-          /* Reply the number of links found in vattr structure */
-          file_numlinks = htonl((fattr4_numlinks) pattr->numlinks);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_numlinks,
-                 sizeof(fattr4_numlinks));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_space_free(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.free_bytes);
+}
 
-        case FATTR4_OWNER:
-          /* Return the uid as a human readable utf8 string */
-          if(uid2utf8(pattr->owner, &file_owner) == 0)
-            {
-              LastOffset += nfs_tools_xdr_utf8(&file_owner,
-                                               (char *)(attrvalsBuffer + LastOffset));
-              op_attr_success = 1;
-            }
-          else
-            op_attr_success = 0;
-          break;
+static int fattr4_encode_space_total(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(fattr4_statfs(ctx) != 0)
+    return -1;
+  return fattr4_put_uint64(buf, ctx->dynamicinfo.total_bytes);
+}
 
-        case FATTR4_OWNER_GROUP:
-          /* Return the gid as a human-readable utf8 string */
-          if(gid2utf8(pattr->group, &file_owner_group) == 0)
-            {
-              LastOffset += nfs_tools_xdr_utf8(&file_owner_group,
-                                               (char *)(attrvalsBuffer + LastOffset));
-              op_attr_success = 1;
-            }
-          else
-            op_attr_success = 0;
-          break;
+static int fattr4_encode_space_used(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* the number of bytes on the filesystem used by the object, which is slightly different 
+   * from the file's size (there can be hole in the file) */
+  return fattr4_put_uint64(buf, (fattr4_space_used) ctx->pattr->spaceused);
+}
 
-        case FATTR4_QUOTA_AVAIL_HARD:
-          quota_avail_hard = nfs_htonl64((fattr4_quota_avail_hard) NFS_V4_MAX_QUOTA_HARD);    /** @todo: not the right answer, actual quotas should be implemented */
-          memcpy((char *)(attrvalsBuffer + LastOffset), &quota_avail_hard,
-                 sizeof(fattr4_quota_avail_hard));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 0;
-          break;
+static int fattr4_encode_time_access(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_time(buf, ctx->pattr->atime.seconds,
+                         ctx->pattr->atime.nseconds);
+}
 
-        case FATTR4_QUOTA_AVAIL_SOFT:
-          quota_avail_soft = nfs_htonl64((fattr4_quota_avail_soft) NFS_V4_MAX_QUOTA_SOFT);    /** @todo: not the right answer, actual quotas should be implemented */
-          memcpy((char *)(attrvalsBuffer + LastOffset), &quota_avail_soft,
-                 sizeof(fattr4_quota_avail_soft));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 0;
-          break;
+static int fattr4_encode_time_access_set(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fsal_time_to_settime4(&ctx->pattr->atime, buf);
+}
 
-        case FATTR4_QUOTA_USED:
-          quota_used = nfs_htonl64((fattr4_quota_used) pattr->filesize);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &quota_used,
-                 sizeof(fattr4_quota_used));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 0;
-          break;
+static int fattr4_encode_time_create(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* No time create nor time backup, return unix's beginning of time */
+  return fattr4_put_time(buf, 0, 0);
+}
 
-        case FATTR4_RAWDEV:
-          rawdev.specdata1 = htonl(pattr->rawdev.major);
-          rawdev.specdata2 = htonl(pattr->rawdev.minor);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &rawdev, sizeof(fattr4_rawdev));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_time_delta(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  /* According to RFC3530, this is "the smallest usefull server time granularity", I set this to 1s */
+  return fattr4_put_time(buf, 1, 0);
+}
 
-        case FATTR4_SPACE_AVAIL:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          space_avail = nfs_htonl64((fattr4_space_avail) dynamicinfo.avail_bytes);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &space_avail,
-                 sizeof(fattr4_space_avail));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_time_metadata(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_time(buf, ctx->pattr->ctime.seconds,
+                         ctx->pattr->ctime.nseconds);
+}
 
-        case FATTR4_SPACE_FREE:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          space_free = nfs_htonl64((fattr4_space_free) dynamicinfo.free_bytes);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &space_free,
-                 sizeof(fattr4_space_free));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_time_modify(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fattr4_put_time(buf, ctx->pattr->mtime.seconds,
+                         ctx->pattr->mtime.nseconds);
+}
 
-        case FATTR4_SPACE_TOTAL:
-          if(!statfscalled)
-            {
-              if((cache_status = cache_inode_statfs(data->current_entry,
-                                                    &dynamicinfo,
-                                                    data->pcontext,
-                                                    &cache_status)) !=
-                 CACHE_INODE_SUCCESS)
-                {
-                  op_attr_success = 0;
-                  break;
-                }
-              else
-                statfscalled = 1;
-            }
-          space_total = nfs_htonl64((fattr4_space_total) dynamicinfo.total_bytes);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &space_total,
-                 sizeof(fattr4_space_total));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_time_modify_set(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  return fsal_time_to_settime4(&ctx->pattr->mtime, buf);
+}
 
-        case FATTR4_SPACE_USED:
-          /* the number of bytes on the filesystem used by the object, which is slightly different 
-           * from the file's size (there can be hole in the file) */
-          file_space_used = nfs_htonl64((fattr4_space_used) pattr->spaceused);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_space_used,
-                 sizeof(fattr4_space_used));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+#if defined(_USE_NFS4_1) && defined(_PNFS_MDS)
+static int fattr4_encode_fs_layout_types(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  u_int len, k;
 
-        case FATTR4_SYSTEM:
-          /* This is not a windows system File-System with respect to the regarding API */
-          system = htonl(FALSE);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &system, sizeof(fattr4_system));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  if(ctx->pstaticinfo == NULL)
+    return -1;
 
-        case FATTR4_TIME_ACCESS:
-          /* This will contain the object's time os last access, the 'atime' in the Unix semantic */
-          memset(&(time_access.seconds), 0, sizeof(int64_t));
-          time_access.seconds = nfs_htonl64((int64_t) pattr->atime.seconds);
-          time_access.nseconds = htonl((uint32_t) pattr->atime.nseconds);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &time_access,
-                 fattr4tab[attribute_to_set].size_fattr4);
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  len = fattr4_put_uint32(buf, ctx->pstaticinfo->fs_layout_types
+                          .fattr4_fs_layout_types_len);
+  for(k = 0; k < (ctx->pstaticinfo->fs_layout_types
+                  .fattr4_fs_layout_types_len); k++)
+    len += fattr4_put_uint32(buf + len, (ctx->pstaticinfo->fs_layout_types
+                                         .fattr4_fs_layout_types_val[k]));
+  return len;
+}
 
-        case FATTR4_TIME_ACCESS_SET:
-          LastOffset += fsal_time_to_settime4(&pattr->atime,
-                                              attrvalsBuffer + LastOffset);
-          op_attr_success = 1;
-          break;
+static int fattr4_encode_layout_blksize(fattr4_encode_ctx_t *ctx, char *buf)
+{
+  if(ctx->pstaticinfo == NULL)
+    return -1;
+  return fattr4_put_uint32(buf, (fattr4_layout_blksize) ctx->pstaticinfo->layout_blksize);
+}
+#endif
 
-        case FATTR4_TIME_BACKUP:
-          /* No time backup, return unix's beginning of time */
-        case FATTR4_TIME_CREATE:
-          /* No time create, return unix's beginning of time */
-          time_create.seconds = nfs_htonl64(0LL);
-          time_create.nseconds = htonl(0);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &time_create,
-                 fattr4tab[attribute_to_set].size_fattr4);
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+/* Attributes with no encoder (mimetype, quotas...) are never returned */
+static const struct
+{
+  fattr4_encode_t encode;
+  int constant;                 /* only depends on the export */
+} fattr4_encoders[FATTR4_PLAN_NATTRS] =
+{
+  [FATTR4_SUPPORTED_ATTRS] = {fattr4_encode_supported_attrs, TRUE},
+  [FATTR4_TYPE] = {fattr4_encode_type, FALSE},
+  [FATTR4_FH_EXPIRE_TYPE] = {fattr4_encode_fh_expire_type, TRUE},
+  [FATTR4_CHANGE] = {fattr4_encode_change, FALSE},
+  [FATTR4_SIZE] = {fattr4_encode_size, FALSE},
+  [FATTR4_LINK_SUPPORT] = {fattr4_encode_true, TRUE},
+  [FATTR4_SYMLINK_SUPPORT] = {fattr4_encode_true, TRUE},
+  [FATTR4_NAMED_ATTR] = {fattr4_encode_false, TRUE},
+  [FATTR4_FSID] = {fattr4_encode_fsid, FALSE},
+  [FATTR4_UNIQUE_HANDLES] = {fattr4_encode_true, TRUE},
+  [FATTR4_LEASE_TIME] = {fattr4_encode_lease_time, TRUE},
+  [FATTR4_RDATTR_ERROR] = {fattr4_encode_rdattr_error, TRUE},
+#ifdef _USE_NFS4_ACL
+  [FATTR4_ACL] = {fattr4_encode_acl, FALSE},
+#else
+  [FATTR4_ACL] = {fattr4_encode_acl, TRUE},
+#endif
+  [FATTR4_ACLSUPPORT] = {fattr4_encode_aclsupport, TRUE},
+  [FATTR4_ARCHIVE] = {fattr4_encode_false, TRUE},
+  [FATTR4_CANSETTIME] = {fattr4_encode_true, TRUE},
+  [FATTR4_CASE_INSENSITIVE] = {fattr4_encode_case_insensitive, TRUE},
+  [FATTR4_CASE_PRESERVING] = {fattr4_encode_case_preserving, TRUE},
+  [FATTR4_CHOWN_RESTRICTED] = {fattr4_encode_chown_restricted, TRUE},
+  [FATTR4_FILEHANDLE] = {fattr4_encode_filehandle, FALSE},
+  [FATTR4_FILEID] = {fattr4_encode_fileid, FALSE},
+  [FATTR4_FILES_AVAIL] = {fattr4_encode_files_avail, FALSE},
+  [FATTR4_FILES_FREE] = {fattr4_encode_files_free, FALSE},
+  [FATTR4_FILES_TOTAL] = {fattr4_encode_files_total, FALSE},
+  [FATTR4_FS_LOCATIONS] = {fattr4_encode_fs_locations, FALSE},
+  [FATTR4_HIDDEN] = {fattr4_encode_false, TRUE},
+  [FATTR4_HOMOGENEOUS] = {fattr4_encode_true, TRUE},
+  [FATTR4_MAXFILESIZE] = {fattr4_encode_maxfilesize, TRUE},
+  [FATTR4_MAXLINK] = {fattr4_encode_maxlink, TRUE},
+  [FATTR4_MAXNAME] = {fattr4_encode_maxname, TRUE},
+  [FATTR4_MAXREAD] = {fattr4_encode_maxread, TRUE},
+  [FATTR4_MAXWRITE] = {fattr4_encode_maxwrite, TRUE},
+  [FATTR4_MODE] = {fattr4_encode_mode, FALSE},
+  [FATTR4_NO_TRUNC] = {fattr4_encode_no_trunc, TRUE},
+  [FATTR4_NUMLINKS] = {fattr4_encode_numlinks, FALSE},
+  [FATTR4_OWNER] = {fattr4_encode_owner, FALSE},
+  [FATTR4_OWNER_GROUP] = {fattr4_encode_owner_group, FALSE},
+  [FATTR4_RAWDEV] = {fattr4_encode_rawdev, FALSE},
+  [FATTR4_SPACE_AVAIL] = {fattr4_encode_space_avail, FALSE},
+  [FATTR4_SPACE_FREE] = {fattr4_encode_space_free, FALSE},
+  [FATTR4_SPACE_TOTAL] = {fattr4_encode_space_total, FALSE},
+  [FATTR4_SPACE_USED] = {fattr4_encode_space_used, FALSE},
+  [FATTR4_SYSTEM] = {fattr4_encode_false, TRUE},
+  [FATTR4_TIME_ACCESS] = {fattr4_encode_time_access, FALSE},
+  [FATTR4_TIME_ACCESS_SET] = {fattr4_encode_time_access_set, FALSE},
+  [FATTR4_TIME_BACKUP] = {fattr4_encode_time_create, TRUE},
+  [FATTR4_TIME_CREATE] = {fattr4_encode_time_create, TRUE},
+  [FATTR4_TIME_DELTA] = {fattr4_encode_time_delta, TRUE},
+  [FATTR4_TIME_METADATA] = {fattr4_encode_time_metadata, FALSE},
+  [FATTR4_TIME_MODIFY] = {fattr4_encode_time_modify, FALSE},
+  [FATTR4_TIME_MODIFY_SET] = {fattr4_encode_time_modify_set, FALSE},
+  [FATTR4_MOUNTED_ON_FILEID] = {fattr4_encode_fileid, FALSE},
+#if defined(_USE_NFS4_1) && defined(_PNFS_MDS)
+  [FATTR4_FS_LAYOUT_TYPES] = {fattr4_encode_fs_layout_types, TRUE},
+  [FATTR4_LAYOUT_BLKSIZE] = {fattr4_encode_layout_blksize, TRUE},
+#endif
+};
 
-        case FATTR4_TIME_DELTA:
-          /* According to RFC3530, this is "the smallest usefull server time granularity", I set this to 1s */
-          time_delta.seconds = nfs_htonl64(1LL);
-          time_delta.nseconds = htonl(0);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &time_delta,
-                 fattr4tab[attribute_to_set].size_fattr4);
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+static fattr4_plan_t *nfs4_fattr_plan_build(exportlist_t *pexport,
+                                            fsal_staticfsinfo_t *pstaticinfo,
+                                            uint32_t *bitmap_val)
+{
+  fattr4_encode_ctx_t ctx;
+  fattr4_plan_t *plan;
+  fattr4_plan_step_t steps[FATTR4_PLAN_NATTRS];
+  fattr4_plan_step_t *step = NULL;
+  uint32_t result[FATTR4_PLAN_WORDS] = { 0, 0, 0 };
+  char constants[2 * NFS4_ATTRVALS_BUFFLEN];
+  uint32_t attrmasklist[FATTR4_PLAN_NATTRS];
+  uint32_t attrmasklen = 0;
+  uint32_t attr;
+  bitmap4 bitmap;
+  u_int nsteps = 0, constlen = 0, i;
+  int len;
 
-        case FATTR4_TIME_METADATA:
-          /* The time for the last metadata operation, the ctime in the unix's semantic */
-          memset(&(time_metadata.seconds), 0, sizeof(int64_t));
-          time_metadata.seconds = nfs_htonl64((int64_t) pattr->ctime.seconds);
-          time_metadata.nseconds = htonl(pattr->ctime.nseconds);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &time_metadata,
-                 fattr4tab[attribute_to_set].size_fattr4);
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.pexport = pexport;
+  ctx.pstaticinfo = pstaticinfo;
 
-        case FATTR4_TIME_MODIFY:
-          /* The time for the last modify operation, the mtime in the unix's semantic */
-          memset(&(time_modify.seconds), 0, sizeof(int64_t));
-          time_modify.seconds = nfs_htonl64((int64_t) pattr->mtime.seconds);
-          time_modify.nseconds = htonl(pattr->mtime.nseconds);
+  /* Convert the attribute bitmap to an attribute list */
+  bitmap.bitmap4_len = FATTR4_PLAN_WORDS;
+  bitmap.bitmap4_val = bitmap_val;
+  nfs4_bitmap4_to_list(&bitmap, &attrmasklen, attrmasklist);
 
-          memcpy((char *)(attrvalsBuffer + LastOffset), &time_modify,
-                 fattr4tab[attribute_to_set].size_fattr4);
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+  for(i = 0; i < attrmasklen; i++)
+    {
+      attr = attrmasklist[i];
 
-        case FATTR4_TIME_MODIFY_SET:
-          LastOffset += fsal_time_to_settime4(&pattr->mtime,
-                                              attrvalsBuffer + LastOffset);
-          op_attr_success = 1;
-          break;
+      if(fattr4_encoders[attr].encode == NULL)
+        {
+          LogFullDebug(COMPONENT_NFS_V4,
+                       " unsupported value for attributes bitmap = %u", attr);
+          continue;
+        }
 
-        case FATTR4_MOUNTED_ON_FILEID:
-          file_id = nfs_htonl64(pattr->fileid);
-          memcpy((char *)(attrvalsBuffer + LastOffset), &file_id, sizeof(fattr4_fileid));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
-          op_attr_success = 1;
-          break;
+      LogFullDebug(COMPONENT_NFS_V4,
+                   "Flag for Operation (Regular) = %d|%d is ON,  name  = %s  reply_size = %d",
+                   attr, fattr4tab[attr].val, fattr4tab[attr].name,
+                   fattr4tab[attr].size_fattr4);
 
-#ifdef _USE_NFS4_1
-        case FATTR4_FS_LAYOUT_TYPES:
-#ifdef _PNFS_MDS
-          *((uint32_t*)(attrvalsBuffer+LastOffset))
-            = htonl(pstaticinfo->fs_layout_types
-                    .fattr4_fs_layout_types_len);
+      if(fattr4_encoders[attr].constant)
+        {
+          len = fattr4_encoders[attr].encode(&ctx, constants + constlen);
+          if(len < 0)
+            continue;
+
+          /* A constant is a few words, the whole set fits in a reply */
+          constlen += len;
+          if(constlen > NFS4_ATTRVALS_BUFFLEN)
+            return NULL;
 
-          LastOffset += sizeof(uint32_t);
-          for (k = 0; k < (pstaticinfo->fs_layout_types
-                           .fattr4_fs_layout_types_len); k++)
+          /* Consecutive constants are copied in one go */
+          if(step == NULL || step->encode != NULL)
             {
-              *((layouttype4*)(attrvalsBuffer+LastOffset))
-                = htonl((pstaticinfo->fs_layout_types
-                         .fattr4_fs_layout_types_val[k]));
-              LastOffset += sizeof(layouttype4);
+              step = &steps[nsteps++];
+              step->attr = attr;
+              step->encode = NULL;
+              step->constoff = constlen - len;
+              step->constlen = 0;
             }
+          step->constlen += len;
+        }
+      else
+        {
+          step = &steps[nsteps++];
+          step->attr = attr;
+          step->encode = fattr4_encoders[attr].encode;
+          step->constoff = 0;
+          step->constlen = 0;
+        }
 
-          op_attr_success = 1;
-          break;
-#endif /* _PNFS_MDS */
+      result[attr / 32] |= (1U << (attr % 32));
+    }
 
-#ifdef _PNFS_MDS
-        case FATTR4_LAYOUT_BLKSIZE:
-          layout_blksize
-            = htonl((fattr4_layout_blksize) pstaticinfo->layout_blksize);
-          memcpy((char *)(attrvalsBuffer + LastOffset),
-                 &layout_blksize, sizeof(fattr4_layout_blksize));
-          LastOffset += fattr4tab[attribute_to_set].size_fattr4;
+  plan = gsh_malloc(sizeof(fattr4_plan_t) + constlen);
+  if(plan == NULL)
+    return NULL;
+
+  plan->pexport = pexport;
+  plan->generation = export_generation;
+  plan->pstaticinfo = pstaticinfo;
+  memcpy(plan->bitmap, bitmap_val, sizeof(plan->bitmap));
+  memcpy(plan->result, result, sizeof(plan->result));
+  plan->nsteps = nsteps;
+  memcpy(plan->steps, steps, nsteps * sizeof(fattr4_plan_step_t));
+  plan->constlen = constlen;
+  memcpy(plan->constants, constants, constlen);
+
+  return plan;
+}
 
-          op_attr_success = 1;
-          break;
-#endif /* _PNFS_MDS */
-#endif /* _USE_NFS4_1 */
+static fattr4_plan_t *nfs4_fattr_plan_get(exportlist_t *pexport,
+                                          fsal_staticfsinfo_t *pstaticinfo,
+                                          bitmap4 *Bitmap)
+{
+  uint32_t bitmap_val[FATTR4_PLAN_WORDS] = { 0, 0, 0 };
+  fattr4_plan_t *plan;
+  unsigned long h;
+  u_int i;
+
+  /* Words past the last attribute the server knows are ignored */
+  for(i = 0; i < Bitmap->bitmap4_len && i < FATTR4_PLAN_WORDS; i++)
+    bitmap_val[i] = Bitmap->bitmap4_val[i];
+
+  h = (unsigned long)pexport / sizeof(exportlist_t);
+  for(i = 0; i < FATTR4_PLAN_WORDS; i++)
+    h = h * 31 + bitmap_val[i];
+  h %= FATTR4_PLAN_CACHE_SIZE;
+
+  plan = fattr4_plan_cache[h];
+  if(plan != NULL &&
+     plan->pexport == pexport &&
+     plan->generation == export_generation &&
+     plan->pstaticinfo == pstaticinfo &&
+     memcmp(plan->bitmap, bitmap_val, sizeof(bitmap_val)) == 0)
+    return plan;
+
+  plan = nfs4_fattr_plan_build(pexport, pstaticinfo, bitmap_val);
+  if(plan == NULL)
+    return NULL;
+
+  /* The cache is per thread, nobody else can be using the old plan */
+  if(fattr4_plan_cache[h] != NULL)
+    gsh_free(fattr4_plan_cache[h]);
+  fattr4_plan_cache[h] = plan;
+
+  return plan;
+}
 
-        default:
-          LogFullDebug(COMPONENT_NFS_V4,
-                       " unsupported value for attributes bitmap = %u", attribute_to_set);
+/**
+ * nfs4_fattr_plan_thread_shutdown: frees the encoding plans cached by
+ * the calling thread, before it exits.
+ */
+void nfs4_fattr_plan_thread_shutdown(void)
+{
+  u_int i;
+
+  for(i = 0; i < FATTR4_PLAN_CACHE_SIZE; i++)
+    if(fattr4_plan_cache[i] != NULL)
+      {
+        gsh_free(fattr4_plan_cache[i]);
+        fattr4_plan_cache[i] = NULL;
+      }
+}
 
-          op_attr_success = 0;
-          break;
-        }                       /* switch( attribute_to_set ) */
+/**
+ *
+ * nfs4_FSALattr_To_Fattr: Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * Converts FSAL Attributes to NFSv4 Fattr buffer, by running the
+ * encoding plan cached for this bitmap and this export.
+ *
+ * @param pexport [IN]  the related export entry.
+ * @param pattr   [IN]  pointer to FSAL attributes.
+ * @param Fattr   [OUT] NFSv4 Fattr buffer
+ *		  Memory for bitmap_val and attr_val is dynamically allocated,
+ *		  caller is responsible for freeing it.
+ * @param data    [IN]  NFSv4 compoud request's data.
+ * @param objFH   [IN]  The NFSv4 filehandle of the object whose
+ *                      attributes are requested
+ * @param Bitmap  [IN]  Bitmap of attributes being requested
+ *
+ * @return -1 if failed, 0 if successful.
+ *
+ */
 
-      /* Increase the Offset for the next operation if this was a success */
-      if(op_attr_success)
-        {
-          /* Set the returned bitmask */
-          attrvalslist[j] = attribute_to_set;
-          j += 1;
+int nfs4_FSALattr_To_Fattr(exportlist_t *pexport,
+                           fsal_attrib_list_t *pattr,
+                           fattr4 *Fattr,
+                           compound_data_t *data,
+                           nfs_fh4 *objFH,
+                           bitmap4 *Bitmap)
+{
+  fattr4_encode_ctx_t ctx;
+  fattr4_plan_t *plan;
+  fattr4_plan_step_t *step;
+  uint32_t bitmap_val[FATTR4_PLAN_WORDS];
+  char attrvalsBuffer[ATTRVALS_BUFFLEN];
+  u_int LastOffset = 0;
+  u_int i;
+  int len;
+
+  ctx.pexport = pexport;
+  ctx.pattr = pattr;
+  ctx.data = data;
+  ctx.objFH = objFH;
+  ctx.pstaticinfo = NULL;
+  ctx.statfscalled = 0;
+
+  if(data != NULL)
+    ctx.pstaticinfo = data->pcontext->export_context->fe_static_fs_info;
+
+  plan = nfs4_fattr_plan_get(pexport, ctx.pstaticinfo, Bitmap);
+  if(plan == NULL)
+    return -1;
+
+  memcpy(bitmap_val, plan->result, sizeof(bitmap_val));
+
+  for(i = 0; i < plan->nsteps; i++)
+    {
+      step = &plan->steps[i];
 
-          /* Be carefull not to get out of attrvalsBuffer */
-          if(LastOffset > ATTRVALS_BUFFLEN)
+      if(step->encode == NULL)
+        {
+          if(LastOffset + step->constlen > ATTRVALS_BUFFLEN)
             return -1;
+          memcpy(attrvalsBuffer + LastOffset, plan->constants + step->constoff,
+                 step->constlen);
+          LastOffset += step->constlen;
+          continue;
         }
 
-    }                           /* for i */
+      len = step->encode(&ctx, attrvalsBuffer + LastOffset);
+      if(len < 0)
+        {
+          /* Not returned for this object */
+          bitmap_val[step->attr / 32] &= ~(1U << (step->attr % 32));
+          continue;
+        }
+      LastOffset += len;
+
+      /* Be carefull not to get out of attrvalsBuffer */
+      if(LastOffset > ATTRVALS_BUFFLEN)
+        return -1;
+    }
 
-  return nfs4_Fattr_Fill(Fattr, j, attrvalslist, LastOffset, attrvalsBuffer);
+  return nfs4_Fattr_Fill_Bitmap(Fattr, bitmap_val, LastOffset, attrvalsBuffer);
 }                               /* nfs4_FSALattr_To_Fattr */
 
 /**
@@ -4251,11 +4186,11 @@ int nfs4_MakeCred(compound_data_t * data)
      == FALSE)
     return NFS4ERR_WRONGSEC;
 
-  if(nfs_check_anon(&related_client, data->pexport, &user_credentials) == FALSE
-     || nfs_build_fsal_context(data->reqp,
-                            data->pexport,
-                            data->pcontext,
-                            &user_credentials) == FALSE)
+  if(nfs_make_fsal_context(data->reqp,
+                           &related_client,
+                           data->pexport,
+                           data->pcontext,
+                           &user_credentials) == FALSE)
     return NFS4ERR_WRONGSEC;
 
   return NFS4_OK;
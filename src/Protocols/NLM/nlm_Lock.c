@@ -108,6 +108,10 @@ int nlm4_Lock(nfs_arg_t            * parg,
       return NFS_REQ_OK;
     }
 
+  /* NLM clients are still coming back, keep the grace period */
+  if(grace)
+    nfs_grace_nlm_reclaim();
+
   rc = nlm_process_parameters(preq,
                               arg->exclusive,
                               &arg->alock,
@@ -97,6 +97,10 @@ int nlm4_Share(nfs_arg_t            * parg,
       return NFS_REQ_OK;
     }
 
+  /* NLM clients are still coming back, keep the grace period */
+  if(grace)
+    nfs_grace_nlm_reclaim();
+
   rc = nlm_process_share_parms(preq,
                                &arg->share,
                                &pentry,
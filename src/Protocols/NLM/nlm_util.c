@@ -172,58 +172,76 @@ void free_grant_arg(state_async_queue_t *arg)
   gsh_free(arg);
 }
 
-/**
- *
- * nlm4_send_grant_msg: Send NLMPROC4_GRANTED_MSG
+/*
+ * NLMPROC4_GRANTED_MSG pipeline
  *
- * This runs in the nlm_asyn_thread context.
+ * Grants are queued on nlm_grant_queue and sent by nlm4_send_grants on
+ * the state async thread, all of those pending at once and grouped by
+ * client, so that a client that can not be reached costs one connection
+ * attempt per batch rather than one per lock.  Nothing waits for the
+ * NLMPROC4_GRANTED_RES: nlm4_check_grant runs once the client has had
+ * time to answer, sends the grant again with a growing delay, and in the
+ * end releases the lock so that the client may ask for it again.
  */
-static void nlm4_send_grant_msg(state_async_queue_t *arg)
+#define NLM_GRANT_MAX_SEND   3
+#define NLM_GRANT_RES_DELAY  2  /* seconds, doubled at each send */
+
+static pthread_mutex_t     nlm_grant_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head   nlm_grant_queue = GLIST_HEAD_INIT(nlm_grant_queue);
+static bool_t              nlm_grant_flush_queued;
+static state_async_queue_t nlm_grant_flush;
+
+static void nlm4_send_grants(state_async_queue_t *unused);
+
+static state_status_t nlm4_queue_grant(state_async_queue_t *arg)
+{
+  state_status_t status = STATE_SUCCESS;
+
+  P(nlm_grant_mutex);
+
+  glist_add_tail(&nlm_grant_queue, &arg->state_async_glist);
+
+  if(!nlm_grant_flush_queued)
+    {
+      nlm_grant_flush.state_async_func = nlm4_send_grants;
+      status = state_async_schedule(&nlm_grant_flush);
+      if(status == STATE_SUCCESS)
+        nlm_grant_flush_queued = TRUE;
+      else
+        glist_del(&arg->state_async_glist);
+    }
+
+  V(nlm_grant_mutex);
+
+  return status;
+}
+
+/* The client did not take the lock, release it. */
+static void nlm4_grant_failed(state_async_queue_t *arg)
 {
-  int                      retval;
   char                     buffer[1024];
   state_status_t           state_status = STATE_SUCCESS;
   state_cookie_entry_t   * cookie_entry;
   fsal_op_context_t        context, * pcontext = &context;
   state_nlm_async_data_t * nlm_arg = &arg->state_async_data.state_nlm_async_data;
+  bool_t                   found;
 
-  if(isDebug(COMPONENT_NLM))
-    {
-      netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.cookie,
-                       buffer, sizeof(buffer));
+  netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.cookie,
+                   buffer, sizeof(buffer));
 
-      LogDebug(COMPONENT_NLM,
-               "Sending GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
-               arg, nlm_arg->nlm_async_args.nlm_async_grant.alock.svid,
-               (unsigned long long) nlm_arg->nlm_async_args.nlm_async_grant.alock.l_offset,
-               (unsigned long long) nlm_arg->nlm_async_args.nlm_async_grant.alock.l_len,
-               buffer);
-    }
+  LogMajor(COMPONENT_NLM,
+           "GRANTED_MSG not accepted after %u attempts. Removing the blocking lock cookie=%s",
+           nlm_arg->nlm_async_sends, buffer);
 
-  retval = nlm_send_async(NLMPROC4_GRANTED_MSG,
-                          nlm_arg->nlm_async_host,
-                          &(nlm_arg->nlm_async_args.nlm_async_grant),
-                          nlm_arg->nlm_async_key);
+  found = state_find_grant(nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_bytes,
+                           nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_len,
+                           &cookie_entry,
+                           &state_status) == STATE_SUCCESS;
 
   dec_nlm_client_ref(nlm_arg->nlm_async_host);
   free_grant_arg(arg);
 
-  /* If success, we are done. */
-  if(retval == RPC_SUCCESS)
-    return;
-
-  /*
-   * We are not able call granted callback. Some client may retry
-   * the lock again. So remove the existing blocked nlm entry
-   */
-  LogMajor(COMPONENT_NLM,
-           "GRANTED_MSG RPC call failed with return code %d. Removing the blocking lock",
-           retval);
-
-  if(state_find_grant(nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_bytes,
-                      nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_len,
-                      &cookie_entry,
-                      &state_status) != STATE_SUCCESS)
+  if(!found)
     {
       /* This must be an old NLM_GRANTED_RES */
       LogFullDebug(COMPONENT_NLM,
@@ -259,6 +277,129 @@ static void nlm4_send_grant_msg(state_async_queue_t *arg)
     }
 }
 
+/**
+ *
+ * nlm4_check_grant: See whether the client answered a GRANTED_MSG
+ *
+ * This runs in the state async thread context.
+ */
+static void nlm4_check_grant(state_async_queue_t *arg)
+{
+  state_nlm_async_data_t * nlm_arg = &arg->state_async_data.state_nlm_async_data;
+
+  /* NLMPROC4_GRANTED_RES, or a cancel or unlock, took the cookie */
+  if(!state_grant_pending(nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_bytes,
+                          nlm_arg->nlm_async_args.nlm_async_grant.cookie.n_len))
+    {
+      dec_nlm_client_ref(nlm_arg->nlm_async_host);
+      free_grant_arg(arg);
+      return;
+    }
+
+  if(nlm_arg->nlm_async_sends < NLM_GRANT_MAX_SEND &&
+     nlm4_queue_grant(arg) == STATE_SUCCESS)
+    return;
+
+  nlm4_grant_failed(arg);
+}
+
+/**
+ *
+ * nlm4_send_grant_msg: Send NLMPROC4_GRANTED_MSG
+ *
+ * This runs in the state async thread context.
+ */
+static int nlm4_send_grant_msg(state_async_queue_t *arg)
+{
+  char                     buffer[1024];
+  state_nlm_async_data_t * nlm_arg = &arg->state_async_data.state_nlm_async_data;
+
+  if(isDebug(COMPONENT_NLM))
+    {
+      netobj_to_string(&nlm_arg->nlm_async_args.nlm_async_grant.cookie,
+                       buffer, sizeof(buffer));
+
+      LogDebug(COMPONENT_NLM,
+               "Sending GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
+               arg, nlm_arg->nlm_async_args.nlm_async_grant.alock.svid,
+               (unsigned long long) nlm_arg->nlm_async_args.nlm_async_grant.alock.l_offset,
+               (unsigned long long) nlm_arg->nlm_async_args.nlm_async_grant.alock.l_len,
+               buffer);
+    }
+
+  /* The answer comes as NLMPROC4_GRANTED_RES, nlm4_check_grant looks for it */
+  return nlm_send_async(NLMPROC4_GRANTED_MSG,
+                        nlm_arg->nlm_async_host,
+                        &(nlm_arg->nlm_async_args.nlm_async_grant),
+                        NULL);
+}
+
+/**
+ *
+ * nlm4_send_grants: Send the queued NLMPROC4_GRANTED_MSG, client by client
+ *
+ * This runs in the state async thread context.
+ */
+static void nlm4_send_grants(state_async_queue_t *unused)
+{
+  struct glist_head        batch;
+  struct glist_head      * glist, * glistn;
+  state_async_queue_t    * arg;
+  state_nlm_async_data_t * nlm_arg;
+  state_nlm_client_t     * host;
+  bool_t                   host_down;
+  time_t                   delay;
+
+  init_glist(&batch);
+
+  P(nlm_grant_mutex);
+  glist_add_list_tail(&batch, &nlm_grant_queue);
+  init_glist(&nlm_grant_queue);
+  nlm_grant_flush_queued = FALSE;
+  V(nlm_grant_mutex);
+
+  while((arg = glist_first_entry(&batch,
+                                 state_async_queue_t,
+                                 state_async_glist)) != NULL)
+    {
+      host      = arg->state_async_data.state_nlm_async_data.nlm_async_host;
+      host_down = FALSE;
+
+      glist_for_each_safe(glist, glistn, &batch)
+        {
+          arg     = glist_entry(glist, state_async_queue_t, state_async_glist);
+          nlm_arg = &arg->state_async_data.state_nlm_async_data;
+
+          if(nlm_arg->nlm_async_host != host)
+            continue;
+
+          glist_del(&arg->state_async_glist);
+
+          delay = NLM_GRANT_RES_DELAY << nlm_arg->nlm_async_sends;
+
+          /* Once the client could not be reached, keep its other
+           * grants for the next attempt, without counting it as a
+           * send. */
+          if(!host_down)
+            {
+              if(nlm4_send_grant_msg(arg) != RPC_SUCCESS)
+                {
+                  LogDebug(COMPONENT_NLM,
+                           "GRANTED_MSG to %s failed, will retry",
+                           host->slc_nlm_caller_name);
+                  host_down = TRUE;
+                }
+              nlm_arg->nlm_async_sends++;
+            }
+
+          arg->state_async_func = nlm4_check_grant;
+
+          if(state_async_schedule_delayed(arg, delay) != STATE_SUCCESS)
+            nlm4_grant_failed(arg);
+        }
+    }
+}
+
 int nlm_process_parameters(struct svc_req        * preq,
                            bool_t                  exclusive,
                            nlm4_lock             * alock,
@@ -708,7 +849,6 @@ state_status_t nlm_granted_callback(cache_entry_t        * pentry,
 
   /* Fill in the arguments for the NLMPROC4_GRANTED_MSG call */
   inc_nlm_client_ref(nlm_grant_client);
-  arg->state_async_func = nlm4_send_grant_msg;
   arg->state_async_data.state_nlm_async_data.nlm_async_host = nlm_grant_client;
   arg->state_async_data.state_nlm_async_data.nlm_async_key  = cookie_entry;
   inarg = &arg->state_async_data.state_nlm_async_data.nlm_async_args.nlm_async_grant;
@@ -741,14 +881,14 @@ state_status_t nlm_granted_callback(cache_entry_t        * pentry,
       netobj_to_string(&inarg->cookie, buffer, sizeof(buffer));
 
       LogDebug(COMPONENT_NLM,
-               "Sending GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
+               "Queuing GRANTED for arg=%p svid=%d start=%llx len=%llx cookie=%s",
                arg, inarg->alock.svid,
                (unsigned long long) inarg->alock.l_offset, (unsigned long long) inarg->alock.l_len,
                buffer);
     }
 
-  /* Now try to schedule NLMPROC4_GRANTED_MSG call */
-  *pstatus = state_async_schedule(arg);
+  /* Now try to queue NLMPROC4_GRANTED_MSG call */
+  *pstatus = nlm4_queue_grant(arg);
 
   if(*pstatus != STATE_SUCCESS)
     goto grant_fail;
@@ -30,51 +30,113 @@
 #include "log.h"
 #include "nfs_core.h"
 
+/*
+ * After a restart or a failover every NLM client comes back at once to
+ * reclaim its locks, each asking for SM_MON before its first one.  The
+ * calls to the local statd go over a few connections so that they do not
+ * wait for one another.
+ */
+#define NSM_CONNECTIONS 4
+
+typedef struct nsm_connection
+{
+  pthread_mutex_t   nc_mutex;
+  CLIENT          * nc_clnt;
+} nsm_connection_t;
+
+static nsm_connection_t nsm_connections[NSM_CONNECTIONS] =
+{
+  { PTHREAD_MUTEX_INITIALIZER, NULL },
+  { PTHREAD_MUTEX_INITIALIZER, NULL },
+  { PTHREAD_MUTEX_INITIALIZER, NULL },
+  { PTHREAD_MUTEX_INITIALIZER, NULL },
+};
+
+/* Protects nsm_count, nodename and ssc_monitored */
 pthread_mutex_t nsm_mutex = PTHREAD_MUTEX_INITIALIZER;
-CLIENT *nsm_clnt;
 unsigned long nsm_count;
 char * nodename;
 
-bool_t nsm_connect()
+static bool_t nsm_nodename()
 {
   struct utsname utsname;
 
-  if(nsm_clnt != NULL)
-    return TRUE;
+  P(nsm_mutex);
 
-  if(uname(&utsname) == -1)
+  if(nodename == NULL)
     {
-      LogDebug(COMPONENT_NLM,
-               "uname failed with errno %d (%s)",
-               errno, strerror(errno));
-      return FALSE;
+      if(uname(&utsname) == -1)
+        {
+          LogDebug(COMPONENT_NLM,
+                   "uname failed with errno %d (%s)",
+                   errno, strerror(errno));
+        }
+      else
+        {
+          nodename = gsh_strdup(utsname.nodename);
+          if(nodename == NULL)
+            LogDebug(COMPONENT_NLM,
+                     "failed to allocate memory for nodename");
+        }
     }
 
-  nodename = gsh_malloc(strlen(utsname.nodename)+1);
-  if(nodename == NULL)
+  V(nsm_mutex);
+
+  return nodename != NULL;
+}
+
+/* Get a connection to nsm on the localhost, preferably an idle one */
+static nsm_connection_t *nsm_connect(void *key)
+{
+  nsm_connection_t * conn = NULL;
+  unsigned int       start, i;
+
+  if(!nsm_nodename())
+    return NULL;
+
+  start = ((uintptr_t) key >> 4) % NSM_CONNECTIONS;
+
+  for(i = 0; i < NSM_CONNECTIONS; i++)
+    if(pthread_mutex_trylock(&nsm_connections[(start + i) % NSM_CONNECTIONS].nc_mutex) == 0)
+      {
+        conn = &nsm_connections[(start + i) % NSM_CONNECTIONS];
+        break;
+      }
+
+  if(conn == NULL)
     {
-      LogDebug(COMPONENT_NLM,
-               "failed to allocate memory for nodename");
-      return FALSE;
+      conn = &nsm_connections[start];
+      P(conn->nc_mutex);
     }
 
-  strcpy(nodename, utsname.nodename);
+  if(conn->nc_clnt == NULL)
+    conn->nc_clnt = Clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
 
-  if(nsm_clnt == NULL)
-    nsm_clnt = Clnt_create("localhost", SM_PROG, SM_VERS, "tcp");
+  if(conn->nc_clnt == NULL)
+    {
+      V(conn->nc_mutex);
+      return NULL;
+    }
 
-  return nsm_clnt != NULL;
+  return conn;
 }
 
-void nsm_disconnect()
+/* Release a connection, closing it if it failed or nothing is monitored */
+static void nsm_disconnect(nsm_connection_t *conn, bool_t failed)
 {
-  if(nsm_count == 0)
+  bool_t idle;
+
+  P(nsm_mutex);
+  idle = nsm_count == 0;
+  V(nsm_mutex);
+
+  if(failed || idle)
     {
-      Clnt_destroy(nsm_clnt);
-      nsm_clnt = NULL;
-      if(nodename != NULL)
-        gsh_free(nodename);
+      Clnt_destroy(conn->nc_clnt);
+      conn->nc_clnt = NULL;
     }
+
+  V(conn->nc_mutex);
 }
 
 bool_t nsm_monitor(state_nsm_client_t *host)
@@ -83,6 +145,7 @@ bool_t nsm_monitor(state_nsm_client_t *host)
   struct mon         nsm_mon;
   struct sm_stat_res res;
   struct timeval     tout = { 5, 0 };
+  nsm_connection_t * conn;
 
   if(host == NULL)
     return TRUE;
@@ -99,22 +162,20 @@ bool_t nsm_monitor(state_nsm_client_t *host)
            "Monitor %s",
            host->ssc_nlm_caller_name);
 
-  P(nsm_mutex);
-
   /* create a connection to nsm on the localhost */
-  if(!nsm_connect())
+  conn = nsm_connect(host);
+  if(conn == NULL)
     {
       LogDebug(COMPONENT_NLM,
                "Can not monitor %s clnt_create returned NULL",
                nsm_mon.mon_id.mon_name);
-      V(nsm_mutex);
       return FALSE;
     }
 
   /* Set this after we call nsm_connect() */
   nsm_mon.mon_id.my_id.my_name = nodename;
 
-  ret = clnt_call(nsm_clnt,
+  ret = clnt_call(conn->nc_clnt,
                   SM_MON,
                   (xdrproc_t) xdr_mon,
                   (caddr_t) & nsm_mon,
@@ -126,9 +187,8 @@ bool_t nsm_monitor(state_nsm_client_t *host)
     {
       LogDebug(COMPONENT_NLM,
                "Can not monitor %s SM_MON ret %d %s",
-               nsm_mon.mon_id.mon_name, ret, clnt_sperror(nsm_clnt, ""));
-      nsm_disconnect();
-      V(nsm_mutex);
+               nsm_mon.mon_id.mon_name, ret, clnt_sperror(conn->nc_clnt, ""));
+      nsm_disconnect(conn, TRUE);
       return FALSE;
     }
 
@@ -137,26 +197,33 @@ bool_t nsm_monitor(state_nsm_client_t *host)
       LogDebug(COMPONENT_NLM,
                "Can not monitor %s SM_MON status %d",
                nsm_mon.mon_id.mon_name, res.res_stat);
-      nsm_disconnect();
-      V(nsm_mutex);
+      nsm_disconnect(conn, FALSE);
       return FALSE;
     }
 
-  nsm_count++;
-  host->ssc_monitored = TRUE;
+  /* Several requests of the client may have asked at the same time */
+  P(nsm_mutex);
+  if(!host->ssc_monitored)
+    {
+      nsm_count++;
+      host->ssc_monitored = TRUE;
+    }
+  V(nsm_mutex);
+
   LogDebug(COMPONENT_NLM,
            "Monitored %s for nodename %s", nsm_mon.mon_id.mon_name, nodename);
 
-  V(nsm_mutex);
+  V(conn->nc_mutex);
   return TRUE;
 }
 
 bool_t nsm_unmonitor(state_nsm_client_t *host)
 {
-  enum clnt_stat ret;
-  struct sm_stat res;
-  struct mon_id  nsm_mon_id;
-  struct timeval tout = { 5, 0 };
+  enum clnt_stat     ret;
+  struct sm_stat     res;
+  struct mon_id      nsm_mon_id;
+  struct timeval     tout = { 5, 0 };
+  nsm_connection_t * conn;
 
   if(host == NULL)
     return TRUE;
@@ -169,22 +236,20 @@ bool_t nsm_unmonitor(state_nsm_client_t *host)
   nsm_mon_id.my_id.my_vers = NLM4_VERS;
   nsm_mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 
-  P(nsm_mutex);
-
   /* create a connection to nsm on the localhost */
-  if(!nsm_connect())
+  conn = nsm_connect(host);
+  if(conn == NULL)
     {
       LogDebug(COMPONENT_NLM,
                "Can not unmonitor %s clnt_create returned NULL",
                nsm_mon_id.mon_name);
-      V(nsm_mutex);
       return FALSE;
     }
 
   /* Set this after we call nsm_connect() */
   nsm_mon_id.my_id.my_name = nodename;
 
-  ret = clnt_call(nsm_clnt,
+  ret = clnt_call(conn->nc_clnt,
                   SM_UNMON,
                   (xdrproc_t) xdr_mon_id,
                   (caddr_t) & nsm_mon_id,
@@ -196,48 +261,51 @@ bool_t nsm_unmonitor(state_nsm_client_t *host)
     {
       LogDebug(COMPONENT_NLM,
                "Can not unmonitor %s SM_MON ret %d %s",
-               nsm_mon_id.mon_name, ret, clnt_sperror(nsm_clnt, ""));
-      nsm_disconnect();
-      V(nsm_mutex);
+               nsm_mon_id.mon_name, ret, clnt_sperror(conn->nc_clnt, ""));
+      nsm_disconnect(conn, TRUE);
       return FALSE;
     }
 
-  host->ssc_monitored = FALSE;
-  nsm_count--;
-  nsm_disconnect();
+  P(nsm_mutex);
+  if(host->ssc_monitored)
+    {
+      host->ssc_monitored = FALSE;
+      nsm_count--;
+    }
+  V(nsm_mutex);
+
   LogDebug(COMPONENT_NLM,
            "Unonitored %s for nodename %s", nsm_mon_id.mon_name, nodename);
 
-  V(nsm_mutex);
+  nsm_disconnect(conn, FALSE);
   return TRUE;
 }
 
 void nsm_unmonitor_all(void)
 {
-  enum clnt_stat ret;
-  struct sm_stat res;
-  struct my_id   nsm_id;
-  struct timeval tout = { 5, 0 };
+  enum clnt_stat     ret;
+  struct sm_stat     res;
+  struct my_id       nsm_id;
+  struct timeval     tout = { 5, 0 };
+  nsm_connection_t * conn;
 
   nsm_id.my_prog = NLMPROG;
   nsm_id.my_vers = NLM4_VERS;
   nsm_id.my_proc = NLMPROC4_SM_NOTIFY;
 
-  P(nsm_mutex);
-
   /* create a connection to nsm on the localhost */
-  if(!nsm_connect())
+  conn = nsm_connect(NULL);
+  if(conn == NULL)
     {
       LogDebug(COMPONENT_NLM,
                "Can not unmonitor all clnt_create returned NULL");
-      V(nsm_mutex);
       return;
     }
 
   /* Set this after we call nsm_connect() */
   nsm_id.my_name = nodename;
 
-  ret = clnt_call(nsm_clnt,
+  ret = clnt_call(conn->nc_clnt,
                   SM_UNMON_ALL,
                   (xdrproc_t) xdr_my_id,
                   (caddr_t) & nsm_id,
@@ -249,9 +317,8 @@ void nsm_unmonitor_all(void)
     {
       LogDebug(COMPONENT_NLM,
                "Can not unmonitor all ret %d %s",
-               ret, clnt_sperror(nsm_clnt, ""));
+               ret, clnt_sperror(conn->nc_clnt, ""));
     }
 
-  nsm_disconnect();
-  V(nsm_mutex);
+  nsm_disconnect(conn, ret != RPC_SUCCESS);
 }
@@ -0,0 +1,303 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    test_xdr_fast.c
+ * \brief   Checks and times the hand written NFSv3 XDR routines.
+ *
+ * Every message is encoded (results) or decoded (arguments) by the
+ * rpcgen routine and by its _fast counterpart; the bytes, or the
+ * decoded fields, must be identical.  Then each is run in a loop over
+ * a memory stream and the time per call is printed.
+ *
+ * usage: test_xdr_fast [iterations]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "ganesha_rpc.h"
+#include "nfs23.h"
+#include "xdr_fast.h"
+
+#define BUFSIZE 4096
+
+static char fh_data[] = "0123456789abcdef0123456789abcdef012345";
+static char verf[NFS3_WRITEVERFSIZE] = "verifier";
+static char payload[4096];
+static char lookup_name[] = "some_file.c";
+
+static void fill_fattr3(fattr3 *attr)
+{
+  attr->type = NF3REG;
+  attr->mode = 0644;
+  attr->nlink = 1;
+  attr->uid = 1000;
+  attr->gid = 100;
+  attr->size = 0x123456789ULL;
+  attr->used = 0x1000;
+  attr->rdev.specdata1 = 0;
+  attr->rdev.specdata2 = 0;
+  attr->fsid = 0xfedcba9876543210ULL;
+  attr->fileid = 42;
+  attr->atime.seconds = 1000000000;
+  attr->atime.nseconds = 1;
+  attr->mtime.seconds = 1000000001;
+  attr->mtime.nseconds = 2;
+  attr->ctime.seconds = 1000000002;
+  attr->ctime.nseconds = 3;
+}
+
+static void fill_post_op_attr(post_op_attr *attr)
+{
+  attr->attributes_follow = TRUE;
+  fill_fattr3(&attr->post_op_attr_u.attributes);
+}
+
+static void fill_fh3(nfs_fh3 *fh)
+{
+  fh->data.data_len = sizeof(fh_data) - 1;
+  fh->data.data_val = fh_data;
+}
+
+static u_int encode(xdrproc_t proc, void *objp, char *buf)
+{
+  XDR xdrs;
+  u_int len;
+
+  xdrmem_create(&xdrs, buf, BUFSIZE, XDR_ENCODE);
+  if(!proc(&xdrs, objp))
+    {
+      fprintf(stderr, "encode failed\n");
+      exit(1);
+    }
+  len = XDR_GETPOS(&xdrs);
+  XDR_DESTROY(&xdrs);
+  return len;
+}
+
+static void decode(xdrproc_t proc, void *objp, size_t size, char *buf,
+                   u_int len)
+{
+  XDR xdrs;
+
+  memset(objp, 0, size);
+  xdrmem_create(&xdrs, buf, len, XDR_DECODE);
+  if(!proc(&xdrs, objp))
+    {
+      fprintf(stderr, "decode failed\n");
+      exit(1);
+    }
+  XDR_DESTROY(&xdrs);
+}
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Encodes a result with both routines, compares, then times them */
+static int bench_res(const char *label, xdrproc_t slow, xdrproc_t fast,
+                     void *objp, int iterations)
+{
+  char buf1[BUFSIZE], buf2[BUFSIZE];
+  u_int len1, len2;
+  double t0, t1, t2;
+  int i;
+
+  len1 = encode(slow, objp, buf1);
+  len2 = encode(fast, objp, buf2);
+  if(len1 != len2 || memcmp(buf1, buf2, len1) != 0)
+    {
+      printf("%-14s MISMATCH (%u/%u bytes)\n", label, len1, len2);
+      return 1;
+    }
+
+  t0 = now();
+  for(i = 0; i < iterations; i++)
+    encode(slow, objp, buf1);
+  t1 = now();
+  for(i = 0; i < iterations; i++)
+    encode(fast, objp, buf2);
+  t2 = now();
+
+  printf("%-14s %4u bytes  rpcgen %7.1f ns  fast %7.1f ns\n", label, len1,
+         (t1 - t0) * 1e9 / iterations, (t2 - t1) * 1e9 / iterations);
+  return 0;
+}
+
+/* Decodes arguments with both routines, compares, then times them */
+static int bench_args(const char *label, xdrproc_t slow, xdrproc_t fast,
+                      void *objp, size_t size, int iterations)
+{
+  char buf[BUFSIZE];
+  void *obj1 = malloc(size), *obj2 = malloc(size);
+  char enc1[BUFSIZE], enc2[BUFSIZE];
+  u_int len, len1, len2;
+  double t0, t1, t2;
+  int i, rc = 0;
+
+  len = encode(slow, objp, buf);
+  decode(slow, obj1, size, buf, len);
+  decode(fast, obj2, size, buf, len);
+
+  /* Compare what was decoded by encoding it again */
+  len1 = encode(slow, obj1, enc1);
+  len2 = encode(slow, obj2, enc2);
+  if(len1 != len2 || memcmp(enc1, enc2, len1) != 0)
+    {
+      printf("%-14s MISMATCH\n", label);
+      rc = 1;
+      goto out;
+    }
+
+  t0 = now();
+  for(i = 0; i < iterations; i++)
+    {
+      decode(slow, obj1, size, buf, len);
+      xdr_free(slow, obj1);
+    }
+  t1 = now();
+  for(i = 0; i < iterations; i++)
+    {
+      decode(fast, obj2, size, buf, len);
+      xdr_free(fast, obj2);
+    }
+  t2 = now();
+
+  printf("%-14s %4u bytes  rpcgen %7.1f ns  fast %7.1f ns\n", label, len,
+         (t1 - t0) * 1e9 / iterations, (t2 - t1) * 1e9 / iterations);
+
+ out:
+  free(obj1);
+  free(obj2);
+  return rc;
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+  int rc = 0;
+  GETATTR3args getattr_args;
+  GETATTR3res getattr_res;
+  LOOKUP3args lookup_args;
+  LOOKUP3res lookup_res;
+  ACCESS3args access_args;
+  ACCESS3res access_res;
+  READ3args read_args;
+  READ3res read_res;
+  WRITE3args write_args;
+  WRITE3res write_res;
+
+  if(iterations <= 0)
+    iterations = 1;
+
+  fill_fh3(&getattr_args.object);
+  rc |= bench_args("GETATTR3args", (xdrproc_t) xdr_GETATTR3args,
+                   (xdrproc_t) xdr_GETATTR3args_fast, &getattr_args,
+                   sizeof(getattr_args), iterations);
+
+  getattr_res.status = NFS3_OK;
+  fill_fattr3(&getattr_res.GETATTR3res_u.resok.obj_attributes);
+  rc |= bench_res("GETATTR3res", (xdrproc_t) xdr_GETATTR3res,
+                  (xdrproc_t) xdr_GETATTR3res_fast, &getattr_res, iterations);
+
+  fill_fh3(&lookup_args.what.dir);
+  lookup_args.what.name = lookup_name;
+  rc |= bench_args("LOOKUP3args", (xdrproc_t) xdr_LOOKUP3args,
+                   (xdrproc_t) xdr_LOOKUP3args_fast, &lookup_args,
+                   sizeof(lookup_args), iterations);
+
+  lookup_res.status = NFS3_OK;
+  fill_fh3(&lookup_res.LOOKUP3res_u.resok.object);
+  fill_post_op_attr(&lookup_res.LOOKUP3res_u.resok.obj_attributes);
+  fill_post_op_attr(&lookup_res.LOOKUP3res_u.resok.dir_attributes);
+  rc |= bench_res("LOOKUP3res", (xdrproc_t) xdr_LOOKUP3res,
+                  (xdrproc_t) xdr_LOOKUP3res_fast, &lookup_res, iterations);
+
+  lookup_res.status = NFS3ERR_NOENT;
+  lookup_res.LOOKUP3res_u.resfail.dir_attributes.attributes_follow = FALSE;
+  rc |= bench_res("LOOKUP3res err", (xdrproc_t) xdr_LOOKUP3res,
+                  (xdrproc_t) xdr_LOOKUP3res_fast, &lookup_res, iterations);
+
+  fill_fh3(&access_args.object);
+  access_args.access = 0x3f;
+  rc |= bench_args("ACCESS3args", (xdrproc_t) xdr_ACCESS3args,
+                   (xdrproc_t) xdr_ACCESS3args_fast, &access_args,
+                   sizeof(access_args), iterations);
+
+  access_res.status = NFS3_OK;
+  fill_post_op_attr(&access_res.ACCESS3res_u.resok.obj_attributes);
+  access_res.ACCESS3res_u.resok.access = 0x1f;
+  rc |= bench_res("ACCESS3res", (xdrproc_t) xdr_ACCESS3res,
+                  (xdrproc_t) xdr_ACCESS3res_fast, &access_res, iterations);
+
+  fill_fh3(&read_args.file);
+  read_args.offset = 0x100000000ULL;
+  read_args.count = 32768;
+  rc |= bench_args("READ3args", (xdrproc_t) xdr_READ3args,
+                   (xdrproc_t) xdr_READ3args_fast, &read_args,
+                   sizeof(read_args), iterations);
+
+  read_res.status = NFS3_OK;
+  fill_post_op_attr(&read_res.READ3res_u.resok.file_attributes);
+  read_res.READ3res_u.resok.count = 1023;
+  read_res.READ3res_u.resok.eof = TRUE;
+  read_res.READ3res_u.resok.data.data_len = 1023;
+  read_res.READ3res_u.resok.data.data_val = payload;
+  rc |= bench_res("READ3res", (xdrproc_t) xdr_READ3res,
+                  (xdrproc_t) xdr_READ3res_fast, &read_res, iterations);
+
+  fill_fh3(&write_args.file);
+  write_args.offset = 4096;
+  write_args.count = 1021;
+  write_args.stable = FILE_SYNC;
+  write_args.data.data_len = 1021;
+  write_args.data.data_val = payload;
+  rc |= bench_args("WRITE3args", (xdrproc_t) xdr_WRITE3args,
+                   (xdrproc_t) xdr_WRITE3args_fast, &write_args,
+                   sizeof(write_args), iterations);
+
+  write_res.status = NFS3_OK;
+  write_res.WRITE3res_u.resok.file_wcc.before.attributes_follow = TRUE;
+  write_res.WRITE3res_u.resok.file_wcc.before.pre_op_attr_u.attributes.size = 4096;
+  write_res.WRITE3res_u.resok.file_wcc.before.pre_op_attr_u.attributes.mtime.seconds = 7;
+  write_res.WRITE3res_u.resok.file_wcc.before.pre_op_attr_u.attributes.mtime.nseconds = 8;
+  write_res.WRITE3res_u.resok.file_wcc.before.pre_op_attr_u.attributes.ctime.seconds = 9;
+  write_res.WRITE3res_u.resok.file_wcc.before.pre_op_attr_u.attributes.ctime.nseconds = 10;
+  fill_post_op_attr(&write_res.WRITE3res_u.resok.file_wcc.after);
+  write_res.WRITE3res_u.resok.count = 1021;
+  write_res.WRITE3res_u.resok.committed = FILE_SYNC;
+  memcpy(write_res.WRITE3res_u.resok.verf, verf, NFS3_WRITEVERFSIZE);
+  rc |= bench_res("WRITE3res", (xdrproc_t) xdr_WRITE3res,
+                  (xdrproc_t) xdr_WRITE3res_fast, &write_res, iterations);
+
+  return rc;
+}
@@ -0,0 +1,495 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    xdr_nfs23_fast.c
+ * \brief   Hand written XDR routines for the hottest NFSv3 procedures.
+ *
+ * Each routine produces exactly the same bytes as its rpcgen
+ * counterpart in xdr_nfs23.c.  The size of the message (or of its
+ * fixed part, for READ and WRITE data) is computed first and the whole
+ * of it is reserved with a single XDR_INLINE, so the bounds are checked
+ * once instead of once per field.  When the stream cannot provide a
+ * contiguous buffer of that size, or for XDR_FREE, the rpcgen routine
+ * is used instead.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <string.h>
+#include "ganesha_rpc.h"
+#include "nfs23.h"
+#include "xdr_fast.h"
+
+#define XDR_FAST_RNDUP(x) (((x) + BYTES_PER_XDR_UNIT - 1) & ~(BYTES_PER_XDR_UNIT - 1))
+#define XDR_FAST_FATTR3_SIZE (21 * BYTES_PER_XDR_UNIT)
+#define XDR_FAST_WCC_ATTR_SIZE (6 * BYTES_PER_XDR_UNIT)
+
+static inline u_int fast_fh3_size(nfs_fh3 *fh)
+{
+  return BYTES_PER_XDR_UNIT + XDR_FAST_RNDUP(fh->data.data_len);
+}
+
+static inline u_int fast_post_op_attr_size(post_op_attr *attr)
+{
+  return BYTES_PER_XDR_UNIT +
+      (attr->attributes_follow ? XDR_FAST_FATTR3_SIZE : 0);
+}
+
+static inline u_int fast_wcc_data_size(wcc_data *wcc)
+{
+  return BYTES_PER_XDR_UNIT +
+      (wcc->before.attributes_follow ? XDR_FAST_WCC_ATTR_SIZE : 0) +
+      fast_post_op_attr_size(&wcc->after);
+}
+
+static inline int32_t *fast_put_u64(int32_t *buf, uint64_t val)
+{
+  IXDR_PUT_U_INT32(buf, (uint32_t) (val >> 32));
+  IXDR_PUT_U_INT32(buf, (uint32_t) val);
+  return buf;
+}
+
+static inline int32_t *fast_get_u64(int32_t *buf, nfs3_uint64 *val)
+{
+  uint64_t hi = IXDR_GET_U_INT32(buf);
+
+  *val = (hi << 32) | IXDR_GET_U_INT32(buf);
+  return buf;
+}
+
+static inline int32_t *fast_put_opaque(int32_t *buf, const char *data,
+                                       u_int len)
+{
+  if(len % BYTES_PER_XDR_UNIT)
+    buf[len / BYTES_PER_XDR_UNIT] = 0;
+  memcpy(buf, data, len);
+  return buf + XDR_FAST_RNDUP(len) / BYTES_PER_XDR_UNIT;
+}
+
+static inline int32_t *fast_put_fh3(int32_t *buf, nfs_fh3 *fh)
+{
+  IXDR_PUT_U_INT32(buf, fh->data.data_len);
+  return fast_put_opaque(buf, fh->data.data_val, fh->data.data_len);
+}
+
+static inline int32_t *fast_put_nfstime3(int32_t *buf, nfstime3 *t)
+{
+  IXDR_PUT_U_INT32(buf, t->seconds);
+  IXDR_PUT_U_INT32(buf, t->nseconds);
+  return buf;
+}
+
+static inline int32_t *fast_put_fattr3(int32_t *buf, fattr3 *attr)
+{
+  IXDR_PUT_INT32(buf, attr->type);
+  IXDR_PUT_U_INT32(buf, attr->mode);
+  IXDR_PUT_U_INT32(buf, attr->nlink);
+  IXDR_PUT_U_INT32(buf, attr->uid);
+  IXDR_PUT_U_INT32(buf, attr->gid);
+  buf = fast_put_u64(buf, attr->size);
+  buf = fast_put_u64(buf, attr->used);
+  IXDR_PUT_U_INT32(buf, attr->rdev.specdata1);
+  IXDR_PUT_U_INT32(buf, attr->rdev.specdata2);
+  buf = fast_put_u64(buf, attr->fsid);
+  buf = fast_put_u64(buf, attr->fileid);
+  buf = fast_put_nfstime3(buf, &attr->atime);
+  buf = fast_put_nfstime3(buf, &attr->mtime);
+  return fast_put_nfstime3(buf, &attr->ctime);
+}
+
+static inline int32_t *fast_put_post_op_attr(int32_t *buf, post_op_attr *attr)
+{
+  IXDR_PUT_BOOL(buf, attr->attributes_follow);
+  if(attr->attributes_follow)
+    buf = fast_put_fattr3(buf, &attr->post_op_attr_u.attributes);
+  return buf;
+}
+
+static inline int32_t *fast_put_wcc_data(int32_t *buf, wcc_data *wcc)
+{
+  IXDR_PUT_BOOL(buf, wcc->before.attributes_follow);
+  if(wcc->before.attributes_follow)
+    {
+      wcc_attr *attr = &wcc->before.pre_op_attr_u.attributes;
+
+      buf = fast_put_u64(buf, attr->size);
+      buf = fast_put_nfstime3(buf, &attr->mtime);
+      buf = fast_put_nfstime3(buf, &attr->ctime);
+    }
+  return fast_put_post_op_attr(buf, &wcc->after);
+}
+
+/* The post_op_attr unions only allow TRUE and FALSE, as in rpcgen */
+static inline bool_t fast_post_op_attr_ok(post_op_attr *attr)
+{
+  return attr->attributes_follow == TRUE || attr->attributes_follow == FALSE;
+}
+
+static inline bool_t fast_wcc_data_ok(wcc_data *wcc)
+{
+  return (wcc->before.attributes_follow == TRUE ||
+          wcc->before.attributes_follow == FALSE) &&
+      fast_post_op_attr_ok(&wcc->after);
+}
+
+/**
+ *
+ * fast_get_fh3: decodes a file handle and reserves what follows it.
+ *
+ * The length is read on its own, then the handle and tail more bytes
+ * are reserved together.  *ptail is set to those tail bytes, or to
+ * NULL if the stream could not provide them, in which case the handle
+ * has still been decoded and the caller goes on field by field.
+ *
+ */
+static bool_t fast_get_fh3(XDR *xdrs, nfs_fh3 *fh, u_int tail, int32_t **ptail)
+{
+  int32_t *buf;
+  u_int len;
+
+  if(!xdr_u_int(xdrs, &len) || len > NFS3_FHSIZE)
+    return FALSE;
+
+  buf = XDR_INLINE(xdrs, XDR_FAST_RNDUP(len) + tail);
+
+  if(len != 0 && fh->data.data_val == NULL)
+    if((fh->data.data_val = mem_alloc(len)) == NULL)
+      return FALSE;
+  fh->data.data_len = len;
+
+  if(buf == NULL)
+    {
+      *ptail = NULL;
+      return xdr_opaque(xdrs, fh->data.data_val, len);
+    }
+
+  memcpy(fh->data.data_val, buf, len);
+  *ptail = buf + XDR_FAST_RNDUP(len) / BYTES_PER_XDR_UNIT;
+  return TRUE;
+}
+
+/* Same as xdr_string(xdrs, name, ~0) once the length has been read */
+static bool_t fast_get_filename3(XDR *xdrs, filename3 *name, u_int len)
+{
+  int32_t *buf;
+
+  if(len + 1 == 0)
+    return FALSE;
+
+  if(*name == NULL)
+    if((*name = mem_alloc(len + 1)) == NULL)
+      return FALSE;
+  (*name)[len] = '\0';
+
+  if((buf = XDR_INLINE(xdrs, XDR_FAST_RNDUP(len))) == NULL)
+    return xdr_opaque(xdrs, *name, len);
+
+  memcpy(*name, buf, len);
+  return TRUE;
+}
+
+bool_t xdr_GETATTR3args_fast(XDR *xdrs, GETATTR3args *objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_GETATTR3args(xdrs, objp);
+
+  return fast_get_fh3(xdrs, &objp->object, 0, &buf);
+}
+
+bool_t xdr_GETATTR3res_fast(XDR *xdrs, GETATTR3res *objp)
+{
+  int32_t *buf;
+  u_int size = BYTES_PER_XDR_UNIT;
+
+  if(xdrs->x_op != XDR_ENCODE)
+    return xdr_GETATTR3res(xdrs, objp);
+
+  if(objp->status == NFS3_OK)
+    size += XDR_FAST_FATTR3_SIZE;
+
+  if((buf = XDR_INLINE(xdrs, size)) == NULL)
+    return xdr_GETATTR3res(xdrs, objp);
+
+  IXDR_PUT_INT32(buf, objp->status);
+  if(objp->status == NFS3_OK)
+    fast_put_fattr3(buf, &objp->GETATTR3res_u.resok.obj_attributes);
+
+  return TRUE;
+}
+
+bool_t xdr_LOOKUP3args_fast(XDR *xdrs, LOOKUP3args *objp)
+{
+  int32_t *buf;
+  u_int len;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_LOOKUP3args(xdrs, objp);
+
+  if(!fast_get_fh3(xdrs, &objp->what.dir, BYTES_PER_XDR_UNIT, &buf))
+    return FALSE;
+
+  if(buf == NULL)
+    return xdr_filename3(xdrs, &objp->what.name);
+
+  len = IXDR_GET_U_INT32(buf);
+  return fast_get_filename3(xdrs, &objp->what.name, len);
+}
+
+bool_t xdr_LOOKUP3res_fast(XDR *xdrs, LOOKUP3res *objp)
+{
+  int32_t *buf;
+  u_int size = BYTES_PER_XDR_UNIT;
+  LOOKUP3resok *resok = &objp->LOOKUP3res_u.resok;
+  LOOKUP3resfail *resfail = &objp->LOOKUP3res_u.resfail;
+
+  if(xdrs->x_op != XDR_ENCODE)
+    return xdr_LOOKUP3res(xdrs, objp);
+
+  if(objp->status == NFS3_OK)
+    {
+      if(resok->object.data.data_len > NFS3_FHSIZE ||
+         !fast_post_op_attr_ok(&resok->obj_attributes) ||
+         !fast_post_op_attr_ok(&resok->dir_attributes))
+        return xdr_LOOKUP3res(xdrs, objp);
+      size += fast_fh3_size(&resok->object) +
+          fast_post_op_attr_size(&resok->obj_attributes) +
+          fast_post_op_attr_size(&resok->dir_attributes);
+    }
+  else
+    {
+      if(!fast_post_op_attr_ok(&resfail->dir_attributes))
+        return xdr_LOOKUP3res(xdrs, objp);
+      size += fast_post_op_attr_size(&resfail->dir_attributes);
+    }
+
+  if((buf = XDR_INLINE(xdrs, size)) == NULL)
+    return xdr_LOOKUP3res(xdrs, objp);
+
+  IXDR_PUT_INT32(buf, objp->status);
+  if(objp->status == NFS3_OK)
+    {
+      buf = fast_put_fh3(buf, &resok->object);
+      buf = fast_put_post_op_attr(buf, &resok->obj_attributes);
+      fast_put_post_op_attr(buf, &resok->dir_attributes);
+    }
+  else
+    fast_put_post_op_attr(buf, &resfail->dir_attributes);
+
+  return TRUE;
+}
+
+bool_t xdr_ACCESS3args_fast(XDR *xdrs, ACCESS3args *objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_ACCESS3args(xdrs, objp);
+
+  if(!fast_get_fh3(xdrs, &objp->object, BYTES_PER_XDR_UNIT, &buf))
+    return FALSE;
+
+  if(buf == NULL)
+    return xdr_nfs3_uint32(xdrs, &objp->access);
+
+  objp->access = IXDR_GET_U_INT32(buf);
+  return TRUE;
+}
+
+bool_t xdr_ACCESS3res_fast(XDR *xdrs, ACCESS3res *objp)
+{
+  int32_t *buf;
+  u_int size = BYTES_PER_XDR_UNIT;
+  ACCESS3resok *resok = &objp->ACCESS3res_u.resok;
+  ACCESS3resfail *resfail = &objp->ACCESS3res_u.resfail;
+
+  if(xdrs->x_op != XDR_ENCODE)
+    return xdr_ACCESS3res(xdrs, objp);
+
+  if(objp->status == NFS3_OK)
+    {
+      if(!fast_post_op_attr_ok(&resok->obj_attributes))
+        return xdr_ACCESS3res(xdrs, objp);
+      size += fast_post_op_attr_size(&resok->obj_attributes) +
+          BYTES_PER_XDR_UNIT;
+    }
+  else
+    {
+      if(!fast_post_op_attr_ok(&resfail->obj_attributes))
+        return xdr_ACCESS3res(xdrs, objp);
+      size += fast_post_op_attr_size(&resfail->obj_attributes);
+    }
+
+  if((buf = XDR_INLINE(xdrs, size)) == NULL)
+    return xdr_ACCESS3res(xdrs, objp);
+
+  IXDR_PUT_INT32(buf, objp->status);
+  if(objp->status == NFS3_OK)
+    {
+      buf = fast_put_post_op_attr(buf, &resok->obj_attributes);
+      IXDR_PUT_U_INT32(buf, resok->access);
+    }
+  else
+    fast_put_post_op_attr(buf, &resfail->obj_attributes);
+
+  return TRUE;
+}
+
+bool_t xdr_READ3args_fast(XDR *xdrs, READ3args *objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_READ3args(xdrs, objp);
+
+  if(!fast_get_fh3(xdrs, &objp->file, 3 * BYTES_PER_XDR_UNIT, &buf))
+    return FALSE;
+
+  if(buf == NULL)
+    return xdr_offset3(xdrs, &objp->offset) &&
+        xdr_count3(xdrs, &objp->count);
+
+  buf = fast_get_u64(buf, &objp->offset);
+  objp->count = IXDR_GET_U_INT32(buf);
+  return TRUE;
+}
+
+bool_t xdr_READ3res_fast(XDR *xdrs, READ3res *objp)
+{
+  int32_t *buf;
+  u_int size = BYTES_PER_XDR_UNIT;
+  READ3resok *resok = &objp->READ3res_u.resok;
+  READ3resfail *resfail = &objp->READ3res_u.resfail;
+
+  if(xdrs->x_op != XDR_ENCODE)
+    return xdr_READ3res(xdrs, objp);
+
+  /* The data is left to xdr_opaque, only the header goes inline */
+  if(objp->status == NFS3_OK)
+    {
+      if(!fast_post_op_attr_ok(&resok->file_attributes))
+        return xdr_READ3res(xdrs, objp);
+      size += fast_post_op_attr_size(&resok->file_attributes) +
+          3 * BYTES_PER_XDR_UNIT;
+    }
+  else
+    {
+      if(!fast_post_op_attr_ok(&resfail->file_attributes))
+        return xdr_READ3res(xdrs, objp);
+      size += fast_post_op_attr_size(&resfail->file_attributes);
+    }
+
+  if((buf = XDR_INLINE(xdrs, size)) == NULL)
+    return xdr_READ3res(xdrs, objp);
+
+  IXDR_PUT_INT32(buf, objp->status);
+  if(objp->status != NFS3_OK)
+    {
+      fast_put_post_op_attr(buf, &resfail->file_attributes);
+      return TRUE;
+    }
+
+  buf = fast_put_post_op_attr(buf, &resok->file_attributes);
+  IXDR_PUT_U_INT32(buf, resok->count);
+  IXDR_PUT_BOOL(buf, resok->eof ? TRUE : FALSE);
+  IXDR_PUT_U_INT32(buf, resok->data.data_len);
+
+  return xdr_opaque(xdrs, resok->data.data_val, resok->data.data_len);
+}
+
+bool_t xdr_WRITE3args_fast(XDR *xdrs, WRITE3args *objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_WRITE3args(xdrs, objp);
+
+  if(!fast_get_fh3(xdrs, &objp->file, 4 * BYTES_PER_XDR_UNIT, &buf))
+    return FALSE;
+
+  if(buf == NULL)
+    {
+      if(!xdr_offset3(xdrs, &objp->offset) ||
+         !xdr_count3(xdrs, &objp->count) ||
+         !xdr_stable_how(xdrs, &objp->stable))
+        return FALSE;
+    }
+  else
+    {
+      buf = fast_get_u64(buf, &objp->offset);
+      objp->count = IXDR_GET_U_INT32(buf);
+      objp->stable = IXDR_GET_ENUM(buf, stable_how);
+    }
+
+  /* The data is decoded by xdr_bytes, as rpcgen does */
+  return xdr_bytes(xdrs, (char **)&objp->data.data_val,
+                   (u_int *) & objp->data.data_len, ~0);
+}
+
+bool_t xdr_WRITE3res_fast(XDR *xdrs, WRITE3res *objp)
+{
+  int32_t *buf;
+  u_int size = BYTES_PER_XDR_UNIT;
+  WRITE3resok *resok = &objp->WRITE3res_u.resok;
+  WRITE3resfail *resfail = &objp->WRITE3res_u.resfail;
+
+  if(xdrs->x_op != XDR_ENCODE)
+    return xdr_WRITE3res(xdrs, objp);
+
+  if(objp->status == NFS3_OK)
+    {
+      if(!fast_wcc_data_ok(&resok->file_wcc))
+        return xdr_WRITE3res(xdrs, objp);
+      size += fast_wcc_data_size(&resok->file_wcc) +
+          2 * BYTES_PER_XDR_UNIT + NFS3_WRITEVERFSIZE;
+    }
+  else
+    {
+      if(!fast_wcc_data_ok(&resfail->file_wcc))
+        return xdr_WRITE3res(xdrs, objp);
+      size += fast_wcc_data_size(&resfail->file_wcc);
+    }
+
+  if((buf = XDR_INLINE(xdrs, size)) == NULL)
+    return xdr_WRITE3res(xdrs, objp);
+
+  IXDR_PUT_INT32(buf, objp->status);
+  if(objp->status == NFS3_OK)
+    {
+      buf = fast_put_wcc_data(buf, &resok->file_wcc);
+      IXDR_PUT_U_INT32(buf, resok->count);
+      IXDR_PUT_ENUM(buf, resok->committed);
+      fast_put_opaque(buf, resok->verf, NFS3_WRITEVERFSIZE);
+    }
+  else
+    fast_put_wcc_data(buf, &resfail->file_wcc);
+
+  return TRUE;
+}
@@ -0,0 +1,580 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    AuthGss_CtxCache.c
+ * \brief   Cache of the established RPCSEC_GSS contexts.
+ *
+ * The contexts live in a table of Context_Cache_Size slots.  The
+ * handle given to the client names the slot directly, together with
+ * the generation of the slot and a random verifier, so a lookup is an
+ * index and a compare and swap on the state of the slot: the live
+ * gss context is used in place, never exported nor imported again.
+ *
+ * The state of a slot packs its generation, a DYING flag and a
+ * reference count.  The table holds one reference on each live
+ * context, every request using it holds another one.  The context is
+ * released, and the generation of its slot bumped, when the last
+ * reference goes away after the context was deleted.
+ *
+ * The sequence window of a context is a single 64 bits word, updated
+ * with compare and swap, so concurrent requests on the same context
+ * never serialize on a lock.
+ *
+ * Only allocating a slot takes a lock.  When no slot is free, the
+ * context unused for the longest time is reclaimed; its client will
+ * establish a new one.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "log.h"
+#include "nfs_core.h"
+#include "abstract_atomic.h"
+
+#include "rpcal.h"
+#ifdef HAVE_HEIMDAL
+#include <gssapi.h>
+#define gss_nt_service_name GSS_C_NT_HOSTBASED_SERVICE
+#else
+#include <gssapi/gssapi.h>
+#include <gssapi/gssapi_generic.h>
+#endif
+
+#define GSS_CTX_REFMASK    0x7fffffffULL
+#define GSS_CTX_DYING      0x80000000ULL
+#define GSS_CTX_GEN(s)     ((uint32_t)((s) >> 32))
+#define GSS_CTX_REFCNT(s)  ((s) & GSS_CTX_REFMASK)
+
+#define GSS_CTX_NO_SLOT    UINT32_MAX
+
+static gss_ctx_entry_t *gss_ctx_table;
+static uint32_t gss_ctx_table_size;
+
+static pthread_mutex_t gss_ctx_free_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t gss_ctx_free_head = GSS_CTX_NO_SLOT;
+
+static int gss_ctx_random_fd = -1;
+static uint64_t gss_ctx_verifier_seed;
+
+static gss_ctx_cache_stats_t gss_ctx_stats;
+
+/**
+ *
+ * gss_ctx_new_verifier: returns the verifier of a new context.
+ *
+ * @return 64 random bits.
+ *
+ */
+static uint64_t gss_ctx_new_verifier(void)
+{
+  uint64_t verifier;
+
+  if(gss_ctx_random_fd >= 0 &&
+     read(gss_ctx_random_fd, &verifier, sizeof(verifier)) == sizeof(verifier))
+    return verifier;
+
+  /* No randomness source, at least make the handles differ between
+   * two runs of the server. */
+  verifier = atomic_add_uint64_t(&gss_ctx_verifier_seed,
+                                 0x9e3779b97f4a7c15ULL);
+  verifier ^= verifier >> 31;
+  verifier *= 0xbf58476d1ce4e5b9ULL;
+
+  return verifier ^ (verifier >> 29);
+}                               /* gss_ctx_new_verifier */
+
+/**
+ *
+ * gss_ctx_release: releases the gss resources of a context and frees its slot.
+ *
+ * Called when the last reference of a deleted context goes away.
+ *
+ * @param entry [INOUT] the context
+ * @param state [IN]    the last state of the slot
+ *
+ */
+static void gss_ctx_release(gss_ctx_entry_t *entry, uint64_t state)
+{
+  OM_uint32 min_stat;
+
+  gss_delete_sec_context(&min_stat, &entry->ctx, GSS_C_NO_BUFFER);
+  gss_release_buffer(&min_stat, &entry->cname);
+  if(entry->client_name)
+    gss_release_name(&min_stat, &entry->client_name);
+
+  entry->ctx = GSS_C_NO_CONTEXT;
+  entry->client_name = NULL;
+
+  /* Handles of the old context no longer match the slot */
+  atomic_store_uint64_t(&entry->state,
+                        (uint64_t)(GSS_CTX_GEN(state) + 1) << 32);
+
+  atomic_dec_uint64_t(&gss_ctx_stats.entries);
+
+  P(gss_ctx_free_mutex);
+  entry->next_free = gss_ctx_free_head;
+  gss_ctx_free_head = entry->slot;
+  V(gss_ctx_free_mutex);
+}                               /* gss_ctx_release */
+
+/**
+ *
+ * gss_ctx_kill: marks a context as deleted and drops the table's reference.
+ *
+ * @param entry [INOUT] the context, the caller holds a reference on it
+ *
+ * @return 1 if the context was deleted by this call, 0 if it was already.
+ *
+ */
+static int gss_ctx_kill(gss_ctx_entry_t *entry)
+{
+  uint64_t state;
+
+  do
+    {
+      state = atomic_fetch_uint64_t(&entry->state);
+      if(state & GSS_CTX_DYING)
+        return 0;
+    }
+  while(!atomic_cas_uint64_t(&entry->state, state, state | GSS_CTX_DYING));
+
+  Gss_ctx_cache_put(entry);
+
+  return 1;
+}                               /* gss_ctx_kill */
+
+/**
+ *
+ * gss_ctx_reclaim: deletes the context unused for the longest time.
+ *
+ * Only contexts no request is using are candidates.
+ *
+ * @return 1 if a context was deleted, 0 otherwise.
+ *
+ */
+static int gss_ctx_reclaim(void)
+{
+  gss_ctx_entry_t *victim = NULL;
+  uint64_t state;
+  uint32_t i;
+
+  for(i = 0; i < gss_ctx_table_size; i++)
+    {
+      state = atomic_fetch_uint64_t(&gss_ctx_table[i].state);
+
+      if(GSS_CTX_REFCNT(state) != 1 || (state & GSS_CTX_DYING))
+        continue;
+
+      if(victim == NULL || gss_ctx_table[i].last_used < victim->last_used)
+        victim = &gss_ctx_table[i];
+    }
+
+  if(victim == NULL)
+    return 0;
+
+  /* Pin it like a lookup would, it may have been taken meanwhile */
+  state = atomic_fetch_uint64_t(&victim->state);
+  if(GSS_CTX_REFCNT(state) == 0 || (state & GSS_CTX_DYING) ||
+     !atomic_cas_uint64_t(&victim->state, state, state + 1))
+    return 0;
+
+  LogDebug(COMPONENT_RPCSEC_GSS,
+           "Reclaiming gss context of %.*s in slot %u, unused since %ld",
+           (int)victim->cname.length, (char *)victim->cname.value,
+           victim->slot, (long)victim->last_used);
+
+  gss_ctx_kill(victim);
+  Gss_ctx_cache_put(victim);
+  atomic_inc_uint64_t(&gss_ctx_stats.reclaimed);
+
+  return 1;
+}                               /* gss_ctx_reclaim */
+
+/**
+ *
+ * gss_ctx_alloc_slot: takes a slot from the free list.
+ *
+ * @return the slot, or NULL if the table is full.
+ *
+ */
+static gss_ctx_entry_t *gss_ctx_alloc_slot(void)
+{
+  gss_ctx_entry_t *entry = NULL;
+  int retry;
+
+  for(retry = 0; retry < 2; retry++)
+    {
+      P(gss_ctx_free_mutex);
+      if(gss_ctx_free_head != GSS_CTX_NO_SLOT)
+        {
+          entry = &gss_ctx_table[gss_ctx_free_head];
+          gss_ctx_free_head = entry->next_free;
+          entry->next_free = GSS_CTX_NO_SLOT;
+        }
+      V(gss_ctx_free_mutex);
+
+      if(entry != NULL || !gss_ctx_reclaim())
+        break;
+    }
+
+  return entry;
+}                               /* gss_ctx_alloc_slot */
+
+/**
+ *
+ * Gss_ctx_cache_insert: adds an established context to the cache.
+ *
+ * The context, the client's name and cname of gd are moved into the
+ * cache, gd is left pointing to them and holding a reference on the
+ * new entry.
+ *
+ * @param gd      [INOUT] the freshly established context
+ * @param phandle [OUT]   the handle to give to the client
+ *
+ * @return the new entry, NULL if the cache is full.
+ *
+ */
+gss_ctx_entry_t *Gss_ctx_cache_insert(struct svc_rpc_gss_data *gd,
+                                      gss_ctx_handle_t *phandle)
+{
+  gss_ctx_entry_t *entry;
+  uint64_t state;
+
+  if((entry = gss_ctx_alloc_slot()) == NULL)
+    {
+      LogCrit(COMPONENT_RPCSEC_GSS,
+              "Gss context cache is full (%u contexts in use)",
+              gss_ctx_table_size);
+      return NULL;
+    }
+
+  entry->ctx = gd->ctx;
+  entry->sec = gd->sec;
+  entry->cname = gd->cname;
+  entry->client_name = gd->client_name;
+  entry->win = gd->win > GSS_CTX_SEQ_WINDOW ? GSS_CTX_SEQ_WINDOW : gd->win;
+  entry->verifier = gss_ctx_new_verifier();
+  entry->seqwin = 0;
+  entry->calls = 0;
+  entry->replays = 0;
+  entry->outside_window = 0;
+  entry->created = entry->last_used = time(NULL);
+
+  /* One reference for the table, one for gd. Publishing the new
+   * state makes the entry visible to Gss_ctx_cache_get. */
+  state = atomic_fetch_uint64_t(&entry->state);
+  atomic_store_uint64_t(&entry->state,
+                        (state & ~(GSS_CTX_REFMASK | GSS_CTX_DYING)) | 2);
+
+  atomic_inc_uint64_t(&gss_ctx_stats.entries);
+
+  gd->entry = entry;
+
+  phandle->slot = entry->slot;
+  phandle->generation = GSS_CTX_GEN(state);
+  phandle->verifier = entry->verifier;
+
+  LogFullDebug(COMPONENT_RPCSEC_GSS,
+               "Gss context of %.*s added to cache in slot %u generation %u",
+               (int)entry->cname.length, (char *)entry->cname.value,
+               phandle->slot, phandle->generation);
+
+  return entry;
+}                               /* Gss_ctx_cache_insert */
+
+/**
+ *
+ * Gss_ctx_cache_get: looks up the context named by a client's handle.
+ *
+ * @param phandle [IN] the handle sent by the client
+ *
+ * @return the context with a reference held, NULL if it is unknown.
+ *
+ */
+gss_ctx_entry_t *Gss_ctx_cache_get(gss_buffer_desc *phandle)
+{
+  gss_ctx_handle_t handle;
+  gss_ctx_entry_t *entry;
+  uint64_t state;
+
+  if(phandle == NULL || phandle->length != sizeof(handle))
+    goto miss;
+
+  memcpy(&handle, phandle->value, sizeof(handle));
+
+  if(handle.slot >= gss_ctx_table_size)
+    goto miss;
+
+  entry = &gss_ctx_table[handle.slot];
+
+  do
+    {
+      state = atomic_fetch_uint64_t(&entry->state);
+
+      if(GSS_CTX_GEN(state) != handle.generation ||
+         GSS_CTX_REFCNT(state) == 0 || (state & GSS_CTX_DYING))
+        goto miss;
+    }
+  while(!atomic_cas_uint64_t(&entry->state, state, state + 1));
+
+  if(entry->verifier != handle.verifier)
+    {
+      Gss_ctx_cache_put(entry);
+      goto miss;
+    }
+
+  atomic_inc_uint64_t(&gss_ctx_stats.hits);
+
+  return entry;
+
+ miss:
+  atomic_inc_uint64_t(&gss_ctx_stats.misses);
+
+  return NULL;
+}                               /* Gss_ctx_cache_get */
+
+/**
+ *
+ * Gss_ctx_cache_put: releases a reference on a context.
+ *
+ * @param entry [INOUT] the context
+ *
+ */
+void Gss_ctx_cache_put(gss_ctx_entry_t *entry)
+{
+  uint64_t state;
+
+  state = atomic_sub_uint64_t(&entry->state, 1);
+
+  if(GSS_CTX_REFCNT(state) == 0)
+    gss_ctx_release(entry, state);
+}                               /* Gss_ctx_cache_put */
+
+/**
+ *
+ * Gss_ctx_cache_del: deletes a context from the cache.
+ *
+ * The context is no longer found by its handle. It is released when
+ * the requests still using it are done.
+ *
+ * @param entry [INOUT] the context, the caller holds a reference on it
+ *
+ * @return 1 if ok, 0 if it was already deleted.
+ *
+ */
+int Gss_ctx_cache_del(gss_ctx_entry_t *entry)
+{
+  return gss_ctx_kill(entry);
+}                               /* Gss_ctx_cache_del */
+
+/**
+ *
+ * Gss_ctx_cache_check_seq: checks a sequence number against the window of a context.
+ *
+ * As described in RFC 2203, a sequence number already seen or lower
+ * than the last one by more than the window is rejected.  The window
+ * is only updated when commit is set, i.e. once the request has been
+ * authenticated.
+ *
+ * @param entry  [INOUT] the context
+ * @param seq    [IN]    the sequence number of the request
+ * @param commit [IN]    TRUE to record seq in the window
+ *
+ * @return GSS_CTX_SEQ_OK if the request may be processed.
+ *
+ */
+gss_ctx_seq_status_t Gss_ctx_cache_check_seq(gss_ctx_entry_t *entry,
+                                             u_int seq,
+                                             bool_t commit)
+{
+  uint64_t seqwin;
+  uint32_t seqlast;
+  uint32_t seqmask;
+  uint32_t offset;
+
+  do
+    {
+      seqwin = atomic_fetch_uint64_t(&entry->seqwin);
+      seqlast = (uint32_t)(seqwin >> 32);
+      seqmask = (uint32_t)seqwin;
+
+      if(seq > seqlast)
+        {
+          offset = seq - seqlast;
+          seqmask = offset >= 32 ? 0 : seqmask << offset;
+          seqlast = seq;
+          offset = 0;
+        }
+      else
+        {
+          offset = seqlast - seq;
+
+          if(offset >= entry->win)
+            {
+              atomic_inc_uint64_t(&entry->outside_window);
+              return GSS_CTX_SEQ_OUTSIDE_WINDOW;
+            }
+
+          if(seqmask & (1U << offset))
+            {
+              atomic_inc_uint64_t(&entry->replays);
+              return GSS_CTX_SEQ_REPLAY;
+            }
+        }
+
+      if(!commit)
+        return GSS_CTX_SEQ_OK;
+
+      seqmask |= 1U << offset;
+    }
+  while(!atomic_cas_uint64_t(&entry->seqwin, seqwin,
+                             ((uint64_t)seqlast << 32) | seqmask));
+
+  atomic_inc_uint64_t(&entry->calls);
+  entry->last_used = time(NULL);
+
+  return GSS_CTX_SEQ_OK;
+}                               /* Gss_ctx_cache_check_seq */
+
+/**
+ *
+ * Gss_ctx_cache_init: Init the GSS context cache
+ *
+ * @param pparam [IN] the krb5 parameters
+ *
+ * @return 0 if successful, -1 otherwise
+ *
+ */
+int Gss_ctx_cache_init(nfs_krb5_parameter_t *pparam)
+{
+  uint32_t i;
+
+  if(pparam->ctx_cache_size == 0)
+    {
+      LogCrit(COMPONENT_RPCSEC_GSS,
+              "GSS_CTX_CACHE: Context_Cache_Size must not be 0");
+      return -1;
+    }
+
+  gss_ctx_table = gsh_calloc(pparam->ctx_cache_size, sizeof(gss_ctx_entry_t));
+  if(gss_ctx_table == NULL)
+    {
+      LogCrit(COMPONENT_RPCSEC_GSS,
+              "GSS_CTX_CACHE: Cannot allocate %u contexts",
+              pparam->ctx_cache_size);
+      return -1;
+    }
+
+  gss_ctx_table_size = pparam->ctx_cache_size;
+
+  /* Thread the slots on the free list, lowest slot first */
+  for(i = gss_ctx_table_size; i > 0; i--)
+    {
+      gss_ctx_table[i - 1].slot = i - 1;
+      gss_ctx_table[i - 1].state = 1ULL << 32;
+      gss_ctx_table[i - 1].next_free = gss_ctx_free_head;
+      gss_ctx_free_head = i - 1;
+    }
+
+  gss_ctx_random_fd = open("/dev/urandom", O_RDONLY);
+  if(gss_ctx_random_fd < 0)
+    LogWarn(COMPONENT_RPCSEC_GSS,
+            "GSS_CTX_CACHE: Cannot open /dev/urandom, context handles "
+            "will be predictable");
+
+  gss_ctx_verifier_seed = ((uint64_t)time(NULL) << 32) ^ getpid();
+
+  return 0;
+}                               /* Gss_ctx_cache_init */
+
+/**
+ *
+ * Gss_ctx_cache_get_stats: returns the counters of the cache.
+ *
+ * @param pstats [OUT] the counters
+ *
+ */
+void Gss_ctx_cache_get_stats(gss_ctx_cache_stats_t *pstats)
+{
+  pstats->entries = atomic_fetch_uint64_t(&gss_ctx_stats.entries);
+  pstats->hits = atomic_fetch_uint64_t(&gss_ctx_stats.hits);
+  pstats->misses = atomic_fetch_uint64_t(&gss_ctx_stats.misses);
+  pstats->reclaimed = atomic_fetch_uint64_t(&gss_ctx_stats.reclaimed);
+}                               /* Gss_ctx_cache_get_stats */
+
+/**
+ *
+ * Gss_ctx_cache_Print: Displays the live contexts and their statistics (for debugging)
+ *
+ */
+void Gss_ctx_cache_Print(void)
+{
+  gss_ctx_entry_t *entry;
+  uint64_t state;
+  uint32_t i;
+
+  LogFullDebug(COMPONENT_RPCSEC_GSS,
+               "Gss context cache: %llu contexts, %llu hits, %llu misses, "
+               "%llu reclaimed",
+               (unsigned long long)gss_ctx_stats.entries,
+               (unsigned long long)gss_ctx_stats.hits,
+               (unsigned long long)gss_ctx_stats.misses,
+               (unsigned long long)gss_ctx_stats.reclaimed);
+
+  for(i = 0; i < gss_ctx_table_size; i++)
+    {
+      entry = &gss_ctx_table[i];
+      state = atomic_fetch_uint64_t(&entry->state);
+
+      if(GSS_CTX_REFCNT(state) == 0)
+        continue;
+
+      LogFullDebug(COMPONENT_RPCSEC_GSS,
+                   "slot=%u gen=%u refs=%llu%s cname=%.*s svc=%u "
+                   "seqwin=%llx calls=%llu replays=%llu outside_window=%llu "
+                   "created=%ld last_used=%ld",
+                   i, GSS_CTX_GEN(state),
+                   (unsigned long long)GSS_CTX_REFCNT(state),
+                   (state & GSS_CTX_DYING) ? " dying" : "",
+                   (int)entry->cname.length, (char *)entry->cname.value,
+                   entry->sec.svc,
+                   (unsigned long long)entry->seqwin,
+                   (unsigned long long)entry->calls,
+                   (unsigned long long)entry->replays,
+                   (unsigned long long)entry->outside_window,
+                   (long)entry->created, (long)entry->last_used);
+    }
+}                               /* Gss_ctx_cache_Print */
@@ -51,6 +51,9 @@
 #else
 #include <gssapi/gssapi.h>
 #include <gssapi/gssapi_generic.h>
+#ifdef HAVE_GSSAPI_GSSAPI_EXT_H
+#include <gssapi/gssapi_ext.h>
+#endif
 #endif
 
 #include "nfs_core.h"
@@ -293,9 +296,11 @@ Svcauth_gss_accept_sec_context(struct svc_req *rqst, struct rpc_gss_init_res *gr
     }
   /*
    * ANDROS: krb5 mechglue returns ctx of size 8 - two pointers,
-   * one to the mechanism oid, one to the internal_ctx_id
+   * one to the mechanism oid, one to the internal_ctx_id.
+   * Once the context is established, the client gets the handle of
+   * the context in the cache instead.
    */
-  if((gr->gr_ctx.value = gsh_malloc(sizeof(gss_union_ctx_id_desc))) == NULL)
+  if((gr->gr_ctx.value = gsh_malloc(sizeof(gss_ctx_handle_t))) == NULL)
     {
       LogCrit(COMPONENT_RPCSEC_GSS,
               "svcauth_gss_accept_context: out of memory");
@@ -305,7 +310,7 @@ Svcauth_gss_accept_sec_context(struct svc_req *rqst, struct rpc_gss_init_res *gr
   gr->gr_ctx.length = sizeof(gss_union_ctx_id_desc);
 
   /* gr->gr_win = 0x00000005; ANDROS: for debugging linux kernel version...  */
-  gr->gr_win = sizeof(gd->seqmask) * 8;
+  gr->gr_win = GSS_CTX_SEQ_WINDOW;
 
   /* Save client info. */
   gd->sec.mech = mech;
@@ -357,6 +362,11 @@ Svcauth_gss_accept_sec_context(struct svc_req *rqst, struct rpc_gss_init_res *gr
           goto errout;
         }
 
+      /* Keep the context in the cache, its handle is sent back */
+      if(Gss_ctx_cache_insert(gd, (gss_ctx_handle_t *)gr->gr_ctx.value) == NULL)
+        goto errout;
+      gr->gr_ctx.length = sizeof(gss_ctx_handle_t);
+
       rqst->rq_xprt->xp_verf.oa_flavor = RPCSEC_GSS;
       rqst->rq_xprt->xp_verf.oa_base = gd->checksum.value;
       rqst->rq_xprt->xp_verf.oa_length = gd->checksum.length;
@@ -364,6 +374,8 @@ Svcauth_gss_accept_sec_context(struct svc_req *rqst, struct rpc_gss_init_res *gr
   return (TRUE);
  errout:
   gss_release_buffer(&min_stat, &gr->gr_token);
+  gsh_free(gr->gr_ctx.value);
+  gr->gr_ctx.value = NULL;
   return (FALSE);
 }
 
@@ -386,6 +398,68 @@ int sprint_ctx(char *buff, unsigned char *ctx, int len)
   return len * 2;
 }
 
+/**
+ *
+ * Svcauth_gss_unbind: drops the context a svc_rpc_gss_data is using.
+ *
+ * If the context comes from the cache, the reference on it is released,
+ * otherwise the context is not established yet and belongs to gd.
+ *
+ * @param gd [INOUT] the structure to be used for authentication
+ *
+ */
+static void Svcauth_gss_unbind(struct svc_rpc_gss_data *gd)
+{
+  OM_uint32 min_stat;
+
+  if(gd->entry != NULL)
+    {
+      Gss_ctx_cache_put(gd->entry);
+      gd->entry = NULL;
+      gd->ctx = GSS_C_NO_CONTEXT;
+      gd->client_name = NULL;
+      gd->cname.value = NULL;
+      gd->cname.length = 0;
+    }
+  else
+    {
+      gss_delete_sec_context(&min_stat, &gd->ctx, GSS_C_NO_BUFFER);
+      gss_release_buffer(&min_stat, &gd->cname);
+      if(gd->client_name)
+        gss_release_name(&min_stat, &gd->client_name);
+    }
+
+  gd->established = FALSE;
+}                               /* Svcauth_gss_unbind */
+
+/**
+ *
+ * Svcauth_gss_bind: makes a svc_rpc_gss_data use a cached context.
+ *
+ * @param gd    [INOUT] the structure to be used for authentication
+ * @param entry [IN]    the context, gd takes over the caller's reference
+ *
+ */
+static void Svcauth_gss_bind(struct svc_rpc_gss_data *gd,
+                             gss_ctx_entry_t *entry)
+{
+  if(gd->entry == entry)
+    {
+      /* Already using it, keep a single reference */
+      Gss_ctx_cache_put(entry);
+      return;
+    }
+
+  Svcauth_gss_unbind(gd);
+
+  gd->entry = entry;
+  gd->ctx = entry->ctx;
+  gd->sec = entry->sec;
+  gd->cname = entry->cname;
+  gd->client_name = entry->client_name;
+  gd->win = entry->win;
+}                               /* Svcauth_gss_bind */
+
 static bool_t
 Svcauth_gss_validate(struct svc_req *rqst, struct svc_rpc_gss_data *gd,
                      struct rpc_msg *msg)
@@ -525,18 +599,11 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
   struct svc_rpc_gss_data *gd;
   struct rpc_gss_cred *gc;
   struct rpc_gss_init_res gr;
-  int call_stat, offset;
+  int call_stat;
   OM_uint32 min_stat;
-  gss_union_ctx_id_desc *gss_ctx_data;
+  gss_ctx_entry_t *entry;
   char ctx_str[64];
 
-  /* Used to update the hashtable entries. 
-   * These should not be used for purposes other than updating
-   * hashtable entries. */
-  bool_t *p_established = NULL;
-  u_int *p_seqlast = NULL;
-  uint32_t *p_seqmask = NULL;
-
   /* Initialize reply. */
   LogFullDebug(COMPONENT_RPCSEC_GSS, "Gssrpc__svcauth_gss called");
 
@@ -579,11 +646,6 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
     }
   XDR_DESTROY(&xdrs);
 
-  if(gc->gc_ctx.length != 0)
-    gss_ctx_data = (gss_union_ctx_id_desc *)(gc->gc_ctx.value);
-  else
-    gss_ctx_data = NULL;
-
   if(isFullDebug(COMPONENT_RPCSEC_GSS))
     {
       sprint_ctx(ctx_str, (char *)gc->gc_ctx.value, gc->gc_ctx.length);
@@ -592,52 +654,47 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
                    gc->gc_proc, str_gc_proc(gc->gc_proc), ctx_str);
     }
 
-  /* If we do not retrieve gss data from the cache, then this important
-   * variables could not possibly be meaningful. */
-  gd->seqlast = 0;
-  gd->seqmask = 0;
-  gd->established = 0;
-
-  /** @todo Think about restoring the correct lines */
-  /* if( gd->established == 0 && gc->gc_proc == RPCSEC_GSS_DATA   )*/
   if(gc->gc_proc == RPCSEC_GSS_DATA || gc->gc_proc == RPCSEC_GSS_DESTROY)
     {
       if(isFullDebug(COMPONENT_RPCSEC_GSS))
         {
           LogFullDebug(COMPONENT_RPCSEC_GSS,
-                       "Dump context hash table");
-          Gss_ctx_Hash_Print();
+                       "Dump context cache");
+          Gss_ctx_cache_Print();
         }
-      
-      LogFullDebug(COMPONENT_RPCSEC_GSS, "Getting gss data struct from "
-                   "hashtable.");
-      
-      /* Fill in svc_rpc_gss_data from cache */
-      if(!Gss_ctx_Hash_Get(gss_ctx_data,
-			   gd,
-			   &p_established,
-			   &p_seqlast,
-			   &p_seqmask))
+
+      /* The handle names the slot of the context in the cache */
+      if((entry = Gss_ctx_cache_get(&gc->gc_ctx)) == NULL)
 	{
           LogCrit(COMPONENT_RPCSEC_GSS, "Could not find gss context ");
+          gd->established = FALSE;
           ret_freegc(AUTH_REJECTEDCRED);
         }
-      else
-        {
-          /* If you 'mount -o sec=krb5i' you will have gc->gc_proc > 
-           * RPCSEC_GSS_SVN_NONE, but the negociation will have been made as
-           * if option was -o sec=krb5, the value of sec.svc has to be updated
-           * id the stored gd that we got fromn the hash */
-          if(gc->gc_svc != gd->sec.svc)
-            gd->sec.svc = gc->gc_svc;
-        }
+
+      Svcauth_gss_bind(gd, entry);
+      gd->established = TRUE;
+
+      /* If you 'mount -o sec=krb5i' you will have gc->gc_proc > 
+       * RPCSEC_GSS_SVN_NONE, but the negociation will have been made as
+       * if option was -o sec=krb5, the value of sec.svc has to be updated
+       * id the stored gd that we got fromn the cache */
+      if(gc->gc_svc != gd->sec.svc)
+        gd->sec.svc = gc->gc_svc;
     }
+  else if(gd->entry != NULL)
+    {
+      /* A new context is negotiated on this connection */
+      Svcauth_gss_unbind(gd);
+    }
+  else
+    gd->established = FALSE;
 
   if(isFullDebug(COMPONENT_RPCSEC_GSS))
     {
       char ctx_str_2[64];
 
-      sprint_ctx(ctx_str_2, (unsigned char *)gd->ctx, sizeof(gss_ctx_data));
+      sprint_ctx(ctx_str_2, (unsigned char *)gd->ctx,
+                 sizeof(gss_union_ctx_id_desc));
       sprint_ctx(ctx_str, (unsigned char *)gc->gc_ctx.value, gc->gc_ctx.length);
 
       LogFullDebug(COMPONENT_RPCSEC_GSS,
@@ -685,36 +742,32 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
           ret_freegc(RPCSEC_GSS_CTXPROBLEM);
         }
 
-      /* Check the difference between the current sequence number 
-       * and the last sequence number. */
+      /* Check the sequence number against the window of the context,
+       * it is recorded once the request is validated. */
       LogFullDebug(COMPONENT_RPCSEC_GSS,
-                   "seqlast: %d  seqnum: %d offset: %d seqwin: %d seqmask: %x",
-                   gd->seqlast, gc->gc_seq, gd->seqlast - gc->gc_seq, gd->win,
-                   gd->seqmask);
+                   "seqnum: %u seqwin: %u seqlast/seqmask: %llx",
+                   gc->gc_seq, gd->win,
+                   (unsigned long long)gd->entry->seqwin);
 
-      if((offset = gd->seqlast - gc->gc_seq) < 0)
-        {
-          gd->seqlast = gc->gc_seq;
-          offset = 0 - offset;
-          gd->seqmask <<= offset;
-          offset = 0;
-        }
-      else if((unsigned int)offset >= gd->win
-              || (gd->seqmask & (1 << (unsigned int)offset)))
+      switch(Gss_ctx_cache_check_seq(gd->entry, gc->gc_seq, FALSE))
         {
-          if ((unsigned int)offset >= gd->win)
-            LogDebug(COMPONENT_RPCSEC_GSS,
-                     "BAD AUTH: the current seqnum is lower "
-                     "than seqlast by %d and out of the seq window of size %d.", offset, gd->win);
-          else
-            LogDebug(COMPONENT_RPCSEC_GSS,
-                     "BAD AUTH: the current seqnum has already been used.");
+        case GSS_CTX_SEQ_OK:
+          break;
+
+        case GSS_CTX_SEQ_OUTSIDE_WINDOW:
+          LogDebug(COMPONENT_RPCSEC_GSS,
+                   "BAD AUTH: the current seqnum %u is out of the seq "
+                   "window of size %u.", gc->gc_seq, gd->win);
+          *no_dispatch = TRUE;
+          ret_freegc(RPCSEC_GSS_CTXPROBLEM);
 
+        case GSS_CTX_SEQ_REPLAY:
+          LogDebug(COMPONENT_RPCSEC_GSS,
+                   "BAD AUTH: the current seqnum has already been used.");
           *no_dispatch = TRUE;
           ret_freegc(RPCSEC_GSS_CTXPROBLEM);
         }
       gd->seq = gc->gc_seq;
-      gd->seqmask |= (1 << offset);
     }
 
   if(gd->established)
@@ -758,6 +811,8 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
 
       if(!Svcauth_gss_nextverf(rqst, htonl(gr.gr_win)))
         {
+          if(gd->entry != NULL)
+            Gss_ctx_cache_del(gd->entry);
           gss_release_buffer(&min_stat, &gr.gr_token);
           gsh_free(gr.gr_ctx.value);
           LogFullDebug(COMPONENT_RPCSEC_GSS, "BAD AUTH: Checksum verification "
@@ -794,19 +849,14 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
       if(!call_stat)
 	{
 	  LogFullDebug(COMPONENT_RPCSEC_GSS, "BAD AUTH: svc_sendreply failed.");
+          /* The client will never use the handle */
+          if(gd->entry != NULL)
+            Gss_ctx_cache_del(gd->entry);
 	  ret_freegc(AUTH_FAILED);
 	}
 
       if(gr.gr_major == GSS_S_COMPLETE)
-        {
-          gss_union_ctx_id_desc *gss_ctx_data2 =
-              (gss_union_ctx_id_desc *)gd->ctx;
-
-          gd->established = TRUE;
-
-          /* Keep the gss context in a hash, gr.gr_ctx.value is used as key */
-          (void) Gss_ctx_Hash_Set(gss_ctx_data2, gd);
-        }
+        gd->established = TRUE;
 
       break;
 
@@ -826,13 +876,15 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
 	  ret_freegc(AUTH_FAILED);
 	}
 
-      /* Update a few important values in the hashtable entry */
-      if ( p_established != NULL)
-	*p_established = gd->established;
-      if ( p_seqlast != NULL)
-	*p_seqlast = gd->seqlast;
-      if (p_seqmask != NULL)
-	*p_seqmask = gd->seqmask;
+      /* Record the sequence number, a concurrent request with the
+       * same one may have been validated meanwhile */
+      if(Gss_ctx_cache_check_seq(gd->entry, gc->gc_seq, TRUE) != GSS_CTX_SEQ_OK)
+        {
+          LogDebug(COMPONENT_RPCSEC_GSS,
+                   "BAD AUTH: the current seqnum has already been used.");
+          *no_dispatch = TRUE;
+          ret_freegc(RPCSEC_GSS_CTXPROBLEM);
+        }
 
       break;
 
@@ -857,13 +909,13 @@ Gssrpc__svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg,
                                  (xdrproc_t)xdr_void,
                                  (caddr_t) NULL);
 
-      if(!Gss_ctx_Hash_Del(gss_ctx_data))
+      if(!Gss_ctx_cache_del(gd->entry))
         {
           LogCrit(COMPONENT_RPCSEC_GSS,
-                  "Could not delete Gss Context from hash");
+                  "Could not delete Gss Context from cache");
         }
       else
-        LogFullDebug(COMPONENT_RPCSEC_GSS, "Gss_ctx_Hash_Del OK");
+        LogFullDebug(COMPONENT_RPCSEC_GSS, "Gss_ctx_cache_del OK");
 
       if(!Svcauth_gss_release_cred())
 	{
@@ -907,14 +959,10 @@ static bool_t Svcauth_gss_destroy(SVCAUTH * auth)
 
   gd = SVCAUTH_PRIVATE(auth);
 
-  gss_delete_sec_context(&min_stat, &gd->ctx, GSS_C_NO_BUFFER);
+  Svcauth_gss_unbind(gd);
 
-  gss_release_buffer(&min_stat, &gd->cname);
   gss_release_buffer(&min_stat, &gd->checksum);
 
-  if(gd->client_name)
-    gss_release_name(&min_stat, &gd->client_name);
-
   gsh_free(gd);
   gsh_free(auth);
 
@@ -961,6 +1009,109 @@ Xdr_rpc_gss_buf(XDR *xdrs, gss_buffer_t buf, u_int maxsize)
 	return xdr_stat;
 }
 
+#ifdef HAVE_GSS_WRAP_IOV
+/*
+ * Marshals and encrypts a databody_priv in place in the XDR stream.
+ *
+ * The rpc_gss_data_t is marshalled after room for the token header,
+ * then encrypted where it lies, so the body is neither copied into a
+ * separate buffer nor copied back into the stream.
+ *
+ * Returns -1, with nothing marshalled, if the mechanism cannot tell
+ * the size of its header; the caller then uses gss_wrap as before.
+ */
+static int
+Xdr_rpc_gss_wrap_in_place(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
+			  gss_ctx_id_t ctx, gss_qop_t qop, u_int seq)
+{
+	gss_iov_buffer_desc	iov[4];
+	gss_buffer_desc	databuf, wrapbuf;
+	OM_uint32	maj_stat, min_stat;
+	u_int		start, hdrlen, datalen, toklen;
+	int		conf_state;
+	bool_t		xdr_stat;
+	char		*token;
+
+	memset(iov, 0, sizeof(iov));
+	iov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+	iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+	iov[2].type = GSS_IOV_BUFFER_TYPE_PADDING;
+	iov[3].type = GSS_IOV_BUFFER_TYPE_TRAILER;
+
+	/* Size of the token header, which does not depend on the body */
+	maj_stat = gss_wrap_iov_length(&min_stat, ctx, TRUE, qop, NULL,
+				       iov, 4);
+	if (maj_stat != GSS_S_COMPLETE)
+		return (-1);
+	hdrlen = iov[0].buffer.length;
+
+	/* Marshal rpc_gss_data_t after the header. */
+	start = XDR_GETPOS(xdrs);
+	XDR_SETPOS(xdrs, start + 4 + hdrlen);
+	if (!xdr_u_int(xdrs, &seq) || !(*xdr_func)(xdrs, xdr_ptr))
+		return (FALSE);
+	datalen = XDR_GETPOS(xdrs) - start - 4 - hdrlen;
+
+	iov[1].buffer.length = datalen;
+	maj_stat = gss_wrap_iov_length(&min_stat, ctx, TRUE, qop, NULL,
+				       iov, 4);
+	if (maj_stat != GSS_S_COMPLETE || iov[0].buffer.length != hdrlen)
+		goto fallback;
+
+	toklen = hdrlen + datalen + iov[2].buffer.length +
+		 iov[3].buffer.length;
+
+	XDR_SETPOS(xdrs, start + 4);
+	token = (char *)XDR_INLINE(xdrs, RNDUP(toklen));
+	if (token == NULL)
+		goto fallback;
+
+	iov[0].buffer.value = token;
+	iov[1].buffer.value = token + hdrlen;
+	iov[2].buffer.value = token + hdrlen + datalen;
+	iov[3].buffer.value = token + hdrlen + datalen + iov[2].buffer.length;
+
+	maj_stat = gss_wrap_iov(&min_stat, ctx, TRUE, qop, &conf_state,
+				iov, 4);
+	if (maj_stat != GSS_S_COMPLETE) {
+		LogFullDebug(COMPONENT_RPCSEC_GSS,"gss_wrap_iov %d %d",
+                             maj_stat, min_stat);
+		return (FALSE);
+	}
+	memset(token + toklen, 0, RNDUP(toklen) - toklen);
+
+	/* Marshal databody_priv length. */
+	XDR_SETPOS(xdrs, start);
+	if (!xdr_u_int(xdrs, &toklen))
+		return (FALSE);
+	XDR_SETPOS(xdrs, start + 4 + RNDUP(toklen));
+
+	return (TRUE);
+
+ fallback:
+	/* Encrypt a copy of the body, as gss_wrap does */
+	XDR_SETPOS(xdrs, start + 4 + hdrlen);
+	databuf.value = XDR_INLINE(xdrs, datalen);
+	databuf.length = datalen;
+	if (databuf.value == NULL)
+		return (FALSE);
+
+	maj_stat = gss_wrap(&min_stat, ctx, TRUE, qop, &databuf,
+			    &conf_state, &wrapbuf);
+	if (maj_stat != GSS_S_COMPLETE) {
+		LogFullDebug(COMPONENT_RPCSEC_GSS,"gss_wrap %d %d",
+                             maj_stat, min_stat);
+		return (FALSE);
+	}
+	XDR_SETPOS(xdrs, start);
+	xdr_stat = Xdr_rpc_gss_buf(xdrs, &wrapbuf,
+				   (u_int)(wrapbuf.length + RPC_SLACK_SPACE));
+	gss_release_buffer(&min_stat, &wrapbuf);
+
+	return (xdr_stat);
+}
+#endif
+
 bool_t
 Xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 		      gss_ctx_id_t ctx, gss_qop_t qop,
@@ -972,6 +1123,15 @@ Xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	bool_t		xdr_stat = FALSE;
 	u_int		databuflen, maxwrapsz;
 
+#ifdef HAVE_GSS_WRAP_IOV
+	if (svc == RPCSEC_GSS_SVC_PRIVACY) {
+		int rc = Xdr_rpc_gss_wrap_in_place(xdrs, xdr_func, xdr_ptr,
+						   ctx, qop, seq);
+		if (rc != -1)
+			return (rc);
+	}
+#endif
+
 	/* Skip databody length. */
 	start = XDR_GETPOS(xdrs);
 	XDR_SETPOS(xdrs, start + 4);
@@ -1029,6 +1189,34 @@ Xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	return (xdr_stat);
 }
 
+#ifdef HAVE_GSS_UNWRAP_IOV
+/*
+ * Decrypts a databody_priv token in place: on success databuf points
+ * to the plain rpc_gss_data_t inside wrapbuf, which still has to be
+ * freed, instead of a newly allocated copy.
+ */
+static OM_uint32
+Gss_unwrap_in_place(OM_uint32 *min_stat, gss_ctx_id_t ctx,
+		    gss_buffer_t wrapbuf, gss_buffer_t databuf,
+		    int *conf_state, gss_qop_t *qop_state)
+{
+	gss_iov_buffer_desc	iov[2];
+	OM_uint32	maj_stat;
+
+	memset(iov, 0, sizeof(iov));
+	iov[0].type = GSS_IOV_BUFFER_TYPE_STREAM;
+	iov[0].buffer = *wrapbuf;
+	iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+
+	maj_stat = gss_unwrap_iov(min_stat, ctx, conf_state, qop_state,
+				  iov, 2);
+	if (maj_stat == GSS_S_COMPLETE)
+		*databuf = iov[1].buffer;
+
+	return (maj_stat);
+}
+#endif
+
 bool_t
 Xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 			gss_ctx_id_t ctx, gss_qop_t qop,
@@ -1094,6 +1282,21 @@ Xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 			return (FALSE);
 		}
 		/* Decrypt databody. */
+#ifdef HAVE_GSS_UNWRAP_IOV
+		maj_stat = Gss_unwrap_in_place(&min_stat, ctx, &wrapbuf,
+					       &databuf, &conf_state,
+					       &qop_state);
+
+		/* Verify encryption and QOP. */
+		if (maj_stat != GSS_S_COMPLETE || qop_state != qop ||
+			conf_state != TRUE) {
+			gsh_free(wrapbuf.value);
+			LogFullDebug(COMPONENT_RPCSEC_GSS,
+                                     "gss_unwrap_iov %d %d", maj_stat,
+                                     min_stat);
+			return (FALSE);
+		}
+#else
 		maj_stat = gss_unwrap(&min_stat, ctx, &wrapbuf, &databuf,
 				      &conf_state, &qop_state);
 
@@ -1107,12 +1310,18 @@ Xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
                                      "gss_unwrap %d %d", maj_stat, min_stat);
 			return (FALSE);
 		}
+#endif
 	}
 	/* Decode rpc_gss_data_t (sequence number + arguments). */
 	xdrmem_create(&tmpxdrs, databuf.value, databuf.length, XDR_DECODE);
 	xdr_stat = (xdr_u_int(&tmpxdrs, &seq_num) &&
 		    (*xdr_func)(&tmpxdrs, xdr_ptr));
 	XDR_DESTROY(&tmpxdrs);
+#ifdef HAVE_GSS_UNWRAP_IOV
+	/* A decrypted body lies inside the token */
+	if (svc == RPCSEC_GSS_SVC_PRIVACY)
+		databuf.value = wrapbuf.value;
+#endif
 #if 0
 	gss_release_buffer(&min_stat, &databuf);
 #else
@@ -1231,6 +1440,7 @@ int copy_svc_authgss(SVCXPRT *xprt_copy, SVCXPRT *xprt_orig)
           gd_o->cname.value     = NULL;
           gd_o->client_name     = NULL;
           gd_o->ctx             = NULL;
+          gd_o->entry           = NULL;
 
           /* fill in xp_auth */
           xprt_copy->xp_auth->svc_ah_private = (void *)gd_c;
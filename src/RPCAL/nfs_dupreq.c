@@ -24,10 +24,10 @@
  */
 
 /**
- * \file    nfs_tools.c
- * \brief   Some tools very usefull in the nfs protocol implementation.
+ * \file    nfs_dupreq.c
+ * \brief   Sharded duplicate request cache.
  *
- * Some tools very usefull in the nfs protocol implementation
+ * Sharded duplicate request cache, see nfs_dupreq.h
  *
  *
  */
@@ -67,22 +67,24 @@
 #include "nfs_exports.h"
 #include "nfs_file_handle.h"
 #include "nfs_dupreq.h"
+#include "crc32c.h"
 
-extern nfs_function_desc_t nfs2_func_desc[];
-extern nfs_function_desc_t nfs3_func_desc[];
-extern nfs_function_desc_t nfs4_func_desc[];
-extern nfs_function_desc_t mnt1_func_desc[];
-extern nfs_function_desc_t mnt3_func_desc[];
-#ifdef _USE_NLM
-extern nfs_function_desc_t nlm4_func_desc[];
-#endif                          /* _USE_NLM */
-#ifdef _USE_RQUOTA
-extern nfs_function_desc_t rquota1_func_desc[];
-extern nfs_function_desc_t rquota2_func_desc[];
-#endif                          /* _USE_QUOTA */
-/* Structure used for duplicated request cache */
-hash_table_t *ht_dupreq_udp;
-hash_table_t *ht_dupreq_tcp;
+/* One shard of the duplicate request cache.  A client's requests
+ * always land in the same shard, whatever the transport. */
+typedef struct dupreq_shard__
+{
+  pthread_mutex_t mtx;
+  struct glist_head *buckets;
+  uint32_t nbuckets;
+  struct glist_head lru;        /* finished entries, oldest first */
+  uint32_t lru_len;
+  uint32_t count[2];            /* entries, [0] UDP, [1] TCP */
+} dupreq_shard_t;
+
+static dupreq_shard_t *dupreq_shards;
+static uint32_t dupreq_nshards;
+static uint32_t dupreq_shard_size;
+static uint32_t dupreq_checksum_len;
 
 void LogDupReq(const char *label, sockaddr_t *addr, long xid, u_long rq_prog)
 {
@@ -105,293 +107,170 @@ static unsigned int get_ipproto_by_xprt( SVCXPRT * xprt )
      return IPPROTO_IP ; /* Dummy output */
 }
 
-
-static hash_table_t * get_ht_by_xprt( SVCXPRT * xprt )
+static inline int proto_index(int ipproto)
 {
-   return (get_ipproto_by_xprt( xprt )==IPPROTO_UDP)?ht_dupreq_udp:ht_dupreq_tcp ;
+  return (ipproto == IPPROTO_UDP) ? 0 : 1;
 }
 
-
-/**
- *
- * print_entry_dupreq: prints an entry in the LRU list.
- *
- * prints an entry in the LRU list.
- *
- * @param data [IN] data stored in a LRU entry to be printed.
- * @param str [OUT] string used to store the result.
- *
- * @return 0 if ok, other values mean an error.
- *
- */
-int print_entry_dupreq(LRU_data_t data, char *str)
+/* State of the XDR stream used to checksum the arguments of a call */
+typedef struct dupreq_crc_stream__
 {
-  strcpy(str, "");
-  return 0;
-}
-
-static int _remove_dupreq(hash_table_t *ht_dupreq, hash_buffer_t *buffkey,
-                          dupreq_entry_t *pdupreq, int nfs_req_status)
+  uint32_t crc;
+  u_int pos;
+  u_int limit;
+} dupreq_crc_stream_t;
+
+/* Returns FALSE once the limit is reached, to stop the encoder */
+static bool_t dupreq_crc_feed(dupreq_crc_stream_t *st, const char *buf,
+                              u_int len)
 {
-  int rc;
-  nfs_function_desc_t funcdesc = nfs2_func_desc[0];
-  hash_buffer_t usedbuffkey;
-
-  rc = HashTable_Del(ht_dupreq, buffkey, &usedbuffkey, NULL);
-
-  /* if hashtable no such key => dupreq garbaged by another thread */
-  if(rc != HASHTABLE_SUCCESS && rc != HASHTABLE_ERROR_NO_SUCH_KEY)
-    return 1;                   /* Error while cleaning */
-  else if(rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-    return 0;                   /* don't free the dupreq twice */
-
-  /* Locate the function descriptor associated with this cached request */
-  if(pdupreq->rq_prog == nfs_param.core_param.program[P_NFS])
-    {
-      switch (pdupreq->rq_vers)
-        {
-        case NFS_V2:
-          funcdesc = nfs2_func_desc[pdupreq->rq_proc];
-          break;
-
-        case NFS_V3:
-          funcdesc = nfs3_func_desc[pdupreq->rq_proc];
-          break;
-
-        case NFS_V4:
-          funcdesc = nfs4_func_desc[pdupreq->rq_proc];
-          break;
-
-        default:
-          /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-          LogMajor(COMPONENT_DUPREQ,
-                   "NFS Protocol version %d unknown in dupreq_gc",
-                   (int)pdupreq->rq_vers);
-        }
-    }
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_MNT])
-    {
-      switch (pdupreq->rq_vers)
-        {
-        case MOUNT_V1:
-          funcdesc = mnt1_func_desc[pdupreq->rq_proc];
-          break;
-
-        case MOUNT_V3:
-          funcdesc = mnt3_func_desc[pdupreq->rq_proc];
-          break;
-
-        default:
-          /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-          LogMajor(COMPONENT_DUPREQ,
-                   "MOUNT Protocol version %d unknown in dupreq_gc",
-                   (int)pdupreq->rq_vers);
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#ifdef _USE_NLM
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_NLM])
-    {
-
-      switch (pdupreq->rq_vers)
-        {
-        case NLM4_VERS:
-          funcdesc = nlm4_func_desc[pdupreq->rq_proc];
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#endif                          /* _USE_NLM */
-#ifdef _USE_RQUOTA
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_RQUOTA])
-    {
+  if(st->pos >= st->limit)
+    return FALSE;
 
-      switch (pdupreq->rq_vers)
-        {
-        case RQUOTAVERS:
-          funcdesc = rquota1_func_desc[pdupreq->rq_proc];
-          break;
-
-        case EXT_RQUOTAVERS:
-          funcdesc = rquota2_func_desc[pdupreq->rq_proc];
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#endif
-  else
-    {
-      /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-      LogMajor(COMPONENT_DUPREQ,
-               "protocol %d is not managed",
-               (int)pdupreq->rq_prog);
-    }
+  st->crc = crc32c(st->crc, buf,
+                   (len < st->limit - st->pos) ? len : st->limit - st->pos);
+  st->pos += len;
 
-  /* Call the free function */
-  if (nfs_req_status == NFS_REQ_OK)
-    funcdesc.free_function(&(pdupreq->res_nfs));
-
-  /* Send the entry back to the pool */
-  pool_free(dupreq_pool, pdupreq);
-  gsh_free(usedbuffkey.pdata);
-
-  return DUPREQ_SUCCESS;
+  return TRUE;
 }
 
-int nfs_dupreq_delete(struct svc_req *req)
+static bool_t dupreq_crc_putlong(XDR *xdrs, const long *lp)
 {
-  int status;
-
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  dupreq_key_t dupkey;
-  dupreq_entry_t *pdupreq;
-  hash_table_t * ht_dupreq = NULL;
+  int32_t l = htonl((int32_t) *lp);
 
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt(req->rq_xprt) ;
+  return dupreq_crc_feed((dupreq_crc_stream_t *) xdrs->x_private,
+                         (char *)&l, sizeof(l));
+}
 
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, req->rq_xprt) == 0)
-    return DUPREQ_NOT_FOUND;
+static bool_t dupreq_crc_putbytes(XDR *xdrs, const char *addr, u_int len)
+{
+  return dupreq_crc_feed((dupreq_crc_stream_t *) xdrs->x_private, addr,
+                         len);
+}
 
-  dupkey.xid = req->rq_xid;
-  dupkey.checksum = 0;
+/* The stream is encode only */
+static bool_t dupreq_crc_getlong(XDR *xdrs, long *lp)
+{
+  return FALSE;
+}
 
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
+static bool_t dupreq_crc_getbytes(XDR *xdrs, caddr_t addr, u_int len)
+{
+  return FALSE;
+}
 
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-    {
-      pdupreq = (dupreq_entry_t *) buffval.pdata;
+static bool_t dupreq_crc_control(XDR *xdrs, int request, void *info)
+{
+  return FALSE;
+}
 
-      /* reset timestamp */
-      pdupreq->timestamp = time(NULL);
+static u_int dupreq_crc_getpostn(XDR *xdrs)
+{
+  return ((dupreq_crc_stream_t *) xdrs->x_private)->pos;
+}
 
-      status = DUPREQ_SUCCESS;
-    }
-  else {
-    return DUPREQ_NOT_FOUND;
-  }
+static bool_t dupreq_crc_setpostn(XDR *xdrs, u_int pos)
+{
+  return FALSE;
+}
 
-  LogDupReq("REMOVING", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+static int32_t *dupreq_crc_inline(XDR *xdrs, u_int len)
+{
+  /* Make the encoders fall back to putlong */
+  return NULL;
+}
 
-  status = _remove_dupreq( ht_dupreq, &buffkey, pdupreq, !NFS_REQ_OK);
-  return status;
+static void dupreq_crc_destroy(XDR *xdrs)
+{
 }
 
+static const struct xdr_ops dupreq_crc_ops = {
+  .x_getlong = dupreq_crc_getlong,
+  .x_putlong = dupreq_crc_putlong,
+  .x_getbytes = dupreq_crc_getbytes,
+  .x_putbytes = dupreq_crc_putbytes,
+  .x_getpostn = dupreq_crc_getpostn,
+  .x_setpostn = dupreq_crc_setpostn,
+  .x_inline = dupreq_crc_inline,
+  .x_destroy = dupreq_crc_destroy,
+  .x_control = dupreq_crc_control,
+};
+
 /**
  *
- * clean_entry_dupreq: cleans an entry in the dupreq cache.
+ * nfs_dupreq_checksum: computes the checksum part of a request's key.
  *
- * cleans an entry in the dupreq cache.
+ * The decoded arguments are encoded again into a stream that keeps
+ * nothing but the CRC32C of its first Checksum_Length bytes.  XDR
+ * being canonical, these are the bytes of the call body as received.
+ * Called once the arguments are decoded, for the requests that go
+ * through the cache.
  *
- * @param pentry [INOUT] entry to be cleaned.
- * @param addparam [IN] additional parameter used for cleaning.
- *
- * @return 0 if ok, other values mean an error.
+ * @param preqnfs [INOUT] the request, with its arguments decoded
+ * @param decode_func [IN] the XDR function of the arguments
  *
  */
-int clean_entry_dupreq(LRU_entry_t *pentry, void *addparam)
+void nfs_dupreq_checksum(struct nfs_request_data__ *preqnfs,
+                         xdrproc_t decode_func)
 {
-  hash_buffer_t buffkey;
-  dupreq_entry_t *pdupreq = (dupreq_entry_t *) (pentry->buffdata.pdata);
-  dupreq_key_t dupkey;
-  hash_table_t * ht_dupreq = NULL ;
+  dupreq_crc_stream_t st;
+  XDR xdrs;
 
-  /* Get the socket address for the key */
-  memcpy((char *)&dupkey.addr, (char *)&pdupreq->addr, sizeof(dupkey.addr));
-  dupkey.xid = pdupreq->xid;
-  dupkey.checksum = pdupreq->checksum;
+  preqnfs->dupreq_checksum = 0;
+  if(dupreq_checksum_len == 0)
+    return;
 
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
+  st.crc = 0;
+  st.pos = 0;
+  st.limit = dupreq_checksum_len;
 
-  /* Get correct HT depending on proto used */
-  if( pdupreq->ipproto == IPPROTO_TCP )
-     ht_dupreq = ht_dupreq_tcp ;
-  else
-     ht_dupreq = ht_dupreq_udp ;
+  memset(&xdrs, 0, sizeof(xdrs));
+  xdrs.x_op = XDR_ENCODE;
+  xdrs.x_ops = (struct xdr_ops *) &dupreq_crc_ops;
+  xdrs.x_private = (caddr_t) &st;
 
-  LogDupReq("Garbage collection on", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  /* The encoder fails once Checksum_Length bytes are fed, or on any
+   * error; the checksum of what was encoded so far is as good as any
+   * for a key as long as it is repeatable */
+  (void) decode_func(&xdrs, &preqnfs->arg_nfs);
 
-  return _remove_dupreq(ht_dupreq, &buffkey, pdupreq, NFS_REQ_OK);
-}                               /* clean_entry_dupreq */
+  preqnfs->dupreq_checksum = st.crc;
+}                               /* nfs_dupreq_checksum */
 
 /**
  *
- * dupreq_rbt_hash_func: computes the hash value for the entry in dupreq cache.
- *
- * Computes the hash value for the entry in dupreq cache.  In fact, it just uses the xid
- * modulo the hash array size.
+ * dupreq_make_key: builds the key of a request and finds its shard.
  *
- * This function is called internal in the HasTable_* function
+ * @param preqnfs [IN] the request
+ * @param pkey [OUT] the key
+ * @param phk [OUT] the hash of the key
  *
- * @param hparam [IN] hash table parameter.
- * @param buffcleff[in] pointer to the hash key buffer
- *
- * @return the computed hash value.
- *
- * @see HashTable_Init
+ * @return the shard, NULL if the client address could not be read.
  *
  */
-uint32_t dupreq_value_hash_func(hash_parameter_t * p_hparam,
-                                hash_buffer_t * buffclef)
+static dupreq_shard_t *dupreq_make_key(nfs_request_data_t *preqnfs,
+                                       dupreq_key_t *pkey,
+                                       uint32_t *phk)
 {
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(buffclef->pdata);
-  unsigned long addr_hash = hash_sockaddr((sockaddr_t *) &pdupkey->addr, CHECK_PORT);
+  struct svc_req *req = &preqnfs->req;
+  unsigned long addr_hash;
 
-  return (((unsigned long)pdupkey->xid + addr_hash)^(pdupkey->checksum)) % p_hparam->index_size;
-}                               /*  dupreq_value_hash_func */
+  memset(pkey, 0, sizeof(dupreq_key_t));
+  if(copy_xprt_addr(&pkey->addr, req->rq_xprt) == 0)
+    return NULL;
 
-/**
- *
- *  dupreq_rbt_hash_func: computes the rbt value for the entry in dupreq cache.
- *
- * Computes the rbt value for the entry in dupreq cache. In fact, it just use the Xid
- * itself (which is an unsigned integer) as the rbt value.
- * This function is called internal in the HasTable_* function
- *
- * @param hparam [IN] hash table parameter.
- * @param buffcleff[in] pointer to the hash key buffer
- *
- * @return the computed rbt value.
- *
- * @see HashTable_Init
- *
- */
-uint64_t dupreq_rbt_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef)
-{
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(buffclef->pdata);
+  pkey->xid = req->rq_xid;
+  pkey->checksum = (int) preqnfs->dupreq_checksum;
 
-  unsigned long addr_hash = hash_sockaddr((sockaddr_t *) &pdupkey->addr, CHECK_PORT);
+  addr_hash = hash_sockaddr(&pkey->addr, CHECK_PORT);
+  *phk = (uint32_t) (((unsigned long)pkey->xid + addr_hash) ^ pkey->checksum);
 
-  return (((unsigned long)pdupkey->xid + addr_hash)^(pdupkey->checksum));
-}                               /* dupreq_rbt_hash_func */
+  return &dupreq_shards[hash_sockaddr(&pkey->addr, IGNORE_PORT) %
+                        dupreq_nshards];
+}
 
-/**
- *
- * compare_req: compares the xid, ip, and port stored in the key buffers.
- * may also compare the checksum if the relevant option was enabled during
- * compile.
- *
- * compare the xid, ip, and port stored in the key buffers. This function is
- * to be used as 'compare_key' field in
- * the hashtable storing the nfs duplicated requests.
- *
- * @param buff1 [IN] first key
- * @param buff2 [IN] second key
- *
- * @return 0 if keys are identifical, 1 if they are different.
- *
- */
-int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2)
+static inline int dupreq_key_cmp(dupreq_key_t *key1, dupreq_key_t *key2)
 {
-  dupreq_key_t *key1 = (dupreq_key_t *)(buff1->pdata);
-  dupreq_key_t *key2 = (dupreq_key_t *)(buff2->pdata);
-
   if (key1->xid != key2->xid)
     return 1;
   if (cmp_sockaddr(&key1->addr, &key2->addr, CHECK_PORT) == 0)
@@ -399,63 +278,126 @@ int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2)
   if (key1->checksum != key2->checksum)
     return 1;
   return 0;
-}                               /* compare_xid */
+}
+
+/* Must be called with the shard locked */
+static dupreq_entry_t *dupreq_lookup(dupreq_shard_t *shard,
+                                     dupreq_key_t *pkey, uint32_t hk,
+                                     int ipproto)
+{
+  struct glist_head *glist;
+  dupreq_entry_t *pdupreq;
+
+  glist_for_each(glist, &shard->buckets[hk % shard->nbuckets])
+    {
+      pdupreq = glist_entry(glist, dupreq_entry_t, hash_link);
+      if(pdupreq->hk == hk && pdupreq->ipproto == ipproto &&
+         dupreq_key_cmp(&pdupreq->key, pkey) == 0)
+        return pdupreq;
+    }
+
+  return NULL;
+}
+
+/* Must be called with the shard locked */
+static void dupreq_remove(dupreq_shard_t *shard, dupreq_entry_t *pdupreq)
+{
+  glist_del(&pdupreq->hash_link);
+  if(!pdupreq->processing)
+    {
+      glist_del(&pdupreq->lru_link);
+      shard->lru_len--;
+    }
+  shard->count[proto_index(pdupreq->ipproto)]--;
+
+  nfs_dupreq_free_reply(&pdupreq->reply);
+  pool_free(dupreq_pool, pdupreq);
+}
+
+/* Must be called with the shard locked.  Drops finished entries that
+ * have expired, then the oldest ones until there is room for one more. */
+static void dupreq_trim(dupreq_shard_t *shard, uint32_t room)
+{
+  time_t now = time(NULL);
+  dupreq_entry_t *pdupreq;
+
+  while(!glist_empty(&shard->lru))
+    {
+      pdupreq = glist_first_entry(&shard->lru, dupreq_entry_t, lru_link);
+      if(shard->lru_len + room <= dupreq_shard_size &&
+         now - pdupreq->timestamp <= nfs_param.core_param.expiration_dupreq)
+        break;
+
+      LogDupReq("Garbage collection on", &pdupreq->key.addr,
+                pdupreq->key.xid, pdupreq->rq_prog);
+      dupreq_remove(shard, pdupreq);
+    }
+}
 
 /**
  *
- * display_req_key: displays the key stored in the buffer.
- *
- * displays the key stored in the buffer. This function is to be used as 'key_to_str' field in
- * the hashtable storing the nfs duplicated requests.
- *
- * @param buff1 [IN]  buffer to display
- * @param buff2 [OUT] output string
+ * xdr_dupreq_reply: sends back the results cached in a reply.
  *
- * @return number of character written.
+ * The bytes were produced by the request's own encoder, so they are
+ * already a multiple of 4 long and xdr_opaque adds no padding.
  *
  */
-int display_req_key(hash_buffer_t * pbuff, char *str)
+bool_t xdr_dupreq_reply(XDR *xdrs, dupreq_reply_t *reply)
 {
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(pbuff->pdata);
-  char namebuf[SOCK_NAME_MAX];
-
-  sprint_sockaddr(&pdupkey->addr, namebuf, sizeof(namebuf));
+  if(xdrs->x_op != XDR_ENCODE)
+    return TRUE;
 
-  return sprintf(str, "addr=%s xid=%ld checksum=%d",
-                 namebuf, pdupkey->xid, pdupkey->checksum);
+  return xdr_opaque(xdrs, reply->data, reply->len);
+}
 
+void nfs_dupreq_free_reply(dupreq_reply_t *reply)
+{
+  if(reply->data != NULL)
+    gsh_free(reply->data);
+  reply->data = NULL;
+  reply->len = 0;
 }
 
 /**
  *
- * display_req_val: displays the value stored in the buffer.
- *
- * displays the value stored in the buffer. This function is to be used as 'val_to_str' field in
- * the hashtable storing the nfs duplicated requests.
+ * nfs_dupreq_delete: removes a request from the duplicate request cache.
  *
- * @param buff1 [IN]  buffer to display
- * @param buff2 [OUT] output string
+ * @param preqnfs [IN] the request
  *
- * @return number of character written.
+ * @return DUPREQ_SUCCESS if the entry was removed, DUPREQ_NOT_FOUND otherwise.
  *
  */
-int display_req_val(hash_buffer_t *pbuff, char *str)
+int nfs_dupreq_delete(nfs_request_data_t *preqnfs)
 {
-  dupreq_entry_t *pdupreq = (dupreq_entry_t *)(pbuff->pdata);
-  char namebuf[SOCK_NAME_MAX];
+  struct svc_req *req = &preqnfs->req;
+  dupreq_key_t dupkey;
+  dupreq_shard_t *shard;
+  dupreq_entry_t *pdupreq;
+  uint32_t hk;
+
+  if((shard = dupreq_make_key(preqnfs, &dupkey, &hk)) == NULL)
+    return DUPREQ_NOT_FOUND;
 
-  sprint_sockaddr(&pdupreq->addr, namebuf, sizeof(namebuf));
+  P(shard->mtx);
+  pdupreq = dupreq_lookup(shard, &dupkey, hk,
+                          get_ipproto_by_xprt(req->rq_xprt));
+  if(pdupreq == NULL)
+    {
+      V(shard->mtx);
+      return DUPREQ_NOT_FOUND;
+    }
 
-  return sprintf(str, "addr=%s xid=%ld checksum=%d rq_prog=%lu rq_vers=%lu rq_proc=%lu",
-                 namebuf, pdupreq->xid, pdupreq->checksum,
-                 pdupreq->rq_prog, pdupreq->rq_vers, pdupreq->rq_proc);
+  LogDupReq("REMOVING", &pdupreq->key.addr, pdupreq->key.xid,
+            pdupreq->rq_prog);
+  dupreq_remove(shard, pdupreq);
+  V(shard->mtx);
+
+  return DUPREQ_SUCCESS;
 }
 
 /**
  *
- * nfs_Init_dupreq: Init the hashtable and LRU for duplicate request cache
- *
- * Perform all the required initialization for hashtable and LRU for duplicate request cache
+ * nfs_Init_dupreq: Init the shards of the duplicate request cache
  *
  * @param param [IN] parameter used to init the duplicate request cache
  *
@@ -464,20 +406,55 @@ int display_req_val(hash_buffer_t *pbuff, char *str)
  */
 int nfs_Init_dupreq(nfs_rpc_dupreq_parameter_t param)
 {
-  if((ht_dupreq_udp = HashTable_Init(&param.hash_param)) == NULL)
+  uint32_t i, j;
+
+  dupreq_nshards = param.hash_param.index_size;
+  dupreq_shard_size = param.shard_size;
+  dupreq_checksum_len = param.checksum_len;
+  if(dupreq_nshards == 0 || dupreq_shard_size == 0)
     {
       LogCrit(COMPONENT_DUPREQ,
-              "Cannot init the duplicate request hash table");
+              "Duplicate request cache needs at least one shard of one entry");
       return -1;
     }
 
-  if((ht_dupreq_tcp = HashTable_Init(&param.hash_param)) == NULL)
+  dupreq_shards = gsh_calloc(dupreq_nshards, sizeof(dupreq_shard_t));
+  if(dupreq_shards == NULL)
     {
       LogCrit(COMPONENT_DUPREQ,
-              "Cannot init the duplicate request hash table");
+              "Cannot allocate the duplicate request cache shards");
       return -1;
     }
 
+  for(i = 0; i < dupreq_nshards; i++)
+    {
+      dupreq_shard_t *shard = &dupreq_shards[i];
+
+      if(pthread_mutex_init(&shard->mtx, NULL) != 0)
+        {
+          LogCrit(COMPONENT_DUPREQ,
+                  "Cannot init the duplicate request cache shard mutex");
+          return -1;
+        }
+
+      /* Keep the chains about one entry long when the shard is full */
+      shard->nbuckets = dupreq_shard_size;
+      shard->buckets = gsh_malloc(shard->nbuckets * sizeof(struct glist_head));
+      if(shard->buckets == NULL)
+        {
+          LogCrit(COMPONENT_DUPREQ,
+                  "Cannot allocate the duplicate request cache buckets");
+          return -1;
+        }
+      for(j = 0; j < shard->nbuckets; j++)
+        init_glist(&shard->buckets[j]);
+
+      init_glist(&shard->lru);
+    }
+
+  LogInfo(COMPONENT_DUPREQ,
+          "Duplicate request cache: %u shards of %u entries",
+          dupreq_nshards, dupreq_shard_size);
 
   return DUPREQ_SUCCESS;
 }                               /* nfs_Init_dupreq */
@@ -486,281 +463,227 @@ int nfs_Init_dupreq(nfs_rpc_dupreq_parameter_t param)
  *
  * nfs_dupreq_add_not_finished: adds an entry in the duplicate requests cache.
  *
- * Adds an entry in the duplicate requests cache.
+ * Adds an entry in the duplicate requests cache.  If the request is
+ * already known and finished, a copy of its encoded reply is returned
+ * in reply, to be sent with xdr_dupreq_reply and released with
+ * nfs_dupreq_free_reply.
  *
- * @param xid [IN] the transfer id to be used as key
- * @param pnfsreq [IN] the request pointer to cache
+ * @param preqnfs [IN] the request
+ * @param reply [OUT] the previous reply if DUPREQ_ALREADY_EXISTS
  *
  * @return DUPREQ_SUCCESS if successfull\n.
+ * @return DUPREQ_ALREADY_EXISTS if the request was answered before.
+ * @return DUPREQ_BEING_PROCESSED if another thread is processing it.
  * @return DUPREQ_INSERT_MALLOC_ERROR if an error occured during the insertion process.
  *
  */
 
-int nfs_dupreq_add_not_finished(struct svc_req *req,
-                                nfs_res_t *res_nfs)
+int nfs_dupreq_add_not_finished(nfs_request_data_t *preqnfs,
+                                dupreq_reply_t *reply)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  hash_buffer_t buffdata;
-  dupreq_entry_t *pdupreq = NULL;
-  int status = 0;
-  dupreq_key_t *pdupkey = NULL;
-  hash_table_t * ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt(req->rq_xprt);
-  /* Entry to be cached */
-  pdupreq = pool_alloc(dupreq_pool, NULL);
-  if(pdupreq == NULL)
+  struct svc_req *req = &preqnfs->req;
+  dupreq_key_t dupkey;
+  dupreq_shard_t *shard;
+  dupreq_entry_t *pdupreq;
+  uint32_t hk;
+  int ipproto = get_ipproto_by_xprt(req->rq_xprt);
+  int status;
+
+  reply->data = NULL;
+  reply->len = 0;
+
+  if((shard = dupreq_make_key(preqnfs, &dupkey, &hk)) == NULL)
     return DUPREQ_INSERT_MALLOC_ERROR;
 
-  if(pthread_mutex_init(&pdupreq->dupreq_mutex, NULL) == -1)
-    {
-      pool_free(dupreq_pool, pdupreq);
-      return DUPREQ_INSERT_MALLOC_ERROR;
-    }
+  P(shard->mtx);
 
-  if((pdupkey = gsh_malloc(sizeof(dupreq_key_t))) == NULL)
+  if((pdupreq = dupreq_lookup(shard, &dupkey, hk, ipproto)) != NULL)
     {
-      pool_free(dupreq_pool, pdupreq);
-      return DUPREQ_INSERT_MALLOC_ERROR;
+      if(pdupreq->processing)
+        status = DUPREQ_BEING_PROCESSED;
+      else if((reply->data = gsh_malloc(pdupreq->reply.len)) == NULL)
+        status = DUPREQ_INSERT_MALLOC_ERROR;
+      else
+        {
+          memcpy(reply->data, pdupreq->reply.data, pdupreq->reply.len);
+          reply->len = pdupreq->reply.len;
+          status = DUPREQ_ALREADY_EXISTS;
+        }
+      V(shard->mtx);
+      return status;
     }
 
-  /* Get the socket address for the key and the request */
-  if(copy_xprt_addr(&pdupkey->addr, req->rq_xprt) == 0 ||
-     copy_xprt_addr(&pdupreq->addr, req->rq_xprt) == 0)
+  dupreq_trim(shard, 1);
+
+  /* Entry to be cached */
+  if((pdupreq = pool_alloc(dupreq_pool, NULL)) == NULL)
     {
-      gsh_free(pdupkey);
-      pool_free(dupreq_pool, pdupreq);
+      V(shard->mtx);
       return DUPREQ_INSERT_MALLOC_ERROR;
     }
 
-  pdupkey->xid = req->rq_xid;
-  pdupreq->xid = req->rq_xid;
-
-  /* Checksum the request */
-  pdupkey->checksum = 0;
-  pdupreq->checksum = 0;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) pdupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-
-  /* I build the data with the request pointer that should be in state 'IN USE' */
+  pdupreq->key = dupkey;
+  pdupreq->hk = hk;
+  pdupreq->ipproto = ipproto;
+  pdupreq->processing = 1;
+  pdupreq->reply.data = NULL;
+  pdupreq->reply.len = 0;
   pdupreq->rq_prog = req->rq_prog;
   pdupreq->rq_vers = req->rq_vers;
   pdupreq->rq_proc = req->rq_proc;
   pdupreq->timestamp = time(NULL);
-  pdupreq->processing = 1;
-  pdupreq->ipproto = get_ipproto_by_xprt(req->rq_xprt) ;
-  buffdata.pdata = (caddr_t) pdupreq;
-  buffdata.len = sizeof(dupreq_entry_t);
 
-  LogDupReq("Add Not Finished", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  glist_add_tail(&shard->buckets[hk % shard->nbuckets], &pdupreq->hash_link);
+  shard->count[proto_index(ipproto)]++;
 
-  status = HashTable_Test_And_Set(ht_dupreq, &buffkey, &buffdata,
-                                  HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+  V(shard->mtx);
 
-  if (status == HASHTABLE_ERROR_KEY_ALREADY_EXISTS)
-    {
-      if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-        {
-          P(((dupreq_entry_t *)buffval.pdata)->dupreq_mutex);
-          if ( ((dupreq_entry_t *)buffval.pdata)->processing == 1)
-            {
-              status = DUPREQ_BEING_PROCESSED;
-            }
-          else
-            {
-              *res_nfs = ((dupreq_entry_t *) buffval.pdata)->res_nfs;
-              status = DUPREQ_ALREADY_EXISTS;
-            }
-          V(((dupreq_entry_t *)buffval.pdata)->dupreq_mutex);
-        }
-      else
-        status = DUPREQ_NOT_FOUND;
-    }
-  else if (status == HASHTABLE_INSERT_MALLOC_ERROR)
-      status = DUPREQ_INSERT_MALLOC_ERROR;
-  else
-    status = DUPREQ_SUCCESS;
-  if (status != DUPREQ_SUCCESS) {
-    pool_free(dupreq_pool, pdupreq);
-    gsh_free(pdupkey);
-  }
-  return status;
+  LogDupReq("Add Not Finished", &dupkey.addr, dupkey.xid, req->rq_prog);
+
+  return DUPREQ_SUCCESS;
 }                               /* nfs_dupreq_add_not_finished */
 
 /**
  *
- * nfs_dupreq_finish: Changes the being_processed flag in a dupreq to 0 and
- * adds the reply info to the buffval.
+ * nfs_dupreq_finish: stores the encoded reply of a request and marks it finished.
  *
- * Changes the being_processed flag in a dupreq to 0 and adds the reply info
- * to the buffval. Used after the duplicate request has already been added to
- * the dupreq cache but has not been fully processed yet.
+ * The results are encoded once more, into a buffer owned by the cache,
+ * so the caller keeps ownership of p_res_nfs and must free it as usual.
+ * If the results cannot be encoded the entry is removed: a
+ * retransmission will then be processed again.
  *
- * @param xid [IN] the transfer id to be used as key
- * @param pnfsreq [IN] the request pointer to cache
+ * @param preqnfs [IN] the request
+ * @param p_res_nfs [IN] the results sent to the client
+ * @param encode_func [IN] the XDR function used to send them
  *
  * @return DUPREQ_SUCCESS if successfull\n.
- * @return DUPREQ_INSERT_MALLOC_ERROR if an error occured during the insertion process.
+ * @return DUPREQ_INSERT_MALLOC_ERROR if the reply could not be kept.
+ * @return DUPREQ_NOT_FOUND if the request is not in the cache.
  *
  */
 
-int nfs_dupreq_finish(struct svc_req *req, nfs_res_t *p_res_nfs,
-                      LRU_list_t *lru_dupreq)
+int nfs_dupreq_finish(nfs_request_data_t *preqnfs, nfs_res_t *p_res_nfs,
+                      xdrproc_t encode_func)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  LRU_entry_t *pentry = NULL;
-  LRU_status_t lru_status;
+  struct svc_req *req = &preqnfs->req;
   dupreq_key_t dupkey;
+  dupreq_shard_t *shard;
   dupreq_entry_t *pdupreq;
-  hash_table_t *ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt(req->rq_xprt) ;
- 
+  dupreq_reply_t reply;
+  uint32_t hk;
+  XDR xdrs;
+  int status = DUPREQ_SUCCESS;
 
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, req->rq_xprt) == 0)
+  if((shard = dupreq_make_key(preqnfs, &dupkey, &hk)) == NULL)
     return DUPREQ_NOT_FOUND;
 
-  dupkey.xid = req->rq_xid;
-  dupkey.checksum = 0;
+  /* Encode outside of the shard lock */
+  reply.len = xdr_sizeof(encode_func, p_res_nfs);
+  reply.data = (reply.len != 0) ? gsh_malloc(reply.len) : NULL;
+  if(reply.data != NULL)
+    {
+      xdrmem_create(&xdrs, reply.data, reply.len, XDR_ENCODE);
+      if(!encode_func(&xdrs, p_res_nfs))
+        nfs_dupreq_free_reply(&reply);
+      else
+        reply.len = XDR_GETPOS(&xdrs);
+      XDR_DESTROY(&xdrs);
+    }
+  if(reply.data == NULL)
+    status = DUPREQ_INSERT_MALLOC_ERROR;
 
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) != HASHTABLE_SUCCESS)
-    return DUPREQ_NOT_FOUND;
+  P(shard->mtx);
 
-  pdupreq = (dupreq_entry_t *)buffval.pdata;
+  pdupreq = dupreq_lookup(shard, &dupkey, hk,
+                          get_ipproto_by_xprt(req->rq_xprt));
+  if(pdupreq == NULL || !pdupreq->processing)
+    {
+      V(shard->mtx);
+      nfs_dupreq_free_reply(&reply);
+      return DUPREQ_NOT_FOUND;
+    }
 
-  LogDupReq("Finish", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  if(status != DUPREQ_SUCCESS)
+    {
+      dupreq_remove(shard, pdupreq);
+      V(shard->mtx);
+      return status;
+    }
 
-  P(pdupreq->dupreq_mutex);
+  LogDupReq("Finish", &dupkey.addr, dupkey.xid, pdupreq->rq_prog);
 
-  pdupreq->res_nfs = *p_res_nfs;
+  pdupreq->reply = reply;
   pdupreq->timestamp = time(NULL);
   pdupreq->processing = 0;
+  glist_add_tail(&shard->lru, &pdupreq->lru_link);
+  shard->lru_len++;
 
-  V(pdupreq->dupreq_mutex);
+  dupreq_trim(shard, 0);
 
-  /* Add it to lru list */
-  if((pentry = LRU_new_entry(lru_dupreq, &lru_status)) == NULL)
-    return DUPREQ_INSERT_MALLOC_ERROR;
-  pentry->buffdata.pdata = buffval.pdata;
-  pentry->buffdata.len = buffval.len;
+  V(shard->mtx);
 
   return DUPREQ_SUCCESS;
 }                               /* nfs_dupreq_finish */
 
 /**
  *
- * nfs_dupreq_get: Tries to get a duplicated requests for dupreq cache
- *
- * Tries to get a duplicated requests for dupreq cache.
+ * nfs_dupreq_gc: drops the expired entries of every shard.
  *
- * @param req [IN] svc_req whose xid we are looking for
- * @param xprt [IN] xprt the related xprt (but we could use req->rq_xprt) XXX
- * @param pstatus [OUT] the pointer to the status for the operation
- *
- * @return the result previously set if *pstatus == DUPREQ_SUCCESS
+ * Shards also expire entries as requests come in; this is for shards
+ * whose clients have gone quiet.
  *
  */
-nfs_res_t nfs_dupreq_get(struct svc_req *req, int *pstatus)
+void nfs_dupreq_gc(void)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  nfs_res_t res_nfs;
-  dupreq_key_t dupkey;
-  hash_table_t * ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt(req->rq_xprt) ;
- 
+  uint32_t i;
 
-  memset(&res_nfs, 0, sizeof(res_nfs));
-
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, req->rq_xprt) == 0)
-    {
-      *pstatus = DUPREQ_NOT_FOUND;
-      return res_nfs;
-    }
-
-  dupkey.xid = req->rq_xid;
-  dupkey.checksum = 0;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-    {
-      dupreq_entry_t *pdupreq = (dupreq_entry_t *)buffval.pdata;
-      /* reset timestamp */
-      pdupreq->timestamp = time(NULL);
-
-      *pstatus = DUPREQ_SUCCESS;
-      res_nfs = pdupreq->res_nfs;
-      LogDupReq(" dupreq_get: Hit in the dupreq cache for", &pdupreq->addr,
-		pdupreq->xid, pdupreq->rq_prog);
-    }
-  else
+  for(i = 0; i < dupreq_nshards; i++)
     {
-      LogDupReq("Failed to get dupreq entry", &dupkey.addr, dupkey.xid, req->rq_prog);
-      *pstatus = DUPREQ_NOT_FOUND;
+      P(dupreq_shards[i].mtx);
+      dupreq_trim(&dupreq_shards[i], 0);
+      V(dupreq_shards[i].mtx);
     }
-  return res_nfs;
-}                               /* nfs_dupreq_get */
+}                               /* nfs_dupreq_gc */
 
 /**
  *
- * nfs_dupreq_gc_function: Tests is an entry in dupreq cache is to be set invalid (has expired).
+ * nfs_dupreq_get_stats: gets the statistics for the duplicate requests.
  *
- * Tests is an entry in dupreq cache is to be set invalid (has expired).
+ * entries is the number of cached requests for each transport, and the
+ * min/max/average node counts describe how they spread over the shards.
  *
- * @param pentry [IN] pointer to the entry to test
+ * @param phstat_udp [OUT] stats for requests received over UDP.
+ * @param phstat_tcp [OUT] stats for requests received over TCP.
  *
- * @return 1 if entry must be set invalid, 0 if not.
- *
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
+ * @return nothing (void function)
  *
  */
-int nfs_dupreq_gc_function(LRU_entry_t * pentry, void *addparam)
+void nfs_dupreq_get_stats(hash_stat_t * phstat_udp, hash_stat_t * phstat_tcp )
 {
-  dupreq_entry_t *pdupreq = NULL;
+  hash_stat_t *phstat[2] = { phstat_udp, phstat_tcp };
+  uint32_t i;
+  int p;
 
-  pdupreq = (dupreq_entry_t *) (pentry->buffdata.pdata);
+  memset(phstat_udp, 0, sizeof(hash_stat_t));
+  memset(phstat_tcp, 0, sizeof(hash_stat_t));
 
-  /* Test if entry is expired */
-  if(time(NULL) - pdupreq->timestamp > nfs_param.core_param.expiration_dupreq)
-    return LRU_LIST_SET_INVALID;
+  for(i = 0; i < dupreq_nshards; i++)
+    {
+      P(dupreq_shards[i].mtx);
+      for(p = 0; p < 2; p++)
+        {
+          unsigned int count = dupreq_shards[i].count[p];
 
-  return LRU_LIST_DO_NOT_SET_INVALID;
-}                               /* nfs_dupreq_fc_function */
+          phstat[p]->entries += count;
+          if(i == 0 || count < phstat[p]->min_rbt_num_node)
+            phstat[p]->min_rbt_num_node = count;
+          if(count > phstat[p]->max_rbt_num_node)
+            phstat[p]->max_rbt_num_node = count;
+        }
+      V(dupreq_shards[i].mtx);
+    }
 
-/**
- *
- * nfs_dupreq_get_stats: gets the hash table statistics for the duplicate requests.
- *
- * Gets the hash table statistics for the duplicate requests.
- *
- * @param phstat [OUT] pointer to the resulting stats.
- *
- * @return nothing (void function)
- *
- * @see HashTable_GetStats
- *
- */
-void nfs_dupreq_get_stats(hash_stat_t * phstat_udp, hash_stat_t * phstat_tcp )
-{
-  HashTable_GetStats(ht_dupreq_udp, phstat_udp);
-  HashTable_GetStats(ht_dupreq_tcp, phstat_tcp);
+  if(dupreq_nshards != 0)
+    for(p = 0; p < 2; p++)
+      phstat[p]->average_rbt_num_node = phstat[p]->entries / dupreq_nshards;
 }                               /* nfs_dupreq_get_stats */
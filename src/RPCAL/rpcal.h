@@ -32,15 +32,57 @@ typedef struct gss_union_ctx_id_t
 extern int copy_svc_authgss(SVCXPRT *xprt_copy, SVCXPRT *xprt_orig);
 extern void free_svc_authgss(SVCXPRT *xprt);
 extern int sprint_ctx(char *buff, unsigned char *ctx, int len);
-extern int Gss_ctx_Hash_Set(gss_union_ctx_id_desc *pgss_ctx,
-                            struct svc_rpc_gss_data *gd);
-extern int Gss_ctx_Hash_Del(gss_union_ctx_id_desc *pgss_ctx);
-extern void Gss_ctx_Hash_Print(void);
-extern int Gss_ctx_Hash_Get(gss_union_ctx_id_desc *pgss_ctx,
-                            struct svc_rpc_gss_data *gd,
-			    bool_t **established,
-			    u_int **seqlast,
-			    uint32_t **seqmask);
+/*
+ * The handle given to the client for an established context: the slot
+ * of the context in the cache, the generation of that slot, and a
+ * random verifier so that handles cannot be guessed or survive a
+ * restart of the server.
+ */
+typedef struct gss_ctx_handle
+{
+  uint32_t slot;
+  uint32_t generation;
+  uint64_t verifier;
+} gss_ctx_handle_t;
+
+/* Sequence window of the contexts, one bit per sequence number */
+#define GSS_CTX_SEQ_WINDOW 32
+
+typedef enum gss_ctx_seq_status
+{
+  GSS_CTX_SEQ_OK,
+  GSS_CTX_SEQ_REPLAY,
+  GSS_CTX_SEQ_OUTSIDE_WINDOW
+} gss_ctx_seq_status_t;
+
+typedef struct gss_ctx_entry
+{
+  uint64_t state;               /* generation << 32 | DYING | refcount */
+  uint64_t seqwin;              /* seqlast << 32 | seqmask */
+  uint64_t verifier;
+  uint32_t slot;
+  uint32_t next_free;
+  gss_ctx_id_t ctx;
+  struct rpc_gss_sec sec;
+  gss_buffer_desc cname;
+  gss_name_t client_name;
+  u_int win;
+  time_t created;
+  time_t last_used;
+  uint64_t calls;
+  uint64_t replays;
+  uint64_t outside_window;
+} gss_ctx_entry_t;
+
+extern gss_ctx_entry_t *Gss_ctx_cache_insert(struct svc_rpc_gss_data *gd,
+                                             gss_ctx_handle_t *phandle);
+extern gss_ctx_entry_t *Gss_ctx_cache_get(gss_buffer_desc *phandle);
+extern void Gss_ctx_cache_put(gss_ctx_entry_t *entry);
+extern int Gss_ctx_cache_del(gss_ctx_entry_t *entry);
+extern gss_ctx_seq_status_t Gss_ctx_cache_check_seq(gss_ctx_entry_t *entry,
+                                                    u_int seq,
+                                                    bool_t commit);
+extern void Gss_ctx_cache_Print(void);
 #endif                          /* _HAVE_GSSAPI */
 
 #endif /* GANESHA_RPCAL_H */
@@ -35,9 +35,13 @@
 #endif
 
 #include "sal_functions.h"
+#include "abstract_atomic.h"
 
 pool_t *nfs41_session_pool = NULL;
 
+/* Slots of all the sessions holding a cached reply */
+static uint32_t nfs41_slot_cache_cnt = 0;
+
 size_t strnlen(const char *s, size_t maxlen);
 
 hash_table_t *ht_session_id;
@@ -298,6 +302,7 @@ int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE])
       dec_client_id_ref(psession->pclientid_record);
 
       /* Free the memory for the session */
+      nfs41_Session_Free_Slots(psession);
       pool_free(nfs41_session_pool, psession);
 
       return 1;
@@ -306,6 +311,316 @@ int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE])
     return 0;
 }                               /* nfs41_Session_Del */
 
+/**
+ *
+ * nfs41_Session_Alloc_Slots
+ *
+ * This routine sizes the slot table of a new session.  Only the table of
+ * pointers is allocated here, each slot is created by its first SEQUENCE.
+ *
+ * @param psession [INOUT] the session being created
+ * @param nb_slots [IN]    ca_maxrequests asked by the client
+ *
+ * @return 1 if ok, 0 otherwise.
+ *
+ */
+int nfs41_Session_Alloc_Slots(nfs41_session_t * psession, uint32_t nb_slots)
+{
+  if(nb_slots > nfs_param.nfsv4_param.max_session_slots)
+    nb_slots = nfs_param.nfsv4_param.max_session_slots;
+  if(nb_slots == 0)
+    nb_slots = 1;
+
+  psession->slots = gsh_calloc(nb_slots, sizeof(nfs41_session_slot_t *));
+  if(psession->slots == NULL)
+    return 0;
+
+  pthread_mutex_init(&psession->slots_lock, NULL);
+  psession->nb_slots = nb_slots;
+  psession->target_highest_slotid = nb_slots - 1;
+
+  return 1;
+}                               /* nfs41_Session_Alloc_Slots */
+
+/**
+ *
+ * nfs41_Session_Free_Slots
+ *
+ * This routine frees the slots of a session and their cached replies.
+ *
+ * @param psession [INOUT] the session being destroyed
+ *
+ * @return nothing (void function)
+ *
+ */
+void nfs41_Session_Free_Slots(nfs41_session_t * psession)
+{
+  uint32_t i;
+
+  if(psession->slots == NULL)
+    return;
+
+  for(i = 0; i < psession->nb_slots; i++)
+    {
+      nfs41_session_slot_t *pslot = psession->slots[i];
+
+      if(pslot == NULL)
+        continue;
+
+      nfs41_Session_Slot_Uncache(pslot);
+      pthread_mutex_destroy(&pslot->lock);
+      gsh_free(pslot);
+    }
+
+  gsh_free(psession->slots);
+  psession->slots = NULL;
+  pthread_mutex_destroy(&psession->slots_lock);
+}                               /* nfs41_Session_Free_Slots */
+
+/**
+ *
+ * nfs41_Session_Get_Slot
+ *
+ * This routine returns a slot of a session, creating it on first use.
+ *
+ * @param psession [IN] the session
+ * @param slotid   [IN] the slot, below psession->nb_slots
+ *
+ * @return the slot, NULL if it could not be allocated.
+ *
+ */
+nfs41_session_slot_t *nfs41_Session_Get_Slot(nfs41_session_t * psession,
+                                             slotid4 slotid)
+{
+  nfs41_session_slot_t *pslot;
+
+  P(psession->slots_lock);
+
+  pslot = psession->slots[slotid];
+  if(pslot == NULL)
+    {
+      pslot = gsh_calloc(1, sizeof(nfs41_session_slot_t));
+      if(pslot != NULL)
+        {
+          pthread_mutex_init(&pslot->lock, NULL);
+          psession->slots[slotid] = pslot;
+        }
+    }
+
+  V(psession->slots_lock);
+
+  return pslot;
+}                               /* nfs41_Session_Get_Slot */
+
+/**
+ *
+ * nfs41_Session_Slot_Cache
+ *
+ * This routine marks the reply to the request using a slot as the one to
+ * cache.  The reply of the previous request is dropped: until
+ * nfs41_Session_Slot_Save, the slot is cache_used without a cached_reply,
+ * which tells a retransmission that the request is still in progress.
+ * Called with the slot locked.
+ *
+ * @param pslot [INOUT] the slot
+ *
+ * @return nothing (void function)
+ *
+ */
+void nfs41_Session_Slot_Cache(nfs41_session_slot_t * pslot)
+{
+  if(pslot->cached_reply != NULL)
+    {
+      gsh_free(pslot->cached_reply);
+      pslot->cached_reply = NULL;
+      pslot->cached_len = 0;
+    }
+
+  if(pslot->cache_used)
+    return;
+
+  pslot->cache_used = TRUE;
+  (void) atomic_inc_uint32_t(&nfs41_slot_cache_cnt);
+}                               /* nfs41_Session_Slot_Cache */
+
+/**
+ *
+ * nfs41_Session_Slot_Uncache
+ *
+ * This routine frees the reply cached in a slot, if any.  Called with the
+ * slot locked, or when no request can use it.
+ *
+ * @param pslot [INOUT] the slot
+ *
+ * @return nothing (void function)
+ *
+ */
+void nfs41_Session_Slot_Uncache(nfs41_session_slot_t * pslot)
+{
+  if(pslot->cached_reply != NULL)
+    {
+      gsh_free(pslot->cached_reply);
+      pslot->cached_reply = NULL;
+      pslot->cached_len = 0;
+    }
+
+  if(!pslot->cache_used)
+    return;
+
+  pslot->cache_used = FALSE;
+  (void) atomic_dec_uint32_t(&nfs41_slot_cache_cnt);
+}                               /* nfs41_Session_Slot_Uncache */
+
+/**
+ *
+ * nfs41_Session_Slot_Save
+ *
+ * This routine keeps the reply to the request using a slot, XDR encoded,
+ * for it to be replayed as is.  A reply larger than maxsize
+ * (ca_maxresponsesize_cached) is not kept, a replay will then get
+ * NFS4ERR_RETRY_UNCACHED_REP.
+ *
+ * @param pslot   [INOUT] the slot
+ * @param pres    [IN]    the reply sent to the client
+ * @param maxsize [IN]    largest reply to keep
+ *
+ * @return nothing (void function)
+ *
+ */
+void nfs41_Session_Slot_Save(nfs41_session_slot_t * pslot,
+                             COMPOUND4res * pres,
+                             u_int maxsize)
+{
+  XDR   xdrs;
+  char *buf = NULL;
+  u_int len;
+
+  /* Encode outside of the slot lock */
+  len = xdr_sizeof((xdrproc_t) xdr_COMPOUND4res, pres);
+  if(len != 0 && len <= maxsize && (buf = gsh_malloc(len)) != NULL)
+    {
+      xdrmem_create(&xdrs, buf, len, XDR_ENCODE);
+      if(xdr_COMPOUND4res(&xdrs, pres))
+        len = XDR_GETPOS(&xdrs);
+      else
+        {
+          gsh_free(buf);
+          buf = NULL;
+        }
+      XDR_DESTROY(&xdrs);
+    }
+
+  if(buf == NULL)
+    LogDebug(COMPONENT_SESSIONS,
+             "Reply of %u bytes not cached in slot %p (max %u)",
+             len, pslot, maxsize);
+
+  P(pslot->lock);
+
+  if(pslot->cached_reply != NULL)
+    gsh_free(pslot->cached_reply);
+
+  pslot->cached_reply = buf;
+  pslot->cached_len = (buf != NULL) ? len : 0;
+
+  if(buf == NULL && pslot->cache_used)
+    {
+      pslot->cache_used = FALSE;
+      (void) atomic_dec_uint32_t(&nfs41_slot_cache_cnt);
+    }
+
+  V(pslot->lock);
+}                               /* nfs41_Session_Slot_Save */
+
+/**
+ *
+ * nfs41_Session_Slot_Replay
+ *
+ * This routine copies the reply cached in a slot into the result of a
+ * retransmitted request.
+ *
+ * @param pslot [IN]    the slot
+ * @param pres  [INOUT] the result, sent with xdr_COMPOUND4res_extended
+ *
+ * @return 1 if ok, 0 if the slot no longer holds a reply.
+ *
+ */
+int nfs41_Session_Slot_Replay(nfs41_session_slot_t * pslot,
+                              COMPOUND4res_extended * pres)
+{
+  uint32_t status;
+
+  P(pslot->lock);
+
+  /* The reply starts with the status of the COMPOUND */
+  if(pslot->cached_reply == NULL || pslot->cached_len < sizeof(status) ||
+     (pres->res_replay = gsh_malloc(pslot->cached_len)) == NULL)
+    {
+      V(pslot->lock);
+      return 0;
+    }
+
+  memcpy(pres->res_replay, pslot->cached_reply, pslot->cached_len);
+  pres->res_replay_len = pslot->cached_len;
+
+  V(pslot->lock);
+
+  memcpy(&status, pres->res_replay, sizeof(status));
+  pres->res_compound4.status = ntohl(status);
+
+  return 1;
+}                               /* nfs41_Session_Slot_Replay */
+
+/**
+ *
+ * nfs41_Session_Target_Slots
+ *
+ * This routine computes the sr_target_highest_slotid of a SEQUENCE.  When
+ * more than Slot_Cache_Hiwat replies are cached server wide, a session is
+ * asked to use half its slots.  Once the client has stopped using the slots
+ * above the target, their cached replies are freed.
+ *
+ * @param psession        [INOUT] the session
+ * @param highest_slotid  [IN]    sa_highest_slotid of the SEQUENCE
+ *
+ * @return the target highest slotid.
+ *
+ */
+slotid4 nfs41_Session_Target_Slots(nfs41_session_t * psession,
+                                   slotid4 highest_slotid)
+{
+  uint32_t target = psession->nb_slots - 1;
+  uint32_t i;
+
+  if(atomic_fetch_uint32_t(&nfs41_slot_cache_cnt) >
+     nfs_param.nfsv4_param.slot_cache_hiwat)
+    target /= 2;
+
+  atomic_store_uint32_t(&psession->target_highest_slotid, target);
+
+  if(highest_slotid > target)
+    return target;
+
+  /* The client no longer uses the slots above the target */
+  P(psession->slots_lock);
+  for(i = target + 1; i < psession->nb_slots; i++)
+    {
+      nfs41_session_slot_t *pslot = psession->slots[i];
+
+      if(pslot == NULL || !pslot->cache_used)
+        continue;
+
+      if(pthread_mutex_trylock(&pslot->lock) != 0)
+        continue;
+
+      nfs41_Session_Slot_Uncache(pslot);
+      V(pslot->lock);
+    }
+  V(psession->slots_lock);
+
+  return target;
+}                               /* nfs41_Session_Target_Slots */
+
 /**
  *
  *  nfs41_Session_PrintAll
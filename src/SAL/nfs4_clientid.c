@@ -144,6 +144,11 @@ void free_client_id(nfs_client_id_t *pclientid)
   if(pclientid->cid_client_record != NULL)
     dec_client_record_ref(pclientid->cid_client_record);
 
+#ifdef _USE_NFS4_1
+  nfs41_Session_Slot_Uncache(&pclientid->cid_create_session_slot);
+  pthread_mutex_destroy(&pclientid->cid_create_session_slot.lock);
+#endif
+
   if(pthread_mutex_destroy(&pclientid->cid_mutex) != 0)
     LogDebug(COMPONENT_CLIENTID,
              "pthread_mutex_destroy returned errno %d (%s)",
@@ -350,10 +355,18 @@ nfs_client_id_t * create_client_id(clientid4              clientid,
   pclientid->cid_client_record = pclient_record;
   pclientid->cid_client_addr   = *pclient_addr;
   pclientid->cid_credential    = *pcredential;
+  pclientid->cid_cb.cid_path_state = CB_PATH_UNKNOWN;
+  pclientid->cid_lease_expire  = 0;
 
   /* need to init the list_head */
   init_glist(&pclientid->cid_openowners);
   init_glist(&pclientid->cid_lockowners);
+  init_glist(&pclientid->cid_lease_list);
+
+#ifdef _USE_NFS4_1
+  /* CREATE_SESSION replies are kept as those of SEQUENCE */
+  pthread_mutex_init(&pclientid->cid_create_session_slot.lock, NULL);
+#endif
 
   /* set up the content of the clientid_owner */
   powner->so_type                              = STATE_CLIENTID_OWNER_NFSV4;
@@ -420,6 +433,9 @@ int nfs_client_id_insert(nfs_client_id_t * pclientid)
   /* Take a reference to the unconfirmed clientid for the hash table. */
   inc_client_id_ref(pclientid);
 
+  /* Have the reaper look at it when its lease runs out */
+  nfs4_lease_wheel_arm(pclientid);
+
   if(isFullDebug(COMPONENT_CLIENTID) && isFullDebug(COMPONENT_HASHTABLE))
     {
       LogFullDebug(COMPONENT_CLIENTID,
@@ -473,6 +489,8 @@ int remove_unconfirmed_client_id(nfs_client_id_t * pclientid)
   /* Set this up so this client id record will be freed. */
   pclientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+  nfs4_lease_wheel_remove(pclientid);
+
   /* Release hash table reference to the unconfirmed record */
   dec_client_id_ref(pclientid);
 
@@ -551,6 +569,8 @@ int nfs_client_id_confirm(nfs_client_id_t * pclientid,
       /* Set this up so this client id record will be freed. */
       pclientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+      nfs4_lease_wheel_remove(pclientid);
+
       /* Release hash table reference to the unconfirmed record */
       dec_client_id_ref(pclientid);
 
@@ -619,6 +639,8 @@ int nfs_client_id_expire(nfs_client_id_t * pclientid)
 
   V(pclientid->cid_mutex);
 
+  nfs4_lease_wheel_remove(pclientid);
+
   /* Detach the clientid record from the client record */
   if(precord->cr_pconfirmed_id == pclientid)
     precord->cr_pconfirmed_id = NULL;
@@ -719,6 +741,9 @@ int nfs_client_id_expire(nfs_client_id_t * pclientid)
         }
     }
 
+  /* release the delegations */
+  state_deleg_release_client(pclientid);
+
   if (pclientid->cid_recov_dir != NULL)
     {
       nfs4_rm_clid(pclientid->cid_recov_dir);
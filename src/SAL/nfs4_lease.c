@@ -45,11 +45,35 @@
 #include "solaris_port.h"
 #endif
 
+#include <pthread.h>
 #include "log.h"
+#include "nlm_list.h"
 #include "nfs_core.h"
 #include "nfs4.h"
 #include "sal_functions.h"
 
+/* Clientids are filed in the lease wheel by the second their lease
+ * runs out, so that the reaper only looks at those whose lease may
+ * have lapsed.  Slot s holds the clientids expiring at any second equal
+ * to s modulo LEASE_WHEEL_SLOTS: with leases longer than that, a slot
+ * also holds clientids due in later turns, which are skipped.
+ *
+ * The wheel mutex is taken after cid_mutex.  A clientid is in the wheel
+ * while it is in one of the clientid hash tables, and is removed from
+ * it before the hash table reference is released.
+ */
+#define LEASE_WHEEL_SLOTS 1024
+
+static struct glist_head lease_wheel[LEASE_WHEEL_SLOTS];
+static pthread_mutex_t lease_wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static time_t lease_wheel_tick = 0;     /* last second fully reaped */
+static int lease_wheel_initialized = FALSE;
+
+static inline struct glist_head *lease_wheel_slot(time_t expire)
+{
+  return &lease_wheel[expire % LEASE_WHEEL_SLOTS];
+}
+
 static unsigned int _valid_lease(nfs_client_id_t * pclientid)
 {
   time_t t;
@@ -155,7 +179,14 @@ void update_lease(nfs_client_id_t * pclientid)
 
   /* Renew lease when last reservation is released */
   if(pclientid->cid_lease_reservations == 0)
-    pclientid->cid_last_renew = time(NULL);
+    {
+      pclientid->cid_last_renew = time(NULL);
+
+      /* Most renewals happen within the second of the previous one */
+      if(pclientid->cid_lease_expire !=
+         pclientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime)
+        nfs4_lease_wheel_arm(pclientid);
+    }
 
   if(isFullDebug(COMPONENT_CLIENTID))
     {
@@ -167,3 +198,144 @@ void update_lease(nfs_client_id_t * pclientid)
                    str);
     }
 }
+
+/**
+ *
+ * nfs4_lease_wheel_arm: (Re)file a clientid in the lease wheel.
+ *
+ * File a clientid in the lease wheel by the second its lease runs out.
+ * A clientid whose lease is reserved, or has already run out, is filed
+ * one lease from now.  Expired clientids are left out.  Caller holds
+ * cid_mutex, or is the only one to know the clientid.
+ *
+ * @param pclientid [IN] clientid record to file.
+ *
+ */
+void nfs4_lease_wheel_arm(nfs_client_id_t * pclientid)
+{
+  time_t now = time(NULL);
+  time_t expire;
+
+  expire = pclientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime;
+
+  if(pclientid->cid_lease_reservations != 0 || expire <= now)
+    expire = now + nfs_param.nfsv4_param.lease_lifetime;
+
+  P(lease_wheel_mutex);
+
+  if(!lease_wheel_initialized)
+    {
+      unsigned int i;
+
+      for(i = 0; i < LEASE_WHEEL_SLOTS; i++)
+        init_glist(&lease_wheel[i]);
+
+      lease_wheel_initialized = TRUE;
+    }
+
+  /* Checked under the wheel mutex, see nfs4_lease_wheel_remove */
+  if(pclientid->cid_confirmed == EXPIRED_CLIENT_ID)
+    {
+      V(lease_wheel_mutex);
+      return;
+    }
+
+  /* Never file behind what the reaper already went through */
+  if(expire <= lease_wheel_tick)
+    expire = lease_wheel_tick + 1;
+
+  if(pclientid->cid_lease_expire != 0)
+    glist_del(&pclientid->cid_lease_list);
+
+  pclientid->cid_lease_expire = expire;
+  glist_add_tail(lease_wheel_slot(expire), &pclientid->cid_lease_list);
+
+  V(lease_wheel_mutex);
+}
+
+/**
+ *
+ * nfs4_lease_wheel_remove: Take a clientid out of the lease wheel.
+ *
+ * Take a clientid out of the lease wheel.  The clientid must have been
+ * marked EXPIRED_CLIENT_ID first, so that it is not filed again.
+ *
+ * @param pclientid [IN] clientid record to remove.
+ *
+ */
+void nfs4_lease_wheel_remove(nfs_client_id_t * pclientid)
+{
+  P(lease_wheel_mutex);
+
+  if(pclientid->cid_lease_expire != 0)
+    {
+      glist_del(&pclientid->cid_lease_list);
+      pclientid->cid_lease_expire = 0;
+    }
+
+  V(lease_wheel_mutex);
+}
+
+/**
+ *
+ * nfs4_lease_wheel_pop: Get a clientid whose lease may have run out.
+ *
+ * Take out of the lease wheel the next clientid filed to expire at or
+ * before now.  Its lease may have been renewed since; the caller checks
+ * it with valid_lease and files it again with nfs4_lease_wheel_arm if
+ * it is to be kept.
+ *
+ * @param now [IN] the current time.
+ *
+ * @return a clientid with a reference the caller must release, or NULL
+ *         once every clientid due has been returned.
+ *
+ */
+nfs_client_id_t * nfs4_lease_wheel_pop(time_t now)
+{
+  struct glist_head * glist;
+  struct glist_head * slot;
+  nfs_client_id_t   * pclientid;
+
+  P(lease_wheel_mutex);
+
+  if(!lease_wheel_initialized)
+    {
+      V(lease_wheel_mutex);
+      return NULL;
+    }
+
+  /* Look at every slot once after a long sleep, or the first time */
+  if(lease_wheel_tick == 0 || now - lease_wheel_tick > LEASE_WHEEL_SLOTS)
+    lease_wheel_tick = now - LEASE_WHEEL_SLOTS;
+
+  while(lease_wheel_tick < now)
+    {
+      slot = lease_wheel_slot(lease_wheel_tick + 1);
+
+      glist_for_each(glist, slot)
+        {
+          pclientid = glist_entry(glist, nfs_client_id_t, cid_lease_list);
+
+          if(pclientid->cid_lease_expire > now)
+            continue;
+
+          glist_del(&pclientid->cid_lease_list);
+          pclientid->cid_lease_expire = 0;
+
+          /* The hash table reference is not released before the
+           * clientid leaves the wheel, so it is safe to take one. */
+          inc_client_id_ref(pclientid);
+
+          V(lease_wheel_mutex);
+
+          return pclientid;
+        }
+
+      lease_wheel_tick++;
+    }
+
+  V(lease_wheel_mutex);
+
+  return NULL;
+}
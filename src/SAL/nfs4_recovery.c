@@ -50,6 +50,9 @@ char v4_old_dir[PATH_MAX];
  * construct to enable grace period, this could be expanded to implement
  * grace instances, where a new grace period is started for every
  * failover.  for now keep it simple, just a global used by all clients.
+ *
+ * the grace period ends early once the clients that may reclaim are done
+ * with it, see nfs4_grace_done().
  */
 typedef struct grace
 {
@@ -57,6 +60,9 @@ typedef struct grace
         time_t g_start;
         time_t g_duration;
         struct glist_head g_clid_list;
+        unsigned int g_clid_count;      /* entries of g_clid_list */
+        unsigned int g_reclaimed;       /* of them, done reclaiming */
+        time_t g_nlm_reclaim;           /* last NLM reclaim */
 } grace_t;
 
 static grace_t grace;
@@ -65,6 +71,7 @@ typedef struct clid_entry
 {
         struct glist_head cl_list;
         char cl_name[256];
+        int cl_reclaimed;
 } clid_entry_t;
 
 static void nfs4_load_recov_clids_nolock(ushort);
@@ -104,18 +111,67 @@ nfs4_start_grace(nfs_grace_start_t *gsp)
 
         grace.g_start = time(NULL);
         grace.g_duration = duration;
+        grace.g_nlm_reclaim = 0;
 
         V(grace.g_mutex);
 }
 
+/*
+ * decide whether the grace period can end before its time, which it does
+ * when all the clients known to have state have told they are done
+ * reclaiming, or Grace_Reclaim_Fraction percent of them have and the
+ * grace period is at least Grace_Reclaim_Timeout seconds old.  NLM clients
+ * are not known, so while NLM is served the grace period also lasts until
+ * no NLM reclaim came for Grace_Reclaim_Timeout seconds, and runs its full
+ * length when no NFSv4 client is known: a quiet NLM alone proves nothing.
+ */
+static int
+nfs4_grace_done(time_t now)
+{
+        nfs_version4_parameter_t *pparam = &nfs_param.nfsv4_param;
+
+        if (grace.g_reclaimed < grace.g_clid_count &&
+            (grace.g_reclaimed * 100 <
+             pparam->grace_reclaim_fraction * grace.g_clid_count ||
+             now < grace.g_start + pparam->grace_reclaim_timeout))
+                return FALSE;
+
+#ifdef _USE_NLM
+        if (nfs_param.core_param.core_options & CORE_OPTION_NFSV3) {
+                time_t quiet = grace.g_start;
+
+                if (grace.g_clid_count == 0)
+                        return FALSE;
+
+                if (grace.g_nlm_reclaim > quiet)
+                        quiet = grace.g_nlm_reclaim;
+                if (now < quiet + pparam->grace_reclaim_timeout)
+                        return FALSE;
+        }
+#endif
+
+        return TRUE;
+}
+
 int
 nfs_in_grace()
 {
         int gp;
+        time_t now = time(NULL);
 
         P(grace.g_mutex);
 
-        gp = ((grace.g_start + grace.g_duration) > time(NULL));
+        gp = ((grace.g_start + grace.g_duration) > now);
+
+        if (gp && nfs_param.nfsv4_param.grace_early_exit &&
+            nfs4_grace_done(now)) {
+                LogEvent(COMPONENT_STATE,
+                    "grace period lifted after %d seconds, %u of %u clients "
+                    "done reclaiming", (int)(now - grace.g_start),
+                    grace.g_reclaimed, grace.g_clid_count);
+                grace.g_duration = now - grace.g_start;
+                gp = 0;
+        }
 
         V(grace.g_mutex);
 
@@ -174,6 +230,11 @@ nfs4_add_clid(nfs_client_id_t *pclientid)
                 return;
         }
 
+        if (nfs_param.nfsv4_param.recov_journal) {
+                nfs4_journal_add(pclientid->cid_recov_dir);
+                return;
+        }
+
         snprintf(path, PATH_MAX, "%s/%s", v4_recov_dir,
             pclientid->cid_recov_dir);
 
@@ -200,6 +261,11 @@ nfs4_rm_clid(char *recov_dir)
         if (recov_dir == NULL)
                 return;
 
+        if (nfs_param.nfsv4_param.recov_journal) {
+                nfs4_journal_rm(recov_dir);
+                return;
+        }
+
         snprintf(path, PATH_MAX, "%s/%s", v4_recov_dir, recov_dir);
 
         err = rmdir(path);
@@ -260,6 +326,58 @@ nfs4_chk_clid(nfs_client_id_t *pclientid)
         V(grace.g_mutex);
 }
 
+/*
+ * a client allowed to reclaim is done with it.  with revoke, the client
+ * sent RECLAIM_COMPLETE and may not reclaim anymore.  without, it is an
+ * NFSv4.0 client, which has no RECLAIM_COMPLETE, sending a non reclaim
+ * OPEN: a hint that it is done, good enough to end the grace period
+ * early, but another of its open owners may still be reclaiming, so it
+ * keeps the right to.
+ */
+void
+nfs4_reclaim_complete(nfs_client_id_t *pclientid, bool_t revoke)
+{
+        struct glist_head *node;
+        clid_entry_t *clid_ent;
+
+        if (pclientid->cid_allow_reclaim != 1 ||
+            pclientid->cid_recov_dir == NULL)
+                return;
+
+        P(grace.g_mutex);
+
+        if (revoke)
+                pclientid->cid_allow_reclaim = 0;
+
+        glist_for_each(node, &grace.g_clid_list) {
+                clid_ent = glist_entry(node, clid_entry_t, cl_list);
+                /* the same client may be in the old and the new list */
+                if (!clid_ent->cl_reclaimed &&
+                    !strncmp(clid_ent->cl_name, pclientid->cid_recov_dir,
+                    256)) {
+                        clid_ent->cl_reclaimed = 1;
+                        grace.g_reclaimed++;
+                }
+        }
+
+        LogDebug(COMPONENT_CLIENTID,
+            "client %s done reclaiming, %u of %u",
+            pclientid->cid_recov_dir, grace.g_reclaimed, grace.g_clid_count);
+
+        V(grace.g_mutex);
+}
+
+/*
+ * an NLM client reclaimed a lock or share, keep the grace period going.
+ */
+void
+nfs_grace_nlm_reclaim()
+{
+        P(grace.g_mutex);
+        grace.g_nlm_reclaim = time(NULL);
+        V(grace.g_mutex);
+}
+
 /*
  * create the client reclaim list.
  * when not doing a take over, first open the old state dir and read in
@@ -289,7 +407,9 @@ nfs4_read_recov_clids(DIR *dp, char *srcdir, int takeover)
                                 return -1;
                         }
                         strncpy(new_ent->cl_name, dentp->d_name, 256);
+                        new_ent->cl_reclaimed = 0;
                         glist_add(&grace.g_clid_list, &new_ent->cl_list);
+                        grace.g_clid_count++;
                         LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
                             new_ent->cl_name);
                         if (srcdir != NULL) {
@@ -314,11 +434,86 @@ nfs4_read_recov_clids(DIR *dp, char *srcdir, int takeover)
         return 0;
 }
 
+static int
+nfs4_add_recov_clids(char **names, int count)
+{
+        clid_entry_t *new_ent;
+        int i;
+
+        for (i = 0; i < count; i++) {
+                new_ent = gsh_malloc(sizeof(clid_entry_t));
+                if (new_ent == NULL) {
+                        LogEvent(COMPONENT_CLIENTID,
+                                 "Unable to allocate memory.");
+                        return -1;
+                }
+                strncpy(new_ent->cl_name, names[i], 256);
+                new_ent->cl_reclaimed = 0;
+                glist_add(&grace.g_clid_list, &new_ent->cl_list);
+                grace.g_clid_count++;
+                LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+                    new_ent->cl_name);
+        }
+
+        return 0;
+}
+
+/*
+ * same as below, with the clients kept in journals.  the journal of the
+ * old state dir is rewritten with its clients and those of srcdir, the
+ * journal of srcdir is emptied unless doing a take over.
+ */
+static void
+nfs4_load_recov_journals(char *srcdir, int takeover)
+{
+        char **old_names = NULL, **names = NULL, **all = NULL;
+        int nb_old = 0, count = 0;
+
+        nb_old = nfs4_journal_read(v4_old_dir, &old_names);
+        if (nb_old == -1) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to read v4 recovery journal (%s)", v4_old_dir);
+                return;
+        }
+
+        count = nfs4_journal_read(srcdir, &names);
+        if (count == -1) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to read v4 recovery journal (%s)", srcdir);
+                goto out;
+        }
+
+        if (nfs4_add_recov_clids(names, count) == -1 ||
+            (!takeover && nfs4_add_recov_clids(old_names, nb_old) == -1))
+                goto out;
+
+        if (count == 0)
+                goto out;
+
+        all = gsh_calloc(nb_old + count, sizeof(char *));
+        if (all == NULL) {
+                LogEvent(COMPONENT_CLIENTID, "Unable to allocate memory.");
+                goto out;
+        }
+        memcpy(all, old_names, nb_old * sizeof(char *));
+        memcpy(all + nb_old, names, count * sizeof(char *));
+
+        if (nfs4_journal_write(v4_old_dir, all, nb_old + count) == 0 &&
+            !takeover)
+                (void) nfs4_journal_reset();
+
+        gsh_free(all);
+
+ out:
+        nfs4_journal_free_names(old_names, nb_old);
+        nfs4_journal_free_names(names, count);
+}
+
 static void
 nfs4_load_recov_clids_nolock(ushort nodeid)
 {
         DIR *dp;
-        struct glist_head *node;
+        struct glist_head *node, *noden;
         clid_entry_t *clid_entry;
         int rc;
         char path[PATH_MAX];
@@ -326,13 +521,20 @@ nfs4_load_recov_clids_nolock(ushort nodeid)
         if (nodeid == 0) {
                 /* when not doing a takeover, start with an empty list */
                 if (!glist_empty(&grace.g_clid_list)) {
-                        glist_for_each(node, &grace.g_clid_list) {
+                        glist_for_each_safe(node, noden, &grace.g_clid_list) {
                                 glist_del(node);
                                 clid_entry = glist_entry(node,
                                     clid_entry_t, cl_list);
                                 gsh_free(clid_entry);
                         }
                 }
+                grace.g_clid_count = 0;
+                grace.g_reclaimed = 0;
+
+                if (nfs_param.nfsv4_param.recov_journal) {
+                        nfs4_load_recov_journals(v4_recov_dir, 0);
+                        return;
+                }
 
                 dp = opendir(v4_old_dir);
                 if (dp == NULL) {
@@ -377,6 +579,11 @@ nfs4_load_recov_clids_nolock(ushort nodeid)
                 snprintf(path, PATH_MAX, "%s/%s/node%d",
                     NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR, nodeid);
 
+                if (nfs_param.nfsv4_param.recov_journal) {
+                        nfs4_load_recov_journals(path, 1);
+                        return;
+                }
+
                 dp = opendir(path);
                 if (dp == NULL) {
                         LogEvent(COMPONENT_CLIENTID,
@@ -421,6 +628,11 @@ nfs4_clean_old_recov_dir()
         char path[PATH_MAX];
         int rc;
 
+        if (nfs_param.nfsv4_param.recov_journal) {
+                (void) nfs4_journal_write(v4_old_dir, NULL, 0);
+                return;
+        }
+
         dp = opendir(v4_old_dir);
         if (dp == NULL) {
                 LogEvent(COMPONENT_CLIENTID,
@@ -501,4 +713,11 @@ nfs4_create_recov_dir()
                             v4_old_dir, errno);
                 }
         }
+
+        if (nfs_param.nfsv4_param.recov_journal &&
+            nfs4_journal_open(v4_recov_dir) == -1) {
+                LogCrit(COMPONENT_CLIENTID,
+                    "Failed to open v4 recovery journal (%s), clients will not be able to reclaim after a restart",
+                    v4_recov_dir);
+        }
 }
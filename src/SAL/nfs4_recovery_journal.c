@@ -0,0 +1,500 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ *
+ * nfs4_recovery_journal.c : NFSv4 recovery clients kept in a journal
+ *
+ * With Recovery_Journal, the clients allowed to reclaim are recorded in
+ * a file, instead of one directory each.  Adding a client appends a
+ * "+name" line, removing it a "-name" line, and the last line for a
+ * name tells whether it is there.
+ *
+ * Adding a client has to be on disk before SETCLIENTID_CONFIRM is
+ * answered.  The thread that finds no fsync running starts one for
+ * every line appended so far, those arriving meanwhile wait for it and
+ * the next one: a storm of clients costs a few fsyncs, not one each.
+ * Removals do not wait; losing one only lets a client try to reclaim.
+ *
+ * When the file holds more than twice as many lines as clients, it is
+ * rewritten with only the clients present, and renamed over the old
+ * one.  A journal is otherwise only ever appended to, and a torn last
+ * line, from a crash during a write, is ignored.
+ *
+ * The journal of a directory is the ".journal" file in it, which the
+ * directory based recovery skips like any other '.' entry.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+
+#define JOURNAL_NAME ".journal"
+#define JOURNAL_TMP_NAME ".journal.tmp"
+
+/* Do not bother compacting journals smaller than that */
+#define JOURNAL_COMPACT_MIN 1024
+
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static char journal_dir[PATH_MAX];
+static int journal_fd = -1;
+static uint64_t journal_appended;       /* lines appended */
+static uint64_t journal_synced;         /* lines known to be on disk */
+static int journal_syncing;             /* an fsync is running */
+static unsigned int journal_lines;      /* lines in the file */
+static unsigned int journal_clients;    /* clients in the file */
+
+typedef struct journal_line
+{
+        char *name;
+        int add;
+        unsigned int seq;
+} journal_line_t;
+
+static int
+journal_line_cmp(const void *a, const void *b)
+{
+        const journal_line_t *la = a;
+        const journal_line_t *lb = b;
+        int rc;
+
+        rc = strcmp(la->name, lb->name);
+        if (rc != 0)
+                return rc;
+
+        return la->seq < lb->seq ? -1 : la->seq > lb->seq;
+}
+
+void
+nfs4_journal_free_names(char **names, int count)
+{
+        int i;
+
+        if (names == NULL)
+                return;
+
+        for (i = 0; i < count; i++)
+                gsh_free(names[i]);
+
+        gsh_free(names);
+}
+
+/*
+ * replay the journal of dir, returning the clients in it in *pnames.
+ * a missing journal holds no client.  returns the number of clients,
+ * or -1 on error.
+ */
+int
+nfs4_journal_read(char *dir, char ***pnames)
+{
+        char path[PATH_MAX];
+        struct stat st;
+        char *buf = NULL, *p, *end, *eol;
+        journal_line_t *lines = NULL;
+        unsigned int nb_lines = 0, i;
+        char **names = NULL;
+        int count = 0;
+        ssize_t len;
+        int fd;
+
+        *pnames = NULL;
+
+        snprintf(path, PATH_MAX, "%s/%s", dir, JOURNAL_NAME);
+
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+                if (errno == ENOENT)
+                        return 0;
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to open recovery journal (%s), errno=%d",
+                    path, errno);
+                return -1;
+        }
+
+        if (fstat(fd, &st) == -1 || st.st_size == 0) {
+                (void) close(fd);
+                return 0;
+        }
+
+        buf = gsh_malloc(st.st_size);
+        lines = gsh_calloc(st.st_size / 2 + 1, sizeof(journal_line_t));
+        if (buf == NULL || lines == NULL) {
+                LogEvent(COMPONENT_CLIENTID, "Unable to allocate memory.");
+                goto err;
+        }
+
+        len = read(fd, buf, st.st_size);
+        if (len == -1) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to read recovery journal (%s), errno=%d",
+                    path, errno);
+                goto err;
+        }
+
+        /* Only complete lines count, the last one may have been torn */
+        end = buf + len;
+        for (p = buf; p < end; p = eol + 1) {
+                eol = memchr(p, '\n', end - p);
+                if (eol == NULL)
+                        break;
+                *eol = '\0';
+
+                if ((p[0] != '+' && p[0] != '-') || p[1] == '\0') {
+                        LogDebug(COMPONENT_CLIENTID,
+                            "Skipping bad line in recovery journal (%s)",
+                            path);
+                        continue;
+                }
+
+                lines[nb_lines].name = p + 1;
+                lines[nb_lines].add = p[0] == '+';
+                lines[nb_lines].seq = nb_lines;
+                nb_lines++;
+        }
+
+        /* Group the lines of each name, in the order they were written */
+        qsort(lines, nb_lines, sizeof(journal_line_t), journal_line_cmp);
+
+        names = gsh_calloc(nb_lines + 1, sizeof(char *));
+        if (names == NULL) {
+                LogEvent(COMPONENT_CLIENTID, "Unable to allocate memory.");
+                goto err;
+        }
+
+        for (i = 0; i < nb_lines; i++) {
+                if (i + 1 < nb_lines &&
+                    !strcmp(lines[i].name, lines[i + 1].name))
+                        continue;
+                if (!lines[i].add)
+                        continue;
+
+                names[count] = gsh_strdup(lines[i].name);
+                if (names[count] == NULL) {
+                        LogEvent(COMPONENT_CLIENTID,
+                            "Unable to allocate memory.");
+                        goto err;
+                }
+                count++;
+        }
+
+        (void) close(fd);
+        gsh_free(buf);
+        gsh_free(lines);
+
+        LogDebug(COMPONENT_CLIENTID,
+            "Read %d clients from %u lines of recovery journal (%s)",
+            count, nb_lines, path);
+
+        *pnames = names;
+        return count;
+
+ err:
+        (void) close(fd);
+        gsh_free(buf);
+        gsh_free(lines);
+        nfs4_journal_free_names(names, count);
+        return -1;
+}
+
+/*
+ * replace the journal of dir by one holding just these clients.  the
+ * new journal is on disk, under its final name, when this returns 0.
+ */
+int
+nfs4_journal_write(char *dir, char **names, int count)
+{
+        char path[PATH_MAX], tmp[PATH_MAX];
+        FILE *f;
+        int dirfd, i, rc = 0;
+
+        snprintf(path, PATH_MAX, "%s/%s", dir, JOURNAL_NAME);
+        snprintf(tmp, PATH_MAX, "%s/%s", dir, JOURNAL_TMP_NAME);
+
+        f = fopen(tmp, "w");
+        if (f == NULL) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to create recovery journal (%s), errno=%d",
+                    tmp, errno);
+                return -1;
+        }
+
+        for (i = 0; i < count && rc >= 0; i++)
+                rc = fprintf(f, "+%s\n", names[i]);
+
+        if (rc < 0 || fflush(f) != 0 || fsync(fileno(f)) != 0) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to write recovery journal (%s), errno=%d",
+                    tmp, errno);
+                (void) fclose(f);
+                (void) unlink(tmp);
+                return -1;
+        }
+
+        (void) fclose(f);
+
+        if (rename(tmp, path) == -1) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to rename recovery journal (%s), errno=%d",
+                    tmp, errno);
+                (void) unlink(tmp);
+                return -1;
+        }
+
+        /* Make the rename itself durable */
+        dirfd = open(dir, O_RDONLY);
+        if (dirfd != -1) {
+                (void) fsync(dirfd);
+                (void) close(dirfd);
+        }
+
+        return 0;
+}
+
+/* (re)open the journal of journal_dir for appending, journal_mutex held */
+static int
+journal_reopen(unsigned int clients)
+{
+        char path[PATH_MAX];
+        int fd;
+
+        snprintf(path, PATH_MAX, "%s/%s", journal_dir, JOURNAL_NAME);
+
+        fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd == -1) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to open recovery journal (%s), errno=%d",
+                    path, errno);
+                return -1;
+        }
+
+        if (journal_fd != -1)
+                (void) close(journal_fd);
+
+        journal_fd = fd;
+        journal_lines = clients;
+        journal_clients = clients;
+
+        /* Whatever was appended to the previous file is in this one */
+        journal_synced = journal_appended;
+        pthread_cond_broadcast(&journal_cond);
+
+        return 0;
+}
+
+/* rewrite the journal with the clients in it, journal_mutex held */
+static void
+journal_compact(void)
+{
+        char **names;
+        int count;
+
+        /* Do not pull the file from under a running fsync */
+        while (journal_syncing)
+                pthread_cond_wait(&journal_cond, &journal_mutex);
+
+        count = nfs4_journal_read(journal_dir, &names);
+        if (count == -1)
+                return;
+
+        if (nfs4_journal_write(journal_dir, names, count) == 0) {
+                LogDebug(COMPONENT_CLIENTID,
+                    "Compacted recovery journal from %u to %d lines",
+                    journal_lines, count);
+                (void) journal_reopen(count);
+        }
+
+        nfs4_journal_free_names(names, count);
+}
+
+/*
+ * open the journal clients are added to and removed from, in dir.
+ */
+int
+nfs4_journal_open(char *dir)
+{
+        char **names;
+        int count, rc;
+
+        P(journal_mutex);
+
+        strncpy(journal_dir, dir, PATH_MAX - 1);
+
+        count = nfs4_journal_read(journal_dir, &names);
+        if (count == -1) {
+                V(journal_mutex);
+                return -1;
+        }
+        nfs4_journal_free_names(names, count);
+
+        rc = journal_reopen(count);
+
+        V(journal_mutex);
+
+        return rc;
+}
+
+/*
+ * empty the journal clients are added to, once they have been moved
+ * to the old journal at startup.
+ */
+int
+nfs4_journal_reset(void)
+{
+        int rc;
+
+        P(journal_mutex);
+
+        while (journal_syncing)
+                pthread_cond_wait(&journal_cond, &journal_mutex);
+
+        rc = nfs4_journal_write(journal_dir, NULL, 0);
+        if (rc == 0)
+                rc = journal_reopen(0);
+
+        V(journal_mutex);
+
+        return rc;
+}
+
+/* append a line, journal_mutex held.  returns its number, 0 on error */
+static uint64_t
+journal_append(char op, char *name)
+{
+        char line[PATH_MAX];
+        int len;
+
+        if (journal_fd == -1)
+                return 0;
+
+        len = snprintf(line, sizeof(line), "%c%s\n", op, name);
+        if (len >= (int) sizeof(line) || strchr(name, '\n') != NULL)
+                return 0;
+
+        /* O_APPEND, a line is written at once */
+        if (write(journal_fd, line, len) != len) {
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to append to recovery journal (%s), errno=%d",
+                    journal_dir, errno);
+                return 0;
+        }
+
+        journal_lines++;
+
+        return ++journal_appended;
+}
+
+/*
+ * record a client as allowed to reclaim, returning once it is on disk.
+ */
+void
+nfs4_journal_add(char *name)
+{
+        uint64_t seq, target;
+        int fd, rc;
+
+        P(journal_mutex);
+
+        seq = journal_append('+', name);
+        if (seq == 0) {
+                V(journal_mutex);
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to add client %s to recovery journal", name);
+                return;
+        }
+
+        journal_clients++;
+
+        while (journal_synced < seq) {
+                if (journal_syncing) {
+                        pthread_cond_wait(&journal_cond, &journal_mutex);
+                        continue;
+                }
+
+                /* Lead an fsync for everything appended so far */
+                journal_syncing = TRUE;
+                target = journal_appended;
+                fd = journal_fd;
+
+                V(journal_mutex);
+
+                rc = fdatasync(fd);
+
+                P(journal_mutex);
+
+                if (rc == -1)
+                        LogEvent(COMPONENT_CLIENTID,
+                            "Failed to sync recovery journal (%s), errno=%d",
+                            journal_dir, errno);
+
+                if (journal_synced < target)
+                        journal_synced = target;
+                journal_syncing = FALSE;
+                pthread_cond_broadcast(&journal_cond);
+        }
+
+        V(journal_mutex);
+
+        LogDebug(COMPONENT_CLIENTID, "Added client %s to recovery journal",
+            name);
+}
+
+/*
+ * record a client as no longer allowed to reclaim.
+ */
+void
+nfs4_journal_rm(char *name)
+{
+        P(journal_mutex);
+
+        if (journal_append('-', name) == 0) {
+                V(journal_mutex);
+                LogEvent(COMPONENT_CLIENTID,
+                    "Failed to remove client %s from recovery journal",
+                    name);
+                return;
+        }
+
+        if (journal_clients > 0)
+                journal_clients--;
+
+        if (journal_lines > JOURNAL_COMPACT_MIN &&
+            journal_lines > 2 * journal_clients)
+                journal_compact();
+
+        V(journal_mutex);
+}
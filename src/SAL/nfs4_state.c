@@ -97,8 +97,14 @@ int state_conflict(state_t      * pstate,
       return FALSE;              /** layout conflict is managed by the FSAL */
 
     case STATE_TYPE_DELEG:
-      /* Not yet implemented for now, answer TRUE to avoid weird behavior */
-      return TRUE;
+      /* Only read delegations are granted, writers exclude them */
+      if(pstate->state_type == STATE_TYPE_SHARE)
+        {
+          if((pstate->state_data.share.share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+             (pstate->state_data.share.share_deny & OPEN4_SHARE_DENY_READ))
+            return TRUE;
+        }
+      return FALSE;
     }
 
   return TRUE;
@@ -137,6 +143,7 @@ state_status_t state_add_impl(cache_entry_t         * pentry,
   struct glist_head    * glist;
   cache_inode_status_t   cache_status;
   bool_t                 got_pinned = FALSE;
+  bool_t                 conflict = FALSE;
 
   if(glist_empty(&pentry->state_list))
     {
@@ -171,27 +178,42 @@ state_status_t state_add_impl(cache_entry_t         * pentry,
 
   memset(pnew_state, 0, sizeof(*pnew_state));
 
-  /* Browse the state's list */
-  glist_for_each(glist, &pentry->state_list)
+  /* Only shares conflict with shares and delegations, and their union is
+   * kept per file: a hot file with thousands of opens need not be browsed.
+   * The state lock is held, so the union is current. */
+  if(pentry->type == REGULAR_FILE)
     {
-      piter_state = glist_entry(glist, state_t, state_list);
-
-      if(state_conflict(piter_state, state_type, pstate_data))
+      conflict = state_share_summary_conflict(pentry, state_type, pstate_data);
+    }
+  else
+    {
+      glist_for_each(glist, &pentry->state_list)
         {
-          LogDebug(COMPONENT_STATE,
-                   "new state conflicts with another state for pentry %p",
-                   pentry);
+          piter_state = glist_entry(glist, state_t, state_list);
 
-          /* stat */
-          pool_free(state_v4_pool, pnew_state);
+          if(state_conflict(piter_state, state_type, pstate_data))
+            {
+              conflict = TRUE;
+              break;
+            }
+        }
+    }
 
-          *pstatus = STATE_STATE_CONFLICT;
+  if(conflict)
+    {
+      LogDebug(COMPONENT_STATE,
+               "new state conflicts with another state for pentry %p",
+               pentry);
 
-          if(got_pinned)
-            cache_inode_dec_pin_ref(pentry);
+      /* stat */
+      pool_free(state_v4_pool, pnew_state);
 
-          return *pstatus;
-        }
+      *pstatus = STATE_STATE_CONFLICT;
+
+      if(got_pinned)
+        cache_inode_dec_pin_ref(pentry);
+
+      return *pstatus;
     }
 
   /* Add the stateid.other, this will increment state_id_counter */
@@ -333,6 +355,10 @@ state_status_t state_del_locked(state_t              * pstate,
   if(pstate->state_type == STATE_TYPE_LOCK)
     glist_del(&pstate->state_data.lock.state_sharelist);
 
+  /* Forget the delegation, recalled or not */
+  if(pstate->state_type == STATE_TYPE_DELEG)
+    state_deleg_release(pstate, pentry);
+
   /* Remove from list of states for a particular export */
   P(pstate->state_pexport->exp_state_mutex);
   glist_del(&pstate->state_export_list);
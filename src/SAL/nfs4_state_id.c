@@ -63,6 +63,7 @@
 #include "nfs_exports.h"
 #include "nfs_file_handle.h"
 #include "sal_functions.h"
+#include "abstract_atomic.h"
 
 size_t strnlen(const char *s, size_t maxlen);
 
@@ -75,10 +76,79 @@ char all_one[OTHERSIZE];
 pthread_mutex_t StateIdMutex = PTHREAD_MUTEX_INITIALIZER;
 uint64_t state_id_counter;
 
+/*
+ * The stateids minted here carry, after the server epoch, the index of a
+ * slot in state_slots (with STATEID_DIRECT set) and the generation of
+ * that slot.  They are resolved without hashing nor locking: the slot is
+ * read between two reads of its generation, which is bumped before the
+ * state is taken out of it.  Once the slots run out, stateids are made
+ * from state_id_counter instead, and kept in ht_state_id.
+ *
+ * Slots are allocated by chunks that are never freed, so a slot may be
+ * read at any time.  StateIdMutex protects the allocation of slots.
+ */
+#define STATEID_DIRECT            0x80000000
+#define STATEID_SLOTS_PER_CHUNK   4096
+#define STATEID_SLOT_CHUNKS       1024
+#define STATEID_NO_SLOT           0xFFFFFFFF
+
+typedef struct stateid_slot
+{
+  state_t  * ss_pstate;
+  uint32_t   ss_gen;
+  uint32_t   ss_next_free;
+} stateid_slot_t;
+
+static stateid_slot_t *state_slots[STATEID_SLOT_CHUNKS];
+static uint32_t state_slots_used = 0;   /* slots ever handed out */
+static uint32_t state_slots_free = STATEID_NO_SLOT;
+
+static inline stateid_slot_t *stateid_slot(uint32_t index)
+{
+  stateid_slot_t *chunk;
+
+  if(index / STATEID_SLOTS_PER_CHUNK >= STATEID_SLOT_CHUNKS)
+    return NULL;
+
+  chunk = (stateid_slot_t *)
+    atomic_fetch_size_t((size_t *) &state_slots[index / STATEID_SLOTS_PER_CHUNK]);
+
+  if(chunk == NULL)
+    return NULL;
+
+  return &chunk[index % STATEID_SLOTS_PER_CHUNK];
+}
+
+/* Slot and generation of a stateid, FALSE if it is not in a slot */
+static inline bool_t stateid_decode(char * other,
+                                    uint32_t * pindex,
+                                    uint32_t * pgen)
+{
+  uint32_t epoch, index;
+
+  memcpy(&epoch, other, sizeof(uint32_t));
+  memcpy(&index, other + sizeof(uint32_t), sizeof(uint32_t));
+
+  if(epoch != (uint32_t) ServerEpoch || (index & STATEID_DIRECT) == 0)
+    return FALSE;
+
+  *pindex = index & ~STATEID_DIRECT;
+  memcpy(pgen, other + 2 * sizeof(uint32_t), sizeof(uint32_t));
+
+  return TRUE;
+}
+
 int display_stateid_other(char * other, char * str)
 {
-  uint32_t epoch = *((uint32_t *)other);
-  uint64_t count = *((uint64_t *)(other + sizeof(uint32_t)));
+  uint32_t epoch, index, gen;
+  uint64_t count;
+
+  if(stateid_decode(other, &index, &gen))
+    return sprintf(str, "epoch=0x%08x slot=%u gen=%u",
+                   (unsigned int) ServerEpoch, index, gen);
+
+  memcpy(&epoch, other, sizeof(uint32_t));
+  memcpy(&count, other + sizeof(uint32_t), sizeof(uint64_t));
   return sprintf(str, "epoch=0x%08x counter=0x%016llx",
                  (unsigned int) epoch, (unsigned long long) count);
 }
@@ -172,12 +242,44 @@ int nfs4_Init_state_id(nfs_state_id_parameter_t param)
   return 0;
 }                               /* nfs_Init_client_id */
 
+/* Take a free slot, StateIdMutex held */
+static uint32_t stateid_slot_alloc(void)
+{
+  stateid_slot_t *pslot;
+  uint32_t index;
+
+  if(state_slots_free != STATEID_NO_SLOT)
+    {
+      index = state_slots_free;
+      state_slots_free = stateid_slot(index)->ss_next_free;
+      return index;
+    }
+
+  if(state_slots_used / STATEID_SLOTS_PER_CHUNK >= STATEID_SLOT_CHUNKS)
+    return STATEID_NO_SLOT;
+
+  if(state_slots_used % STATEID_SLOTS_PER_CHUNK == 0)
+    {
+      pslot = gsh_calloc(STATEID_SLOTS_PER_CHUNK, sizeof(stateid_slot_t));
+      if(pslot == NULL)
+        return STATEID_NO_SLOT;
+
+      atomic_store_size_t((size_t *)
+                          &state_slots[state_slots_used / STATEID_SLOTS_PER_CHUNK],
+                          (size_t) pslot);
+    }
+
+  return state_slots_used++;
+}
+
 /**
  *
  * nfs4_BuildStateId_Other
  *
  * This routine builds the 12 byte "other" portion of a stateid from
- * the ServerEpoch and a 64 bit global counter.
+ * the ServerEpoch and a free slot of the stateid table with its
+ * generation, or a 63 bit global counter if all slots are taken.
+ * nfs4_State_Set must then be called, for the slot to be used.
  * @param other       [OUT]   the stateid.other object (a char[OTHERSIZE] string)
  *
  */
@@ -185,19 +287,41 @@ void nfs4_BuildStateId_Other(char * other)
 {
   /* Use only 32 bits of server epoch */
   uint32_t epoch = (uint32_t) ServerEpoch;
+  uint32_t index, gen;
+  uint64_t count;
+
   memcpy(other, &epoch, sizeof(uint32_t));
 
   P(StateIdMutex);
-  memcpy(other + sizeof(uint32_t), &state_id_counter, sizeof(uint64_t));
-  state_id_counter++;
+
+  index = stateid_slot_alloc();
+
+  if(index != STATEID_NO_SLOT)
+    {
+      gen = atomic_fetch_uint32_t(&stateid_slot(index)->ss_gen);
+      V(StateIdMutex);
+
+      index |= STATEID_DIRECT;
+      memcpy(other + sizeof(uint32_t), &index, sizeof(uint32_t));
+      memcpy(other + 2 * sizeof(uint32_t), &gen, sizeof(uint32_t));
+      return;
+    }
+
+  /* Keep STATEID_DIRECT clear in the word that would hold the slot */
+  count = state_id_counter++ & ~((uint64_t) STATEID_DIRECT << 32);
   V(StateIdMutex);
+
+  index = (uint32_t) (count >> 32);
+  gen = (uint32_t) count;
+  memcpy(other + sizeof(uint32_t), &index, sizeof(uint32_t));
+  memcpy(other + 2 * sizeof(uint32_t), &gen, sizeof(uint32_t));
 }
 
 /**
  *
  * nfs4_State_Set
  *
- * This routine sets a state into the states's hashtable.
+ * This routine sets a state into its slot, or the states's hashtable.
  *
  * @param pstate [IN] pointer to the stateid to be checked.
  *
@@ -206,8 +330,21 @@ void nfs4_BuildStateId_Other(char * other)
  */
 int nfs4_State_Set(char other[OTHERSIZE], state_t * pstate_data)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
+  hash_buffer_t    buffkey;
+  hash_buffer_t    buffval;
+  stateid_slot_t * pslot;
+  uint32_t         index, gen;
+
+  if(stateid_decode(other, &index, &gen))
+    {
+      /* The slot was reserved by nfs4_BuildStateId_Other */
+      pslot = stateid_slot(index);
+      if(pslot == NULL || atomic_fetch_uint32_t(&pslot->ss_gen) != gen)
+        return 0;
+
+      atomic_store_size_t((size_t *) &pslot->ss_pstate, (size_t) pstate_data);
+      return 1;
+    }
 
   if((buffkey.pdata = gsh_malloc(OTHERSIZE)) == NULL)
     return 0;
@@ -240,7 +377,8 @@ int nfs4_State_Set(char other[OTHERSIZE], state_t * pstate_data)
  *
  * nfs4_State_Get_Pointer
  *
- * This routine gets a pointer to a state from the states's hashtable.
+ * This routine gets a pointer to a state from its slot, without locking,
+ * or from the states's hashtable.
  *
  * @param pstate       [IN] pointer to the stateid to be checked.
  * @param ppstate_data [OUT] pointer's state found
@@ -250,9 +388,32 @@ int nfs4_State_Set(char other[OTHERSIZE], state_t * pstate_data)
  */
 int nfs4_State_Get_Pointer(char other[OTHERSIZE], state_t * *pstate_data)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  int           rc;
+  hash_buffer_t    buffkey;
+  hash_buffer_t    buffval;
+  int              rc;
+  stateid_slot_t * pslot;
+  state_t        * pstate;
+  uint32_t         index, gen;
+
+  if(stateid_decode(other, &index, &gen))
+    {
+      pslot = stateid_slot(index);
+      if(pslot == NULL || atomic_fetch_uint32_t(&pslot->ss_gen) != gen)
+        return 0;
+
+      pstate = (state_t *) atomic_fetch_size_t((size_t *) &pslot->ss_pstate);
+
+      /* Not taken out of the slot, nor replaced, meanwhile */
+      if(pstate == NULL || atomic_fetch_uint32_t(&pslot->ss_gen) != gen)
+        {
+          LogDebug(COMPONENT_STATE,
+                   "Stateid slot %u generation %u is gone", index, gen);
+          return 0;
+        }
+
+      *pstate_data = pstate;
+      return 1;
+    }
 
   buffkey.pdata = (caddr_t) other;
   buffkey.len = OTHERSIZE;
@@ -274,7 +435,7 @@ int nfs4_State_Get_Pointer(char other[OTHERSIZE], state_t * *pstate_data)
  *
  * nfs4_State_Del
  *
- * This routine removes a state from the states's hashtable.
+ * This routine removes a state from its slot, or the states's hashtable.
  *
  * @param other [IN] stateid'other field, used as a hash key
  *
@@ -283,7 +444,35 @@ int nfs4_State_Get_Pointer(char other[OTHERSIZE], state_t * *pstate_data)
  */
 int nfs4_State_Del(char other[OTHERSIZE])
 {
-  hash_buffer_t buffkey, old_key, old_value;
+  hash_buffer_t    buffkey, old_key, old_value;
+  stateid_slot_t * pslot;
+  uint32_t         index, gen;
+
+  if(stateid_decode(other, &index, &gen))
+    {
+      pslot = stateid_slot(index);
+      if(pslot == NULL)
+        return 0;
+
+      P(StateIdMutex);
+
+      if(atomic_fetch_uint32_t(&pslot->ss_gen) != gen)
+        {
+          V(StateIdMutex);
+          return 0;
+        }
+
+      /* Lookups of this stateid fail from now on */
+      (void) atomic_inc_uint32_t(&pslot->ss_gen);
+      atomic_store_size_t((size_t *) &pslot->ss_pstate, 0);
+
+      pslot->ss_next_free = state_slots_free;
+      state_slots_free = index;
+
+      V(StateIdMutex);
+
+      return 1;
+    }
 
   buffkey.pdata = (caddr_t) other;
   buffkey.len = OTHERSIZE;
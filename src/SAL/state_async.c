@@ -57,8 +57,30 @@
 #ifdef _USE_BLOCKING_LOCKS
 static pthread_t               state_async_thread_id;
 static struct glist_head       state_async_queue;
+static struct glist_head       state_async_delayed;    /* sorted by due time */
 nfs_tcb_t                      state_async_tcb;
 
+/* Move the delayed work that is due to the queue, return when the next
+ * delayed work is due, or 0 if there is none.  Called with tcb_mutex. */
+static time_t state_async_promote_locked(void)
+{
+  state_async_queue_t * entry;
+  time_t                now = time(NULL);
+
+  while((entry = glist_first_entry(&state_async_delayed,
+                                   state_async_queue_t,
+                                   state_async_glist)) != NULL)
+    {
+      if(entry->state_async_due > now)
+        return entry->state_async_due;
+
+      glist_del(&entry->state_async_glist);
+      glist_add_tail(&state_async_queue, &entry->state_async_glist);
+    }
+
+  return 0;
+}
+
 /* Execute a func from the async queue */
 void *state_async_thread(void *UnusedArg)
 {
@@ -66,6 +88,7 @@ void *state_async_thread(void *UnusedArg)
   struct timeval        now;
   struct timespec       timeout;
   state_block_data_t  * pblock;
+  time_t                next_due;
 
   SetNameFunction("state_async_thread");
 
@@ -91,6 +114,7 @@ void *state_async_thread(void *UnusedArg)
           while(1)
             {
               P(state_async_tcb.tcb_mutex);
+              next_due = state_async_promote_locked();
               if((state_async_tcb.tcb_state == STATE_AWAKE) &&
                   (!glist_empty(&state_async_queue) ||
                    !glist_empty(&state_notified_locks)))
@@ -110,6 +134,8 @@ void *state_async_thread(void *UnusedArg)
                         gettimeofday(&now, NULL);
                         timeout.tv_sec = 10 + now.tv_sec;
                         timeout.tv_nsec = 0;
+                        if(next_due != 0 && next_due < timeout.tv_sec)
+                          timeout.tv_sec = next_due;
                         pthread_cond_timedwait(&state_async_tcb.tcb_condvar,
                                                &state_async_tcb.tcb_mutex,
                                                &timeout);
@@ -150,6 +176,8 @@ void *state_async_thread(void *UnusedArg)
       /* Process one request if available */
       P(state_async_tcb.tcb_mutex);
 
+      (void) state_async_promote_locked();
+
       entry = glist_first_entry(&state_async_queue,
                                 state_async_queue_t,
                                 state_async_glist);
@@ -197,6 +225,48 @@ state_status_t state_async_schedule(state_async_queue_t *arg)
   return rc != -1 ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
 }
 
+/* Schedule Async Work to run in delay seconds */
+state_status_t state_async_schedule_delayed(state_async_queue_t *arg,
+                                            time_t               delay)
+{
+  struct glist_head   * glist;
+  state_async_queue_t * entry;
+  int                   rc;
+
+  arg->state_async_due = time(NULL) + delay;
+
+  LogFullDebug(COMPONENT_STATE, "Schedule %p in %d seconds", arg, (int) delay);
+
+  P(state_async_tcb.tcb_mutex);
+
+  /* Most work is delayed by the same few amounts, look from the end */
+  for(glist = state_async_delayed.prev;
+      glist != &state_async_delayed;
+      glist = glist->prev)
+    {
+      entry = glist_entry(glist, state_async_queue_t, state_async_glist);
+      if(entry->state_async_due <= arg->state_async_due)
+        break;
+    }
+
+  /* Insert after glist */
+  glist_add(glist, &arg->state_async_glist);
+
+  /* The thread may be sleeping past the new due time */
+  rc = pthread_cond_signal(&state_async_tcb.tcb_condvar);
+
+  if(rc == -1)
+    {
+      LogFullDebug(COMPONENT_STATE,
+                   "Unable to signal State Async Thread");
+      glist_del(&arg->state_async_glist);
+    }
+
+  V(state_async_tcb.tcb_mutex);
+
+  return rc != -1 ? STATE_SUCCESS : STATE_SIGNAL_ERROR;
+}
+
 /* Signal Async Work */
 void signal_async_work()
 {
@@ -218,6 +288,7 @@ state_status_t state_async_init()
 {
 #ifdef _USE_BLOCKING_LOCKS
   init_glist(&state_async_queue);
+  init_glist(&state_async_delayed);
   tcb_new(&state_async_tcb, "State Async Thread");
 #endif
   return STATE_SUCCESS;
@@ -0,0 +1,652 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    state_deleg.c
+ * \brief   Read delegations granted to NFSv4.0 clients.
+ *
+ * A delegation is a state of type STATE_TYPE_DELEG on the file, owned
+ * by the clientid owner of the client holding it.  It is only granted
+ * when nothing suggests it will have to be recalled soon:
+ *
+ *  - the open is for reading only and denies nothing;
+ *  - the file is not open for writing nor denied for reading;
+ *  - the client's callback path has been checked (CB_NULL), and no
+ *    callback to it has failed since;
+ *  - the file's delegations have not been recalled in the last lease
+ *    period.
+ *
+ * A conflicting OPEN, WRITE or SETATTR from another client sends
+ * CB_RECALL for each delegation on the file and gets NFS4ERR_DELAY
+ * until they are all returned.  A delegation that is not returned
+ * within a lease period, or whose CB_RECALL could not be sent, is
+ * revoked by the reaper thread.
+ *
+ * Locking: the delegations of a file are protected by its state_lock.
+ * deleg_mutex protects the list of recalled delegations and the list of
+ * clients to probe; it is taken after state_lock.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <time.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "log.h"
+#include "nlm_list.h"
+#include "abstract_atomic.h"
+#include "fsal.h"
+#include "sal_functions.h"
+#include "nfs_core.h"
+#include "cache_inode_lru.h"
+#include "nfs_rpc_callback.h"
+
+typedef struct deleg_probe
+{
+  struct glist_head list;
+  nfs_client_id_t *pclientid;
+} deleg_probe_t;
+
+static uint32_t deleg_outstanding = 0;
+static uint64_t deleg_granted = 0;
+static uint64_t deleg_recalled = 0;
+static uint64_t deleg_returned = 0;
+static uint64_t deleg_revoked = 0;
+
+static pthread_mutex_t deleg_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Delegations CB_RECALL was sent for, oldest first */
+static struct glist_head deleg_recalls = {
+  &deleg_recalls, &deleg_recalls
+};
+
+/* Clients whose callback path is to be checked by the reaper */
+static struct glist_head deleg_probes = {
+  &deleg_probes, &deleg_probes
+};
+
+static inline clientid4 deleg_clientid(state_t *pstate)
+{
+  return pstate->state_powner->so_owner.so_nfs4_owner.so_clientid;
+}
+
+/* Tell if the client's callback path may be relied upon, queuing it to
+ * be checked if that is not known yet. */
+static bool_t deleg_cb_path_up(nfs_client_id_t *pclientid)
+{
+  deleg_probe_t *probe;
+
+  switch(atomic_fetch_uint32_t(&pclientid->cid_cb.cid_path_state))
+    {
+    case CB_PATH_UP:
+      return TRUE;
+
+    case CB_PATH_UNKNOWN:
+      if(pclientid->cid_cb.cid_client_r_addr[0] == '\0')
+        return FALSE;
+
+      probe = gsh_malloc(sizeof(deleg_probe_t));
+      if(probe == NULL)
+        return FALSE;
+
+      if(!atomic_cas_uint32_t(&pclientid->cid_cb.cid_path_state,
+                              CB_PATH_UNKNOWN, CB_PATH_PROBING))
+        {
+          gsh_free(probe);
+          return FALSE;
+        }
+
+      inc_client_id_ref(pclientid);
+      probe->pclientid = pclientid;
+
+      P(deleg_mutex);
+      glist_add_tail(&deleg_probes, &probe->list);
+      V(deleg_mutex);
+      return FALSE;
+
+    default:
+      return FALSE;
+    }
+}
+
+/**
+ * state_deleg_grant: try to grant a read delegation with an open.
+ *
+ * Called without the state_lock of pentry.
+ *
+ * @param pentry       [IN]  file being opened
+ * @param popen_owner  [IN]  open owner of the open
+ * @param pexport      [IN]  export the file is opened through
+ * @param pcontext     [IN]  FSAL credentials
+ * @param share_access [IN]  share access of the open
+ * @param share_deny   [IN]  share deny of the open
+ * @param pfh          [IN]  file handle of the file, to recall with
+ * @param ppstate      [OUT] delegation state
+ *
+ * @return TRUE if a delegation was granted.
+ */
+bool_t state_deleg_grant(cache_entry_t     * pentry,
+                         state_owner_t     * popen_owner,
+                         exportlist_t      * pexport,
+                         fsal_op_context_t * pcontext,
+                         uint32_t            share_access,
+                         uint32_t            share_deny,
+                         nfs_fh4           * pfh,
+                         state_t          ** ppstate)
+{
+  nfs_client_id_t   * pclientid;
+  state_owner_t     * pdeleg_owner;
+  state_data_t        deleg_data;
+  state_status_t      status;
+  struct glist_head * glist;
+  time_t              now;
+
+  if(!nfs_param.nfsv4_param.delegations)
+    return FALSE;
+
+  if(share_access != OPEN4_SHARE_ACCESS_READ ||
+     share_deny != OPEN4_SHARE_DENY_NONE ||
+     pentry->type != REGULAR_FILE ||
+     !popen_owner->so_owner.so_nfs4_owner.so_confirmed ||
+     nfs_in_grace())
+    return FALSE;
+
+  if(atomic_fetch_uint32_t(&deleg_outstanding) >=
+     nfs_param.nfsv4_param.max_delegations)
+    return FALSE;
+
+  pclientid = popen_owner->so_owner.so_nfs4_owner.so_pclientid;
+  if(!deleg_cb_path_up(pclientid))
+    return FALSE;
+
+  memset(&deleg_data, 0, sizeof(deleg_data));
+  deleg_data.deleg.sd_type = OPEN_DELEGATE_READ;
+  deleg_data.deleg.sd_status = DELEG_GRANTED;
+  deleg_data.deleg.sd_fh.nfs_fh4_len = pfh->nfs_fh4_len;
+  deleg_data.deleg.sd_fh.nfs_fh4_val = gsh_malloc(pfh->nfs_fh4_len);
+  if(deleg_data.deleg.sd_fh.nfs_fh4_val == NULL)
+    return FALSE;
+  memcpy(deleg_data.deleg.sd_fh.nfs_fh4_val, pfh->nfs_fh4_val,
+         pfh->nfs_fh4_len);
+
+  pdeleg_owner = &pclientid->cid_owner;
+  now = time(NULL);
+
+  pthread_rwlock_wrlock(&pentry->state_lock);
+
+  /* Contended lately, or being written */
+  if(pentry->object.file.deleg_recall_time +
+     nfs_param.nfsv4_param.lease_lifetime > now ||
+     pentry->object.file.share_state.share_access_write != 0 ||
+     pentry->object.file.share_state.share_deny_read != 0)
+    goto refuse;
+
+  /* One delegation per client is enough */
+  if(pentry->object.file.deleg_cnt != 0)
+    glist_for_each(glist, &pentry->state_list)
+      {
+        state_t *pstate = glist_entry(glist, state_t, state_list);
+
+        if(pstate->state_type == STATE_TYPE_DELEG &&
+           deleg_clientid(pstate) == pclientid->cid_clientid)
+          goto refuse;
+      }
+
+  /* state_del_locked releases the reference of the state to its owner */
+  inc_state_owner_ref(pdeleg_owner);
+
+  if(state_add_impl(pentry, STATE_TYPE_DELEG, &deleg_data, pdeleg_owner,
+                    pcontext, ppstate, &status) != STATE_SUCCESS)
+    {
+      LogDebug(COMPONENT_STATE,
+               "Could not add delegation, error %s",
+               state_err_str(status));
+      dec_state_owner_ref(pdeleg_owner);
+      goto refuse;
+    }
+
+  init_glist(&(*ppstate)->state_data.deleg.sd_recall_list);
+  (*ppstate)->state_seqid = 1;
+
+  (*ppstate)->state_pexport = pexport;
+  P(pexport->exp_state_mutex);
+  glist_add_tail(&pexport->exp_state_list, &(*ppstate)->state_export_list);
+  V(pexport->exp_state_mutex);
+
+  (void) atomic_inc_uint32_t(&pentry->object.file.deleg_cnt);
+
+  pthread_rwlock_unlock(&pentry->state_lock);
+
+  (void) atomic_inc_uint32_t(&deleg_outstanding);
+  (void) atomic_inc_uint64_t(&deleg_granted);
+
+  LogFullDebug(COMPONENT_STATE,
+               "Granted read delegation %p on entry %p to clientid %"PRIx64,
+               *ppstate, pentry, pclientid->cid_clientid);
+
+  return TRUE;
+
+ refuse:
+  pthread_rwlock_unlock(&pentry->state_lock);
+  gsh_free(deleg_data.deleg.sd_fh.nfs_fh4_val);
+  return FALSE;
+}
+
+static int32_t deleg_recall_done(rpc_call_t *call, rpc_call_hook hook,
+                                 void *arg, uint32_t flags)
+{
+  nfs_client_id_t *pclientid = call->u_data[0];
+
+  if(hook != RPC_CALL_COMPLETE)
+    return 0;
+
+  if(call->stat != RPC_SUCCESS)
+    {
+      /* The reaper revokes the delegations it holds */
+      LogEvent(COMPONENT_NFS_CB,
+               "CB_RECALL to clientid %"PRIx64" failed, rpc status %d",
+               pclientid->cid_clientid, call->stat);
+      atomic_store_uint32_t(&pclientid->cid_cb.cid_path_state,
+                            CB_PATH_DOWN);
+    }
+  else if(call->cbt.v_u.v4.res.status != NFS4_OK)
+    {
+      LogDebug(COMPONENT_NFS_CB,
+               "CB_RECALL to clientid %"PRIx64" returned %s",
+               pclientid->cid_clientid,
+               nfsstat4_to_str(call->cbt.v_u.v4.res.status));
+    }
+
+  gsh_free(call->u_data[1]);
+  free_rpc_call(call);
+  dec_client_id_ref(pclientid);
+
+  return 0;
+}
+
+/* Queue a CB_RECALL for the delegation.  What the call needs is copied:
+ * the delegation may be gone by the time it is sent. */
+static void deleg_send_recall(state_t *pstate)
+{
+  nfs_client_id_t *pclientid =
+    pstate->state_powner->so_owner.so_nfs4_owner.so_pclientid;
+  state_deleg_t *pdeleg = &pstate->state_data.deleg;
+  nfs_cb_argop4 argop;
+  rpc_call_t *call;
+  char *fh;
+
+  if(atomic_fetch_uint32_t(&pclientid->cid_cb.cid_path_state) != CB_PATH_UP)
+    return;
+
+  fh = gsh_malloc(pdeleg->sd_fh.nfs_fh4_len);
+  call = alloc_rpc_call();
+  if(fh == NULL || call == NULL)
+    {
+      LogCrit(COMPONENT_NFS_CB,
+              "Could not allocate CB_RECALL for clientid %"PRIx64,
+              pclientid->cid_clientid);
+      gsh_free(fh);
+      if(call != NULL)
+        free_rpc_call(call);
+      return;
+    }
+
+  memcpy(fh, pdeleg->sd_fh.nfs_fh4_val, pdeleg->sd_fh.nfs_fh4_len);
+
+  call->chan = &pclientid->cid_cb.cb_u.v40.cb_chan;
+  cb_compound_init_v4(&call->cbt, 1,
+                      pclientid->cid_cb.cb_u.v40.cb_callback_ident,
+                      NULL, 0);
+
+  memset(&argop, 0, sizeof(argop));
+  argop.argop = NFS4_OP_CB_RECALL;
+  argop.nfs_cb_argop4_u.opcbrecall.stateid.seqid = pstate->state_seqid;
+  memcpy(argop.nfs_cb_argop4_u.opcbrecall.stateid.other,
+         pstate->stateid_other, OTHERSIZE);
+  argop.nfs_cb_argop4_u.opcbrecall.truncate = FALSE;
+  argop.nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_len = pdeleg->sd_fh.nfs_fh4_len;
+  argop.nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val = fh;
+  cb_compound_add_op(&call->cbt, &argop);
+
+  inc_client_id_ref(pclientid);
+  call->u_data[0] = pclientid;
+  call->u_data[1] = fh;
+  call->call_hook = deleg_recall_done;
+
+  (void) nfs_rpc_submit_call(call, NFS_RPC_CALL_NONE);
+}
+
+/**
+ * state_deleg_recall_locked: recall the delegations conflicting with an
+ * operation.
+ *
+ * The delegations held by the client of powner do not conflict with
+ * it.  Called with the state_lock of pentry held for writing.
+ *
+ * @param pentry [IN] file being opened, written or changed
+ * @param powner [IN] owner the operation is done for, NULL if anonymous
+ *
+ * @return TRUE if the operation is to wait (NFS4ERR_DELAY) for
+ *         delegations to be returned.
+ */
+bool_t state_deleg_recall_locked(cache_entry_t *pentry, state_owner_t *powner)
+{
+  struct glist_head * glist;
+  state_t           * pstate;
+  state_deleg_t     * pdeleg;
+  bool_t              conflict = FALSE;
+  time_t              now;
+
+  if(pentry->type != REGULAR_FILE ||
+     atomic_fetch_uint32_t(&pentry->object.file.deleg_cnt) == 0)
+    return FALSE;
+
+  now = time(NULL);
+
+  glist_for_each(glist, &pentry->state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_list);
+
+      if(pstate->state_type != STATE_TYPE_DELEG)
+        continue;
+
+      if(powner != NULL &&
+         deleg_clientid(pstate) == powner->so_owner.so_nfs4_owner.so_clientid)
+        continue;
+
+      conflict = TRUE;
+      pentry->object.file.deleg_recall_time = now;
+
+      pdeleg = &pstate->state_data.deleg;
+      if(pdeleg->sd_status == DELEG_RECALLED)
+        continue;
+
+      pdeleg->sd_status = DELEG_RECALLED;
+      pdeleg->sd_recall_time = now;
+
+      P(deleg_mutex);
+      glist_add_tail(&deleg_recalls, &pdeleg->sd_recall_list);
+      V(deleg_mutex);
+
+      (void) atomic_inc_uint64_t(&deleg_recalled);
+
+      LogFullDebug(COMPONENT_STATE,
+                   "Recalling delegation %p on entry %p from clientid %"PRIx64,
+                   pstate, pentry, deleg_clientid(pstate));
+
+      deleg_send_recall(pstate);
+    }
+
+  return conflict;
+}
+
+/**
+ * state_deleg_recall: same as state_deleg_recall_locked, taking the
+ * state_lock.
+ */
+bool_t state_deleg_recall(cache_entry_t *pentry, state_owner_t *powner)
+{
+  bool_t conflict;
+
+  if(pentry->type != REGULAR_FILE ||
+     atomic_fetch_uint32_t(&pentry->object.file.deleg_cnt) == 0)
+    return FALSE;
+
+  pthread_rwlock_wrlock(&pentry->state_lock);
+  conflict = state_deleg_recall_locked(pentry, powner);
+  pthread_rwlock_unlock(&pentry->state_lock);
+
+  return conflict;
+}
+
+/**
+ * state_deleg_release: forget a delegation state_del_locked is deleting.
+ */
+void state_deleg_release(state_t *pstate, cache_entry_t *pentry)
+{
+  state_deleg_t *pdeleg = &pstate->state_data.deleg;
+
+  if(pdeleg->sd_status == DELEG_RECALLED)
+    {
+      P(deleg_mutex);
+      glist_del(&pdeleg->sd_recall_list);
+      V(deleg_mutex);
+    }
+
+  gsh_free(pdeleg->sd_fh.nfs_fh4_val);
+  pdeleg->sd_fh.nfs_fh4_val = NULL;
+
+  (void) atomic_dec_uint32_t(&pentry->object.file.deleg_cnt);
+  (void) atomic_dec_uint32_t(&deleg_outstanding);
+}
+
+/**
+ * state_deleg_return: DELEGRETURN of a delegation.
+ */
+state_status_t state_deleg_return(state_t *pstate, state_status_t *pstatus)
+{
+  if(state_del(pstate, pstatus) == STATE_SUCCESS)
+    (void) atomic_inc_uint64_t(&deleg_returned);
+
+  return *pstatus;
+}
+
+/**
+ * state_deleg_release_client: delete the delegations of an expired
+ * client.
+ */
+void state_deleg_release_client(nfs_client_id_t *pclientid)
+{
+  state_owner_t        * powner = &pclientid->cid_owner;
+  struct glist_head    * glist, * glistn;
+  cache_entry_t        * pentry;
+  state_status_t         state_status;
+
+  glist_for_each_safe(glist, glistn,
+                      &powner->so_owner.so_nfs4_owner.so_state_list)
+    {
+      state_t *pstate = glist_entry(glist, state_t, state_owner_list);
+
+      if(pstate->state_type != STATE_TYPE_DELEG)
+        continue;
+
+      pentry = pstate->state_pentry;
+
+      /* Make sure we hold an lru ref to the cache inode while calling state_del */
+      if(cache_inode_lru_ref(pentry, 0) != CACHE_INODE_SUCCESS)
+        LogCrit(COMPONENT_CLIENTID,
+                "Ugliness - cache_inode_lru_ref has returned non-success");
+
+      if(state_del(pstate, &state_status) != STATE_SUCCESS)
+        LogDebug(COMPONENT_CLIENTID,
+                 "EXPIRY failed to release delegation error %s",
+                 state_err_str(state_status));
+
+      cache_inode_lru_unref(pentry, 0);
+    }
+}
+
+/* Check the callback paths of the clients queued by deleg_cb_path_up */
+static void deleg_probe_clients(void)
+{
+  struct timeval timeout = { 5, 0 };
+  deleg_probe_t *probe;
+  nfs_client_id_t *pclientid;
+  rpc_call_channel_t *chan;
+  bool_t connected;
+  uint32_t state;
+
+  for(;;)
+    {
+      P(deleg_mutex);
+      if(glist_empty(&deleg_probes))
+        {
+          V(deleg_mutex);
+          return;
+        }
+      probe = glist_first_entry(&deleg_probes, deleg_probe_t, list);
+      glist_del(&probe->list);
+      V(deleg_mutex);
+
+      pclientid = probe->pclientid;
+      chan = &pclientid->cid_cb.cb_u.v40.cb_chan;
+
+      pthread_mutex_lock(&chan->mtx);
+      if(chan->clnt == NULL &&
+         nfs_rpc_create_chan_v40(pclientid, NFS_RPC_FLAG_NONE) != 0 &&
+         chan->clnt != NULL)
+        nfs_rpc_destroy_chan(chan);
+      connected = chan->clnt != NULL;
+      pthread_mutex_unlock(&chan->mtx);
+
+      if(connected && rpc_cb_null(chan, timeout) == RPC_SUCCESS)
+        state = CB_PATH_UP;
+      else
+        state = CB_PATH_DOWN;
+
+      /* SETCLIENTID_CONFIRM may have changed the callback meanwhile */
+      (void) atomic_cas_uint32_t(&pclientid->cid_cb.cid_path_state,
+                                 CB_PATH_PROBING, state);
+
+      LogDebug(COMPONENT_NFS_CB,
+               "Callback path of clientid %"PRIx64" is %s",
+               pclientid->cid_clientid,
+               state == CB_PATH_UP ? "up" : "down");
+
+      dec_client_id_ref(pclientid);
+      gsh_free(probe);
+    }
+}
+
+/* Find a recalled delegation to revoke, taking an lru reference on its
+ * file.  Returns FALSE if there is none. */
+static bool_t deleg_find_expired(time_t now, cache_entry_t **ppentry,
+                                 char other[OTHERSIZE])
+{
+  struct glist_head * glist;
+  state_t           * pstate;
+  nfs_client_id_t   * pclientid;
+  bool_t              found = FALSE;
+
+  P(deleg_mutex);
+
+  glist_for_each(glist, &deleg_recalls)
+    {
+      pstate = glist_entry(glist, state_t, state_data.deleg.sd_recall_list);
+      pclientid = pstate->state_powner->so_owner.so_nfs4_owner.so_pclientid;
+
+      if(pstate->state_data.deleg.sd_recall_time + nfs_param.nfsv4_param.lease_lifetime > now &&
+         atomic_fetch_uint32_t(&pclientid->cid_cb.cid_path_state) == CB_PATH_UP)
+        continue;
+
+      /* The delegation pins its file until state_del_locked, which
+       * needs deleg_mutex to take it off this list. */
+      if(cache_inode_lru_ref(pstate->state_pentry, 0) != CACHE_INODE_SUCCESS)
+        continue;
+
+      *ppentry = pstate->state_pentry;
+      memcpy(other, pstate->stateid_other, OTHERSIZE);
+      found = TRUE;
+      break;
+    }
+
+  V(deleg_mutex);
+
+  return found;
+}
+
+/**
+ * state_deleg_reap: check the callback paths of the clients asking for
+ * delegations and revoke the delegations not returned in time.
+ *
+ * Called by the reaper thread.
+ */
+void state_deleg_reap(void)
+{
+  cache_entry_t   * pentry;
+  state_t         * pstate;
+  char              other[OTHERSIZE];
+  time_t            now = time(NULL);
+  struct glist_head failed;
+
+  init_glist(&failed);
+
+  deleg_probe_clients();
+
+  while(deleg_find_expired(now, &pentry, other))
+    {
+      pthread_rwlock_wrlock(&pentry->state_lock);
+
+      /* It may have been returned since */
+      if(nfs4_State_Get_Pointer(other, &pstate) &&
+         pstate->state_pentry == pentry &&
+         pstate->state_type == STATE_TYPE_DELEG &&
+         pstate->state_data.deleg.sd_status == DELEG_RECALLED)
+        {
+          LogEvent(COMPONENT_STATE,
+                   "Revoking delegation %p on entry %p of clientid %"PRIx64
+                   ", not returned in time",
+                   pstate, pentry, deleg_clientid(pstate));
+
+          if(state_del_locked(pstate, pentry) == STATE_SUCCESS)
+            (void) atomic_inc_uint64_t(&deleg_revoked);
+          else
+            {
+              /* Set it aside until the next pass, or it would be
+               * found again right away */
+              LogDebug(COMPONENT_STATE,
+                       "Could not revoke delegation %p, retrying later",
+                       pstate);
+              P(deleg_mutex);
+              glist_del(&pstate->state_data.deleg.sd_recall_list);
+              glist_add_tail(&failed,
+                             &pstate->state_data.deleg.sd_recall_list);
+              V(deleg_mutex);
+            }
+        }
+
+      pthread_rwlock_unlock(&pentry->state_lock);
+      cache_inode_lru_unref(pentry, 0);
+    }
+
+  P(deleg_mutex);
+  glist_add_list_tail(&deleg_recalls, &failed);
+  V(deleg_mutex);
+}
+
+void state_deleg_get_stats(state_deleg_stats_t *pstats)
+{
+  pstats->outstanding = atomic_fetch_uint32_t(&deleg_outstanding);
+  pstats->granted = atomic_fetch_uint64_t(&deleg_granted);
+  pstats->recalled = atomic_fetch_uint64_t(&deleg_recalled);
+  pstats->returned = atomic_fetch_uint64_t(&deleg_returned);
+  pstats->revoked = atomic_fetch_uint64_t(&deleg_revoked);
+}
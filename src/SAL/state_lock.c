@@ -562,6 +562,111 @@ void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
     }
 }
 
+/*
+ * Every entry on a file's lock_list is also indexed by range: in
+ * lock_tree while it is granted or being granted, in blocked_tree
+ * otherwise.  Conflict checks, merges and unlocks only visit the
+ * entries overlapping the range they work on.
+ */
+static inline struct itree_root *lock_entry_tree(state_lock_entry_t * lock_entry)
+{
+  cache_entry_t * pentry = lock_entry->sle_pentry;
+
+  if(lock_entry->sle_blocked == STATE_NON_BLOCKING ||
+     lock_entry->sle_blocked == STATE_GRANTING)
+    return &pentry->object.file.lock_tree;
+
+  return &pentry->object.file.blocked_tree;
+}
+
+static void lock_entry_index(state_lock_entry_t * lock_entry)
+{
+  struct cache_inode_file__ * pfile = &lock_entry->sle_pentry->object.file;
+
+  if(itree_empty(&pfile->lock_tree) && itree_empty(&pfile->blocked_tree))
+    {
+      pfile->lock_pexport     = lock_entry->sle_pexport;
+      pfile->lock_pexport_cnt = 0;
+    }
+
+  if(lock_entry->sle_pexport == pfile->lock_pexport)
+    pfile->lock_pexport_cnt++;
+
+  itree_insert(lock_entry_tree(lock_entry),
+               &lock_entry->sle_tree,
+               lock_entry->sle_lock.lock_start,
+               lock_end(&lock_entry->sle_lock));
+}
+
+static void lock_entry_unindex(state_lock_entry_t * lock_entry)
+{
+  struct cache_inode_file__ * pfile = &lock_entry->sle_pentry->object.file;
+
+  if(!itree_linked(&lock_entry->sle_tree))
+    return;
+
+  itree_remove(&lock_entry->sle_tree);
+
+  if(lock_entry->sle_pexport == pfile->lock_pexport)
+    pfile->lock_pexport_cnt--;
+}
+
+/* The range of an indexed entry has changed */
+static void lock_entry_reindex(state_lock_entry_t * lock_entry)
+{
+  if(itree_linked(&lock_entry->sle_tree))
+    itree_update(&lock_entry->sle_tree,
+                 lock_entry->sle_lock.lock_start,
+                 lock_end(&lock_entry->sle_lock));
+}
+
+/* sle_blocked of an indexed entry has changed */
+static void lock_entry_reclassify(state_lock_entry_t * lock_entry)
+{
+  if(itree_linked(&lock_entry->sle_tree) &&
+     lock_entry->sle_tree.tree != lock_entry_tree(lock_entry))
+    {
+      lock_entry_unindex(lock_entry);
+      lock_entry_index(lock_entry);
+    }
+}
+
+static void lock_list_add(cache_entry_t        * pentry,
+                          struct glist_head    * list,
+                          state_lock_entry_t   * lock_entry)
+{
+  glist_add_tail(list, &lock_entry->sle_list);
+
+  if(list == &pentry->object.file.lock_list)
+    lock_entry_index(lock_entry);
+}
+
+/* Lock held by powner on the file through another export than pexport */
+static state_lock_entry_t *get_export_conflict(cache_entry_t  * pentry,
+                                               state_owner_t  * powner,
+                                               exportlist_t   * pexport)
+{
+  struct cache_inode_file__ * pfile = &pentry->object.file;
+  struct glist_head         * glist;
+  state_lock_entry_t        * found_entry;
+
+  /* Nearly always, all the locks are held through the same export */
+  if(pfile->lock_pexport == pexport &&
+     pfile->lock_pexport_cnt == pfile->lock_tree.count + pfile->blocked_tree.count)
+    return NULL;
+
+  glist_for_each(glist, &pfile->lock_list)
+    {
+      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+
+      if(found_entry->sle_pexport != pexport &&
+         !different_owners(found_entry->sle_owner, powner))
+        return found_entry;
+    }
+
+  return NULL;
+}
+
 static void remove_from_locklist(state_lock_entry_t   * lock_entry)
 {
   state_owner_t * powner = lock_entry->sle_owner;
@@ -604,6 +709,7 @@ static void remove_from_locklist(state_lock_entry_t   * lock_entry)
       dec_state_owner_ref_locked(powner);
     }
 
+  lock_entry_unindex(lock_entry);
   lock_entry->sle_owner = NULL;
   glist_del(&lock_entry->sle_list);
   lock_entry_dec_ref(lock_entry);
@@ -614,38 +720,30 @@ static state_lock_entry_t *get_overlapping_entry(cache_entry_t     * pentry,
                                                  state_owner_t     * powner,
                                                  fsal_lock_param_t * plock)
 {
-  struct glist_head *glist;
+  struct itree_node *node;
   state_lock_entry_t *found_entry = NULL;
-  uint64_t found_entry_end, plock_end = lock_end(plock);
+  uint64_t plock_end = lock_end(plock);
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
+  /* Blocked or cancelled locks are not in lock_tree */
+  for(node = itree_first(&pentry->object.file.lock_tree,
+                         plock->lock_start, plock_end);
+      node != NULL;
+      node = itree_next(node, plock->lock_start, plock_end))
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       LogEntry("Checking", found_entry);
 
-      /* Skip blocked or cancelled locks */
-      if(found_entry->sle_blocked == STATE_NLM_BLOCKING ||
-         found_entry->sle_blocked == STATE_NFSV4_BLOCKING ||
-         found_entry->sle_blocked == STATE_CANCELED)
-          continue;
-
-      found_entry_end = lock_end(&found_entry->sle_lock);
-
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
+      /* lock overlaps see if we can allow
+       * allow if neither lock is exclusive or the owner is the same
+       */
+      if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
+          plock->lock_type == FSAL_LOCK_W) &&
+         different_owners(found_entry->sle_owner, powner)
+         )
         {
-          /* lock overlaps see if we can allow
-           * allow if neither lock is exclusive or the owner is the same
-           */
-          if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
-              plock->lock_type == FSAL_LOCK_W) &&
-             different_owners(found_entry->sle_owner, powner)
-             )
-            {
-              /* found a conflicting lock, return it */
-              return found_entry;
-            }
+          /* found a conflicting lock, return it */
+          return found_entry;
         }
     }
 
@@ -664,18 +762,37 @@ static void merge_lock_entry(cache_entry_t        * pentry,
   state_lock_entry_t * check_entry_right;
   uint64_t             check_entry_end;
   uint64_t             lock_entry_end;
-  struct glist_head  * glist;
-  struct glist_head  * glistn;
+  uint64_t             touch_start, touch_end;
+  struct itree_node  * node;
+  struct itree_node  * noden;
+  bool_t               indexed = itree_linked(&lock_entry->sle_tree);
 
   /* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
-    {
-      check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+  /* lock_entry grows as it absorbs its neighbours, keep it out of the
+   * index until it is done.
+   */
+  if(indexed)
+    lock_entry_unindex(lock_entry);
 
-      /* Skip entry being merged - it could be in the list */
-      if(check_entry == lock_entry)
-        continue;
+ again:
+
+  /* Locks that touch lock_entry are merged too */
+  lock_entry_end = lock_end(&lock_entry->sle_lock);
+  touch_start    = lock_entry->sle_lock.lock_start;
+  touch_end      = lock_entry_end;
+
+  if(touch_start > 0)
+    touch_start--;
+
+  if(touch_end < UINT64_MAX)
+    touch_end++;
+
+  itree_for_each_overlap_safe(node, noden,
+                              &pentry->object.file.lock_tree,
+                              touch_start, touch_end)
+    {
+      check_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       if(different_owners(check_entry->sle_owner, lock_entry->sle_owner))
         continue;
@@ -685,15 +802,6 @@ static void merge_lock_entry(cache_entry_t        * pentry,
         continue;
 
       check_entry_end = lock_end(&check_entry->sle_lock);
-      lock_entry_end  = lock_end(&lock_entry->sle_lock);
-
-      if((check_entry_end + 1) < lock_entry->sle_lock.lock_start)
-        /* nothing to merge */
-        continue;
-
-      if((lock_entry_end + 1) < check_entry->sle_lock.lock_start)
-        /* nothing to merge */
-        continue;
 
       /* Need to handle locks of different types differently, may split an old lock.
        * If new lock totally overlaps old lock, the new lock will replace the old
@@ -716,7 +824,6 @@ static void merge_lock_entry(cache_entry_t        * pentry,
                            "Memory allocation failure during lock upgrade/downgrade");
                   continue;
                 }
-              glist_add_tail(&pentry->object.file.lock_list, &(check_entry_right->sle_list));
             }
           else
             {
@@ -730,7 +837,17 @@ static void merge_lock_entry(cache_entry_t        * pentry,
               check_entry_right->sle_lock.lock_start  = lock_entry_end + 1;
               check_entry_right->sle_lock.lock_length = check_entry_end - lock_entry_end;
               LogEntry("Merge shrunk right", check_entry_right);
-              continue;
+
+              if(check_entry_right == check_entry)
+                {
+                  lock_entry_reindex(check_entry);
+                  continue;
+                }
+
+              /* Split, the left lock still has to be shrunk */
+              lock_list_add(pentry,
+                            &pentry->object.file.lock_list,
+                            check_entry_right);
             }
           if(check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
             {
@@ -738,6 +855,7 @@ static void merge_lock_entry(cache_entry_t        * pentry,
               LogEntry("Merge shrinking left", check_entry);
               check_entry->sle_lock.lock_length = lock_entry->sle_lock.lock_start - check_entry->sle_lock.lock_start;
               LogEntry("Merge shrunk left", check_entry);
+              lock_entry_reindex(check_entry);
               continue;
             }
           /* Done splitting/shrinking old lock */
@@ -760,7 +878,15 @@ static void merge_lock_entry(cache_entry_t        * pentry,
       LogEntry("Merged", lock_entry);
       LogEntry("Merging removing", check_entry);
       remove_from_locklist(check_entry);
+
+      /* lock_entry may now touch locks the walk has passed or will not reach */
+      if(lock_entry->sle_lock.lock_start < touch_start ||
+         lock_entry_end > touch_end)
+        goto again;
     }
+
+  if(indexed)
+    lock_entry_index(lock_entry);
 }
 
 static void free_list(struct glist_head    * list)
@@ -845,12 +971,56 @@ static bool_t subtract_lock_from_entry(cache_entry_t        * pentry,
 complete_remove:
 
   /* Remove the lock from the list it's on and put it on the remove_list */
+  lock_entry_unindex(found_entry);
   glist_del(&found_entry->sle_list);
   glist_add_tail(remove_list, &(found_entry->sle_list));
 
   return TRUE;
 }
 
+/* Subtract a lock from an entry of a list, if it is a granted lock of powner. */
+static bool_t subtract_lock_from_owned_entry(cache_entry_t        * pentry,
+                                             fsal_op_context_t    * pcontext,
+                                             state_owner_t        * powner,
+                                             state_t              * pstate,
+                                             state_lock_entry_t   * found_entry,
+                                             fsal_lock_param_t    * plock,
+                                             struct glist_head    * split_list,
+                                             struct glist_head    * remove_list,
+                                             state_status_t       * pstatus)
+{
+  if(powner != NULL && different_owners(found_entry->sle_owner, powner))
+    return FALSE;
+
+  /* Only care about granted locks */
+  if(found_entry->sle_blocked != STATE_NON_BLOCKING)
+    return FALSE;
+
+#ifdef _USE_NLM
+  /* Skip locks owned by this NLM state.
+   * This protects NLM locks from the current iteration of an NLM
+   * client from being released by SM_NOTIFY.
+   */
+  if(pstate != NULL &&
+     lock_owner_is_nlm(found_entry) &&
+     found_entry->sle_state == pstate)
+    return FALSE;
+#endif
+
+  /*
+   * We have matched owner.
+   * Even though we are taking a reference to found_entry, we
+   * don't inc the ref count because we want to drop the lock entry.
+   */
+  return subtract_lock_from_entry(pentry,
+                                  pcontext,
+                                  found_entry,
+                                  plock,
+                                  split_list,
+                                  remove_list,
+                                  pstatus);
+}
+
 /* Subtract a lock from a list of locks, possibly splitting entries in the list. */
 static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
                                       fsal_op_context_t    * pcontext,
@@ -863,51 +1033,60 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
   state_lock_entry_t *found_entry;
   struct glist_head split_lock_list, remove_list;
   struct glist_head *glist, *glistn;
+  struct itree_node *node, *noden;
+  uint64_t plock_end = lock_end(plock);
   bool_t rc = FALSE;
 
   init_glist(&split_lock_list);
   init_glist(&remove_list);
 
   *pstatus = STATE_SUCCESS;
-  glist_for_each_safe(glist, glistn, list)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
-      if(powner != NULL && different_owners(found_entry->sle_owner, powner))
-        continue;
-
-      /* Only care about granted locks */
-      if(found_entry->sle_blocked != STATE_NON_BLOCKING)
-        continue;
-
 
-#ifdef _USE_NLM
-      /* Skip locks owned by this NLM state.
-       * This protects NLM locks from the current iteration of an NLM
-       * client from being released by SM_NOTIFY.
-       */
-      if(pstate != NULL &&
-         lock_owner_is_nlm(found_entry) &&
-         found_entry->sle_state == pstate)
-        continue;
-#endif
+  if(list == &pentry->object.file.lock_list)
+    {
+      /* Only the granted locks overlapping plock can be affected */
+      itree_for_each_overlap_safe(node, noden,
+                                  &pentry->object.file.lock_tree,
+                                  plock->lock_start, plock_end)
+        {
+          found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
-      /*
-       * We have matched owner.
-       * Even though we are taking a reference to found_entry, we
-       * don't inc the ref count because we want to drop the lock entry.
-       */
-      rc |= subtract_lock_from_entry(pentry,
-                                     pcontext,
-                                     found_entry,
-                                     plock,
-                                     &split_lock_list,
-                                     &remove_list,
-                                     pstatus);
-      if(*pstatus != STATE_SUCCESS)
+          rc |= subtract_lock_from_owned_entry(pentry,
+                                               pcontext,
+                                               powner,
+                                               pstate,
+                                               found_entry,
+                                               plock,
+                                               &split_lock_list,
+                                               &remove_list,
+                                               pstatus);
+          if(*pstatus != STATE_SUCCESS)
+            {
+              /* We ran out of memory while splitting, deal with it outside loop */
+              break;
+            }
+        }
+    }
+  else
+    {
+      glist_for_each_safe(glist, glistn, list)
         {
-          /* We ran out of memory while splitting, deal with it outside loop */
-          break;
+          found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+
+          rc |= subtract_lock_from_owned_entry(pentry,
+                                               pcontext,
+                                               powner,
+                                               pstate,
+                                               found_entry,
+                                               plock,
+                                               &split_lock_list,
+                                               &remove_list,
+                                               pstatus);
+          if(*pstatus != STATE_SUCCESS)
+            {
+              /* We ran out of memory while splitting, deal with it outside loop */
+              break;
+            }
         }
     }
 
@@ -923,7 +1102,7 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
         {
           found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
           glist_del(&found_entry->sle_list);
-          glist_add_tail(list, &(found_entry->sle_list));
+          lock_list_add(pentry, list, found_entry);
         }
     }
   else
@@ -932,7 +1111,12 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
       free_list(&remove_list);
 
       /* now add the split lock list */
-      glist_add_list_tail(list, &split_lock_list);
+      glist_for_each_safe(glist, glistn, &split_lock_list)
+        {
+          found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+          glist_del(&found_entry->sle_list);
+          lock_list_add(pentry, list, found_entry);
+        }
     }
 
   LogFullDebug(COMPONENT_STATE,
@@ -1340,6 +1524,23 @@ state_status_t state_find_grant(void                  * pcookie,
   return *pstatus;
 }
 
+/**
+ *
+ * state_grant_pending: check, without taking it, that a grant cookie is
+ * still waiting for the client to accept the lock.
+ */
+bool_t state_grant_pending(void * pcookie,
+                           int    cookie_size)
+{
+  hash_buffer_t buffkey;
+  hash_buffer_t buffval;
+
+  buffkey.pdata = (caddr_t) pcookie;
+  buffkey.len   = cookie_size;
+
+  return HashTable_Get(ht_lock_cookies, &buffkey, &buffval) == HASHTABLE_SUCCESS;
+}
+
 void grant_blocked_lock_immediate(cache_entry_t         * pentry,
                                   fsal_op_context_t     * pcontext,
                                   state_lock_entry_t    * lock_entry)
@@ -1380,6 +1581,7 @@ void grant_blocked_lock_immediate(cache_entry_t         * pentry,
 
   /* Mark lock as granted */
   lock_entry->sle_blocked = STATE_NON_BLOCKING;
+  lock_entry_reclassify(lock_entry);
 
   /* Merge any touching or overlapping locks into this one. */
   LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1412,6 +1614,7 @@ void state_complete_grant(fsal_op_context_t     * pcontext,
     {
       /* Mark lock as granted */
       lock_entry->sle_blocked = STATE_NON_BLOCKING;
+      lock_entry_reclassify(lock_entry);
 
       /* Merge any touching or overlapping locks into this one. */
       LogEntry("Granted, merging locks for", lock_entry);
@@ -1450,7 +1653,8 @@ void try_to_grant_lock(state_lock_entry_t   * lock_entry)
       /*
        * Mark the lock_entry as provisionally granted and make the granted
        * call back. The granted call back is responsible for acquiring a
-       * reference to the lock entry if needed.
+       * reference to the lock entry if needed. The lock_entry stays in
+       * blocked_tree until the call back has accepted it.
        */
       blocked = lock_entry->sle_blocked;
       lock_entry->sle_blocked = STATE_GRANTING;
@@ -1467,7 +1671,10 @@ void try_to_grant_lock(state_lock_entry_t   * lock_entry)
         }
 
       if(status == STATE_SUCCESS)
-        return;
+        {
+          lock_entry_reclassify(lock_entry);
+          return;
+        }
     }
 
   /* There was no call back data, the call back failed, or the block was cancelled.
@@ -1498,20 +1705,100 @@ void process_blocked_lock_upcall(state_block_data_t   * block_data)
   pthread_rwlock_unlock(&pentry->state_lock);
 }
 
+/**
+ *
+ * state_async_grant: try to grant a blocked lock on the async thread.
+ *
+ * The lock may have been granted, cancelled or unlocked since it was
+ * queued, and another lock may have been granted over its range.
+ */
+static void state_async_grant(state_async_queue_t * arg)
+{
+  state_lock_entry_t * lock_entry;
+  cache_entry_t      * pentry;
+
+  lock_entry = arg->state_async_data.state_async_block_data.state_async_lock_entry;
+  pentry     = lock_entry->sle_pentry;
+
+  pthread_rwlock_wrlock(&pentry->state_lock);
+
+  if(lock_entry->sle_owner != NULL &&
+     (lock_entry->sle_blocked == STATE_NLM_BLOCKING ||
+      lock_entry->sle_blocked == STATE_NFSV4_BLOCKING) &&
+     get_overlapping_entry(pentry,
+                           NULL,
+                           lock_entry->sle_owner,
+                           &lock_entry->sle_lock) == NULL)
+    {
+      try_to_grant_lock(lock_entry);
+
+      /* In case all locks have wound up free, we must release the pin reference. */
+      if(glist_empty(&pentry->object.file.lock_list))
+          cache_inode_dec_pin_ref(pentry);
+    }
+
+  pthread_rwlock_unlock(&pentry->state_lock);
+
+  lock_entry_dec_ref(lock_entry);
+  cache_inode_lru_unref(pentry, 0);
+  gsh_free(arg);
+}
+
+/*
+ * Granting a lock goes to the FSAL and then calls the client back, so
+ * it is left to the async thread rather than done by the thread that
+ * unlocked.  Returns FALSE if the lock could not be queued.
+ */
+static bool_t queue_blocked_lock_grant(state_lock_entry_t * lock_entry)
+{
+  state_async_queue_t * arg;
+  cache_entry_t       * pentry = lock_entry->sle_pentry;
+
+  arg = gsh_malloc(sizeof(*arg));
+  if(arg == NULL)
+    return FALSE;
+
+  memset(arg, 0, sizeof(*arg));
+
+  if(cache_inode_lru_ref(pentry, 0) != CACHE_INODE_SUCCESS)
+    {
+      gsh_free(arg);
+      return FALSE;
+    }
+
+  lock_entry_inc_ref(lock_entry);
+  arg->state_async_func = state_async_grant;
+  arg->state_async_data.state_async_block_data.state_async_lock_entry = lock_entry;
+
+  if(state_async_schedule(arg) != STATE_SUCCESS)
+    {
+      lock_entry_dec_ref(lock_entry);
+      cache_inode_lru_unref(pentry, 0);
+      gsh_free(arg);
+      return FALSE;
+    }
+
+  LogEntry("Queued grant of", lock_entry);
+
+  return TRUE;
+}
+
 static void grant_blocked_locks(cache_entry_t        * pentry,
                                 fsal_op_context_t    * pcontext)
 {
   state_lock_entry_t   * found_entry;
-  struct glist_head    * glist, * glistn;
+  struct itree_node    * node, * noden;
   fsal_staticfsinfo_t  * pstatic = pcontext->export_context->fe_static_fs_info;
 
   /* If FSAL supports async blocking locks, allow it to grant blocked locks. */
   if(pstatic->lock_support_async_block)
     return;
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
+  itree_for_each_overlap_safe(node, noden,
+                              &pentry->object.file.blocked_tree,
+                              0, UINT64_MAX)
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       if(found_entry->sle_blocked != STATE_NLM_BLOCKING &&
          found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
@@ -1524,8 +1811,9 @@ static void grant_blocked_locks(cache_entry_t        * pentry,
                                &found_entry->sle_lock) != NULL)
         continue;
 
-      /* Found an entry that might work, try to grant it. */
-      try_to_grant_lock(found_entry);
+      /* Found an entry that might work, have it granted, or try here. */
+      if(!queue_blocked_lock_grant(found_entry))
+        try_to_grant_lock(found_entry);
     }
 }
 
@@ -1539,6 +1827,7 @@ state_status_t cancel_blocked_lock(cache_entry_t        * pentry,
   /* Mark lock as canceled */
   LogEntry("Cancelling blocked", lock_entry);
   lock_entry->sle_blocked = STATE_CANCELED;
+  lock_entry_reclassify(lock_entry);
 
       /* Unlocking the entire region will remove any FSAL locks we held, whether
        * from fully granted locks, or from blocking locks that were in the process
@@ -1626,13 +1915,21 @@ void cancel_blocked_locks_range(cache_entry_t        * pentry,
                                 state_t              * pstate,
                                 fsal_lock_param_t    * plock)
 {
-  struct glist_head  * glist, * glistn;
+  struct itree_root  * trees[2];
+  struct itree_node  * node, * noden;
   state_lock_entry_t * found_entry = NULL;
-  uint64_t             found_entry_end, plock_end = lock_end(plock);
+  uint64_t             plock_end = lock_end(plock);
+  int                  i;
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
+  /* Locks being granted are in lock_tree */
+  trees[0] = &pentry->object.file.blocked_tree;
+  trees[1] = &pentry->object.file.lock_tree;
+
+  for(i = 0; i < 2; i++)
+    itree_for_each_overlap_safe(node, noden, trees[i],
+                                plock->lock_start, plock_end)
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       /* Skip locks not owned by owner */
       if(powner != NULL && different_owners(found_entry->sle_owner, powner))
@@ -1653,14 +1950,8 @@ void cancel_blocked_locks_range(cache_entry_t        * pentry,
 
       LogEntry("Checking", found_entry);
 
-      found_entry_end = lock_end(&found_entry->sle_lock);
-
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
-        {
-          /* lock overlaps, cancel it. */
-          (void) cancel_blocked_lock(pentry, pcontext, found_entry);
-        }
+      /* lock overlaps, cancel it. */
+      (void) cancel_blocked_lock(pentry, pcontext, found_entry);
     }
 }
 
@@ -1691,6 +1982,7 @@ state_status_t state_release_grant(fsal_op_context_t     * pcontext,
     {
       /* Mark lock as canceled */
       lock_entry->sle_blocked = STATE_CANCELED;
+      lock_entry_reclassify(lock_entry);
 
       /* Remove the lock from the lock list.
        * Will not free yet because of cookie reference to lock entry.
@@ -2071,10 +2363,12 @@ state_status_t state_lock(cache_entry_t         * pentry,
                           state_status_t        * pstatus)
 {
   bool_t                 allow = TRUE, overlap = FALSE;
-  struct glist_head    * glist;
+  struct itree_root    * trees[2];
+  struct itree_node    * node;
   state_lock_entry_t   * found_entry;
   uint64_t               found_entry_end;
   uint64_t               plock_end = lock_end(plock);
+  int                    i;
   cache_inode_status_t   cache_status;
   fsal_staticfsinfo_t  * pstatic = pcontext->export_context->fe_static_fs_info;
   fsal_lock_op_t         lock_op;
@@ -2100,6 +2394,30 @@ state_status_t state_lock(cache_entry_t         * pentry,
 
   pthread_rwlock_wrlock(&pentry->state_lock);
 
+  /* Need to reject lock request if this lock owner already has a lock
+   * on this file via a different export.
+   */
+  found_entry = get_export_conflict(pentry, powner, pexport);
+
+  if(found_entry != NULL)
+    {
+      pthread_rwlock_unlock(&pentry->state_lock);
+
+      cache_inode_dec_pin_ref(pentry);
+
+      LogEvent(COMPONENT_STATE,
+               "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+               found_entry->sle_pexport->id,
+               found_entry->sle_pexport->fullpath,
+               pexport->id,
+               pexport->fullpath);
+
+      LogEntry("Found lock entry belonging to another export", found_entry);
+
+      *pstatus = STATE_INVALID_ARGUMENT;
+      return *pstatus;
+    }
+
 #ifdef _USE_BLOCKING_LOCKS
 
   if(blocking != STATE_NON_BLOCKING)
@@ -2109,33 +2427,16 @@ state_status_t state_lock(cache_entry_t         * pentry,
        * request and keep sending us new lock request again and again. So if
        * we have a mapping blocked request return that
        */
-      glist_for_each(glist, &pentry->object.file.lock_list)
+      for(node = itree_first(&pentry->object.file.blocked_tree,
+                             plock->lock_start, plock_end);
+          node != NULL;
+          node = itree_next(node, plock->lock_start, plock_end))
         {
-          found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+          found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
           if(different_owners(found_entry->sle_owner, powner))
             continue;
 
-          /* Need to reject lock request if this lock owner already has a lock
-           * on this file via a different export.
-           */
-          if(found_entry->sle_pexport != pexport)
-            {
-              pthread_rwlock_unlock(&pentry->state_lock);
-
-              cache_inode_dec_pin_ref(pentry);
-
-              LogEvent(COMPONENT_STATE,
-                       "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-                       found_entry->sle_pexport->id,
-                       found_entry->sle_pexport->fullpath,
-                       pexport->id,
-                       pexport->fullpath);
-              LogEntry("Found lock entry belonging to another export", found_entry);
-              *pstatus = STATE_INVALID_ARGUMENT;
-              return *pstatus;
-            }
-
           if(found_entry->sle_blocked != blocking)
             continue;
 
@@ -2157,57 +2458,35 @@ state_status_t state_lock(cache_entry_t         * pentry,
     }
 #endif
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
-      /* Need to reject lock request if this lock owner already has a lock
-       * on this file via a different export.
-       */
-      if(found_entry->sle_pexport != pexport &&
-         !different_owners(found_entry->sle_owner, powner))
-        {
-          pthread_rwlock_unlock(&pentry->state_lock);
-
-          cache_inode_dec_pin_ref(pentry);
-
-          LogEvent(COMPONENT_STATE,
-                   "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-                   found_entry->sle_pexport->id,
-                   found_entry->sle_pexport->fullpath,
-                   pexport->id,
-                   pexport->fullpath);
+  /* Don't skip blocked locks for fairness */
+  trees[0] = &pentry->object.file.lock_tree;
+  trees[1] = &pentry->object.file.blocked_tree;
 
-          LogEntry("Found lock entry belonging to another export", found_entry);
-
-          *pstatus = STATE_INVALID_ARGUMENT;
-          return *pstatus;
-        }
-
-      /* Don't skip blocked locks for fairness */
+  for(i = 0; i < 2 && allow; i++)
+    for(node = itree_first(trees[i], plock->lock_start, plock_end);
+        node != NULL;
+        node = itree_next(node, plock->lock_start, plock_end))
+    {
+      found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       found_entry_end = lock_end(&found_entry->sle_lock);
 
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
+      /* lock overlaps see if we can allow
+       * allow if neither lock is exclusive or the owner is the same
+       */
+      if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
+          plock->lock_type == FSAL_LOCK_W) &&
+         different_owners(found_entry->sle_owner, powner))
         {
-          /* lock overlaps see if we can allow
-           * allow if neither lock is exclusive or the owner is the same
+          /* Found a conflicting lock, break out of loop.
+           * Also indicate overlap hint.
            */
-          if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
-              plock->lock_type == FSAL_LOCK_W) &&
-             different_owners(found_entry->sle_owner, powner))
-            {
-              /* Found a conflicting lock, break out of loop.
-               * Also indicate overlap hint.
-               */
-              LogEntry("Conflicts with", found_entry);
-              LogList("Locks", pentry, &pentry->object.file.lock_list);
-              copy_conflict(found_entry, holder, conflict);
-              allow   = FALSE;
-              overlap = TRUE;
-              break;
-            }
+          LogEntry("Conflicts with", found_entry);
+          LogList("Locks", pentry, &pentry->object.file.lock_list);
+          copy_conflict(found_entry, holder, conflict);
+          allow   = FALSE;
+          overlap = TRUE;
+          break;
         }
 
       if(found_entry_end >= plock_end &&
@@ -2385,7 +2664,7 @@ state_status_t state_lock(cache_entry_t         * pentry,
       if(glist_empty(&pentry->object.file.lock_list))
           cache_inode_inc_pin_ref(pentry);
 
-      glist_add_tail(&pentry->object.file.lock_list, &found_entry->sle_list);
+      lock_list_add(pentry, &pentry->object.file.lock_list, found_entry);
 
 #ifdef _USE_BLOCKING_LOCKS
       /* A lock downgrade could unblock blocked locks */
@@ -2417,7 +2696,7 @@ state_status_t state_lock(cache_entry_t         * pentry,
       if(glist_empty(&pentry->object.file.lock_list))
           cache_inode_inc_pin_ref(pentry);
 
-      glist_add_tail(&pentry->object.file.lock_list, &found_entry->sle_list);
+      lock_list_add(pentry, &pentry->object.file.lock_list, found_entry);
 
       pthread_rwlock_unlock(&pentry->state_lock);
 
@@ -2610,9 +2889,13 @@ state_status_t state_cancel(cache_entry_t        * pentry,
                             fsal_lock_param_t    * plock,
                             state_status_t       * pstatus)
 {
-  struct glist_head    * glist;
+  struct itree_root    * trees[2];
+  struct itree_node    * node;
   state_lock_entry_t   * found_entry;
+  uint64_t               plock_end = lock_end(plock);
   cache_inode_status_t   cache_status;
+  bool_t                 cancelled = FALSE;
+  int                    i;
 
   if(pentry->type != REGULAR_FILE)
     {
@@ -2650,9 +2933,16 @@ state_status_t state_cancel(cache_entry_t        * pentry,
       return *pstatus;
     }
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
+  /* Locks being granted are in lock_tree */
+  trees[0] = &pentry->object.file.blocked_tree;
+  trees[1] = &pentry->object.file.lock_tree;
+
+  for(i = 0; i < 2 && !cancelled; i++)
+    for(node = itree_first(trees[i], plock->lock_start, plock_end);
+        node != NULL;
+        node = itree_next(node, plock->lock_start, plock_end))
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = itree_entry(node, state_lock_entry_t, sle_tree);
 
       if(different_owners(found_entry->sle_owner, powner))
         continue;
@@ -2670,6 +2960,7 @@ state_status_t state_cancel(cache_entry_t        * pentry,
       /* Check to see if we can grant any blocked locks. */
       grant_blocked_locks(pentry, pcontext);
 
+      cancelled = TRUE;
       break;
     }
 
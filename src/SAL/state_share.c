@@ -58,6 +58,7 @@
 #include "nlm_util.h"
 #endif
 #include "cache_inode_lru.h"
+#include "abstract_atomic.h"
 
 /* Update the ref counter of share state of given file. */
 static void state_share_update_counter(cache_entry_t * pentry,
@@ -544,6 +545,12 @@ static void state_share_update_counter(cache_entry_t * pentry,
   if(v4)
     pentry->object.file.share_state.share_deny_write_v4 += deny_write_inc;
 
+  /* Publish the new union for the lockless checks */
+  atomic_store_uint32_t(&pentry->object.file.share_state.share_summary,
+                        state_share_get_share_access(pentry) |
+                        (state_share_get_share_deny(pentry) <<
+                         SHARE_SUMMARY_DENY_SHIFT));
+
   LogFullDebug(COMPONENT_STATE, "pentry %p: share counter: "
                "access_read %u, access_write %u, "
                "deny_read %u, deny_write %u, deny_write_v4 %u",
@@ -589,6 +596,47 @@ static unsigned int state_share_get_share_deny(cache_entry_t * pentry)
   return share_deny;
 }
 
+/* Get the union of share access and deny of given file.  This may be called
+ * without the state lock, to tell beforehand if an open would conflict. */
+void state_share_get_summary(cache_entry_t * pentry,
+                             unsigned int  * pshare_access,
+                             unsigned int  * pshare_deny)
+{
+  uint32_t summary;
+
+  summary = atomic_fetch_uint32_t(&pentry->object.file.share_state.share_summary);
+
+  *pshare_access = summary & ((1 << SHARE_SUMMARY_DENY_SHIFT) - 1);
+  *pshare_deny = summary >> SHARE_SUMMARY_DENY_SHIFT;
+}
+
+/* Check a candidate share or delegation against the union of the shares of
+ * given file, as state_conflict would against each of them.  Without the
+ * state lock the answer may be stale, and only a conflict can be relied on
+ * as a reason to fail early. */
+int state_share_summary_conflict(cache_entry_t * pentry,
+                                 state_type_t    state_type,
+                                 state_data_t  * pstate_data)
+{
+  unsigned int share_access, share_deny;
+
+  state_share_get_summary(pentry, &share_access, &share_deny);
+
+  switch (state_type)
+    {
+    case STATE_TYPE_SHARE:
+      return (share_access & pstate_data->share.share_deny) ||
+             (share_deny & pstate_data->share.share_access);
+
+    case STATE_TYPE_DELEG:
+      return (share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+             (share_deny & OPEN4_SHARE_DENY_READ);
+
+    default:
+      return FALSE;
+    }
+}
+
 state_status_t state_share_anonymous_io_start(cache_entry_t  * pentry,
                                               int              share_access,
                                               state_status_t * pstatus)
@@ -1418,4 +1418,64 @@ atomic_store_uint8_t(uint8_t *var, uint8_t val)
      __sync_lock_test_and_set(var, 0);
 }
 #endif
+
+/*
+ * Compare and swap
+ */
+
+/**
+ * @brief Atomically compare and swap a uint64_t
+ *
+ * This function stores newval in the variable indicated by the
+ * supplied pointer if, and only if, it still holds oldval.
+ *
+ * @param[in,out] var    Pointer to the variable to modify
+ * @param[in]     oldval The value the variable is expected to hold
+ * @param[in]     newval The value to store
+ *
+ * @return non-zero if the value was swapped.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline int
+atomic_cas_uint64_t(uint64_t *var, uint64_t oldval, uint64_t newval)
+{
+     return __atomic_compare_exchange_n(var, &oldval, newval, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline int
+atomic_cas_uint64_t(uint64_t *var, uint64_t oldval, uint64_t newval)
+{
+     return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a uint32_t
+ *
+ * This function stores newval in the variable indicated by the
+ * supplied pointer if, and only if, it still holds oldval.
+ *
+ * @param[in,out] var    Pointer to the variable to modify
+ * @param[in]     oldval The value the variable is expected to hold
+ * @param[in]     newval The value to store
+ *
+ * @return non-zero if the value was swapped.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline int
+atomic_cas_uint32_t(uint32_t *var, uint32_t oldval, uint32_t newval)
+{
+     return __atomic_compare_exchange_n(var, &oldval, newval, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline int
+atomic_cas_uint32_t(uint32_t *var, uint32_t oldval, uint32_t newval)
+{
+     return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+#endif
 #endif /* !_ABSTRACT_ATOMIC_H */
@@ -47,6 +47,7 @@
 #include "HashData.h"
 #include "HashTable.h"
 #include "avltree.h"
+#include "interval_tree.h"
 #include "generic_weakref.h"
 #include "fsal.h"
 #include "log.h"
@@ -86,8 +87,12 @@ typedef enum cache_inode_expire_type__
                               less recently than grace period
                               for their type allows. */
   CACHE_INODE_EXPIRE_NEVER = 1, /*< Data never expire based on time. */
-  CACHE_INODE_EXPIRE_IMMEDIATE = 2 /*< Data are always treated as
-                                       expired. */
+  CACHE_INODE_EXPIRE_IMMEDIATE = 2, /*< Data are always treated as
+                                        expired. */
+  CACHE_INODE_EXPIRE_ADAPTIVE = 3 /*< Data expire after a per-entry
+                                      lifetime that grows while the
+                                      object is stable and is reset
+                                      when it changes. */
 } cache_inode_expire_type_t;
 
 /**
@@ -143,10 +148,26 @@ typedef struct cache_inode_parameter__
   time_t grace_period_attr; /*< Cached attributes grace period */
   time_t grace_period_link; /*< Cached link grace period */
   time_t grace_period_dirent; /*< Cached dirent grace period */
+  time_t attr_ttl_min; /*< Initial adaptive attribute lifetime */
+  time_t attr_ttl_max; /*< Ceiling on adaptive attribute lifetime */
   bool_t getattr_dir_invalidation; /*< Use getattr as for directory
                                        invalidation */
   bool_t use_test_access; /*< Is FSAL_test_access to be used? */
   bool_t use_fsal_hash; /*< Do we rely on FSAL to hash handle or not? */
+  bool_t use_dirent_array; /*< Keep cached dirents in compact arrays
+                                rather than AVL trees */
+  bool_t use_path_cache; /*< Cache multi-component LOOKUP resolutions */
+  uint32_t path_cache_size; /*< Number of slots in the path cache */
+  bool_t use_readdir_prefetch; /*< Populate looked up directories in the
+                                   background */
+  fsal_size_t readdir_prefetch_max_size; /*< Largest directory (by size
+                                             attribute) to prefetch */
+  uint32_t readdir_prefetch_queue; /*< Maximum pending prefetches */
+  char snapshot_file[MAXPATHLEN]; /*< Where to save the hot set of
+                                      entries; empty to disable */
+  time_t snapshot_interval; /*< Seconds between periodic snapshots, 0 to
+                                save only at shutdown */
+  uint32_t snapshot_max_entries; /*< Most entries saved in a snapshot */
 } cache_inode_parameter_t;
 
 extern cache_inode_parameter_t cache_inode_params;
@@ -219,6 +240,9 @@ static const uint32_t CACHE_INODE_TRUST_CONTENT
 static const uint32_t CACHE_INODE_DIR_POPULATED
   = 0x00000004; /*< The directory has been populated (negative lookups
                   are meaningful) */
+static const uint32_t CACHE_INODE_DIR_PREFETCHED
+  = 0x00000008; /*< The directory was populated by the prefetch thread
+                  and no READDIR has used it yet */
 
 /**
  * Structure storing cached symlink content.
@@ -254,6 +278,10 @@ typedef struct cache_inode_unstable_data__
  * enforced against v3 writes (v3 deny writes can not be enforced against
  * v3 writes because there is no connection between the share reservation
  * and the write operation). v3 reads will always be allowed.
+ *
+ * The counters are updated under the state_lock; share_summary holds
+ * the union of the access (low bits) and deny (high bits) they add up
+ * to, and may be read atomically without the lock.
  */
 typedef struct cache_inode_share__
 {
@@ -262,8 +290,11 @@ typedef struct cache_inode_share__
   unsigned int share_deny_read;
   unsigned int share_deny_write;
   unsigned int share_deny_write_v4; /**< Count of v4 share deny write */
+  uint32_t share_summary; /**< Union of share access and deny */
 } cache_inode_share_t;
 
+#define SHARE_SUMMARY_DENY_SHIFT 2
+
 /**
  * \brief Represents a cached directory entry
  *
@@ -287,6 +318,26 @@ typedef struct cache_inode_dir_entry__
   uint32_t flags; /*< Flags */
 } cache_inode_dir_entry_t;
 
+/**
+ * \brief A directory entry slot in the compact dirent array
+ *
+ * When Use_Dirent_Array is set, cached directory entries are stored
+ * as fixed size slots in a per-directory array, in readdir order, with
+ * their names kept in a per-directory string arena.  Deleted entries
+ * stay in place (flagged DIR_ENTRY_FLAG_DELETED) so that their
+ * cookies remain valid until the array is compacted.
+ */
+
+typedef struct cache_inode_dirent_slot__
+{
+  uint64_t k; /*< Integer cookie */
+  gweakref_t entry; /*< Weak reference pointing to the cache entry */
+  uint32_t name_off; /*< Offset of the NUL terminated name in the arena */
+  uint16_t name_len; /*< Length of the name */
+  uint8_t p; /*< Number of probes (saturating) */
+  uint8_t flags; /*< Flags */
+} cache_inode_dirent_slot_t;
+
 /**
  * @brief Represents a cached inode
  *
@@ -350,6 +401,10 @@ struct cache_entry_t
                           for anything else (servicing getattr,
                           etc.) */
   time_t attr_time; /*< Time at which we last refreshed attributes. */
+  time_t attr_ttl; /*< Adaptive lifetime of the cached attributes,
+                       protected by attr_lock. */
+  fsal_u64_t attr_change; /*< Change attribute seen at the last
+                              refresh, protected by attr_lock. */
   cache_inode_lru_t lru; /*< New style LRU link */
   pthread_rwlock_t attr_lock; /*< Reader-writer lock for attributes */
   fsal_attrib_list_t attributes; /*< The FSAL Attributes */
@@ -374,6 +429,15 @@ struct cache_entry_t
       cache_inode_opened_file_t open_fd;/*< Cached fsal_file_t for
                                             optimized access */
       struct glist_head lock_list; /*< Pointers for lock list */
+      struct itree_root lock_tree; /*< Granted locks on lock_list,
+                                       by range */
+      struct itree_root blocked_tree; /*< Blocked locks on lock_list,
+                                          by range */
+      struct exportlist__ *lock_pexport; /*< Export of the first lock
+                                             indexed */
+      uint32_t lock_pexport_cnt; /*< Locks indexed with lock_pexport */
+      uint32_t deleg_cnt; /*< Delegations on state_list */
+      time_t deleg_recall_time; /*< Last time they were recalled */
 #ifdef _USE_NLM
       struct glist_head nlm_share_list; /**< Pointers for NLM share list */
 #endif
@@ -389,6 +453,11 @@ struct cache_entry_t
     {
       bool_t root; /*< Marks this as the root directory of an export */
       uint32_t nbactive; /*< Number of known active children */
+      uint32_t dirent_gen; /*< Bumped whenever a cached name is removed
+                               or renamed, or the dirents are released,
+                               so that the path cache can detect that
+                               a resolution it recorded may no longer
+                               hold. */
       char *referral; /*< NULL is not a referral.  If not, this a
                           'referral string' */
       gweakref_t parent; /*< The parent of this directory
@@ -397,7 +466,26 @@ struct cache_entry_t
           struct avltree t;                     /**< Children */
           struct avltree c;                     /**< Persist cookies */
           uint32_t collisions;                  /**< Heuristic. Expect 0. */
-      } avl;
+      } avl; /*< Dirents when Use_Dirent_Array is not set */
+      struct {
+          cache_inode_dirent_slot_t *slots; /**< Dirents, in readdir
+                                                 order */
+          uint32_t *index;                  /**< Open addressed
+                                                 table of slot
+                                                 numbers plus one,
+                                                 keyed by cookie */
+          char *names;                      /**< String arena */
+          uint32_t nslots;                  /**< Slots in use */
+          uint32_t maxslots;                /**< Slots allocated */
+          uint32_t ndeleted;                /**< Deleted slots */
+          uint32_t index_mask;              /**< Index size - 1 */
+          uint32_t names_len;               /**< Arena bytes used */
+          uint32_t names_size;              /**< Arena bytes
+                                                 allocated */
+          uint32_t names_garbage;           /**< Arena bytes no
+                                                 longer referenced */
+          uint32_t collisions;              /**< Heuristic. Expect 0. */
+      } array; /*< Dirents when Use_Dirent_Array is set */
     } dir; /*< DIRECTORY data */
   } object; /*< Filetype specific data, discriminated by the type
                 field.  Note that data for special files is in
@@ -519,6 +607,13 @@ static const uint32_t CACHE_INODE_FLAG_CONTENT_HAVE = 0x20; /*< For a
                                                          that the
                                                          content lock
                                                          is held */
+static const uint32_t CACHE_INODE_FLAG_STALE = 0x40; /*< The attributes
+                                                  handed to
+                                                  cache_inode_new_entry
+                                                  did not just come
+                                                  from the FSAL and
+                                                  must be refreshed
+                                                  before use */
 static const uint32_t CACHE_INODE_FLAG_REALLYCLOSE = 0x80; /*< Close a file
                                                         even with
                                                         caching
@@ -753,6 +848,7 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t *fsdata,
                                      fsal_attrib_list_t *attr,
                                      cache_inode_file_type_t type,
                                      cache_inode_create_arg_t *create_arg,
+                                     uint32_t flags,
                                      cache_inode_status_t *status);
 
 cache_inode_status_t cache_inode_add_data_cache(cache_entry_t *entry,
@@ -906,12 +1002,30 @@ int display_not_implemented(hash_buffer_t *pbuff,
                             char *str);
 int display_value(hash_buffer_t *pbuff, char *str);
 
+/**
+ * @brief Double the adaptive attribute lifetime of an entry
+ *
+ * The lifetime is capped at Attr_Expiration_Max.  The caller must
+ * hold the attribute lock for write.
+ *
+ * @param[in,out] entry The entry on which we operate.
+ */
+
+static inline void
+cache_inode_grow_attr_ttl(cache_entry_t *entry)
+{
+     entry->attr_ttl *= 2;
+     if (entry->attr_ttl > cache_inode_params.attr_ttl_max) {
+          entry->attr_ttl = cache_inode_params.attr_ttl_max;
+     }
+}
+
 /**
  * @brief Update cache_entry metadata from its attributes
  *
  * This function, to be used after a FSAL_getattr, yodates the
- * attribute trust flag and time, and stores the type and change time
- * in the main cache_entry_t.
+ * attribute trust flag and time, the adaptive attribute lifetime,
+ * and stores the type and change time in the main cache_entry_t.
  *
  * @param[in,out] entry The entry on which we operate.
  */
@@ -921,6 +1035,15 @@ cache_inode_fixup_md(cache_entry_t *entry)
 {
      /* Set the refresh time for the cache entry */
      entry->attr_time = time(NULL);
+     /* Grow the adaptive lifetime while the object is stable, start
+        over as soon as it changes. */
+     if ((entry->attr_ttl != 0) &&
+         (entry->attributes.change == entry->attr_change)) {
+          cache_inode_grow_attr_ttl(entry);
+     } else {
+          entry->attr_ttl = cache_inode_params.attr_ttl_min;
+     }
+     entry->attr_change = entry->attributes.change;
      /* TODO: This should really be changed to use sub-second time
         resolution when it's available. */
      entry->change_time = entry->attributes.chgtime.seconds;
@@ -38,6 +38,12 @@
  * reproduce.  Heuristic methods are used to detect worst-case scenarios and
  * fall back to tractable (e.g., lookup) algorthims.
  *
+ * When Use_Dirent_Array is set, the same interface is backed by the
+ * compact array representation in cache_inode_dirarray.c.  Callers
+ * must then treat the cache_inode_dir_entry_t pointers returned as
+ * views, valid only until the next call on the directory, and must
+ * update entries only through these functions.
+ *
  */
 
 #ifndef _CACHE_INODE_AVL_H
@@ -86,11 +92,22 @@ int cache_inode_avl_qp_insert(cache_entry_t *entry,
 cache_inode_dir_entry_t *cache_inode_avl_lookup_k(
     cache_entry_t *entry,
     uint64_t k,
-    uint32_t flags);
+    uint32_t flags,
+    cache_inode_dir_entry_t *scratch);
 cache_inode_dir_entry_t *cache_inode_avl_qp_lookup_s(
     cache_entry_t *entry,
     cache_inode_dir_entry_t *v,
     int maxj);
+cache_inode_dir_entry_t *cache_inode_avl_first(
+    cache_entry_t *entry,
+    cache_inode_dir_entry_t *scratch);
+cache_inode_dir_entry_t *cache_inode_avl_next(
+    cache_entry_t *entry,
+    cache_inode_dir_entry_t *v,
+    cache_inode_dir_entry_t *scratch);
+void cache_inode_avl_set_entry(cache_entry_t *entry,
+                               cache_inode_dir_entry_t *v,
+                               gweakref_t ref);
 
 static inline void
 cache_inode_avl_remove(cache_entry_t *entry,
@@ -0,0 +1,87 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_dirarray.h
+ * \brief Compact array dirent representation
+ *
+ * \section DESCRIPTION
+ *
+ * An alternative to the AVL dirent representation, selected with
+ * Use_Dirent_Array.  Cookies are computed exactly as for the AVL
+ * trees (Murmur3 of the name with quadratic probing), but entries
+ * are kept in a flat array of cache_inode_dirent_slot_t, in the
+ * order they were added, with an open addressed index from cookie to
+ * slot and the names packed in a per-directory string arena.
+ *
+ * Functions here are not meant to be called directly; the
+ * cache_inode_avl_* functions dispatch to them.  Since slots are not
+ * individually allocated, the cache_inode_dir_entry_t pointers they
+ * hand back are the caller supplied key or scratch buffer, filled in
+ * from the slot.  Slots are always located again by cookie, so such
+ * a buffer stays usable across insertions and compactions.
+ *
+ */
+
+#ifndef _CACHE_INODE_DIRARRAY_H
+#define _CACHE_INODE_DIRARRAY_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "cache_inode.h"
+
+void cache_inode_dirarray_init(cache_entry_t *entry);
+void cache_inode_dirarray_release(cache_entry_t *entry,
+                                  cache_inode_avl_which_t which);
+int cache_inode_dirarray_insert_impl(cache_entry_t *entry,
+                                     cache_inode_dir_entry_t *v,
+                                     int j, int j2);
+cache_inode_dir_entry_t *cache_inode_dirarray_lookup(
+    cache_entry_t *entry,
+    cache_inode_dir_entry_t *v);
+cache_inode_dir_entry_t *cache_inode_dirarray_lookup_k(
+    cache_entry_t *entry,
+    uint64_t k,
+    uint32_t flags,
+    cache_inode_dir_entry_t *scratch);
+cache_inode_dir_entry_t *cache_inode_dirarray_first(
+    cache_entry_t *entry,
+    cache_inode_dir_entry_t *scratch);
+cache_inode_dir_entry_t *cache_inode_dirarray_next(
+    cache_entry_t *entry,
+    cache_inode_dir_entry_t *v,
+    cache_inode_dir_entry_t *scratch);
+void cache_inode_dirarray_set_deleted(cache_entry_t *entry,
+                                      cache_inode_dir_entry_t *v);
+void cache_inode_dirarray_clear_deleted(cache_entry_t *entry,
+                                        cache_inode_dir_entry_t *v);
+void cache_inode_dirarray_set_entry(cache_entry_t *entry,
+                                    cache_inode_dir_entry_t *v,
+                                    gweakref_t ref);
+
+#endif /* _CACHE_INODE_DIRARRAY_H */
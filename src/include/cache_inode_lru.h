@@ -170,6 +170,7 @@ extern void cache_inode_lru_kill(cache_entry_t *entry);
 extern void cache_inode_lru_unref(cache_entry_t *entry,
                                   uint32_t flags);
 extern void lru_wake_thread(uint32_t flags);
+extern size_t cache_inode_lru_collect(gweakref_t *refs, size_t max);
 extern cache_inode_status_t cache_inode_inc_pin_ref(cache_entry_t *entry);
 extern void cache_inode_unpinnable(cache_entry_t *entry);
 extern cache_inode_status_t cache_inode_dec_pin_ref(cache_entry_t *entry);
@@ -0,0 +1,153 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_path.h
+ * \brief Path-prefix lookup cache
+ *
+ * \section DESCRIPTION
+ *
+ * A bounded, direct-mapped cache from (export, starting directory,
+ * multi-component relative path) to a weak reference on the entry the
+ * path resolves to.  Each record also remembers, for every directory
+ * traversed, a weak reference, the change attribute and the dirent
+ * generation observed when the path was resolved, so that a hit can
+ * be validated without taking any content lock or searching any
+ * dirent tree.
+ *
+ * A walk (cache_inode_path_walk_t) accumulates a record while an
+ * NFSv4 COMPOUND resolves a run of LOOKUP operations one component
+ * at a time; when the run completes, the record is published.
+ *
+ */
+
+#ifndef _CACHE_INODE_PATH_H
+#define _CACHE_INODE_PATH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "cache_inode.h"
+#include "generic_weakref.h"
+
+/* Maximum number of components in a cached path */
+#define CACHE_INODE_PATH_MAX_DEPTH 16
+
+/* Maximum size of the packed (NUL separated) component string */
+#define CACHE_INODE_PATH_MAX_LEN 1024
+
+/**
+ * Validation data for one directory traversed by a cached path.
+ */
+
+typedef struct cache_inode_path_anc__
+{
+  gweakref_t dir; /*< The directory searched */
+  fsal_u64_t change; /*< Its change attribute at resolution time */
+  uint32_t dirent_gen; /*< Its dirent generation at resolution time */
+} cache_inode_path_anc_t;
+
+/**
+ * A path resolution in progress, kept in the NFSv4 compound data.
+ */
+
+typedef struct cache_inode_path_walk__
+{
+  uint32_t remaining; /*< Components left to resolve; 0 if no walk */
+  uint32_t depth; /*< Components resolved so far */
+  gweakref_t base; /*< Directory the walk started from */
+  gweakref_t last; /*< Entry the walk currently points to */
+  uint32_t len; /*< Length of the packed component string */
+  char path[CACHE_INODE_PATH_MAX_LEN]; /*< Packed component string */
+  cache_inode_path_anc_t anc[CACHE_INODE_PATH_MAX_DEPTH]; /*< Validators */
+} cache_inode_path_walk_t;
+
+/**
+ * Statistics for the path cache
+ */
+
+typedef struct cache_inode_path_stats__
+{
+  uint64_t hits; /*< Probes served from the cache */
+  uint64_t misses; /*< Probes with no matching record */
+  uint64_t stale; /*< Probes matching a record that failed validation */
+  uint64_t inserts; /*< Records published */
+} cache_inode_path_stats_t;
+
+void cache_inode_path_init(void);
+void cache_inode_path_shutdown(void);
+
+cache_entry_t *cache_inode_path_lookup(cache_entry_t *base,
+                                       fsal_name_t *names,
+                                       uint32_t count,
+                                       fsal_attrib_list_t *attr,
+                                       fsal_op_context_t *context);
+
+bool_t cache_inode_path_walk_start(cache_inode_path_walk_t *walk,
+                                   cache_entry_t *base,
+                                   fsal_name_t *names,
+                                   uint32_t count);
+void cache_inode_path_walk_enter(cache_inode_path_walk_t *walk,
+                                 cache_entry_t *dir);
+void cache_inode_path_walk_leave(cache_inode_path_walk_t *walk,
+                                 cache_entry_t *entry,
+                                 fsal_op_context_t *context);
+
+void cache_inode_path_get_stats(cache_inode_path_stats_t *stats);
+
+/**
+ * @brief Abandon a walk in progress
+ *
+ * @param[in,out] walk The walk to reset
+ */
+
+static inline void
+cache_inode_path_walk_abort(cache_inode_path_walk_t *walk)
+{
+     walk->remaining = 0;
+     walk->depth = 0;
+}
+
+/**
+ * @brief Check whether a walk continues from the given directory
+ *
+ * @param[in] walk The walk
+ * @param[in] dir  The directory about to be searched
+ *
+ * @return TRUE if dir is where the walk currently points.
+ */
+
+static inline bool_t
+cache_inode_path_walk_active(cache_inode_path_walk_t *walk,
+                             cache_entry_t *dir)
+{
+     return (walk->remaining > 0) &&
+          (walk->last.ptr == dir->weakref.ptr) &&
+          (walk->last.gen == dir->weakref.gen);
+}
+
+#endif /* _CACHE_INODE_PATH_H */
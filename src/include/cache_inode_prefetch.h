@@ -0,0 +1,82 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_prefetch.h
+ * \brief Background directory prefetch ("readdir warming")
+ *
+ * \section DESCRIPTION
+ *
+ * When Use_Readdir_Prefetch is set, a directory newly brought into
+ * the cache by a lookup, and whose size attribute is no larger than
+ * Readdir_Prefetch_Max_Size, is queued for a background
+ * cache_inode_readdir_populate, so that a READDIR following the
+ * LOOKUP finds the dirent cache already warm.
+ *
+ * The queue holds weak references, so a queued directory that is
+ * recycled before the thread gets to it is silently skipped.  A
+ * prefetched directory carries CACHE_INODE_DIR_PREFETCHED until the
+ * first READDIR consumes it (a useful prefetch) or its dirents are
+ * released (a wasted one).
+ *
+ */
+
+#ifndef _CACHE_INODE_PREFETCH_H
+#define _CACHE_INODE_PREFETCH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "cache_inode.h"
+
+/**
+ * Statistics for directory prefetch
+ */
+
+typedef struct cache_inode_prefetch_stats__
+{
+  uint64_t queued; /*< Directories queued for prefetch */
+  uint64_t dropped; /*< Directories not queued because the queue was full */
+  uint64_t skipped; /*< Queued directories gone or already populated */
+  uint64_t failed; /*< Populates that returned an error */
+  uint64_t populated; /*< Directories populated by the prefetch thread */
+  uint64_t useful; /*< Prefetched directories later read by READDIR */
+  uint64_t wasted; /*< Prefetched directories released before any READDIR */
+} cache_inode_prefetch_stats_t;
+
+void cache_inode_prefetch_pkginit(void);
+void cache_inode_prefetch_pkgshutdown(void);
+
+void cache_inode_prefetch_dir(cache_entry_t *entry,
+                              fsal_attrib_list_t *attr,
+                              fsal_op_context_t *context);
+void cache_inode_prefetch_consumed(cache_entry_t *entry);
+void cache_inode_prefetch_discarded(cache_entry_t *entry);
+
+void cache_inode_prefetch_get_stats(cache_inode_prefetch_stats_t *stats);
+
+#endif /* _CACHE_INODE_PREFETCH_H */
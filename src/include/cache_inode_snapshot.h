@@ -0,0 +1,65 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file cache_inode_snapshot.h
+ * \brief Persistent snapshot of the hot set of cache entries
+ *
+ * \section DESCRIPTION
+ *
+ * When Snapshot_File is set, the entries nearest the MRU end of the
+ * LRU queues are written to that file every Snapshot_Interval
+ * seconds and at shutdown: their handle keys, attributes, symbolic
+ * link content and cached directory entries.  At startup the file is
+ * read back into the cache in the background.
+ *
+ * Reloaded entries never have their attributes trusted: the first
+ * use of each one refreshes them from the FSAL, and a directory whose
+ * mtime has moved since the snapshot drops its reloaded dirents at
+ * that point, exactly as for any other directory.  What the snapshot
+ * saves is the LOOKUPs and READDIRs needed to find the entries again.
+ *
+ * The file is only meaningful to the build that wrote it; a file
+ * written with a different attribute or handle layout is ignored.
+ *
+ */
+
+#ifndef _CACHE_INODE_SNAPSHOT_H
+#define _CACHE_INODE_SNAPSHOT_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "cache_inode.h"
+
+void cache_inode_snapshot_pkginit(void);
+void cache_inode_snapshot_pkgshutdown(void);
+
+int cache_inode_snapshot_save(const char *path, uint32_t max);
+int cache_inode_snapshot_load(const char *path);
+
+#endif /* _CACHE_INODE_SNAPSHOT_H */
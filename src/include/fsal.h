@@ -586,6 +586,11 @@ fsal_status_t FSAL_getattrs_descriptor(fsal_file_t * p_file_descriptor,
                                        fsal_attrib_list_t * p_object_attributes /* IN/OUT */
     );
 
+fsal_status_t FSAL_getchange(fsal_handle_t * p_filehandle,   /* IN */
+                             fsal_op_context_t * p_context,  /* IN */
+                             fsal_u64_t * p_change           /* OUT */
+    );
+
 fsal_status_t FSAL_setattrs(fsal_handle_t * filehandle, /* IN */
                             fsal_op_context_t * p_context,      /* IN */
                             fsal_attrib_list_t * attrib_set,    /* IN */
@@ -1470,6 +1475,11 @@ typedef struct fsal_functions__
                                   fsal_op_context_t      * p_context,           /* IN */
                                   void                   * p_owner,             /* IN (opaque to FSAL) */
                                   fsal_share_param_t       request_share        /* IN */ );
+
+  /* FSAL_getchange (optional cheap probe of the change attribute) */
+  fsal_status_t(*fsal_getchange) (fsal_handle_t * p_filehandle,   /* IN */
+                                  fsal_op_context_t * p_context,  /* IN */
+                                  fsal_u64_t * p_change           /* OUT */ );
 } fsal_functions_t;
 
 /* Structure allow assignement, char[<n>] do not */
@@ -49,10 +49,10 @@ struct svc_rpc_gss_data
   gss_buffer_desc cname;        /* GSS client name */
   u_int seq;                    /* sequence number */
   u_int win;                    /* sequence window */
-  u_int seqlast;                /* last sequence number */
-  uint32_t seqmask;             /* bitmask of seqnums */
   gss_name_t client_name;       /* unparsed name string */
   gss_buffer_desc checksum;     /* so we can free it */
+  struct gss_ctx_entry *entry;  /* cached context ctx, cname and
+                                   client_name belong to, if any */
 };
 
 typedef struct nfs_krb5_param__
@@ -67,27 +67,30 @@ typedef struct nfs_krb5_param__
       gss_name_t gss_name;
   } svc;
   bool_t active_krb5;
-  hash_parameter_t hash_param;
+  unsigned int ctx_cache_size;
 } nfs_krb5_parameter_t;
 
+typedef struct gss_ctx_cache_stats__
+{
+  uint64_t entries;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t reclaimed;
+} gss_ctx_cache_stats_t;
+
 #define SVCAUTH_PRIVATE(auth) \
   ((struct svc_rpc_gss_data *)(auth)->svc_ah_private)
 
 bool_t Svcauth_gss_import_name(char *service);
 bool_t Svcauth_gss_acquire_cred(void);
 bool_t Svcauth_gss_set_svc_name(gss_name_t name);
-int Gss_ctx_Hash_Init(nfs_krb5_parameter_t param);
+int Gss_ctx_cache_init(nfs_krb5_parameter_t *pparam);
+void Gss_ctx_cache_get_stats(gss_ctx_cache_stats_t *pstats);
 enum auth_stat Rpcsecgss__authenticate(register struct svc_req *rqst,
                                        struct rpc_msg *msg,
                                        bool_t * no_dispatch);
 
 void log_sperror_gss(char *outmsg, OM_uint32 maj_stat, OM_uint32 min_stat);
-uint32_t gss_ctx_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef);
-uint64_t gss_ctx_rbt_hash_func(hash_parameter_t * p_hparam,
-                               hash_buffer_t * buffclef);
-int compare_gss_ctx(hash_buffer_t * buff1, hash_buffer_t * buff2);
-int display_gss_ctx(hash_buffer_t * pbuff, char *str);
-int display_gss_svc_data(hash_buffer_t * pbuff, char *str);
 const char *str_gc_proc(rpc_gss_proc_t gc_proc);
 
 #endif                          /* _HAVE_GSSAPI */
@@ -99,12 +102,18 @@ const char *str_gc_proc(rpc_gss_proc_t gc_proc);
 #define XPRT_PRIVATE_FLAG_DESTROYED  0x0001 /* forward destroy */
 #define XPRT_PRIVATE_FLAG_LOCKED     0x0002
 #define XPRT_PRIVATE_FLAG_REF        0x0004
+#define XPRT_PRIVATE_FLAG_ADMIT      0x0008 /* under admission control */
+
+struct tcp_reply_queue;
 
 typedef struct gsh_xprt_private
 {
     uint32_t flags;
     uint32_t refcnt;
     uint32_t multi_cnt; /* multi-dispatch counter */
+    struct tcp_reply_queue *reply_queue; /* coalesced TCP replies */
+    uint32_t inflight; /* requests read and not yet answered */
+    uint32_t throttled; /* why events are held, see nfs_rpc_admission.c */
 } gsh_xprt_private_t;
 
 static inline gsh_xprt_private_t *
@@ -114,6 +123,9 @@ alloc_gsh_xprt_private(uint32_t flags)
 
     xu->flags = 0;
     xu->multi_cnt = 0;
+    xu->reply_queue = NULL;
+    xu->inflight = 0;
+    xu->throttled = 0;
 
     if (flags & XPRT_PRIVATE_FLAG_REF)
         xu->refcnt = 1;
@@ -0,0 +1,103 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file interval_tree.h
+ * \brief Intrusive tree of closed 64 bit intervals
+ *
+ * \section DESCRIPTION
+ *
+ * Nodes are kept in a binary search tree ordered by the start of their
+ * interval, and each node also records the largest end found in its
+ * subtree.  The nodes overlapping a range are then found, in start
+ * order, in O(log n + k).  The tree is balanced as a treap whose
+ * priorities are derived from the node addresses.
+ *
+ * The tree neither locks nor allocates: nodes are embedded in the
+ * caller's structures, the same way as glist_head.
+ *
+ */
+
+#ifndef _INTERVAL_TREE_H
+#define _INTERVAL_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct itree_root;
+
+struct itree_node
+{
+  struct itree_node *left;
+  struct itree_node *right;
+  struct itree_node *parent;
+  uint64_t start;               /* first offset of the interval */
+  uint64_t last;                /* last offset of the interval, inclusive */
+  uint64_t max;                 /* largest last in this subtree */
+  uint32_t prio;
+  struct itree_root *tree;      /* tree the node is in, NULL if none */
+};
+
+struct itree_root
+{
+  struct itree_node *root;
+  uint32_t count;
+};
+
+#define itree_entry(node, type, member) \
+        ((type *)((char *)(node)-(unsigned long)(&((type *)0)->member)))
+
+static inline void itree_init(struct itree_root *tree)
+{
+  tree->root = NULL;
+  tree->count = 0;
+}
+
+static inline int itree_empty(struct itree_root *tree)
+{
+  return tree->root == NULL;
+}
+
+static inline int itree_linked(struct itree_node *node)
+{
+  return node->tree != NULL;
+}
+
+void itree_insert(struct itree_root *tree, struct itree_node *node,
+                  uint64_t start, uint64_t last);
+void itree_remove(struct itree_node *node);
+void itree_update(struct itree_node *node, uint64_t start, uint64_t last);
+
+struct itree_node *itree_first(struct itree_root *tree,
+                               uint64_t start, uint64_t last);
+struct itree_node *itree_next(struct itree_node *node,
+                              uint64_t start, uint64_t last);
+
+/* Walk the nodes overlapping [start, last].  The current node may be
+ * removed or moved, but not the next one. */
+#define itree_for_each_overlap_safe(node, noden, tree, start, last)          \
+  for(node = itree_first(tree, start, last),                                 \
+      noden = node != NULL ? itree_next(node, start, last) : NULL;           \
+      node != NULL;                                                          \
+      node = noden,                                                          \
+      noden = node != NULL ? itree_next(node, start, last) : NULL)
+
+#endif /* _INTERVAL_TREE_H */
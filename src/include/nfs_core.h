@@ -81,6 +81,8 @@
 #define NB_MAX_PENDING_REQUEST 30
 #define NB_REQUEST_BEFORE_GC 50
 #define PRIME_DUPREQ 17         /* has to be a prime number */
+#define DUPREQ_SHARD_SIZE 1024
+#define DUPREQ_CHECKSUM_LEN 256
 #define PRIME_ID_MAPPER 17      /* has to be a prime number */
 #define DUPREQ_EXPIRATION 180
 
@@ -98,6 +100,7 @@
 #define DEFAULT_NFS_PRINCIPAL     "nfs" /* GSSAPI will expand this to nfs/host@DOMAIN */
 #define DEFAULT_NFS_KEYTAB        ""    /* let GSSAPI use keytab specified in /etc/krb5.conf */
 #define DEFAULT_NFS_CCACHE_DIR    "/var/run/ganesha"
+#define DEFAULT_GSS_CTX_CACHE_SIZE 8192
 
 /* Config labels */
 #define CONF_LABEL_NFS_CORE         "NFS_Core_Param"
@@ -126,6 +129,11 @@
 #define RQCRED_SIZE           400        /* this size is excessive */
 #define NFS_DEFAULT_SEND_BUFFER_SIZE 32768
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 32768
+#define NFS_DEFAULT_UDP_BATCH_SIZE 32
+#define NFS_DEFAULT_UDP_BATCH_DELAY 500 /* microseconds */
+#define NFS_DEFAULT_TCP_COALESCE_DELAY 500 /* microseconds */
+#define NFS_DEFAULT_MAX_INFLIGHT 4096
+#define NFS_DEFAULT_MAX_INFLIGHT_XPRT 64
 
 /* Default 'Raw Dev' values */
 #define GANESHA_RAW_DEV_MAJOR 168
@@ -177,13 +185,14 @@ typedef char path_str_t[MAXPATHLEN] ;
 
 typedef struct nfs_worker_param__
 {
-  LRU_parameter_t lru_dupreq;
   unsigned int nb_before_gc;
 } nfs_worker_parameter_t;
 
 typedef struct nfs_rpc_dupreq_param__
 {
-  hash_parameter_t hash_param;
+  hash_parameter_t hash_param;  /* index_size is the number of shards */
+  uint32_t shard_size;          /* finished entries kept per shard */
+  uint32_t checksum_len;        /* bytes of call body in the key, 0 for none */
 } nfs_rpc_dupreq_parameter_t;
 
 typedef enum protos
@@ -226,6 +235,14 @@ typedef struct nfs_core_param__
   unsigned int core_options;
   unsigned int max_send_buffer_size; /* Size of RPC send buffer */
   unsigned int max_recv_buffer_size; /* Size of RPC recv buffer */
+  unsigned int udp_batch_size; /* Datagrams per recvmmsg/sendmmsg, <= 1 disables */
+  unsigned int udp_batch_delay; /* Max wait of a queued UDP reply (usec) */
+  unsigned int tcp_coalesce_delay; /* Max wait of a queued TCP reply (usec), 0 disables */
+  unsigned int max_inflight; /* TCP requests in progress, 0 for no limit */
+  unsigned int max_inflight_xprt; /* Same, per connection, 0 for no limit */
+  unsigned int cred_cache_size; /* Entries in the credential cache, 0 disables */
+  unsigned int cred_cache_expiration; /* Lifetime of a cached credential (sec) */
+  bool_t manage_gids; /* Resolve supplementary groups on the server */
 #ifdef _USE_NLM
   bool_t nsm_use_caller_name;
 #endif
@@ -290,6 +307,14 @@ typedef struct nfs_version4_parameter__
   unsigned int return_bad_stateid;
   char domainname[NFS4_MAX_DOMAIN_LEN];
   char idmapconf[MAXPATHLEN];
+  unsigned int max_session_slots; /* Highest ca_maxrequests granted */
+  unsigned int slot_cache_hiwat; /* Cached slot replies before slots are recalled */
+  unsigned int delegations; /* Grant read delegations to NFSv4.0 clients */
+  unsigned int max_delegations; /* Delegations outstanding, server wide */
+  unsigned int recov_journal; /* Recovery clients in a journal, not directories */
+  unsigned int grace_early_exit; /* End grace once known clients have reclaimed */
+  unsigned int grace_reclaim_fraction; /* Percent of them enough after the timeout */
+  unsigned int grace_reclaim_timeout; /* Seconds, also NLM quiet time before the end */
 } nfs_version4_parameter_t;
 
 typedef struct nfs_param__
@@ -348,6 +373,7 @@ typedef struct nfs_request_data__
   char cred_area[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
   nfs_res_t res_nfs;
   nfs_arg_t arg_nfs;
+  uint32_t dupreq_checksum; /* CRC32C of the start of the call body */
   struct timeval time_queued; /* The time at which a request was added
                                * to the worker thread queue. */
 } nfs_request_data_t;
@@ -534,7 +560,6 @@ struct nfs_worker_data__
   unsigned int worker_index;
   int  pending_request_len;
   struct glist_head pending_request;
-  LRU_list_t *duplicate_request;
   hash_table_t *ht_ip_stats;
   pthread_mutex_t request_pool_mutex;
   nfs_tcb_t wcb; /* Worker control block */
@@ -656,7 +681,7 @@ pause_rc wait_for_workers_to_awaken();
 void DispatchWorkNFS(request_data_t *pnfsreq, unsigned int worker_index);
 void *worker_thread(void *IndexArg);
 request_data_t *nfs_rpc_get_nfsreq(nfs_worker_data_t *worker, uint32_t flags);
-process_status_t process_rpc_request(SVCXPRT *xprt);
+process_status_t dispatch_rpc_request(SVCXPRT *xprt);
 
 process_status_t dispatch_rpc_subrequest(nfs_worker_data_t *mydata,
                                          request_data_t *onfsreq);
@@ -742,6 +767,7 @@ int export_client_matchv6(struct in6_addr *paddrv6,
                           unsigned int export_option);
 
 /* Config reparsing routines */
+extern uint32_t export_generation;
 void admin_replace_exports();
 int CleanUpExportContext(fsal_export_context_t * p_export_context);
 exportlist_t *RemoveExportEntry(exportlist_t * exportEntry);
@@ -754,13 +780,6 @@ void Print_param_in_log();
 
 void nfs_reset_stats(void);
 
-int display_req_key(hash_buffer_t * pbuff, char *str);
-int display_req_val(hash_buffer_t * pbuff, char *str);
-int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2);
-
-int print_entry_dupreq(LRU_data_t data, char *str);
-int clean_entry_dupreq(LRU_entry_t * pentry, void *addparam);
-
 int print_pending_request(LRU_data_t data, char *str);
 
 void auth_stat2str(enum auth_stat, char *str);
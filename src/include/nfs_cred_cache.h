@@ -0,0 +1,82 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file nfs_cred_cache.h
+ * \brief Cache of resolved caller credentials
+ *
+ * \section DESCRIPTION
+ *
+ * Two kinds of entries share one cache, bounded by Cred_Cache_Size
+ * entries, each valid for Cred_Cache_Expiration seconds:
+ *
+ *  - the FSAL context built for an AUTH_UNIX credential, keyed by the
+ *    credential body less its stamp, the export and the generation
+ *    of the export list, and whether the client has root access to
+ *    it, so a reload of the exports makes the old contexts
+ *    unreachable;
+ *
+ *  - the primary and supplementary groups of a uid, looked up in the
+ *    password and group databases when Manage_Gids is set.
+ *
+ */
+
+#ifndef _NFS_CRED_CACHE_H
+#define _NFS_CRED_CACHE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "ganesha_rpc.h"
+#include "fsal.h"
+#include "nfs_exports.h"
+
+typedef struct nfs_cred_cache_stats__
+{
+  uint64_t entries;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t expired;
+  uint64_t evicted;
+} nfs_cred_cache_stats_t;
+
+int nfs_Init_cred_cache(void);
+
+bool_t nfs_cred_cache_get_context(struct svc_req *req,
+                                  exportlist_t *pexport,
+                                  exportlist_client_entry_t *pclient,
+                                  fsal_op_context_t *pcontext);
+void nfs_cred_cache_set_context(struct svc_req *req,
+                                exportlist_t *pexport,
+                                exportlist_client_entry_t *pclient,
+                                fsal_op_context_t *pcontext);
+
+bool_t nfs_cred_cache_get_groups(uid_t uid, gid_t *pgid,
+                                 gid_t *groups, unsigned int *pglen);
+
+void nfs_cred_cache_get_stats(nfs_cred_cache_stats_t *pstats);
+
+#endif /* _NFS_CRED_CACHE_H */
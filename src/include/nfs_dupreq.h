@@ -30,6 +30,12 @@
  *
  * Prototypes for duplicate requsts cache management.
  *
+ * Only requests whose function descriptor carries CAN_BE_DUP (the
+ * non-idempotent ones) go through the cache.  Entries are spread over
+ * Index_Size shards chosen by client address, each with its own lock,
+ * bucket array and LRU bounded to Shard_Size finished entries.  A
+ * finished entry holds the XDR encoded results, so a retransmission is
+ * answered by sending those bytes again.
  *
  */
 
@@ -50,6 +56,7 @@ typedef unsigned long u_long;
 #include "nfs4.h"
 #include "fsal.h"
 #include "nfs_tools.h"
+#include "nlm_list.h"
 
 typedef struct dupreq_key__
 {
@@ -64,46 +71,35 @@ typedef struct dupreq_key__
   sockaddr_t addr;
 
   /* In very rare cases, ip/port/xid is not enough. In databases
-   * and other specific applications this may be a greater concern.
-   * In those cases a checksum of the first 200 bytes of the request
-   * should be used */
+   * and other specific applications this may be a greater concern,
+   * and xids wrap quickly for clients behind a NAT. So a CRC32C of
+   * the first Checksum_Length bytes of the call body is used too */
   int checksum;
 } dupreq_key_t;
 
-typedef struct dupreq_entry__
+/* An encoded reply, as it was put on the wire the first time */
+typedef struct dupreq_reply__
 {
-  long xid;
-  sockaddr_t addr;
-  int checksum;
-  int ipproto ;
+  u_int len;
+  char *data;
+} dupreq_reply_t;
 
-  pthread_mutex_t dupreq_mutex;
+typedef struct dupreq_entry__
+{
+  struct glist_head hash_link; /* chain in the shard's bucket */
+  struct glist_head lru_link;  /* shard LRU, finished entries only */
+  dupreq_key_t key;
+  uint32_t hk;                 /* full hash of key */
+  int ipproto;
   int processing; /* if currently being processed, this should be = 1 */
 
-  nfs_res_t res_nfs;
+  dupreq_reply_t reply;        /* XDR encoded results */
   u_long rq_prog;               /* service program number        */
   u_long rq_vers;               /* service protocol version      */
   u_long rq_proc;
   time_t timestamp;
 } dupreq_entry_t;
 
-int compare_req(hash_buffer_t *buff1, hash_buffer_t *buff2);
-int print_entry_dupreq(LRU_data_t data, char *str);
-int clean_entry_dupreq(LRU_entry_t *pentry, void *addparam);
-int nfs_dupreq_gc_function(LRU_entry_t *pentry, void *addparam);
-
-nfs_res_t nfs_dupreq_get(struct svc_req *req, int *pstatus);
-int nfs_dupreq_delete(struct svc_req *req);
-int nfs_dupreq_add_not_finished(struct svc_req *req, nfs_res_t *res_nfs);
-
-int nfs_dupreq_finish(struct svc_req *req, nfs_res_t *p_res_nfs,
-                      LRU_list_t *lru_dupreq);
-
-uint32_t dupreq_value_hash_func(hash_parameter_t *p_hparam,
-                                     hash_buffer_t *buffclef);
-uint64_t dupreq_rbt_hash_func(hash_parameter_t *p_hparam, hash_buffer_t *buffclef);
-void nfs_dupreq_get_stats(hash_stat_t *phstat_udp, hash_stat_t *phstat_tcp ) ;
-
 typedef enum dupreq_status
 {
     DUPREQ_SUCCESS = 0,
@@ -113,4 +109,20 @@ typedef enum dupreq_status
     DUPREQ_ALREADY_EXISTS,
 } dupreq_status_t;
 
+struct nfs_request_data__;
+
+void nfs_dupreq_checksum(struct nfs_request_data__ *preqnfs,
+                         xdrproc_t decode_func);
+int nfs_dupreq_delete(struct nfs_request_data__ *preqnfs);
+int nfs_dupreq_add_not_finished(struct nfs_request_data__ *preqnfs,
+                                dupreq_reply_t *reply);
+int nfs_dupreq_finish(struct nfs_request_data__ *preqnfs, nfs_res_t *p_res_nfs,
+                      xdrproc_t encode_func);
+void nfs_dupreq_gc(void);
+
+bool_t xdr_dupreq_reply(XDR *xdrs, dupreq_reply_t *reply);
+void nfs_dupreq_free_reply(dupreq_reply_t *reply);
+
+void nfs_dupreq_get_stats(hash_stat_t *phstat_udp, hash_stat_t *phstat_tcp ) ;
+
 #endif                          /* _NFS_DUPREQ_H */
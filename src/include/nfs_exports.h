@@ -56,6 +56,7 @@
 #include "mount.h"
 #include "nfs_stat.h"
 #include "cache_inode.h"
+#include "cache_inode_path.h"
 #include "nfs_ip_stats.h"
 #include "nlm_list.h"
 
@@ -365,12 +366,19 @@ typedef struct compoud_data
   nfs_client_cred_t credential; /*< Raw RPC credentials */
   nfs_client_id_t *preserved_clientid; /*< clientid that has lease
                                            reserved, if any */
-#ifdef _USE_NFS4_1
-  COMPOUND4res_extended *pcached_res; /*< NFv41: pointer to cached RPC res in
-                                          a session's slot */
-  bool_t use_drc; /*< Set to TRUE if session DRC is to be used */
+  struct nfs_argop4 *argarray; /*< The operations of the compound, for
+                                   operations that look ahead */
+  uint32_t argarray_len; /*< Number of operations in the compound */
   uint32_t oppos; /*< Position of the operation within the request
                       processed  */
+  uint32_t lookup_skip; /*< Number of following LOOKUPs already
+                            resolved through the path cache */
+  cache_inode_path_walk_t path_walk; /*< Path cache record being built
+                                         by a run of LOOKUPs */
+#ifdef _USE_NFS4_1
+  struct nfs41_session_slot__ *pcached_slot; /*< NFv41: session's slot
+                                                 to cache the reply in */
+  bool_t use_drc; /*< Set to TRUE if session DRC is to be used */
   nfs41_session_t *psession; /*< Related session (found by OP_SEQUENCE) */
 #endif                          /* USE_NFS4_1 */
 } compound_data_t;
@@ -385,6 +393,11 @@ int nfs_build_fsal_context(struct svc_req *ptr_req,
                            exportlist_t * pexport,
                            fsal_op_context_t * pcontext,
                            struct user_cred *user_credentials);
+int nfs_make_fsal_context(struct svc_req *ptr_req,
+                          exportlist_client_entry_t * pexport_client,
+                          exportlist_t * pexport,
+                          fsal_op_context_t * pcontext,
+                          struct user_cred *user_credentials);
 int get_req_uid_gid(struct svc_req *ptr_req,
                     exportlist_t * pexport,
                     struct user_cred *user_credentials);
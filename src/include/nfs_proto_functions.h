@@ -132,7 +132,8 @@ typedef union nfs_arg__
 struct COMPOUND4res_extended
 {
   COMPOUND4res res_compound4;
-  bool_t       res_cached;
+  char       * res_replay;      /* NFSv4.1 replay, sent instead of res_compound4 */
+  u_int        res_replay_len;
 };
 
 typedef union nfs_res__
@@ -1209,6 +1210,9 @@ static const fattr4_dent_t __attribute__ ((__unused__)) fattr4tab[] =
 
 /* BUGAZOMEU: Some definitions to be removed. FSAL parameters to be used instead */
 #define NFS4_LEASE_LIFETIME 120
+#define NFS41_DEFAULT_MAX_SLOTS 64
+#define NFS41_DEFAULT_SLOT_CACHE_HIWAT 16384
+#define NFS4_DEFAULT_MAX_DELEGATIONS 10000
 #define FSINFO_MAX_FILESIZE  0xFFFFFFFFFFFFFFFFll
 #define MAX_HARD_LINK_VALUE           (0xffff)
 #define NFS4_PSEUDOFS_MAX_READ_SIZE  1048576
@@ -1281,7 +1285,7 @@ void nfs2_Readlink_Free(nfs_res_t * resp);
 void nfs4_Compound_FreeOne(nfs_resop4 * pres);
 void nfs4_Compound_Free(nfs_res_t * pres);
 void nfs4_Compound_CopyResOne(nfs_resop4 * pres_dst, nfs_resop4 * pres_src);
-void nfs4_Compound_CopyRes(nfs_res_t * pres_dst, nfs_res_t * pres_src);
+bool_t xdr_COMPOUND4res_extended(XDR * xdrs, COMPOUND4res_extended * objp);
 
 void nfs4_op_access_Free(ACCESS4res * resp);
 void nfs4_op_close_Free(CLOSE4res * resp);
@@ -1512,6 +1516,7 @@ int nfs4_FSALattr_To_Fattr(exportlist_t *pexport,
                            compound_data_t *data,
                            nfs_fh4 *objFH,
                            bitmap4 *Bitmap);
+void nfs4_fattr_plan_thread_shutdown(void);
 
 void nfs4_list_to_bitmap4(bitmap4 * b, uint_t plen, uint32_t * pval);
 void nfs4_bitmap4_to_list(bitmap4 * b, uint_t * plen, uint32_t * pval);
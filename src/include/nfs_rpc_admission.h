@@ -0,0 +1,67 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file nfs_rpc_admission.h
+ * \brief Admission control of the requests read on TCP connections
+ *
+ * \section DESCRIPTION
+ *
+ * The requests read from the TCP connections and not yet answered are
+ * counted, in total and per connection.  A connection over
+ * Max_Inflight_Requests_Per_Conn, or any connection once the total is
+ * over Max_Inflight_Requests, is parked: its events stay blocked, so
+ * nothing more is read from it and TCP flow control pushes back on the
+ * client.  It is dispatched again once requests have completed.
+ *
+ */
+
+#ifndef _NFS_RPC_ADMISSION_H
+#define _NFS_RPC_ADMISSION_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "ganesha_rpc.h"
+
+typedef struct nfs_rpc_admission_stats__
+{
+  uint64_t inflight;
+  uint64_t parked;
+  uint64_t throttled_xprt;
+  uint64_t throttled_global;
+} nfs_rpc_admission_stats_t;
+
+void nfs_rpc_admission_attach(SVCXPRT *xprt);
+
+bool_t nfs_rpc_admit(SVCXPRT *xprt);
+void nfs_rpc_admission_begin(SVCXPRT *xprt);
+void nfs_rpc_admission_end(SVCXPRT *xprt);
+void nfs_rpc_admission_kick(void);
+
+void nfs_rpc_admission_get_stats(nfs_rpc_admission_stats_t *pstats);
+
+#endif /* _NFS_RPC_ADMISSION_H */
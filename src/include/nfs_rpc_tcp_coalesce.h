@@ -0,0 +1,64 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file nfs_rpc_tcp_coalesce.h
+ * \brief Coalescing of the replies sent on a TCP connection
+ *
+ * \section DESCRIPTION
+ *
+ * When TCP_Reply_Coalesce_Delay is not 0, the replies on a TCP
+ * connection are record marked into a buffer of the connection
+ * instead of being written one by one.  The buffer is written with a
+ * single write() when no other request of the connection is in
+ * progress, when it is full, or at the latest TCP_Reply_Coalesce_Delay
+ * microseconds after its oldest reply was queued.
+ *
+ * Replies larger than the buffer are written directly, after what is
+ * already queued.
+ *
+ */
+
+#ifndef _NFS_RPC_TCP_COALESCE_H
+#define _NFS_RPC_TCP_COALESCE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <signal.h>
+#include "ganesha_rpc.h"
+
+/* Size of the reply buffer of each connection */
+#define TCP_COALESCE_BUFSIZE 65536
+
+void nfs_rpc_tcp_coalesce_attach(SVCXPRT *xprt);
+void nfs_rpc_tcp_coalesce_release(SVCXPRT *xprt);
+void nfs_rpc_tcp_coalesce_begin(SVCXPRT *xprt);
+void nfs_rpc_tcp_coalesce_done(SVCXPRT *xprt, sigset_t *sigmask);
+
+void *tcp_coalesce_thread(void *UnusedArg);
+
+#endif /* _NFS_RPC_TCP_COALESCE_H */
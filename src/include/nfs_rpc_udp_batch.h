@@ -0,0 +1,69 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/**
+ *
+ * \file nfs_rpc_udp_batch.h
+ * \brief Batched receive and transmit on the UDP transports
+ *
+ * \section DESCRIPTION
+ *
+ * When UDP_Batch_Size is greater than 1, a worker woken for one of the
+ * UDP transports reads up to that many datagrams with a single
+ * recvmmsg().  Each datagram gets a transport of its own (a "clone"
+ * sharing the socket of its parent) and is dispatched to the workers
+ * as an independent request, so the datagrams of one batch are
+ * decoded and executed in parallel.
+ *
+ * Replies sent on a clone are encoded into the clone and queued on
+ * the sending worker.  The queue is sent with sendmmsg() when it is
+ * full, when its oldest reply has waited UDP_Batch_Delay microseconds,
+ * and whenever the worker runs out of requests to process.
+ *
+ */
+
+#ifndef _NFS_RPC_UDP_BATCH_H
+#define _NFS_RPC_UDP_BATCH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif                          /* HAVE_CONFIG_H */
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "ganesha_rpc.h"
+
+/* Upper bound on UDP_Batch_Size */
+#define UDP_BATCH_SIZE_MAX 256
+
+void nfs_rpc_udp_batch_thread_init(void);
+void nfs_rpc_udp_batch_thread_shutdown(void);
+
+bool_t nfs_rpc_udp_batch_parent(SVCXPRT *xprt);
+bool_t nfs_rpc_udp_batch_clone(SVCXPRT *xprt);
+
+unsigned int nfs_rpc_udp_batch_recv(SVCXPRT *xprt);
+void nfs_rpc_udp_batch_done(SVCXPRT *xprt);
+void nfs_rpc_udp_batch_flush(void);
+void nfs_rpc_udp_batch_flush_due(void);
+
+#endif /* _NFS_RPC_UDP_BATCH_H */
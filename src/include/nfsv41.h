@@ -7260,6 +7260,187 @@ static inline bool_t xdr_nfs_opnum4(XDR * xdrs, nfs_opnum4 * objp)
   return TRUE;
 }
 
+/*
+ * Hand written routines for the operations found in nearly every
+ * COMPOUND.  Each one reserves the whole fixed part of the message with
+ * a single XDR_INLINE and fills it with the IXDR macros; when the
+ * stream cannot hand out that much contiguous space, or for the other
+ * direction and XDR_FREE, they fall back to the routine above.
+ */
+
+#define NFS4_FAST_STATEID_SIZE (BYTES_PER_XDR_UNIT + 12)
+
+static inline int32_t *nfs4_fast_get_stateid(int32_t * buf, stateid4 * stateid)
+{
+  stateid->seqid = IXDR_GET_U_INT32(buf);
+  memcpy(stateid->other, buf, 12);
+  return buf + 3;
+}
+
+static inline int32_t *nfs4_fast_get_u64(int32_t * buf, uint64_t * val)
+{
+  uint64_t hi = IXDR_GET_U_INT32(buf);
+
+  *val = (hi << 32) | IXDR_GET_U_INT32(buf);
+  return buf;
+}
+
+static inline bool_t xdr_SEQUENCE4args_fast(XDR * xdrs, SEQUENCE4args * objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op == XDR_DECODE
+     && (buf = XDR_INLINE(xdrs, NFS4_SESSIONID_SIZE + 4 * BYTES_PER_XDR_UNIT)))
+    {
+      memcpy(objp->sa_sessionid, buf, NFS4_SESSIONID_SIZE);
+      buf += NFS4_SESSIONID_SIZE / BYTES_PER_XDR_UNIT;
+      objp->sa_sequenceid = IXDR_GET_U_INT32(buf);
+      objp->sa_slotid = IXDR_GET_U_INT32(buf);
+      objp->sa_highest_slotid = IXDR_GET_U_INT32(buf);
+      objp->sa_cachethis = IXDR_GET_BOOL(buf);
+      return TRUE;
+    }
+  return xdr_SEQUENCE4args(xdrs, objp);
+}
+
+static inline bool_t xdr_SEQUENCE4res_fast(XDR * xdrs, SEQUENCE4res * objp)
+{
+  SEQUENCE4resok *resok = &objp->SEQUENCE4res_u.sr_resok4;
+  int32_t *buf;
+
+  if(xdrs->x_op == XDR_ENCODE && objp->sr_status == NFS4_OK
+     && (buf = XDR_INLINE(xdrs, NFS4_SESSIONID_SIZE + 6 * BYTES_PER_XDR_UNIT)))
+    {
+      IXDR_PUT_ENUM(buf, objp->sr_status);
+      memcpy(buf, resok->sr_sessionid, NFS4_SESSIONID_SIZE);
+      buf += NFS4_SESSIONID_SIZE / BYTES_PER_XDR_UNIT;
+      IXDR_PUT_U_INT32(buf, resok->sr_sequenceid);
+      IXDR_PUT_U_INT32(buf, resok->sr_slotid);
+      IXDR_PUT_U_INT32(buf, resok->sr_highest_slotid);
+      IXDR_PUT_U_INT32(buf, resok->sr_target_highest_slotid);
+      IXDR_PUT_U_INT32(buf, resok->sr_status_flags);
+      return TRUE;
+    }
+  return xdr_SEQUENCE4res(xdrs, objp);
+}
+
+static inline bool_t xdr_GETATTR4res_fast(XDR * xdrs, GETATTR4res * objp)
+{
+  fattr4 *attr = &objp->GETATTR4res_u.resok4.obj_attributes;
+  u_int len, i;
+  int32_t *buf;
+
+  if(xdrs->x_op != XDR_ENCODE || objp->status != NFS4_OK)
+    return xdr_GETATTR4res(xdrs, objp);
+
+  /* status, bitmap, then the already encoded attributes as opaque */
+  len = (3 + attr->attrmask.bitmap4_len) * BYTES_PER_XDR_UNIT
+      + RNDUP(attr->attr_vals.attrlist4_len);
+  buf = XDR_INLINE(xdrs, len);
+  if(buf == NULL)
+    return xdr_GETATTR4res(xdrs, objp);
+
+  IXDR_PUT_ENUM(buf, objp->status);
+  IXDR_PUT_U_INT32(buf, attr->attrmask.bitmap4_len);
+  for(i = 0; i < attr->attrmask.bitmap4_len; i++)
+    IXDR_PUT_U_INT32(buf, attr->attrmask.bitmap4_val[i]);
+  IXDR_PUT_U_INT32(buf, attr->attr_vals.attrlist4_len);
+  if(attr->attr_vals.attrlist4_len % BYTES_PER_XDR_UNIT)
+    buf[attr->attr_vals.attrlist4_len / BYTES_PER_XDR_UNIT] = 0;
+  memcpy(buf, attr->attr_vals.attrlist4_val, attr->attr_vals.attrlist4_len);
+  return TRUE;
+}
+
+static inline bool_t xdr_PUTFH4args_fast(XDR * xdrs, PUTFH4args * objp)
+{
+  nfs_fh4 *fh = &objp->object;
+  int32_t *buf;
+  u_int len;
+
+  if(xdrs->x_op != XDR_DECODE)
+    return xdr_PUTFH4args(xdrs, objp);
+
+  /* The length must be read first to know how much to reserve */
+  if(!inline_xdr_u_int32_t(xdrs, &len) || len > NFS4_FHSIZE)
+    return FALSE;
+
+  if(len != 0 && fh->nfs_fh4_val == NULL)
+    if((fh->nfs_fh4_val = mem_alloc(len)) == NULL)
+      return FALSE;
+  fh->nfs_fh4_len = len;
+
+  if((buf = XDR_INLINE(xdrs, RNDUP(len))) == NULL)
+    return xdr_opaque(xdrs, fh->nfs_fh4_val, len);
+
+  memcpy(fh->nfs_fh4_val, buf, len);
+  return TRUE;
+}
+
+static inline bool_t xdr_READ4args_fast(XDR * xdrs, READ4args * objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op == XDR_DECODE
+     && (buf = XDR_INLINE(xdrs, NFS4_FAST_STATEID_SIZE + 3 * BYTES_PER_XDR_UNIT)))
+    {
+      buf = nfs4_fast_get_stateid(buf, &objp->stateid);
+      buf = nfs4_fast_get_u64(buf, &objp->offset);
+      objp->count = IXDR_GET_U_INT32(buf);
+      return TRUE;
+    }
+  return xdr_READ4args(xdrs, objp);
+}
+
+static inline bool_t xdr_READ4res_fast(XDR * xdrs, READ4res * objp)
+{
+  READ4resok *resok = &objp->READ4res_u.resok4;
+  int32_t *buf;
+
+  /* Only the header: the data is copied once by xdr_opaque */
+  if(xdrs->x_op == XDR_ENCODE && objp->status == NFS4_OK
+     && (buf = XDR_INLINE(xdrs, 3 * BYTES_PER_XDR_UNIT)))
+    {
+      IXDR_PUT_ENUM(buf, objp->status);
+      IXDR_PUT_BOOL(buf, resok->eof);
+      IXDR_PUT_U_INT32(buf, resok->data.data_len);
+      return xdr_opaque(xdrs, resok->data.data_val, resok->data.data_len);
+    }
+  return xdr_READ4res(xdrs, objp);
+}
+
+static inline bool_t xdr_WRITE4args_fast(XDR * xdrs, WRITE4args * objp)
+{
+  int32_t *buf;
+
+  if(xdrs->x_op == XDR_DECODE
+     && (buf = XDR_INLINE(xdrs, NFS4_FAST_STATEID_SIZE + 3 * BYTES_PER_XDR_UNIT)))
+    {
+      buf = nfs4_fast_get_stateid(buf, &objp->stateid);
+      buf = nfs4_fast_get_u64(buf, &objp->offset);
+      objp->stable = IXDR_GET_ENUM(buf, stable_how4);
+      return inline_xdr_bytes(xdrs, (char **)&objp->data.data_val,
+                              (u_int *) & objp->data.data_len, ~0);
+    }
+  return xdr_WRITE4args(xdrs, objp);
+}
+
+static inline bool_t xdr_WRITE4res_fast(XDR * xdrs, WRITE4res * objp)
+{
+  WRITE4resok *resok = &objp->WRITE4res_u.resok4;
+  int32_t *buf;
+
+  if(xdrs->x_op == XDR_ENCODE && objp->status == NFS4_OK
+     && (buf = XDR_INLINE(xdrs, 3 * BYTES_PER_XDR_UNIT + NFS4_VERIFIER_SIZE)))
+    {
+      IXDR_PUT_ENUM(buf, objp->status);
+      IXDR_PUT_U_INT32(buf, resok->count);
+      IXDR_PUT_ENUM(buf, resok->committed);
+      memcpy(buf, resok->writeverf, NFS4_VERIFIER_SIZE);
+      return TRUE;
+    }
+  return xdr_WRITE4res(xdrs, objp);
+}
+
 static inline bool_t xdr_nfs_argop4(XDR * xdrs, nfs_argop4 * objp)
 {
   if(!xdr_nfs_opnum4(xdrs, &objp->argop))
@@ -7339,7 +7520,7 @@ static inline bool_t xdr_nfs_argop4(XDR * xdrs, nfs_argop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_PUTFH:
-      if(!xdr_PUTFH4args(xdrs, &objp->nfs_argop4_u.opputfh))
+      if(!xdr_PUTFH4args_fast(xdrs, &objp->nfs_argop4_u.opputfh))
         return FALSE;
       break;
     case NFS4_OP_PUTPUBFH:
@@ -7347,7 +7528,7 @@ static inline bool_t xdr_nfs_argop4(XDR * xdrs, nfs_argop4 * objp)
     case NFS4_OP_PUTROOTFH:
       break;
     case NFS4_OP_READ:
-      if(!xdr_READ4args(xdrs, &objp->nfs_argop4_u.opread))
+      if(!xdr_READ4args_fast(xdrs, &objp->nfs_argop4_u.opread))
         return FALSE;
       break;
     case NFS4_OP_READDIR:
@@ -7393,7 +7574,7 @@ static inline bool_t xdr_nfs_argop4(XDR * xdrs, nfs_argop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_WRITE:
-      if(!xdr_WRITE4args(xdrs, &objp->nfs_argop4_u.opwrite))
+      if(!xdr_WRITE4args_fast(xdrs, &objp->nfs_argop4_u.opwrite))
         return FALSE;
       break;
     case NFS4_OP_RELEASE_LOCKOWNER:
@@ -7453,7 +7634,7 @@ static inline bool_t xdr_nfs_argop4(XDR * xdrs, nfs_argop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_SEQUENCE:
-      if(!xdr_SEQUENCE4args(xdrs, &objp->nfs_argop4_u.opsequence))
+      if(!xdr_SEQUENCE4args_fast(xdrs, &objp->nfs_argop4_u.opsequence))
         return FALSE;
       break;
     case NFS4_OP_SET_SSV:
@@ -7515,7 +7696,7 @@ static inline bool_t xdr_nfs_resop4(XDR * xdrs, nfs_resop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_GETATTR:
-      if(!xdr_GETATTR4res(xdrs, &objp->nfs_resop4_u.opgetattr))
+      if(!xdr_GETATTR4res_fast(xdrs, &objp->nfs_resop4_u.opgetattr))
         return FALSE;
       break;
     case NFS4_OP_GETFH:
@@ -7579,7 +7760,7 @@ static inline bool_t xdr_nfs_resop4(XDR * xdrs, nfs_resop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_READ:
-      if(!xdr_READ4res(xdrs, &objp->nfs_resop4_u.opread))
+      if(!xdr_READ4res_fast(xdrs, &objp->nfs_resop4_u.opread))
         return FALSE;
       break;
     case NFS4_OP_READDIR:
@@ -7631,7 +7812,7 @@ static inline bool_t xdr_nfs_resop4(XDR * xdrs, nfs_resop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_WRITE:
-      if(!xdr_WRITE4res(xdrs, &objp->nfs_resop4_u.opwrite))
+      if(!xdr_WRITE4res_fast(xdrs, &objp->nfs_resop4_u.opwrite))
         return FALSE;
       break;
     case NFS4_OP_RELEASE_LOCKOWNER:
@@ -7691,7 +7872,7 @@ static inline bool_t xdr_nfs_resop4(XDR * xdrs, nfs_resop4 * objp)
         return FALSE;
       break;
     case NFS4_OP_SEQUENCE:
-      if(!xdr_SEQUENCE4res(xdrs, &objp->nfs_resop4_u.opsequence))
+      if(!xdr_SEQUENCE4res_fast(xdrs, &objp->nfs_resop4_u.opsequence))
         return FALSE;
       break;
     case NFS4_OP_SET_SSV:
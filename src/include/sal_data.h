@@ -105,14 +105,14 @@ typedef struct state_layout_segment_t state_layout_segment_t;
  ******************************************************************************/
 
 #define NFS41_SESSION_PER_CLIENT 3
-#define NFS41_NB_SLOTS           3
 #define NFS41_DRC_SIZE          32768
 
 typedef struct nfs41_session_slot__
 {
   sequenceid4            sequence;
   pthread_mutex_t        lock;
-  COMPOUND4res_extended  cached_result;
+  char                 * cached_reply;     /* as encoded on the wire */
+  u_int                  cached_len;
   unsigned int           cache_used;
 } nfs41_session_slot_t;
 
@@ -125,7 +125,10 @@ struct nfs41_session__
   char                   session_id[NFS4_SESSIONID_SIZE];
   channel_attrs4         fore_channel_attrs;
   channel_attrs4         back_channel_attrs;
-  nfs41_session_slot_t   slots[NFS41_NB_SLOTS];
+  pthread_mutex_t        slots_lock;       /* creation of the slots */
+  uint32_t               nb_slots;         /* ca_maxrequests granted */
+  uint32_t               target_highest_slotid;
+  nfs41_session_slot_t **slots;            /* nb_slots, created on first use */
 };
 
 /******************************************************************************
@@ -160,11 +163,30 @@ typedef struct state_lock_t
   struct glist_head   state_sharelist; /**< List of states related to a share          */
 } state_lock_t;
 
+typedef enum state_deleg_status__
+{
+  DELEG_GRANTED,
+  DELEG_RECALLED
+} state_deleg_status_t;
+
 typedef struct state_deleg__
 {
-  unsigned int nothing;
+  open_delegation_type4 sd_type;        /**< Only OPEN_DELEGATE_READ is granted          */
+  state_deleg_status_t  sd_status;
+  time_t                sd_recall_time; /**< When CB_RECALL was sent                     */
+  struct glist_head     sd_recall_list; /**< Entry in the list of recalled delegations   */
+  nfs_fh4               sd_fh;          /**< Handle the client knows the file by         */
 } state_deleg_t;
 
+typedef struct state_deleg_stats__
+{
+  uint64_t outstanding;
+  uint64_t granted;
+  uint64_t recalled;
+  uint64_t returned;
+  uint64_t revoked;
+} state_deleg_stats_t;
+
 typedef struct state_layout__
 {
 #ifdef _PNFS_MDS
@@ -351,6 +373,12 @@ typedef enum nfs_clientid_confirm_state__
 #define CLIENT_ID_INVALID_ARGUMENT    3
 #define CLIENT_ID_STATE_ERROR         4
 
+/* Values of cid_cb.cid_path_state */
+#define CB_PATH_UNKNOWN 0
+#define CB_PATH_PROBING 1       /* CB_NULL queued */
+#define CB_PATH_UP      2
+#define CB_PATH_DOWN    3       /* a callback failed */
+
 struct nfs_client_id_t
 {
   clientid4                      cid_clientid;
@@ -376,6 +404,7 @@ struct nfs_client_id_t
               uint32_t                cb_callback_ident;
           } v40;
       } cb_u;
+      uint32_t                   cid_path_state; /* CB_PATH_*, for delegations */
   } cid_cb;
 #ifdef _USE_NFS4_1
   char                           cid_server_owner[MAXNAMLEN];
@@ -387,6 +416,8 @@ struct nfs_client_id_t
   state_owner_t                  cid_owner;
   int32_t                        cid_refcount;
   int                            cid_lease_reservations;
+  struct glist_head              cid_lease_list;   /* slot of the lease wheel */
+  time_t                         cid_lease_expire; /* 0 if not in the wheel */
 };
 
 struct nfs_client_record_t
@@ -538,6 +569,7 @@ typedef void state_block_data_t;
 struct state_lock_entry_t
 {
   struct glist_head      sle_list;
+  struct itree_node      sle_tree;
   struct glist_head      sle_owner_locks;
   struct glist_head      sle_locks;
 #ifdef _DEBUG_MEMLEAKS
@@ -608,6 +640,7 @@ typedef struct state_nlm_async_data_t
 {
   state_nlm_client_t       * nlm_async_host;
   void                     * nlm_async_key;
+  unsigned int               nlm_async_sends;   /* GRANTED_MSG sent so far */
   union
     {
       nfs_res_t              nlm_async_res;
@@ -625,11 +658,13 @@ struct state_async_queue_t
 {
   struct glist_head              state_async_glist;
   state_async_func_t           * state_async_func;
+  time_t                         state_async_due;   /* for delayed work */
   union
     {
 #ifdef _USE_NLM
       state_nlm_async_data_t     state_nlm_async_data;
 #endif /* _USE_NLM */
+      state_async_block_data_t   state_async_block_data;
       void                     * state_no_data;
     } state_async_data;
 };
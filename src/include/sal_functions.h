@@ -284,6 +284,19 @@ int nfs41_Session_Get_Pointer(char               sessionid[NFS4_SESSIONID_SIZE],
                               nfs41_session_t ** psession_data);
 
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
+int nfs41_Session_Alloc_Slots(nfs41_session_t * psession, uint32_t nb_slots);
+void nfs41_Session_Free_Slots(nfs41_session_t * psession);
+nfs41_session_slot_t *nfs41_Session_Get_Slot(nfs41_session_t * psession,
+                                             slotid4 slotid);
+void nfs41_Session_Slot_Cache(nfs41_session_slot_t * pslot);
+void nfs41_Session_Slot_Uncache(nfs41_session_slot_t * pslot);
+void nfs41_Session_Slot_Save(nfs41_session_slot_t * pslot,
+                             COMPOUND4res * pres,
+                             u_int maxsize);
+int nfs41_Session_Slot_Replay(nfs41_session_slot_t * pslot,
+                              COMPOUND4res_extended * pres);
+slotid4 nfs41_Session_Target_Slots(nfs41_session_t * psession,
+                                   slotid4 highest_slotid);
 void nfs41_Build_sessionid(clientid4 * pclientid, char * sessionid);
 void nfs41_Session_PrintAll(void);
 int display_session(nfs41_session_t * psession, char * str);
@@ -345,6 +358,9 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t * p_hparam,
 int  reserve_lease(nfs_client_id_t * pclientid);
 void update_lease(nfs_client_id_t * pclientid);
 int  valid_lease(nfs_client_id_t * pclientid);
+void nfs4_lease_wheel_arm(nfs_client_id_t * pclientid);
+void nfs4_lease_wheel_remove(nfs_client_id_t * pclientid);
+nfs_client_id_t * nfs4_lease_wheel_pop(time_t now);
 
 /******************************************************************************
  *
@@ -476,6 +492,9 @@ state_status_t state_find_grant(void                  * pcookie,
                                 state_cookie_entry_t ** ppcookie_entry,
                                 state_status_t        * pstatus);
 
+bool_t state_grant_pending(void * pcookie,
+                           int    cookie_size);
+
 void state_complete_grant(fsal_op_context_t    * pcontext,
                           state_cookie_entry_t * cookie_entry);
 
@@ -606,6 +625,51 @@ void state_nfs4_state_wipe(cache_entry_t        * pentry);
 void release_lockstate(state_owner_t * plock_owner);
 void release_openstate(state_owner_t * popen_owner);
 
+/******************************************************************************
+ *
+ * Delegation functions
+ *
+ ******************************************************************************/
+
+bool_t state_deleg_grant(cache_entry_t     * pentry,
+                         state_owner_t     * popen_owner,
+                         exportlist_t      * pexport,
+                         fsal_op_context_t * pcontext,
+                         uint32_t            share_access,
+                         uint32_t            share_deny,
+                         nfs_fh4           * pfh,
+                         state_t          ** ppstate);
+
+bool_t state_deleg_recall_locked(cache_entry_t *pentry, state_owner_t *powner);
+bool_t state_deleg_recall(cache_entry_t *pentry, state_owner_t *powner);
+
+void state_deleg_release(state_t *pstate, cache_entry_t *pentry);
+state_status_t state_deleg_return(state_t *pstate, state_status_t *pstatus);
+void state_deleg_release_client(nfs_client_id_t *pclientid);
+
+void state_deleg_reap(void);
+void state_deleg_get_stats(state_deleg_stats_t *pstats);
+
+/*
+ * Tells if the delegation stateid pstate may be used for an I/O: a
+ * read delegation covers READ, only a write delegation covers WRITE
+ * and a change of size.
+ */
+static inline nfsstat4 state_deleg_check_io(state_t *pstate, bool_t write)
+{
+  switch(pstate->state_data.deleg.sd_type)
+    {
+      case OPEN_DELEGATE_WRITE:
+        return NFS4_OK;
+
+      case OPEN_DELEGATE_READ:
+        return write ? NFS4ERR_OPENMODE : NFS4_OK;
+
+      default:
+        return NFS4ERR_BAD_STATEID;
+    }
+}
+
 /******************************************************************************
  *
  * Share functions
@@ -651,6 +715,14 @@ state_status_t state_share_check_conflict(cache_entry_t  * pentry,
                                           int              share_deny,
                                           state_status_t * pstatus);
 
+void state_share_get_summary(cache_entry_t * pentry,
+                             unsigned int  * pshare_access,
+                             unsigned int  * pshare_deny);
+
+int state_share_summary_conflict(cache_entry_t * pentry,
+                                 state_type_t    state_type,
+                                 state_data_t  * pstate_data);
+
 state_status_t state_share_anonymous_io_start(cache_entry_t  * pentry,
                                               int              share_access,
                                               state_status_t * pstatus);
@@ -684,6 +756,10 @@ state_status_t state_nlm_unshare(cache_entry_t        * pentry,
 /* Schedule Async Work */
 state_status_t state_async_schedule(state_async_queue_t *arg);
 
+/* Schedule Async Work to run in delay seconds */
+state_status_t state_async_schedule_delayed(state_async_queue_t *arg,
+                                            time_t               delay);
+
 /* Signal Async Work */
 void signal_async_work();
 
@@ -715,8 +791,18 @@ void nfs4_create_clid_name(nfs_client_record_t *, nfs_client_id_t *,
 void nfs4_add_clid(nfs_client_id_t *);
 void nfs4_rm_clid(char *);
 void nfs4_chk_clid(nfs_client_id_t *);
+void nfs4_reclaim_complete(nfs_client_id_t *, bool_t);
+void nfs_grace_nlm_reclaim();
 void nfs4_load_recov_clids(ushort nodeid);
 void nfs4_clean_old_recov_dir();
 void nfs4_create_recov_dir();
 
+int nfs4_journal_open(char *dir);
+int nfs4_journal_reset(void);
+int nfs4_journal_read(char *dir, char ***pnames);
+int nfs4_journal_write(char *dir, char **names, int count);
+void nfs4_journal_free_names(char **names, int count);
+void nfs4_journal_add(char *name);
+void nfs4_journal_rm(char *name);
+
 #endif                          /*  _SAL_FUNCTIONS_H */
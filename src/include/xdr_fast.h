@@ -0,0 +1,50 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    xdr_fast.h
+ * \brief   Hand written XDR routines for the hottest NFSv3 procedures.
+ *
+ * Arguments only have a decoder and results only an encoder; every
+ * other operation goes to the rpcgen routine of the same name without
+ * the _fast suffix.  The NFSv4.1 counterparts are static inline in
+ * nfsv41.h, next to the routines they replace.
+ *
+ */
+
+#ifndef _XDR_FAST_H
+#define _XDR_FAST_H
+
+#include "ganesha_rpc.h"
+#include "nfs23.h"
+
+bool_t xdr_GETATTR3args_fast(XDR *xdrs, GETATTR3args *objp);
+bool_t xdr_GETATTR3res_fast(XDR *xdrs, GETATTR3res *objp);
+bool_t xdr_LOOKUP3args_fast(XDR *xdrs, LOOKUP3args *objp);
+bool_t xdr_LOOKUP3res_fast(XDR *xdrs, LOOKUP3res *objp);
+bool_t xdr_ACCESS3args_fast(XDR *xdrs, ACCESS3args *objp);
+bool_t xdr_ACCESS3res_fast(XDR *xdrs, ACCESS3res *objp);
+bool_t xdr_READ3args_fast(XDR *xdrs, READ3args *objp);
+bool_t xdr_READ3res_fast(XDR *xdrs, READ3res *objp);
+bool_t xdr_WRITE3args_fast(XDR *xdrs, WRITE3args *objp);
+bool_t xdr_WRITE3res_fast(XDR *xdrs, WRITE3res *objp);
+
+#endif                          /* _XDR_FAST_H */
@@ -0,0 +1,103 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    crc32c.c
+ * \brief   CRC32C (Castagnoli) checksum.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <string.h>
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78  /* reflected 0x1EDC6F41 */
+
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32C_HW 1
+static int crc32c_have_hw;
+#endif
+
+static void crc32c_init(void)
+{
+  uint32_t i, j, crc;
+
+  for(i = 0; i < 256; i++)
+    {
+      crc = i;
+      for(j = 0; j < 8; j++)
+        crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      crc32c_table[i] = crc;
+    }
+
+#ifdef CRC32C_HW
+  __builtin_cpu_init();
+  crc32c_have_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+  while(len--)
+    crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+  uint64_t crc64 = crc;
+  uint64_t word;
+
+  while(len >= sizeof(word))
+    {
+      memcpy(&word, p, sizeof(word));
+      crc64 = __builtin_ia32_crc32di(crc64, word);
+      p += sizeof(word);
+      len -= sizeof(word);
+    }
+  crc = (uint32_t) crc64;
+  while(len--)
+    crc = __builtin_ia32_crc32qi(crc, *p++);
+
+  return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+  pthread_once(&crc32c_once, crc32c_init);
+
+  crc = ~crc;
+#ifdef CRC32C_HW
+  if(crc32c_have_hw)
+    return ~crc32c_hw(crc, buf, len);
+#endif
+  return ~crc32c_sw(crc, buf, len);
+}
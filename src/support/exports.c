@@ -3099,6 +3099,10 @@ int CleanUpExportContext(fsal_export_context_t * p_export_context)
 }
 
 
+/* Bumped each time the export list is replaced: export entries are
+ * then reused at the same address with other contents */
+uint32_t export_generation = 0;
+
 /* Frees current export entry and returns next export entry. */
 exportlist_t *RemoveExportEntry(exportlist_t * exportEntry)
 {
@@ -0,0 +1,275 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    interval_tree.c
+ * \brief   Intrusive tree of closed 64 bit intervals, see interval_tree.h
+ *
+ * A node is inserted as a leaf and rotated up while its priority is
+ * above its parent's; it is removed by rotating it down, towards its
+ * child of higher priority, until it is a leaf.  Rotations recompute
+ * the max of the two nodes they move, which is all that changes.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "interval_tree.h"
+
+static inline uint64_t itree_max(struct itree_node *node)
+{
+  uint64_t max = node->last;
+
+  if(node->left != NULL && node->left->max > max)
+    max = node->left->max;
+
+  if(node->right != NULL && node->right->max > max)
+    max = node->right->max;
+
+  return max;
+}
+
+/* Locks are allocated one after the other, mix the address so that
+ * their priorities are not ordered like them. */
+static inline uint32_t itree_prio(struct itree_node *node)
+{
+  uint64_t h = (uint64_t) (uintptr_t) node;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return (uint32_t) h;
+}
+
+static inline void itree_replace_child(struct itree_root *tree,
+                                       struct itree_node *parent,
+                                       struct itree_node *old,
+                                       struct itree_node *new)
+{
+  if(parent == NULL)
+    tree->root = new;
+  else if(parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Bring node->right above node */
+static void itree_rotate_left(struct itree_root *tree, struct itree_node *node)
+{
+  struct itree_node *pivot = node->right;
+
+  node->right = pivot->left;
+  if(pivot->left != NULL)
+    pivot->left->parent = node;
+
+  pivot->parent = node->parent;
+  itree_replace_child(tree, node->parent, node, pivot);
+
+  pivot->left = node;
+  node->parent = pivot;
+
+  node->max = itree_max(node);
+  pivot->max = itree_max(pivot);
+}
+
+/* Bring node->left above node */
+static void itree_rotate_right(struct itree_root *tree, struct itree_node *node)
+{
+  struct itree_node *pivot = node->left;
+
+  node->left = pivot->right;
+  if(pivot->right != NULL)
+    pivot->right->parent = node;
+
+  pivot->parent = node->parent;
+  itree_replace_child(tree, node->parent, node, pivot);
+
+  pivot->right = node;
+  node->parent = pivot;
+
+  node->max = itree_max(node);
+  pivot->max = itree_max(pivot);
+}
+
+/**
+ * itree_insert: add node, covering [start, last], to the tree.
+ *
+ * Nodes with the same start are kept in insertion order.
+ */
+void itree_insert(struct itree_root *tree, struct itree_node *node,
+                  uint64_t start, uint64_t last)
+{
+  struct itree_node *parent = NULL;
+  struct itree_node **link = &tree->root;
+
+  node->left = NULL;
+  node->right = NULL;
+  node->start = start;
+  node->last = last;
+  node->max = last;
+  node->prio = itree_prio(node);
+  node->tree = tree;
+
+  while(*link != NULL)
+    {
+      parent = *link;
+
+      if(parent->max < last)
+        parent->max = last;
+
+      if(start < parent->start)
+        link = &parent->left;
+      else
+        link = &parent->right;
+    }
+
+  node->parent = parent;
+  *link = node;
+
+  while(node->parent != NULL && node->prio > node->parent->prio)
+    {
+      if(node->parent->left == node)
+        itree_rotate_right(tree, node->parent);
+      else
+        itree_rotate_left(tree, node->parent);
+    }
+
+  tree->count++;
+}
+
+/**
+ * itree_remove: take node out of the tree.
+ */
+void itree_remove(struct itree_node *node)
+{
+  struct itree_root *tree = node->tree;
+  struct itree_node *parent;
+
+  while(node->left != NULL || node->right != NULL)
+    {
+      if(node->right == NULL ||
+         (node->left != NULL && node->left->prio > node->right->prio))
+        itree_rotate_right(tree, node);
+      else
+        itree_rotate_left(tree, node);
+    }
+
+  parent = node->parent;
+  itree_replace_child(tree, parent, node, NULL);
+
+  for(; parent != NULL; parent = parent->parent)
+    parent->max = itree_max(parent);
+
+  node->parent = NULL;
+  node->tree = NULL;
+  tree->count--;
+}
+
+/**
+ * itree_update: change the interval covered by a node of the tree.
+ */
+void itree_update(struct itree_node *node, uint64_t start, uint64_t last)
+{
+  struct itree_root *tree = node->tree;
+
+  if(start != node->start)
+    {
+      itree_remove(node);
+      itree_insert(tree, node, start, last);
+      return;
+    }
+
+  node->last = last;
+
+  for(; node != NULL; node = node->parent)
+    node->max = itree_max(node);
+}
+
+/* Leftmost node of the subtree overlapping [start, last] */
+static struct itree_node *itree_subtree_first(struct itree_node *node,
+                                              uint64_t start, uint64_t last)
+{
+  while(node != NULL && node->max >= start)
+    {
+      /* Anything overlapping on the left comes first. If what is on
+       * the left only ends after start by beginning after last, so
+       * does everything from node on. */
+      if(node->left != NULL && node->left->max >= start)
+        {
+          node = node->left;
+          continue;
+        }
+
+      if(node->start > last)
+        return NULL;
+
+      if(node->last >= start)
+        return node;
+
+      node = node->right;
+    }
+
+  return NULL;
+}
+
+/**
+ * itree_first: first node, by start, overlapping [start, last].
+ */
+struct itree_node *itree_first(struct itree_root *tree,
+                               uint64_t start, uint64_t last)
+{
+  return itree_subtree_first(tree->root, start, last);
+}
+
+/**
+ * itree_next: node following node, by start, overlapping [start, last].
+ */
+struct itree_node *itree_next(struct itree_node *node,
+                              uint64_t start, uint64_t last)
+{
+  struct itree_node *prev;
+
+  for(;;)
+    {
+      if(node->right != NULL && node->right->max >= start)
+        return itree_subtree_first(node->right, start, last);
+
+      /* Climb up to the first ancestor node is on the left of */
+      do
+        {
+          prev = node;
+          node = node->parent;
+          if(node == NULL)
+            return NULL;
+        }
+      while(node->right == prev);
+
+      if(node->start > last)
+        return NULL;
+
+      if(node->last >= start)
+        return node;
+    }
+}
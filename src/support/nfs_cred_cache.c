@@ -0,0 +1,470 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs_cred_cache.c
+ * \brief   Cache of resolved caller credentials, see nfs_cred_cache.h
+ *
+ * Entries are variable length: a key (a small header, plus the
+ * credential body less its stamp for AUTH_UNIX contexts) followed by
+ * the value.  The
+ * cache is split in shards, each with its own lock, buckets and LRU
+ * list, the way the duplicate request cache is.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include "log.h"
+#include "nlm_list.h"
+#include "murmur3.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_cred_cache.h"
+
+#define CRED_CACHE_SHARDS 16
+
+/* Length of the stamp at the start of an AUTH_UNIX body */
+#define AUTH_UNIX_STAMP_LEN BYTES_PER_XDR_UNIT
+
+/* Upper bound of the group list asked to getgrouplist(), the FSAL
+ * keeps at most FSAL_NGROUPS_MAX of them anyway */
+#define CRED_CACHE_GETGROUPS_MAX 1024
+
+typedef enum cred_key_type__
+{
+  CRED_KEY_UNIX_CONTEXT = 1,
+  CRED_KEY_UID_GROUPS = 2
+} cred_key_type_t;
+
+/* Fixed part of every key */
+typedef struct cred_key_hdr__
+{
+  uint32_t type;
+  uint32_t root_access;
+  exportlist_t *pexport;
+  unsigned short export_id;
+  uint32_t export_generation;   /* export entries are reused on reload */
+  uid_t uid;
+} cred_key_hdr_t;
+
+/* Value of a CRED_KEY_UID_GROUPS entry */
+typedef struct cred_groups__
+{
+  bool_t found;
+  gid_t gid;
+  unsigned int glen;
+  gid_t groups[FSAL_NGROUPS_MAX];
+} cred_groups_t;
+
+typedef struct cred_entry__
+{
+  struct glist_head hash;
+  struct glist_head lru;
+  uint32_t hk;
+  time_t expires;
+  uint32_t keylen;
+  uint32_t vallen;
+  char data[];                  /* key, then value */
+} cred_entry_t;
+
+typedef struct cred_shard__
+{
+  pthread_mutex_t mtx;
+  struct glist_head *buckets;
+  uint32_t nbuckets;
+  struct glist_head lru;        /* least recently used first */
+  uint32_t count;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t expired;
+  uint64_t evicted;
+} cred_shard_t;
+
+static cred_shard_t *cred_shards = NULL;
+static uint32_t cred_shard_size;
+
+static inline uint32_t cred_hash(const char *key, uint32_t keylen)
+{
+  uint32_t hk;
+
+  MurmurHash3_x86_32(key, keylen, 0x6372, &hk);
+  return hk;
+}
+
+static void cred_remove(cred_shard_t *shard, cred_entry_t *entry)
+{
+  glist_del(&entry->hash);
+  glist_del(&entry->lru);
+  shard->count--;
+  gsh_free(entry);
+}
+
+/*
+ * Copies the value stored under key into val.  Returns FALSE if there
+ * is no valid entry.
+ */
+static bool_t cred_lookup(const char *key, uint32_t keylen,
+                          void *val, uint32_t vallen)
+{
+  uint32_t hk = cred_hash(key, keylen);
+  cred_shard_t *shard = &cred_shards[hk % CRED_CACHE_SHARDS];
+  struct glist_head *bucket;
+  struct glist_head *node;
+  cred_entry_t *entry;
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&shard->mtx);
+
+  bucket = &shard->buckets[(hk / CRED_CACHE_SHARDS) % shard->nbuckets];
+  glist_for_each(node, bucket)
+    {
+      entry = glist_entry(node, cred_entry_t, hash);
+      if(entry->hk != hk || entry->keylen != keylen ||
+         entry->vallen != vallen || memcmp(entry->data, key, keylen))
+        continue;
+
+      if(entry->expires <= now)
+        {
+          cred_remove(shard, entry);
+          shard->expired++;
+          break;
+        }
+
+      memcpy(val, entry->data + keylen, vallen);
+
+      /* Most recently used goes last */
+      glist_del(&entry->lru);
+      glist_add_tail(&shard->lru, &entry->lru);
+      shard->hits++;
+
+      pthread_mutex_unlock(&shard->mtx);
+      return TRUE;
+    }
+
+  shard->misses++;
+  pthread_mutex_unlock(&shard->mtx);
+  return FALSE;
+}
+
+static void cred_insert(const char *key, uint32_t keylen,
+                        const void *val, uint32_t vallen)
+{
+  uint32_t hk = cred_hash(key, keylen);
+  cred_shard_t *shard = &cred_shards[hk % CRED_CACHE_SHARDS];
+  struct glist_head *bucket;
+  struct glist_head *node, *noden;
+  cred_entry_t *entry, *old;
+
+  entry = gsh_malloc(sizeof(cred_entry_t) + keylen + vallen);
+  if(entry == NULL)
+    return;
+
+  entry->hk = hk;
+  entry->expires = time(NULL) + nfs_param.core_param.cred_cache_expiration;
+  entry->keylen = keylen;
+  entry->vallen = vallen;
+  memcpy(entry->data, key, keylen);
+  memcpy(entry->data + keylen, val, vallen);
+
+  pthread_mutex_lock(&shard->mtx);
+
+  bucket = &shard->buckets[(hk / CRED_CACHE_SHARDS) % shard->nbuckets];
+
+  /* Another worker may have resolved the same credential meanwhile */
+  glist_for_each_safe(node, noden, bucket)
+    {
+      old = glist_entry(node, cred_entry_t, hash);
+      if(old->hk == hk && old->keylen == keylen &&
+         !memcmp(old->data, key, keylen))
+        cred_remove(shard, old);
+    }
+
+  while(shard->count >= cred_shard_size && !glist_empty(&shard->lru))
+    {
+      old = glist_first_entry(&shard->lru, cred_entry_t, lru);
+      cred_remove(shard, old);
+      shard->evicted++;
+    }
+
+  glist_add_tail(bucket, &entry->hash);
+  glist_add_tail(&shard->lru, &entry->lru);
+  shard->count++;
+
+  pthread_mutex_unlock(&shard->mtx);
+}
+
+/* Builds the key of an AUTH_UNIX context in buf, returns its length */
+static uint32_t cred_context_key(struct svc_req *req,
+                                 exportlist_t *pexport,
+                                 exportlist_client_entry_t *pclient,
+                                 char *buf)
+{
+  cred_key_hdr_t hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = CRED_KEY_UNIX_CONTEXT;
+  hdr.root_access = (pclient->options & EXPORT_OPTION_ROOT) != 0;
+  hdr.pexport = pexport;
+  hdr.export_id = pexport->id;
+  hdr.export_generation = export_generation;
+
+  memcpy(buf, &hdr, sizeof(hdr));
+
+  /* The body is the stamp, then the machine name, uid, gid and gids.
+   * Clients such as Linux change the stamp every second, so it is
+   * left out of the key. */
+  memcpy(buf + sizeof(hdr), req->rq_cred.oa_base + AUTH_UNIX_STAMP_LEN,
+         req->rq_cred.oa_length - AUTH_UNIX_STAMP_LEN);
+
+  return sizeof(hdr) + req->rq_cred.oa_length - AUTH_UNIX_STAMP_LEN;
+}
+
+static inline bool_t cred_context_cacheable(struct svc_req *req)
+{
+  return cred_shards != NULL &&
+         req->rq_cred.oa_flavor == AUTH_UNIX &&
+         req->rq_cred.oa_length > AUTH_UNIX_STAMP_LEN &&
+         req->rq_cred.oa_length <= MAX_AUTH_BYTES;
+}
+
+/**
+ *
+ * nfs_Init_cred_cache: sets up the credential cache.
+ *
+ * Does nothing if Cred_Cache_Size is 0.
+ *
+ * @return 0 if successful, -1 otherwise.
+ *
+ */
+int nfs_Init_cred_cache(void)
+{
+  uint32_t i, j;
+
+  if(nfs_param.core_param.cred_cache_size == 0)
+    return 0;
+
+  cred_shard_size = nfs_param.core_param.cred_cache_size / CRED_CACHE_SHARDS;
+  if(cred_shard_size == 0)
+    cred_shard_size = 1;
+
+  cred_shards = gsh_calloc(CRED_CACHE_SHARDS, sizeof(cred_shard_t));
+  if(cred_shards == NULL)
+    return -1;
+
+  for(i = 0; i < CRED_CACHE_SHARDS; i++)
+    {
+      cred_shard_t *shard = &cred_shards[i];
+
+      pthread_mutex_init(&shard->mtx, NULL);
+      init_glist(&shard->lru);
+      shard->nbuckets = cred_shard_size;
+      shard->buckets = gsh_calloc(shard->nbuckets, sizeof(struct glist_head));
+      if(shard->buckets == NULL)
+        return -1;
+      for(j = 0; j < shard->nbuckets; j++)
+        init_glist(&shard->buckets[j]);
+    }
+
+  LogInfo(COMPONENT_INIT,
+          "Credential cache: %u entries, expiration %u s, manage gids %s",
+          nfs_param.core_param.cred_cache_size,
+          nfs_param.core_param.cred_cache_expiration,
+          nfs_param.core_param.manage_gids ? "yes" : "no");
+
+  return 0;
+}
+
+/**
+ *
+ * nfs_cred_cache_get_context: looks up the FSAL context of an AUTH_UNIX
+ * request.
+ *
+ * @param req [IN] the request
+ * @param pexport [IN] the export being accessed
+ * @param pclient [IN] the export client entry matching the caller
+ * @param pcontext [OUT] the context, if found
+ *
+ * @return TRUE if pcontext was filled from the cache.
+ *
+ */
+bool_t nfs_cred_cache_get_context(struct svc_req *req,
+                                  exportlist_t *pexport,
+                                  exportlist_client_entry_t *pclient,
+                                  fsal_op_context_t *pcontext)
+{
+  char key[sizeof(cred_key_hdr_t) + MAX_AUTH_BYTES];
+  uint32_t keylen;
+
+  if(!cred_context_cacheable(req))
+    return FALSE;
+
+  keylen = cred_context_key(req, pexport, pclient, key);
+
+  return cred_lookup(key, keylen, pcontext, sizeof(fsal_op_context_t));
+}
+
+/**
+ *
+ * nfs_cred_cache_set_context: remembers the FSAL context built for an
+ * AUTH_UNIX request.
+ *
+ */
+void nfs_cred_cache_set_context(struct svc_req *req,
+                                exportlist_t *pexport,
+                                exportlist_client_entry_t *pclient,
+                                fsal_op_context_t *pcontext)
+{
+  char key[sizeof(cred_key_hdr_t) + MAX_AUTH_BYTES];
+  uint32_t keylen;
+
+  if(!cred_context_cacheable(req))
+    return;
+
+  keylen = cred_context_key(req, pexport, pclient, key);
+
+  cred_insert(key, keylen, pcontext, sizeof(fsal_op_context_t));
+}
+
+/* Looks up the groups of uid in the password and group databases */
+static void cred_resolve_groups(uid_t uid, cred_groups_t *res)
+{
+  struct passwd pwd, *ppwd = NULL;
+  char buf[1024];
+  gid_t *groups;
+  int ngroups = CRED_CACHE_GETGROUPS_MAX;
+  int i;
+
+  memset(res, 0, sizeof(*res));
+
+  if(getpwuid_r(uid, &pwd, buf, sizeof(buf), &ppwd) != 0 || ppwd == NULL)
+    {
+      LogDebug(COMPONENT_DISPATCH,
+               "No password entry for uid %u, groups not resolved",
+               (unsigned int)uid);
+      return;
+    }
+
+  groups = gsh_malloc(ngroups * sizeof(gid_t));
+  if(groups == NULL)
+    return;
+
+  if(getgrouplist(pwd.pw_name, pwd.pw_gid, groups, &ngroups) < 0)
+    ngroups = CRED_CACHE_GETGROUPS_MAX;
+
+  if(ngroups > FSAL_NGROUPS_MAX)
+    {
+      LogDebug(COMPONENT_DISPATCH,
+               "uid %u is in %d groups, only %d are kept",
+               (unsigned int)uid, ngroups, FSAL_NGROUPS_MAX);
+      ngroups = FSAL_NGROUPS_MAX;
+    }
+
+  res->found = TRUE;
+  res->gid = pwd.pw_gid;
+  res->glen = ngroups;
+  for(i = 0; i < ngroups; i++)
+    res->groups[i] = groups[i];
+
+  gsh_free(groups);
+}
+
+/**
+ *
+ * nfs_cred_cache_get_groups: gets the groups of a uid, as resolved on
+ * the server.
+ *
+ * @param uid [IN] the caller's uid
+ * @param pgid [OUT] its primary group
+ * @param groups [OUT] its groups, room for FSAL_NGROUPS_MAX entries
+ * @param pglen [OUT] number of entries in groups
+ *
+ * @return FALSE if the uid is unknown to the server.
+ *
+ */
+bool_t nfs_cred_cache_get_groups(uid_t uid, gid_t *pgid,
+                                 gid_t *groups, unsigned int *pglen)
+{
+  cred_key_hdr_t hdr;
+  cred_groups_t res;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.type = CRED_KEY_UID_GROUPS;
+  hdr.uid = uid;
+
+  if(cred_shards == NULL ||
+     !cred_lookup((char *)&hdr, sizeof(hdr), &res, sizeof(res)))
+    {
+      /* Unknown uids are cached too, so they are not looked up again
+       * on every request */
+      cred_resolve_groups(uid, &res);
+      if(cred_shards != NULL)
+        cred_insert((char *)&hdr, sizeof(hdr), &res, sizeof(res));
+    }
+
+  if(!res.found)
+    return FALSE;
+
+  *pgid = res.gid;
+  *pglen = res.glen;
+  memcpy(groups, res.groups, res.glen * sizeof(gid_t));
+
+  return TRUE;
+}
+
+/**
+ *
+ * nfs_cred_cache_get_stats: gets the counters of the credential cache.
+ *
+ */
+void nfs_cred_cache_get_stats(nfs_cred_cache_stats_t *pstats)
+{
+  uint32_t i;
+
+  memset(pstats, 0, sizeof(*pstats));
+
+  if(cred_shards == NULL)
+    return;
+
+  for(i = 0; i < CRED_CACHE_SHARDS; i++)
+    {
+      cred_shard_t *shard = &cred_shards[i];
+
+      pthread_mutex_lock(&shard->mtx);
+      pstats->entries += shard->count;
+      pstats->hits += shard->hits;
+      pstats->misses += shard->misses;
+      pstats->expired += shard->expired;
+      pstats->evicted += shard->evicted;
+      pthread_mutex_unlock(&shard->mtx);
+    }
+}
@@ -107,6 +107,7 @@
 #include "nfs_tools.h"
 #include "nfs_exports.h"
 #include "nfs_file_handle.h"
+#include "nfs_cred_cache.h"
 
 const char *Rpc_gss_svc_name[] =
     { "no name", "RPCSEC_GSS_SVC_NONE", "RPCSEC_GSS_SVC_INTEGRITY",
@@ -145,6 +146,29 @@ exportlist_t *nfs_Get_export_by_id(exportlist_t * exportroot, unsigned short exp
     return piter;
 }                               /* nfs_Get_export_by_id */
 
+/* Groups resolved on the server for the request of this thread, when
+ * Manage_Gids is set */
+static __thread gid_t managed_gids[FSAL_NGROUPS_MAX];
+
+/*
+ * Replaces the supplementary groups of the caller with those known to
+ * the server.  They are left alone if the uid is unknown here.
+ */
+static void get_managed_gids(struct user_cred *user_credentials)
+{
+  gid_t gid;
+  unsigned int glen;
+
+  if(!nfs_cred_cache_get_groups(user_credentials->caller_uid, &gid,
+                                managed_gids, &glen))
+    return;
+
+  if(user_credentials->caller_gid == (gid_t) -1)
+    user_credentials->caller_gid = gid;
+  user_credentials->caller_glen = glen;
+  user_credentials->caller_garray = managed_gids;
+}
+
 /**
  *
  * get_req_uid_gid: 
@@ -198,6 +222,9 @@ int get_req_uid_gid(struct svc_req *req,
       user_credentials->caller_glen = punix_creds->aup_len;
       user_credentials->caller_garray = punix_creds->aup_gids;
 
+      if(nfs_param.core_param.manage_gids)
+        get_managed_gids(user_credentials);
+
       LogFullDebug(COMPONENT_DISPATCH, "----> Uid=%u Gid=%u",
                    (unsigned int)user_credentials->caller_uid,
                    (unsigned int)user_credentials->caller_gid);
@@ -290,6 +317,9 @@ int get_req_uid_gid(struct svc_req *req,
       user_credentials->caller_glen = 0;
       user_credentials->caller_garray = 0;
 
+      if(nfs_param.core_param.manage_gids)
+        get_managed_gids(user_credentials);
+
       break;
 #endif                          /* _USE_GSSRPC */
 
@@ -396,6 +426,45 @@ int nfs_build_fsal_context(struct svc_req *req,
   return TRUE;
 }                               /* nfs_build_fsal_context */
 
+/**
+ *
+ * nfs_make_fsal_context: Squashes the caller if needed and builds its
+ * FSAL context, going through the credential cache.
+ *
+ * @param req [IN]  incoming request.
+ * @param pexport_client [IN] related export client
+ * @param pexport [IN]  related export entry
+ * @param pcontext   [OUT] the context built for the caller
+ * @param user_credentials [IN/OUT] uid and gids of the caller
+ *
+ * @return TRUE if successful, FALSE otherwise
+ *
+ */
+int nfs_make_fsal_context(struct svc_req *req,
+                          exportlist_client_entry_t * pexport_client,
+                          exportlist_t * pexport,
+                          fsal_op_context_t * pcontext,
+                          struct user_cred *user_credentials)
+{
+  if(nfs_check_anon(pexport_client, pexport, user_credentials) == FALSE)
+    return FALSE;
+
+  if(nfs_cred_cache_get_context(req, pexport, pexport_client, pcontext))
+    {
+      /* The cached context has the address of its first caller */
+      copy_xprt_addr(&pcontext->credential.caller_addr, req->rq_xprt);
+      return TRUE;
+    }
+
+  if(nfs_build_fsal_context(req, pexport, pcontext,
+                            user_credentials) == FALSE)
+    return FALSE;
+
+  nfs_cred_cache_set_context(req, pexport, pexport_client, pcontext);
+
+  return TRUE;
+}                               /* nfs_make_fsal_context */
+
 /**
  *
  * nfs_compare_rpc_cred: Compares two RPC creds
@@ -437,6 +437,38 @@ int nfs_read_core_conf(config_file_t in_config, nfs_core_parameter_t * pparam)
         {
           pparam->max_recv_buffer_size = atoi(key_value);
         }
+      else if(!strcasecmp( key_name, "UDP_Batch_Size" ) )
+        {
+          pparam->udp_batch_size = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "UDP_Batch_Delay" ) )
+        {
+          pparam->udp_batch_delay = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "TCP_Reply_Coalesce_Delay" ) )
+        {
+          pparam->tcp_coalesce_delay = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "Max_Inflight_Requests" ) )
+        {
+          pparam->max_inflight = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "Max_Inflight_Requests_Per_Conn" ) )
+        {
+          pparam->max_inflight_xprt = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "Cred_Cache_Size" ) )
+        {
+          pparam->cred_cache_size = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "Cred_Cache_Expiration" ) )
+        {
+          pparam->cred_cache_expiration = atoi(key_value);
+        }
+      else if(!strcasecmp( key_name, "Manage_Gids" ) )
+        {
+          pparam->manage_gids = StrToBoolean(key_value);
+        }
 #ifdef _USE_NLM
       else if(!strcasecmp( key_name, "NSM_Use_Caller_Name" ) )
         {
@@ -528,6 +560,14 @@ int nfs_read_dupreq_hash_conf(config_file_t in_config,
         {
           pparam->hash_param.alphabet_length = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Shard_Size"))
+        {
+          pparam->shard_size = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Checksum_Length"))
+        {
+          pparam->checksum_len = atoi(key_value);
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -1069,6 +1109,10 @@ int nfs_read_krb5_conf(config_file_t in_config, nfs_krb5_parameter_t * pparam)
         {
           pparam->active_krb5 = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Context_Cache_Size"))
+        {
+          pparam->ctx_cache_size = atoi(key_value);
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -1165,6 +1209,50 @@ int nfs_read_version4_conf(config_file_t in_config, nfs_version4_parameter_t * p
         {
           pparam->return_bad_stateid = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Max_Session_Slots"))
+        {
+          pparam->max_session_slots = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Slot_Cache_Hiwat"))
+        {
+          pparam->slot_cache_hiwat = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Delegations"))
+        {
+          pparam->delegations = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Max_Delegations"))
+        {
+          pparam->max_delegations = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Recovery_Journal"))
+        {
+          pparam->recov_journal = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Grace_Early_Exit"))
+        {
+          pparam->grace_early_exit = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Grace_Reclaim_Fraction"))
+        {
+          pparam->grace_reclaim_fraction = atoi(key_value);
+          if(pparam->grace_reclaim_fraction > 100)
+            pparam->grace_reclaim_fraction = 100;
+        }
+      else if(!strcasecmp(key_name, "Grace_Reclaim_Timeout"))
+        {
+          int timeout = atoi(key_value);
+
+          /* Past 60 seconds, the grace period is over anyway */
+          if(timeout < 0 || timeout > 60)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid Grace_Reclaim_Timeout \"%s\", values can be "
+                      "0 to 60 seconds.", key_value);
+              return -1;
+            }
+          pparam->grace_reclaim_timeout = timeout;
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
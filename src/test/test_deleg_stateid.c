@@ -0,0 +1,102 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    test_deleg_stateid.c
+ * \brief   Checks which I/O a delegation stateid is accepted for.
+ *
+ * A client opens a file for reading and is handed a read delegation,
+ * as OPEN does through state_deleg_grant.  Linux clients then send
+ * their READs with the delegation stateid rather than the open one:
+ * READ must accept it, while WRITE and a SETATTR of the size must
+ * answer NFS4ERR_OPENMODE, as the delegation only covers reading.
+ *
+ * usage: test_deleg_stateid
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "sal_functions.h"
+
+static int failures = 0;
+
+static void check(const char *what, nfsstat4 got, nfsstat4 expected)
+{
+  if(got == expected)
+    {
+      printf("%-40s ok\n", what);
+      return;
+    }
+
+  printf("%-40s FAILED: got %d, expected %d\n", what, (int)got,
+         (int)expected);
+  failures++;
+}
+
+int main(int argc, char *argv[])
+{
+  state_t open_state;
+  state_t deleg_state;
+
+  /* OPEN4_SHARE_ACCESS_READ, OPEN4_SHARE_DENY_NONE */
+  memset(&open_state, 0, sizeof(open_state));
+  open_state.state_type = STATE_TYPE_SHARE;
+  open_state.state_data.share.share_access = OPEN4_SHARE_ACCESS_READ;
+  open_state.state_data.share.share_deny = OPEN4_SHARE_DENY_NONE;
+
+  /* The delegation granted with it */
+  memset(&deleg_state, 0, sizeof(deleg_state));
+  deleg_state.state_type = STATE_TYPE_DELEG;
+  deleg_state.state_data.deleg.sd_type = OPEN_DELEGATE_READ;
+  deleg_state.state_data.deleg.sd_status = DELEG_GRANTED;
+
+  check("READ with a read delegation",
+        state_deleg_check_io(&deleg_state, FALSE), NFS4_OK);
+  check("WRITE with a read delegation",
+        state_deleg_check_io(&deleg_state, TRUE), NFS4ERR_OPENMODE);
+
+  /* A recall in progress does not stop the client from using it */
+  deleg_state.state_data.deleg.sd_status = DELEG_RECALLED;
+  check("READ with a recalled read delegation",
+        state_deleg_check_io(&deleg_state, FALSE), NFS4_OK);
+
+  deleg_state.state_data.deleg.sd_type = OPEN_DELEGATE_WRITE;
+  check("WRITE with a write delegation",
+        state_deleg_check_io(&deleg_state, TRUE), NFS4_OK);
+
+  deleg_state.state_data.deleg.sd_type = OPEN_DELEGATE_NONE;
+  check("READ with no delegation type",
+        state_deleg_check_io(&deleg_state, FALSE), NFS4ERR_BAD_STATEID);
+
+  if(failures != 0)
+    {
+      printf("%d check(s) failed\n", failures);
+      return 1;
+    }
+
+  printf("all checks passed\n");
+  return 0;
+}
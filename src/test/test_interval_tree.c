@@ -0,0 +1,341 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    test_interval_tree.c
+ * \brief   Checks and times the interval tree used to index byte-range
+ *          locks.
+ *
+ * A file locked in many small ranges, the way databases and MPI-IO
+ * jobs do, is modelled by a set of intervals kept both in an array and
+ * in the tree.  Random queries, removals, moves and insertions are
+ * applied to both and every query must return the same intervals, in
+ * start order.  Then the same queries are timed against the tree and
+ * against a linear scan of the array, which is what the lock list used
+ * to be.
+ *
+ * usage: test_interval_tree [ranges]
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "interval_tree.h"
+
+#define NB_QUERIES 10000
+
+typedef struct range
+{
+  struct itree_node node;
+  uint64_t start;
+  uint64_t last;
+  int in_tree;
+  int seen;
+} range_t;
+
+static range_t *ranges;
+static unsigned int nb_ranges;
+static struct itree_root tree;
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static uint64_t rand64(void)
+{
+  return ((uint64_t) random() << 32) ^ (uint64_t) random();
+}
+
+/* A lock on the file: mostly small records, a few whole-file locks */
+static void pick_range(uint64_t *start, uint64_t *last)
+{
+  uint64_t space = (uint64_t) nb_ranges * 4096;
+
+  if(random() % 1000 == 0)
+    {
+      *start = random() % 4096;
+      *last = UINT64_MAX;
+      return;
+    }
+
+  *start = (rand64() % space) & ~511ULL;
+  *last = *start + 512 * (1 + random() % 8) - 1;
+}
+
+static int check_invariants(struct itree_node *node, struct itree_node *parent,
+                            unsigned int *count)
+{
+  uint64_t max;
+
+  if(node == NULL)
+    return 0;
+
+  if(node->parent != parent ||
+     (parent != NULL && node->prio > parent->prio) ||
+     (node->left != NULL && node->left->start > node->start) ||
+     (node->right != NULL && node->right->start < node->start))
+    return 1;
+
+  max = node->last;
+  if(node->left != NULL && node->left->max > max)
+    max = node->left->max;
+  if(node->right != NULL && node->right->max > max)
+    max = node->right->max;
+  if(node->max != max)
+    return 1;
+
+  (*count)++;
+
+  return check_invariants(node->left, node, count) ||
+         check_invariants(node->right, node, count);
+}
+
+/* Compare one query against the array */
+static int check_query(uint64_t start, uint64_t last, range_t **found,
+                       range_t **expected)
+{
+  struct itree_node *node;
+  unsigned int i, nb_found = 0, nb_expected = 0;
+  int rc = 0;
+
+  for(node = itree_first(&tree, start, last); node != NULL;
+      node = itree_next(node, start, last))
+    {
+      found[nb_found++] = itree_entry(node, range_t, node);
+      if(nb_found > 1 &&
+         found[nb_found - 2]->start > found[nb_found - 1]->start)
+        {
+          printf("query [%llu, %llu] out of order\n",
+                 (unsigned long long)start, (unsigned long long)last);
+          return 1;
+        }
+    }
+
+  for(i = 0; i < nb_ranges; i++)
+    if(ranges[i].in_tree && ranges[i].last >= start &&
+       ranges[i].start <= last)
+      expected[nb_expected++] = &ranges[i];
+
+  if(nb_found != nb_expected)
+    {
+      printf("query [%llu, %llu] found %u ranges, expected %u\n",
+             (unsigned long long)start, (unsigned long long)last,
+             nb_found, nb_expected);
+      return 1;
+    }
+
+  /* Same set, each range once */
+  for(i = 0; i < nb_found; i++)
+    {
+      if(found[i]->seen)
+        {
+          printf("query [%llu, %llu] returned a range twice\n",
+                 (unsigned long long)start, (unsigned long long)last);
+          rc = 1;
+        }
+      found[i]->seen = 1;
+    }
+
+  for(i = 0; i < nb_expected; i++)
+    {
+      if(!expected[i]->seen)
+        {
+          printf("query [%llu, %llu] missed a range\n",
+                 (unsigned long long)start, (unsigned long long)last);
+          rc = 1;
+        }
+      expected[i]->seen = 0;
+    }
+
+  return rc;
+}
+
+int main(int argc, char *argv[])
+{
+  range_t **found, **expected;
+  struct itree_node *node, *noden;
+  uint64_t start, last, space;
+  unsigned int i, count, in_tree;
+  unsigned long hits = 0;
+  double t0, t1, t2;
+  int rc = 0;
+
+  nb_ranges = argc > 1 ? atoi(argv[1]) : 50000;
+  if(nb_ranges == 0)
+    nb_ranges = 50000;
+  space = (uint64_t) nb_ranges * 4096;
+
+  ranges = calloc(nb_ranges, sizeof(range_t));
+  found = calloc(nb_ranges, sizeof(range_t *));
+  expected = calloc(nb_ranges, sizeof(range_t *));
+  if(ranges == NULL || found == NULL || expected == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+
+  srandom(42);
+  itree_init(&tree);
+
+  t0 = now();
+  for(i = 0; i < nb_ranges; i++)
+    {
+      pick_range(&ranges[i].start, &ranges[i].last);
+      itree_insert(&tree, &ranges[i].node, ranges[i].start, ranges[i].last);
+      ranges[i].in_tree = 1;
+    }
+  t1 = now();
+  printf("insert %u ranges: %.3f us/op\n",
+         nb_ranges, (t1 - t0) * 1e6 / nb_ranges);
+
+  /* Churn: remove, move and re-insert ranges, checking as we go */
+  for(i = 0; i < 2000; i++)
+    {
+      range_t *r = &ranges[random() % nb_ranges];
+
+      switch(random() % 3)
+        {
+        case 0:
+          if(r->in_tree)
+            {
+              itree_remove(&r->node);
+              r->in_tree = 0;
+            }
+          break;
+
+        case 1:
+          if(r->in_tree)
+            {
+              /* Shrink from the end, or move the start, as merges do */
+              if(random() % 2 && r->last > r->start)
+                r->last = r->start + (r->last - r->start) / 2;
+              else
+                r->start = r->start + (r->last - r->start) / 2;
+              itree_update(&r->node, r->start, r->last);
+            }
+          break;
+
+        default:
+          if(!r->in_tree)
+            {
+              pick_range(&r->start, &r->last);
+              itree_insert(&tree, &r->node, r->start, r->last);
+              r->in_tree = 1;
+            }
+          break;
+        }
+
+      if(i % 100 == 0)
+        {
+          start = rand64() % space;
+          last = start + random() % 65536;
+          rc |= check_query(start, last, found, expected);
+        }
+    }
+
+  count = 0;
+  in_tree = 0;
+  for(i = 0; i < nb_ranges; i++)
+    in_tree += ranges[i].in_tree;
+  if(check_invariants(tree.root, NULL, &count) || count != in_tree ||
+     tree.count != in_tree)
+    {
+      printf("tree invariants broken (%u nodes, %u ranges)\n",
+             count, in_tree);
+      rc = 1;
+    }
+
+  for(i = 0; i < 200; i++)
+    {
+      start = rand64() % space;
+      last = start + random() % 65536;
+      rc |= check_query(start, last, found, expected);
+    }
+  rc |= check_query(0, UINT64_MAX, found, expected);
+
+  /* Time conflict checks of single records */
+  srandom(7);
+  t0 = now();
+  for(i = 0; i < NB_QUERIES; i++)
+    {
+      start = rand64() % space;
+      for(node = itree_first(&tree, start, start + 511); node != NULL;
+          node = itree_next(node, start, start + 511))
+        hits++;
+    }
+  t1 = now();
+
+  srandom(7);
+  for(i = 0; i < NB_QUERIES; i++)
+    {
+      unsigned int j;
+
+      start = rand64() % space;
+      for(j = 0; j < nb_ranges; j++)
+        if(ranges[j].in_tree && ranges[j].last >= start &&
+           ranges[j].start <= start + 511)
+          hits--;
+    }
+  t2 = now();
+
+  if(hits != 0)
+    {
+      printf("timed queries disagree\n");
+      rc = 1;
+    }
+
+  printf("query %u ranges: tree %.3f us/op, list %.3f us/op\n",
+         in_tree,
+         (t1 - t0) * 1e6 / NB_QUERIES,
+         (t2 - t1) * 1e6 / NB_QUERIES);
+
+  /* Unlock everything, walking the whole file as state_unlock does */
+  t0 = now();
+  itree_for_each_overlap_safe(node, noden, &tree, 0, UINT64_MAX)
+    itree_remove(node);
+  t1 = now();
+  printf("remove %u ranges: %.3f us/op\n",
+         in_tree, in_tree ? (t1 - t0) * 1e6 / in_tree : 0.0);
+
+  if(!itree_empty(&tree) || tree.count != 0)
+    {
+      printf("tree not empty after removing everything\n");
+      rc = 1;
+    }
+
+  printf("%s\n", rc ? "FAILED" : "PASSED");
+
+  free(ranges);
+  free(found);
+  free(expected);
+
+  return rc;
+}